@@ -0,0 +1,257 @@
+/*
+AdaptiveRx - receive with the packet length adapted to the protocol
+*/
+#include "AdaptiveRx.h"
+
+#include <string.h>
+
+// GDOx signals
+#define GDO_RX_THRESHOLD 0x00
+#define GDO_SYNC_WORD    0x06
+
+static_assert(ADAPTIVE_ID_BYTES % 4 == 0 && ADAPTIVE_ID_BYTES < ADAPTIVE_LEN_6IN1 - 1,
+              "ADAPTIVE_ID_BYTES must be a FIFO threshold and leave time to rewrite PKTLEN");
+static_assert(ADAPTIVE_CHUNK_BYTES % 4 == 0 && ADAPTIVE_CHUNK_BYTES <= ADAPTIVE_ID_BYTES,
+              "ADAPTIVE_CHUNK_BYTES must be a FIFO threshold");
+
+AdaptiveRx::AdaptiveRx() :
+    _bus(nullptr), _adaptive(true), _streaming(false), _state(ADAPTIVE_LISTEN), _syncUs(0),
+    _pktLen(BRESSER_FRAME_SIZE), _read(0)
+{
+    memset(&_frame, 0, sizeof(_frame));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void AdaptiveRx::begin(CC1101Bus *bus, bool adaptive, bool streaming)
+{
+    _bus       = bus;
+    _adaptive  = adaptive;
+    _streaming = streaming;
+    _bus->strobe(CC1101_SIDLE);
+    _bus->writeReg(CC1101_IOCFG0, GDO_SYNC_WORD);
+    _bus->writeReg(CC1101_IOCFG2, GDO_RX_THRESHOLD);
+    uint8_t threshold = streaming ? ADAPTIVE_CHUNK_BYTES : ADAPTIVE_ID_BYTES;
+    uint8_t fifothr   = _bus->readReg(CC1101_FIFOTHR);
+    _bus->writeReg(CC1101_FIFOTHR, (fifothr & 0xf0) | (threshold / 4 - 1));
+    uint8_t mcsm1 = _bus->readReg(CC1101_MCSM1);
+    _bus->writeReg(CC1101_MCSM1, (mcsm1 & ~CC1101_MCSM1_RXOFF_MASK) | CC1101_MCSM1_RXOFF_RX);
+    _bus->writeReg(CC1101_PKTLEN, BRESSER_FRAME_SIZE);
+    _bus->strobe(CC1101_SFRX);
+    _bus->strobe(CC1101_SRX);
+    _state = ADAPTIVE_LISTEN;
+}
+
+//
+// End reception, flush the FIFO and listen again
+//
+void AdaptiveRx::rearm(uint32_t now_us)
+{
+    _bus->strobe(CC1101_SIDLE);
+    _bus->strobe(CC1101_SFRX);
+    _bus->writeReg(CC1101_PKTLEN, BRESSER_FRAME_SIZE);
+    _bus->strobe(CC1101_SRX);
+    _stats.busy_us += now_us - _syncUs;
+    _state = ADAPTIVE_LISTEN;
+}
+
+//
+// 5-in-1: bytes 1..13 are repeated inverted in bytes 14..26 - one of the
+// first two pairs has to match (tolerates a bit error in the other)
+//
+BresserProtocol AdaptiveRx::identify(const uint8_t *data)
+{
+    if ((data[1] ^ data[14]) == 0xff || (data[2] ^ data[15]) == 0xff) {
+        return BRESSER_5IN1;
+    }
+    return BRESSER_6IN1;
+}
+
+//
+// 5-in-1 inverted pairs which do not match - about 1 in 128 6-in-1 frames
+// passes identify(), and fails here
+//
+static unsigned parityErrors(const uint8_t *data)
+{
+    unsigned errors = 0;
+    for (unsigned i = 1; i <= BRESSER_5IN1_SIZE / 2; i++) {
+        if ((data[i] ^ data[i + BRESSER_5IN1_SIZE / 2]) != 0xff) {
+            errors++;
+        }
+    }
+    return errors;
+}
+
+bool AdaptiveRx::poll(AdaptiveFrame *pOut, uint32_t now_us)
+{
+    if (_state == ADAPTIVE_LISTEN) {
+        if (!_bus->gdo(0)) {
+            return false;
+        }
+        _syncUs = now_us;
+        _pktLen = BRESSER_FRAME_SIZE;
+        _read   = 0;
+        _check.reset();
+        _state  = _streaming ? ADAPTIVE_STREAM : ADAPTIVE_ID;
+    }
+
+    if (now_us - _syncUs > ADAPTIVE_TIMEOUT_US) {
+        _stats.timeouts++;
+        rearm(now_us);
+        return false;
+    }
+
+    if (_state == ADAPTIVE_STREAM) {
+        return pollStream(pOut, now_us);
+    }
+
+    if (_state == ADAPTIVE_ID) {
+        // The last byte in the RX FIFO must not be read while receiving
+        if (!_bus->gdo(2)) {
+            return false;
+        }
+        uint8_t rxbytes = _bus->readStatus(CC1101_RXBYTES);
+        if (rxbytes & CC1101_FIFO_OVERFLOW) {
+            _stats.overflows++;
+            rearm(now_us);
+            return false;
+        }
+        if (CC1101_FIFO_BYTES(rxbytes) <= ADAPTIVE_ID_BYTES) {
+            return false;
+        }
+        memset(&_frame, 0, sizeof(_frame));
+        _bus->readBurst(CC1101_FIFO, _frame.data, ADAPTIVE_ID_BYTES);
+        if (_frame.data[0] != 0xD4) {
+            _stats.aborted++;
+            rearm(now_us);
+            return false;
+        }
+        _frame.protocol = identify(_frame.data);
+        _frame.len      = BRESSER_FRAME_SIZE;
+        if (_adaptive) {
+            uint8_t len = (_frame.protocol == BRESSER_5IN1) ? ADAPTIVE_LEN_5IN1 : ADAPTIVE_LEN_6IN1;
+            // PKTLEN must be written before the radio has reached it
+            if (CC1101_FIFO_BYTES(rxbytes) + 1 < len) {
+                _bus->writeReg(CC1101_PKTLEN, len);
+                _frame.len = len;
+            } else {
+                _stats.late++;
+            }
+        }
+        _state = ADAPTIVE_BODY;
+    }
+
+    // Rest of the frame and RSSI/LQI - the radio is listening again by now
+    uint8_t rest    = _frame.len - ADAPTIVE_ID_BYTES + 2;
+    uint8_t rxbytes = _bus->readStatus(CC1101_RXBYTES);
+    if (rxbytes & CC1101_FIFO_OVERFLOW) {
+        _stats.overflows++;
+        rearm(now_us);
+        return false;
+    }
+    if (CC1101_FIFO_BYTES(rxbytes) < rest) {
+        return false;
+    }
+    uint8_t buf[BRESSER_FRAME_SIZE + 2];
+    _bus->readBurst(CC1101_FIFO, buf, rest);
+    memcpy(&_frame.data[ADAPTIVE_ID_BYTES], buf, rest - 2);
+    if (_frame.protocol == BRESSER_5IN1 && parityErrors(_frame.data) > FRAME_CHECK_PARITY_ERRORS) {
+        // A 6-in-1 frame (the packet was not shortened) - its digest is
+        // checked by the decoder
+        _frame.protocol = BRESSER_6IN1;
+        _stats.reidentified++;
+    }
+    complete(&buf[rest - 2], pOut, now_us);
+    return true;
+}
+
+//
+// Packet read up to the appended RSSI/LQI - hand out the frame
+//
+void AdaptiveRx::complete(const uint8_t *status, AdaptiveFrame *pOut, uint32_t now_us)
+{
+    if (_frame.len != BRESSER_FRAME_SIZE) {
+        _bus->writeReg(CC1101_PKTLEN, BRESSER_FRAME_SIZE);
+    }
+    uint8_t rssi_raw = status[0];
+    _frame.rssi    = cc1101RssiDbm(rssi_raw);
+    _frame.lqi     = status[1] & 0x7f;
+    _frame.busy_us = now_us - _syncUs;
+
+    _stats.frames[_frame.protocol]++;
+    _stats.busy_us += _frame.busy_us;
+    _state = ADAPTIVE_LISTEN;
+    *pOut  = _frame;
+}
+
+//
+// Drain the RX FIFO into FrameCheck - the last byte is left in the FIFO
+// while the packet is being received
+//
+bool AdaptiveRx::pollStream(AdaptiveFrame *pOut, uint32_t now_us)
+{
+    // Below the FIFO threshold and packet not ended yet - except right before
+    // identification, where every byte counts to rewrite PKTLEN in time
+    bool identifying = !_check.identified() && _read + ADAPTIVE_CHUNK_BYTES >= ADAPTIVE_ID_BYTES;
+    if (!identifying && !_bus->gdo(2) && _bus->gdo(0)) {
+        return false;
+    }
+    uint8_t rxbytes = _bus->readStatus(CC1101_RXBYTES);
+    if (rxbytes & CC1101_FIFO_OVERFLOW) {
+        _stats.overflows++;
+        rearm(now_us);
+        return false;
+    }
+    unsigned avail = CC1101_FIFO_BYTES(rxbytes);
+    bool     done  = (_read + avail >= _pktLen + 2u);
+    unsigned n     = done ? _pktLen + 2u - _read : (avail > 1 ? avail - 1 : 0);
+    if (n == 0) {
+        return false;
+    }
+
+    uint8_t buf[BRESSER_FRAME_SIZE + 2];
+    _bus->readBurst(CC1101_FIFO, buf, n);
+    unsigned data = (_read < _pktLen) ? _pktLen - _read : 0;
+    bool     identified = _check.identified();
+    CheckResult result  = _check.feed(buf, (n < data) ? n : data);
+    _read += n;
+
+    switch (result) {
+    case CHECK_NO_SYNC:
+        _stats.aborted++;
+        rearm(now_us);
+        return false;
+    case CHECK_PARITY:
+    case CHECK_DIGEST:
+    case CHECK_CHECKSUM:
+        _stats.rejected++;
+        rearm(now_us);
+        return false;
+    default:
+        break;
+    }
+
+    if (!identified && _check.identified() && _adaptive) {
+        // PKTLEN must be written before the radio has reached it
+        if (_read + avail - n + 1 < _check.length()) {
+            _pktLen = _check.length();
+            _bus->writeReg(CC1101_PKTLEN, _pktLen);
+        } else {
+            _stats.late++;
+        }
+    }
+    if (!done) {
+        return false;
+    }
+
+    memcpy(_frame.data, _check.data(), BRESSER_FRAME_SIZE);
+    _frame.protocol = _check.protocol();
+    _frame.len      = _pktLen;
+    complete(&buf[n - 2], pOut, now_us);
+    return true;
+}
+
+float AdaptiveRx::busyPerFrame() const
+{
+    uint32_t n = _stats.frames[BRESSER_5IN1] + _stats.frames[BRESSER_6IN1] + _stats.aborted + _stats.rejected;
+    return n ? (float)_stats.busy_us / n : 0;
+}
@@ -0,0 +1,117 @@
+/*
+AdaptiveRx - receive with the packet length adapted to the protocol
+
+In fixed packet length mode the radio collects BRESSER_FRAME_SIZE (27)
+bytes after the sync word, although a 6-in-1 frame ends after 19 - the
+rest is noise, and the radio is busy for another 8 byte times before it can
+catch the next frame. AdaptiveRx identifies the protocol while the frame is
+still being received and shortens the packet:
+
+- GDO0 (0x06) signals the sync word, GDO2 (0x00) the RX FIFO threshold of
+  ADAPTIVE_ID_BYTES (16) bytes.
+- The first 16 bytes are read. No 0xD4 in front: not a Bresser frame, the
+  reception is aborted and the radio re-armed at once. A 5-in-1 frame
+  starts with 13 bytes which are repeated inverted - it is recognized by one
+  of the first two pairs; anything else is taken as 6-in-1. Once the whole
+  frame is read, a 5-in-1 frame with more than FRAME_CHECK_PARITY_ERRORS
+  mismatching pairs is taken as 6-in-1 after all (as FrameCheck rejects it
+  when streaming).
+- PKTLEN is rewritten to 27 (5-in-1) or 19 (6-in-1) before byte 19 has
+  arrived, so the CC1101 ends the packet there (PKTLEN is evaluated
+  while receiving).
+- RXOFF_MODE is RX: the radio is listening again right at the end of the
+  packet; the rest of the frame and the appended RSSI/LQI are read after
+  that, and PKTLEN is restored to 27 for the next frame.
+
+stats() gives the radio time spent per frame (sync word to re-armed), to
+compare with fixed length (begin(bus, false)).
+
+Streaming (begin(bus, true, true)): the RX FIFO threshold is lowered to
+ADAPTIVE_CHUNK_BYTES (4) and the FIFO drained whenever it is reached. The
+bytes go through FrameCheck as they arrive - a frame failing its integrity
+checks is dropped and the radio re-armed while the frame is still on air,
+and a frame is validated by the time its last byte has been read.
+
+The CC1101 must have been configured by RadioLib (fixed packet length 27,
+appended status bytes).
+*/
+#ifndef ADAPTIVE_RX_H
+#define ADAPTIVE_RX_H
+
+#include <stdint.h>
+#include "CC1101Bus.h"
+#include "BresserEncoder.h"
+#include "FrameCheck.h"
+
+// Bytes read for identification (RX FIFO threshold, multiple of 4)
+#define ADAPTIVE_ID_BYTES 16
+
+// RX FIFO threshold when streaming (multiple of 4)
+#define ADAPTIVE_CHUNK_BYTES 4
+
+// Frame lengths incl. the 0xD4 byte
+#define ADAPTIVE_LEN_5IN1 (1 + BRESSER_5IN1_SIZE)
+#define ADAPTIVE_LEN_6IN1 (1 + BRESSER_6IN1_SIZE)
+
+// Give up on a packet which does not complete (us)
+#ifndef ADAPTIVE_TIMEOUT_US
+#define ADAPTIVE_TIMEOUT_US 60000
+#endif
+
+struct AdaptiveFrame {
+    uint8_t         data[BRESSER_FRAME_SIZE];  // 0xD4 + payload, zero padded
+    uint8_t         len;                       // bytes received
+    BresserProtocol protocol;
+    float           rssi;                      // dBm
+    uint8_t         lqi;
+    uint32_t        busy_us;                   // sync word to radio re-armed
+};
+
+struct AdaptiveStats {
+    uint32_t frames[2];            // by protocol
+    uint32_t aborted;              // no 0xD4 after the sync word
+    uint32_t rejected;             // integrity check failed while receiving (streaming)
+    uint32_t late;                 // identified too late to shorten the packet
+    uint32_t reidentified;         // taken as 5-in-1, 6-in-1 by the parity of the whole frame
+    uint32_t overflows;
+    uint32_t timeouts;
+    uint64_t busy_us;              // radio time of all frames incl. aborted ones
+};
+
+class AdaptiveRx {
+public:
+    AdaptiveRx();
+
+    // Take over receiving - adaptive false: fixed length (for comparison),
+    // streaming true: check frames while they are received
+    void begin(CC1101Bus *bus, bool adaptive = true, bool streaming = false);
+
+    // Process the frame being received - returns true if one is complete
+    bool poll(AdaptiveFrame *pOut, uint32_t now_us);
+
+    // Average radio time per frame (us)
+    float busyPerFrame() const;
+
+    const AdaptiveStats& stats() const { return _stats; }
+
+private:
+    enum State { ADAPTIVE_LISTEN, ADAPTIVE_ID, ADAPTIVE_BODY, ADAPTIVE_STREAM };
+
+    void rearm(uint32_t now_us);
+    bool pollStream(AdaptiveFrame *pOut, uint32_t now_us);
+    void complete(const uint8_t *status, AdaptiveFrame *pOut, uint32_t now_us);
+    static BresserProtocol identify(const uint8_t *data);
+
+    CC1101Bus    *_bus;
+    bool          _adaptive;
+    bool          _streaming;
+    State         _state;
+    uint32_t      _syncUs;
+    uint8_t       _pktLen;         // packet length in effect
+    uint8_t       _read;           // bytes read from the RX FIFO (streaming)
+    FrameCheck    _check;
+    AdaptiveFrame _frame;
+    AdaptiveStats _stats;
+};
+
+#endif // ADAPTIVE_RX_H
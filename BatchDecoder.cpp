@@ -0,0 +1,286 @@
+/*
+BatchDecoder - 5-in-1 decoder for many frames at once (offline processing)
+
+See BatchDecoder.h. Every kernel computes the same expressions as
+decodeBresser5In1Payload(); keep them in step when the decoder changes.
+*/
+#include "BatchDecoder.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BATCH_X86
+#include <immintrin.h>
+#endif
+
+// Byte k of frame i
+#define PLANE(in, k) (&(in)->planes[(size_t)(k) * (in)->stride])
+
+//
+// One frame at a time - frames [first, in->count)
+//
+static void decodeScalar(const Batch5In1Frames *in, Batch5In1Readings *out, size_t first)
+{
+    for (size_t i = first; i < in->count; i++) {
+        uint8_t msg[26];
+        for (unsigned k = 0; k < sizeof(msg); k++) {
+            msg[k] = PLANE(in, k)[i];
+        }
+
+        uint8_t tolerated = 0;
+        for (unsigned col = 0; col < 13; col++) {
+            if ((msg[col] ^ msg[col + 13]) != 0xff) {
+                tolerated |= BATCH_PAR_ERR;
+            }
+        }
+        uint8_t bitsSet = 0;
+        for (unsigned p = 14; p < sizeof(msg); p++) {
+            bitsSet += __builtin_popcount(msg[p]);
+        }
+        if (bitsSet != msg[13]) {
+            tolerated |= BATCH_CHK_ERR;
+        }
+        out->tolerated[i] = tolerated;
+
+        out->sensor_id[i] = msg[14];
+
+        int temp_raw = (msg[20] & 0x0f) + ((msg[20] & 0xf0) >> 4) * 10 + (msg[21] & 0x0f) * 100;
+        if (msg[25] & 0x0f) {
+            temp_raw = -temp_raw;
+        }
+        out->temp_c[i]             = temp_raw * 0.1f;
+        out->humidity[i]           = (msg[22] & 0x0f) + ((msg[22] & 0xf0) >> 4) * 10;
+        out->wind_direction_deg[i] = ((msg[17] & 0xf0) >> 4) * 22.5f;
+        int gust_raw               = ((msg[17] & 0x0f) << 8) + msg[16];
+        out->wind_gust_meter_sec[i] = gust_raw * 0.1f;
+        int wind_raw               = (msg[18] & 0x0f) + ((msg[18] & 0xf0) >> 4) * 10 + (msg[19] & 0x0f) * 100;
+        out->wind_avg_meter_sec[i] = wind_raw * 0.1f;
+        int rain_raw               = (msg[23] & 0x0f) + ((msg[23] & 0xf0) >> 4) * 10 + (msg[24] & 0x0f) * 100;
+        out->rain_mm[i]            = rain_raw * 0.1f;
+        out->battery_ok[i]         = (msg[25] & 0x80) ? 0 : 1;
+    }
+}
+
+#ifdef BATCH_X86
+// 4 bytes, unaligned
+static inline int loadU32(const uint8_t *p)
+{
+    int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+//
+// AVX2: checks, humidity and battery of 32 frames on 8-bit lanes
+//
+__attribute__((target("avx2")))
+static void bytesAvx2(const Batch5In1Frames *in, Batch5In1Readings *out, size_t i)
+{
+    #define LOAD(k) _mm256_loadu_si256((const __m256i *)&PLANE(in, k)[i])
+    const __m256i nibble = _mm256_set1_epi8(0x0f);
+    const __m256i bits   = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+
+    // All bytes 0..12 XOR their copy must be 0xff
+    __m256i parity = _mm256_set1_epi8(-1);
+    for (unsigned k = 0; k < 13; k++) {
+        parity = _mm256_and_si256(parity, _mm256_xor_si256(LOAD(k), LOAD(k + 13)));
+    }
+    __m256i par_ok = _mm256_cmpeq_epi8(parity, _mm256_set1_epi8(-1));
+
+    // Bits set in bytes 14..25 (at most 96)
+    __m256i count = _mm256_setzero_si256();
+    for (unsigned k = 14; k < 26; k++) {
+        __m256i v = LOAD(k);
+        count = _mm256_add_epi8(count, _mm256_shuffle_epi8(bits, _mm256_and_si256(v, nibble)));
+        count = _mm256_add_epi8(count, _mm256_shuffle_epi8(bits, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+    }
+    __m256i chk_ok = _mm256_cmpeq_epi8(count, LOAD(13));
+
+    __m256i tolerated = _mm256_or_si256(_mm256_andnot_si256(par_ok, _mm256_set1_epi8(BATCH_PAR_ERR)),
+                                        _mm256_andnot_si256(chk_ok, _mm256_set1_epi8(BATCH_CHK_ERR)));
+    _mm256_storeu_si256((__m256i *)&out->tolerated[i], tolerated);
+
+    // Humidity: lo + hi * 10 - 16-bit shifts keep nibble values within their byte
+    __m256i h  = LOAD(22);
+    __m256i lo = _mm256_and_si256(h, nibble);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(h, 4), nibble);
+    __m256i hum = _mm256_add_epi8(lo, _mm256_add_epi8(_mm256_slli_epi16(hi, 3), _mm256_slli_epi16(hi, 1)));
+    _mm256_storeu_si256((__m256i *)&out->humidity[i], hum);
+
+    __m256i low = _mm256_and_si256(LOAD(25), _mm256_set1_epi8((char)0x80));
+    __m256i bat = _mm256_and_si256(_mm256_cmpeq_epi8(low, _mm256_setzero_si256()), _mm256_set1_epi8(1));
+    _mm256_storeu_si256((__m256i *)&out->battery_ok[i], bat);
+    #undef LOAD
+}
+
+//
+// AVX2: sensor ID and scaled fields of 8 frames on 32-bit lanes
+//
+__attribute__((target("avx2")))
+static void fieldsAvx2(const Batch5In1Frames *in, Batch5In1Readings *out, size_t i)
+{
+    #define LOAD(k) _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&PLANE(in, k)[i]))
+    #define LO(v)   _mm256_and_si256(v, nibble)
+    #define HI(v)   _mm256_srli_epi32(v, 4)
+    #define BCD3(a, b) _mm256_add_epi32(_mm256_add_epi32(LO(a), _mm256_mullo_epi32(HI(a), ten)), \
+                                        _mm256_mullo_epi32(LO(b), hundred))
+    const __m256i nibble  = _mm256_set1_epi32(0x0f);
+    const __m256i ten     = _mm256_set1_epi32(10);
+    const __m256i hundred = _mm256_set1_epi32(100);
+    const __m256  tenth   = _mm256_set1_ps(0.1f);
+
+    _mm256_storeu_si256((__m256i *)&out->sensor_id[i], LOAD(14));
+
+    // Sign: negated where the low nibble of byte 25 is not 0
+    __m256i temp = BCD3(LOAD(20), LOAD(21));
+    __m256i neg  = _mm256_cmpgt_epi32(LO(LOAD(25)), _mm256_setzero_si256());
+    temp = _mm256_sub_epi32(_mm256_xor_si256(temp, neg), neg);
+    _mm256_storeu_ps(&out->temp_c[i], _mm256_mul_ps(_mm256_cvtepi32_ps(temp), tenth));
+
+    __m256i b17 = LOAD(17);
+    _mm256_storeu_ps(&out->wind_direction_deg[i], _mm256_mul_ps(_mm256_cvtepi32_ps(HI(b17)), _mm256_set1_ps(22.5f)));
+    __m256i gust = _mm256_add_epi32(_mm256_slli_epi32(LO(b17), 8), LOAD(16));
+    _mm256_storeu_ps(&out->wind_gust_meter_sec[i], _mm256_mul_ps(_mm256_cvtepi32_ps(gust), tenth));
+    _mm256_storeu_ps(&out->wind_avg_meter_sec[i], _mm256_mul_ps(_mm256_cvtepi32_ps(BCD3(LOAD(18), LOAD(19))), tenth));
+    _mm256_storeu_ps(&out->rain_mm[i], _mm256_mul_ps(_mm256_cvtepi32_ps(BCD3(LOAD(23), LOAD(24))), tenth));
+    #undef BCD3
+    #undef HI
+    #undef LO
+    #undef LOAD
+}
+
+__attribute__((target("avx2")))
+static size_t decodeAvx2(const Batch5In1Frames *in, Batch5In1Readings *out)
+{
+    size_t i = 0;
+    for (; i + 32 <= in->count; i += 32) {
+        bytesAvx2(in, out, i);
+        for (unsigned j = 0; j < 32; j += 8) {
+            fieldsAvx2(in, out, i + j);
+        }
+    }
+    return i;
+}
+
+//
+// SSE4.1: as above, 16 frames on 8-bit lanes, 4 on 32-bit lanes
+//
+__attribute__((target("sse4.1")))
+static void bytesSse41(const Batch5In1Frames *in, Batch5In1Readings *out, size_t i)
+{
+    #define LOAD(k) _mm_loadu_si128((const __m128i *)&PLANE(in, k)[i])
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    const __m128i bits   = _mm_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+
+    __m128i parity = _mm_set1_epi8(-1);
+    for (unsigned k = 0; k < 13; k++) {
+        parity = _mm_and_si128(parity, _mm_xor_si128(LOAD(k), LOAD(k + 13)));
+    }
+    __m128i par_ok = _mm_cmpeq_epi8(parity, _mm_set1_epi8(-1));
+
+    __m128i count = _mm_setzero_si128();
+    for (unsigned k = 14; k < 26; k++) {
+        __m128i v = LOAD(k);
+        count = _mm_add_epi8(count, _mm_shuffle_epi8(bits, _mm_and_si128(v, nibble)));
+        count = _mm_add_epi8(count, _mm_shuffle_epi8(bits, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+    }
+    __m128i chk_ok = _mm_cmpeq_epi8(count, LOAD(13));
+
+    __m128i tolerated = _mm_or_si128(_mm_andnot_si128(par_ok, _mm_set1_epi8(BATCH_PAR_ERR)),
+                                     _mm_andnot_si128(chk_ok, _mm_set1_epi8(BATCH_CHK_ERR)));
+    _mm_storeu_si128((__m128i *)&out->tolerated[i], tolerated);
+
+    __m128i h  = LOAD(22);
+    __m128i lo = _mm_and_si128(h, nibble);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(h, 4), nibble);
+    __m128i hum = _mm_add_epi8(lo, _mm_add_epi8(_mm_slli_epi16(hi, 3), _mm_slli_epi16(hi, 1)));
+    _mm_storeu_si128((__m128i *)&out->humidity[i], hum);
+
+    __m128i low = _mm_and_si128(LOAD(25), _mm_set1_epi8((char)0x80));
+    __m128i bat = _mm_and_si128(_mm_cmpeq_epi8(low, _mm_setzero_si128()), _mm_set1_epi8(1));
+    _mm_storeu_si128((__m128i *)&out->battery_ok[i], bat);
+    #undef LOAD
+}
+
+__attribute__((target("sse4.1")))
+static void fieldsSse41(const Batch5In1Frames *in, Batch5In1Readings *out, size_t i)
+{
+    #define LOAD(k) _mm_cvtepu8_epi32(_mm_cvtsi32_si128(loadU32(&PLANE(in, k)[i])))
+    #define LO(v)   _mm_and_si128(v, nibble)
+    #define HI(v)   _mm_srli_epi32(v, 4)
+    #define BCD3(a, b) _mm_add_epi32(_mm_add_epi32(LO(a), _mm_mullo_epi32(HI(a), ten)), \
+                                     _mm_mullo_epi32(LO(b), hundred))
+    const __m128i nibble  = _mm_set1_epi32(0x0f);
+    const __m128i ten     = _mm_set1_epi32(10);
+    const __m128i hundred = _mm_set1_epi32(100);
+    const __m128  tenth   = _mm_set1_ps(0.1f);
+
+    _mm_storeu_si128((__m128i *)&out->sensor_id[i], LOAD(14));
+
+    __m128i temp = BCD3(LOAD(20), LOAD(21));
+    __m128i neg  = _mm_cmpgt_epi32(LO(LOAD(25)), _mm_setzero_si128());
+    temp = _mm_sub_epi32(_mm_xor_si128(temp, neg), neg);
+    _mm_storeu_ps(&out->temp_c[i], _mm_mul_ps(_mm_cvtepi32_ps(temp), tenth));
+
+    __m128i b17 = LOAD(17);
+    _mm_storeu_ps(&out->wind_direction_deg[i], _mm_mul_ps(_mm_cvtepi32_ps(HI(b17)), _mm_set1_ps(22.5f)));
+    __m128i gust = _mm_add_epi32(_mm_slli_epi32(LO(b17), 8), LOAD(16));
+    _mm_storeu_ps(&out->wind_gust_meter_sec[i], _mm_mul_ps(_mm_cvtepi32_ps(gust), tenth));
+    _mm_storeu_ps(&out->wind_avg_meter_sec[i], _mm_mul_ps(_mm_cvtepi32_ps(BCD3(LOAD(18), LOAD(19))), tenth));
+    _mm_storeu_ps(&out->rain_mm[i], _mm_mul_ps(_mm_cvtepi32_ps(BCD3(LOAD(23), LOAD(24))), tenth));
+    #undef BCD3
+    #undef HI
+    #undef LO
+    #undef LOAD
+}
+
+__attribute__((target("sse4.1")))
+static size_t decodeSse41(const Batch5In1Frames *in, Batch5In1Readings *out)
+{
+    size_t i = 0;
+    for (; i + 16 <= in->count; i += 16) {
+        bytesSse41(in, out, i);
+        for (unsigned j = 0; j < 16; j += 4) {
+            fieldsSse41(in, out, i + j);
+        }
+    }
+    return i;
+}
+#endif
+
+BatchIsa batchIsa(void)
+{
+    #ifdef BATCH_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            return BATCH_AVX2;
+        }
+        if (__builtin_cpu_supports("sse4.1")) {
+            return BATCH_SSE41;
+        }
+    #endif
+    return BATCH_SCALAR;
+}
+
+const char *batchIsaName(BatchIsa isa)
+{
+    switch (isa) {
+        case BATCH_AVX2:  return "avx2";
+        case BATCH_SSE41: return "sse4.1";
+        default:          return "scalar";
+    }
+}
+
+void decodeBresser5In1Batch(const Batch5In1Frames *in, Batch5In1Readings *out, BatchIsa isa)
+{
+    size_t done = 0;
+    #ifdef BATCH_X86
+        if (isa == BATCH_AVX2) {
+            done = decodeAvx2(in, out);
+        } else if (isa == BATCH_SSE41) {
+            done = decodeSse41(in, out);
+        }
+    #endif
+    decodeScalar(in, out, done);
+}
@@ -0,0 +1,71 @@
+/*
+BatchDecoder - 5-in-1 decoder for many frames at once (offline processing)
+
+decodeBresser5In1Payload() looks at one frame byte by byte. For archives,
+the batch decoder takes frames in structure-of-arrays layout - byte k of
+all frames next to each other - and decodes 32 (AVX2) or 16 (SSE4.1)
+frames per step:
+
+    Batch5In1Frames in = { planes, stride, count };  // byte k of frame i: planes[k * stride + i]
+    Batch5In1Readings out = { sensor_id, temp_c, ... };
+    decodeBresser5In1Batch(&in, &out, batchIsa());
+
+- inversion check (bytes 0..12 == ~bytes 13..25) and bit count checksum
+  (pshufb nibble table) on 8-bit lanes
+- BCD/binary fields on 32-bit lanes, scaled in float as the scalar decoder
+  does (value * 0.1f, ...)
+
+The results are bit for bit those of decodeBresser5In1Payload() with
+msgSize BRESSER_5IN1_SIZE: that decoder only reports parity and checksum
+errors (to the tolerated hook) and returns DECODE_OK - the batch decoder
+reports them in tolerated[] (BATCH_PAR_ERR, BATCH_CHK_ERR). Decoder hooks
+are not consulted; filter on sensor_id[] instead. The 6-in-1 protocol
+(LFSR digest) is not batched.
+
+The kernels are selected at run time (batchIsa()); on other targets than
+x86, and for the frames after the last full block, the scalar code is used.
+*/
+#ifndef BATCH_DECODER_H
+#define BATCH_DECODER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Errors tolerated by the 5-in-1 decoder
+#define BATCH_PAR_ERR 0x01
+#define BATCH_CHK_ERR 0x02
+
+enum BatchIsa {
+    BATCH_SCALAR, BATCH_SSE41, BATCH_AVX2
+};
+
+// 5-in-1 payloads (BRESSER_5IN1_SIZE bytes following 0xD4), byte k of frame
+// i at planes[k * stride + i]
+struct Batch5In1Frames {
+    const uint8_t *planes;
+    size_t         stride;         // >= count
+    size_t         count;
+};
+
+// Decoded fields, arrays of count entries
+struct Batch5In1Readings {
+    uint32_t *sensor_id;
+    float    *temp_c;
+    uint8_t  *humidity;
+    float    *wind_direction_deg;
+    float    *wind_gust_meter_sec;
+    float    *wind_avg_meter_sec;
+    float    *rain_mm;
+    uint8_t  *battery_ok;
+    uint8_t  *tolerated;           // BATCH_x
+};
+
+// Best kernels supported by the CPU
+BatchIsa batchIsa(void);
+
+const char *batchIsaName(BatchIsa isa);
+
+// Decode in->count frames with the kernels of isa (at most batchIsa())
+void decodeBresser5In1Batch(const Batch5In1Frames *in, Batch5In1Readings *out, BatchIsa isa);
+
+#endif // BATCH_DECODER_H
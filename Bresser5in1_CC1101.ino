@@ -20,10 +20,279 @@ https://github.com/merbanan/rtl_433/blob/master/src/devices/bresser_6in1.c
 // Uncomment   BRESSER_6_IN_1 to use decodeBresser6In1Payload()
 //#define BRESSER_6_IN_1
 //#define _DEBUG_MODE_
+
+// Packet length incl. the last sync byte - a 6-in-1 frame ends after 19 bytes,
+// a 5-in-1 frame after 27
+#ifdef BRESSER_6_IN_1
+    #define RECV_LENGTH 19
+#else
+    #define RECV_LENGTH 27
+#endif
+
+// Uncomment READING_LOG to keep a persistent log of decoded readings in LittleFS;
+// readings are logged once the clock has been set by NTP (connects to WiFi)
+//#define READING_LOG
+#define READING_LOG_DIR "/littlefs/log"
+#define READING_LOG_FLUSH_INTERVAL 300000 // ms
+#define NTP_SERVER "pool.ntp.org"
+#define CLOCK_VALID_AFTER 1600000000      // time() before is taken as not set
+
+// Uncomment COLUMNAR_EXPORT to write decoded readings as Arrow IPC stream
+// (columnar, for analysis tools) to LittleFS, a new file per boot and
+// whenever a file has reached COLUMNAR_EXPORT_FILE_SIZE; the oldest files
+// beyond COLUMNAR_MAX_FILES (ColumnarExport.h) are deleted
+//#define COLUMNAR_EXPORT
+#define COLUMNAR_EXPORT_DIR "/littlefs/export"
+#define COLUMNAR_EXPORT_FLUSH_INTERVAL 300000 // ms
+#define COLUMNAR_EXPORT_FILE_SIZE (64 * 1024) // bytes
+
+// Uncomment TIME_SERIES_STORE to keep a compressed per-sensor history in RAM
+//#define TIME_SERIES_STORE
+
+// Uncomment ROLLUPS to maintain 1 min/10 min/1 h/1 day min/max/avg per sensor
+//#define ROLLUPS
+
+// Uncomment MQTT_PUBLISH to publish decoded readings (batched, report by exception)
+//#define MQTT_PUBLISH
+#ifndef MQTT_HOST
+    #define MQTT_HOST "192.168.0.1"
+#endif
+#define MQTT_PORT 1883
+#define MQTT_TOPIC "bresser/readings"
+
+// Uncomment HTTP_SERVER to serve the current readings as JSON via HTTP
+//#define HTTP_SERVER
+#define HTTP_PORT 80
+
+// Uncomment METRICS to expose receiver metrics in Prometheus format at
+// http://<ip>/metrics (enables HTTP_SERVER)
+//#define METRICS
+#if defined(METRICS) && !defined(HTTP_SERVER)
+    #define HTTP_SERVER
+#endif
+
+// Uncomment SENSOR_FILTER to accept only (SENSOR_FILTER_ALLOW) or to reject
+// (SENSOR_FILTER_DENY) the sensor IDs in SENSOR_FILTER_IDS - other frames are
+// dropped right after the integrity check, before decoding
+//#define SENSOR_FILTER
+#define SENSOR_FILTER_MODE SENSOR_FILTER_ALLOW
+#define SENSOR_FILTER_IDS 0x39582376, 0x00000042
+
+// Uncomment SENSOR_SCHEDULE to learn each sensor's transmit period and phase,
+// predict its next transmission and count missed frames
+//#define SENSOR_SCHEDULE
+
+// Uncomment LOW_POWER_RX to let the MCU light-sleep until a frame is received
+// or a predicted transmission is due (enables SENSOR_SCHEDULE); uncomment
+// LOW_POWER_WOR to put the radio into Wake-On-Radio instead of power down
+// between predicted transmissions
+//#define LOW_POWER_RX
+//#define LOW_POWER_WOR
+#ifdef LOW_POWER_RX
+    #if defined(MQTT_PUBLISH) || defined(HTTP_SERVER) || defined(READING_LOG)
+        #error "LOW_POWER_RX cannot be used with WiFi (MQTT_PUBLISH, HTTP_SERVER, METRICS, READING_LOG)"
+    #endif
+    #ifndef SENSOR_SCHEDULE
+        #define SENSOR_SCHEDULE
+    #endif
+#endif
+
+// Uncomment MULTI_RADIO to receive with a second CC1101 on the same SPI bus
+// (own CS and GDO0 pins) - on another frequency or, for antenna diversity,
+// on the same one; copies of a frame are merged, keeping the best RSSI
+//#define MULTI_RADIO
+#define PIN_RADIO2_CS 17
+#define PIN_RADIO2_GDO0 16
+#define PIN_RADIO2_GDO2 RADIOLIB_NC
+#define RADIO2_FREQUENCY 868.3
+#if defined(MULTI_RADIO) && defined(LOW_POWER_RX)
+    #error "MULTI_RADIO cannot be used with LOW_POWER_RX"
+#endif
+
+// Uncomment SENSOR_EMULATOR to transmit frames of emulated sensors instead of
+// receiving (traffic source for testing another receiver): EMULATOR_SENSORS_5IN1
+// + EMULATOR_SENSORS_6IN1 sensors, each sending every EMULATOR_PERIOD_MS
+//#define SENSOR_EMULATOR
+#define EMULATOR_SENSORS_5IN1 2
+#define EMULATOR_SENSORS_6IN1 2
+#define EMULATOR_PERIOD_MS 12000
+#if defined(SENSOR_EMULATOR) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO))
+    #error "SENSOR_EMULATOR cannot be used with LOW_POWER_RX or MULTI_RADIO"
+#endif
+
+// Uncomment ADAPTIVE_LENGTH to receive 5-in-1 and 6-in-1 frames: the protocol
+// is identified from the first 16 bytes (RX FIFO threshold on GDO2) and the
+// packet ended after 27 or 19 bytes - the radio is ready for the next frame
+// sooner; frames without the last sync byte are aborted after 16 bytes
+//#define ADAPTIVE_LENGTH
+
+// Uncomment STREAM_CHECK to drain the RX FIFO every 4 bytes and check the frame
+// while it arrives (enables ADAPTIVE_LENGTH): frames failing the digest,
+// checksum or 5-in-1 parity are dropped while still on air
+//#define STREAM_CHECK
+#if defined(STREAM_CHECK) && !defined(ADAPTIVE_LENGTH)
+    #define ADAPTIVE_LENGTH
+#endif
+#if defined(ADAPTIVE_LENGTH) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(SENSOR_EMULATOR))
+    #error "ADAPTIVE_LENGTH cannot be used with LOW_POWER_RX, MULTI_RADIO or SENSOR_EMULATOR"
+#endif
+
+// Uncomment RADIO_IMAGE to configure the radio from a register image computed
+// at compile time (one SPI burst, read back once) instead of RadioLib's
+// setters; the image also restores the radio after receive errors or if its
+// modem registers are found changed (checked every RADIO_CHECK_INTERVAL ms)
+//#define RADIO_IMAGE
+#define RADIO_CHECK_INTERVAL 60000
+#if defined(RADIO_IMAGE) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO))
+    #error "RADIO_IMAGE cannot be used with LOW_POWER_RX or MULTI_RADIO"
+#endif
+
+// Uncomment FREQ_TRACKING to track the carrier frequency offset of each sensor
+// (FREQEST after every good packet) and to retune the radio by FSCTRL0 to
+// the centre of all offsets - or, with SENSOR_SCHEDULE, to the offset of the
+// sensor whose transmission is due (nominal frequency in between); receiving
+// does not block
+//#define FREQ_TRACKING
+#if defined(FREQ_TRACKING) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(ADAPTIVE_LENGTH) || defined(SENSOR_EMULATOR))
+    #error "FREQ_TRACKING cannot be used with LOW_POWER_RX, MULTI_RADIO, ADAPTIVE_LENGTH or SENSOR_EMULATOR"
+#endif
+
+// Uncomment NOISE_FLOOR to track the ambient noise floor (RSSI sampled every
+// NOISE_SAMPLE_MS while listening) and to have the radio drop packets of
+// noise itself: sync word qualified by carrier sense, with the threshold
+// above the noise floor, and the preamble quality threshold raised while
+// junk still gets through; receiving does not block. The history is served
+// at http://<ip>/noise with HTTP_SERVER.
+//#define NOISE_FLOOR
+#define NOISE_SAMPLE_MS 100
+#if defined(NOISE_FLOOR) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(ADAPTIVE_LENGTH) || defined(SENSOR_EMULATOR))
+    #error "NOISE_FLOOR cannot be used with LOW_POWER_RX, MULTI_RADIO, ADAPTIVE_LENGTH or SENSOR_EMULATOR"
+#endif
+
+// Uncomment PROFILE_SCANNER to receive on several radio profiles in turn
+// (frequency, data rate, sync word - see scanParams): each profile gets
+// SCAN_MIN_DWELL_MS of every SCAN_CYCLE_MS, the rest is shared according
+// to the frames received on it; receiving does not block. The radio module
+// must cover all frequencies.
+//#define PROFILE_SCANNER
+#define SCAN_FREQUENCY2 915.0
+#if defined(PROFILE_SCANNER) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(ADAPTIVE_LENGTH) || defined(SENSOR_EMULATOR) || defined(FREQ_TRACKING) || defined(NOISE_FLOOR))
+    #error "PROFILE_SCANNER cannot be used with LOW_POWER_RX, MULTI_RADIO, ADAPTIVE_LENGTH, SENSOR_EMULATOR, FREQ_TRACKING or NOISE_FLOOR"
+#endif
+
+// Uncomment EVENT_LOOP to run the radio and the housekeeping (MQTT, HTTP,
+// log flush, schedule) as tasks of a cooperative event loop: the radio task
+// is signalled by GDO0 at the end of a packet (and polled every
+// EVENT_RADIO_POLL_MS) and runs before any housekeeping still waiting;
+// receiving does not block
+//#define EVENT_LOOP
+#define EVENT_RADIO_POLL_MS 10
+#if defined(EVENT_LOOP) && (defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(ADAPTIVE_LENGTH) || defined(SENSOR_EMULATOR))
+    #error "EVENT_LOOP cannot be used with LOW_POWER_RX, MULTI_RADIO, ADAPTIVE_LENGTH or SENSOR_EMULATOR"
+#endif
+
+// Receive by polling (receivePolled(), end of packet latched by an
+// interrupt) instead of blocking in radio.receive(): needed to retune or
+// switch the radio between packets, and with HTTP_SERVER (and METRICS) so
+// requests are served while waiting for a frame and the receive stage is
+// timed from the end of the packet
+#if defined(FREQ_TRACKING) || defined(NOISE_FLOOR) || defined(PROFILE_SCANNER) || defined(EVENT_LOOP) || \
+    (defined(HTTP_SERVER) && !defined(MULTI_RADIO) && !defined(ADAPTIVE_LENGTH) && !defined(SENSOR_EMULATOR))
+    #define POLLED_RX
+#endif
+
+// Uncomment STATIC_POOLS to hold decoded readings in a fixed-capacity pool
+// (recordPool) instead of on the stack until all outputs have taken them;
+// its use is in /metrics.
+// Build with HEAP_GUARD (see platformio.ini) to have every heap allocation
+// by loop() after setup() reported (and abort) - not with MQTT_PUBLISH or
+// HTTP_SERVER, which allocate in loop() on every (re)connection (WiFiClient,
+// lwIP socket calls).
+//#define STATIC_POOLS
+#define POOL_RECORDS 8
+#if defined(HEAP_GUARD) && (defined(MQTT_PUBLISH) || defined(HTTP_SERVER))
+    #error "HEAP_GUARD cannot be used with MQTT_PUBLISH or HTTP_SERVER (METRICS)"
+#endif
+
+#ifndef WIFI_SSID
+    #define WIFI_SSID "ssid"
+    #define WIFI_PASS "password"
+#endif
+
 #define RADIOLIB_DEBUG
 #include <Arduino.h>
 #include <RadioLib.h>
 #include <stdint.h>
+#include <time.h>
+#include "WeatherData.h"
+#include "BresserDecoder.h"
+#if defined(READING_LOG) || defined(COLUMNAR_EXPORT)
+    #include <LittleFS.h>
+#endif
+#ifdef READING_LOG
+    #include "ReadingLog.h"
+#endif
+#ifdef COLUMNAR_EXPORT
+    #include "ColumnarExport.h"
+#endif
+#ifdef TIME_SERIES_STORE
+    #include "TimeSeriesStore.h"
+#endif
+#ifdef ROLLUPS
+    #include "Rollups.h"
+#endif
+#if defined(MQTT_PUBLISH) || defined(HTTP_SERVER) || defined(READING_LOG)
+    #include <WiFi.h>
+#endif
+#ifdef MQTT_PUBLISH
+    #include <PubSubClient.h>
+    #include "MqttPublisher.h"
+#endif
+#ifdef HTTP_SERVER
+    #include "HttpServer.h"
+#endif
+#ifdef METRICS
+    #include "Metrics.h"
+#endif
+#ifdef SENSOR_FILTER
+    #include "SensorFilter.h"
+#endif
+#ifdef SENSOR_SCHEDULE
+    #include "SensorSchedule.h"
+#endif
+#if defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(ADAPTIVE_LENGTH) || defined(RADIO_IMAGE) || defined(POLLED_RX)
+    #include "CC1101Bus.h"
+#endif
+#if defined(RADIO_IMAGE) || defined(PROFILE_SCANNER)
+    #include "CC1101Image.h"
+#endif
+#ifdef LOW_POWER_RX
+    #include "LowPowerRx.h"
+#endif
+#ifdef MULTI_RADIO
+    #include "RadioArray.h"
+#endif
+#ifdef SENSOR_EMULATOR
+    #include "SensorEmulator.h"
+#endif
+#ifdef ADAPTIVE_LENGTH
+    #include "AdaptiveRx.h"
+#endif
+#ifdef FREQ_TRACKING
+    #include "FreqTracker.h"
+#endif
+#ifdef NOISE_FLOOR
+    #include "NoiseFloor.h"
+#endif
+#ifdef PROFILE_SCANNER
+    #include "ProfileScanner.h"
+#endif
+#ifdef EVENT_LOOP
+    #include "EventLoop.h"
+#endif
+#if defined(STATIC_POOLS) || defined(HEAP_GUARD)
+    #include "MemoryPools.h"
+#endif
 #define RADIOLIB_BUILD_ARDUINO
 #define xstr(s) str(s)
 #define str(s) #s
@@ -36,307 +305,562 @@ https://github.com/merbanan/rtl_433/blob/master/src/devices/bresser_6in1.c
 #define PIN_CC1101_GDO0 27
 #define PIN_CC1101_GDO2 4
 
+// Radio parameters (see initRadio())
+#define RADIO_FREQUENCY 868.3
+#define RADIO_BITRATE   8.21
+#define RADIO_DEVIATION 57.136417
+#define RADIO_RX_BW     270
+#define RADIO_POWER     10
+#define RADIO_PREAMBLE  32
+#ifdef NOISE_FLOOR
+    #define RADIO_CARRIER_SENSE true
+#else
+    #define RADIO_CARRIER_SENSE false
+#endif
 
-CC1101 radio = new Module(PIN_CC1101_CS, PIN_CC1101_GDO0, RADIOLIB_NC, PIN_CC1101_GDO2);
 
-typedef enum DecodeStatus {
-    DECODE_OK, DECODE_PAR_ERR, DECODE_CHK_ERR, DECODE_DIG_ERR
-} DecodeStatus;
-
-struct WeatherData_S {
-    uint8_t  s_type;               // only 6-in1
-    uint32_t sensor_id;            // 5-in-1: 1 byte / 6-in-1: 4 bytes
-    uint8_t  chan;                 // only 6-in-1
-    bool     temp_ok;              // only 6-in-1
-    float    temp_c;
-    int      humidity;
-    bool     uv_ok;                // only 6-in-1
-    float    uv;                   // only 6-in-1
-    bool     wind_ok;              // only 6-in-1
-    float    wind_direction_deg;
-    float    wind_gust_meter_sec;
-    float    wind_avg_meter_sec;
-    bool     rain_ok;              // only 6-in-1
-    float    rain_mm;
-    bool     battery_ok;
-    bool     moisture_ok;          // only 6-in-1
-    int      moisture;             // only 6-in-1
+#ifdef RADIO_IMAGE
+Module radioModule(PIN_CC1101_CS, PIN_CC1101_GDO0, RADIOLIB_NC, PIN_CC1101_GDO2);
+CC1101 radio = &radioModule;
+
+constexpr CC1101Params radioParams = {
+    RADIO_FREQUENCY, RADIO_BITRATE, RADIO_DEVIATION, RADIO_RX_BW, RADIO_POWER, RADIO_PREAMBLE, RECV_LENGTH,
+    RADIO_CARRIER_SENSE
 };
+static_assert(cc1101ImageValid(radioParams), "Radio parameters not supported by CC1101Image");
+constexpr CC1101Image radioImage = cc1101Image(radioParams);
+uint32_t radioChecked;
+#else
+CC1101 radio = new Module(PIN_CC1101_CS, PIN_CC1101_GDO0, RADIOLIB_NC, PIN_CC1101_GDO2);
+#endif
 
-typedef struct WeatherData_S WeatherData;
+#if defined(LOW_POWER_RX) || defined(MULTI_RADIO) || defined(ADAPTIVE_LENGTH) || defined(RADIO_IMAGE) || defined(POLLED_RX)
+CC1101SpiBus radioBus(PIN_CC1101_CS, PIN_CC1101_GDO0, PIN_CC1101_GDO2);
+#endif
+
+#ifdef MULTI_RADIO
+CC1101       radio2 = new Module(PIN_RADIO2_CS, PIN_RADIO2_GDO0, RADIOLIB_NC, PIN_RADIO2_GDO2);
+CC1101SpiBus radio2Bus(PIN_RADIO2_CS, PIN_RADIO2_GDO0, PIN_RADIO2_GDO2);
+RadioArray   radios;
+#endif
+
+#ifdef READING_LOG
+ReadingLog readingLog;
+uint32_t   readingLogFlushed;
+#endif
+
+#ifdef COLUMNAR_EXPORT
+ColumnarWriter columnarExport;
+FILE          *columnarFile;
+uint32_t       columnarFlushed;
 
 //
-// From from rtl_433 project - https://github.com/merbanan/rtl_433/blob/master/src/util.c
+// Start a new stream file - the current one is ended, the oldest ones are
+// deleted. A stream cut off by a reset is readable up to the last batch
+// flushed.
 //
-uint16_t lfsr_digest16(uint8_t const message[], unsigned bytes, uint16_t gen, uint16_t key)
-{
-    uint16_t sum = 0;
-    for (unsigned k = 0; k < bytes; ++k) {
-        uint8_t data = message[k];
-        for (int i = 7; i >= 0; --i) {
-            // fprintf(stderr, "key at bit %d : %04x\n", i, key);
-            // if data bit is set then xor with key
-            if ((data >> i) & 1)
-                sum ^= key;
-
-            // roll the key right (actually the lsb is dropped here)
-            // and apply the gen (needs to include the dropped lsb as msb)
-            if (key & 1)
-                key = (key >> 1) ^ gen;
-            else
-                key = (key >> 1);
+bool columnarOpen() {
+    char path[48];
+    if (columnarFile) {
+        columnarExport.finish();
+        fclose(columnarFile);
+        columnarFile = nullptr;
+    }
+    if (!columnarNextPath(COLUMNAR_EXPORT_DIR, path, sizeof(path)) || !(columnarFile = fopen(path, "wb"))) {
+        return false;
+    }
+    if (!columnarExport.begin(columnarFileSink, columnarFile, false)) {
+        fclose(columnarFile);
+        columnarFile = nullptr;
+        return false;
+    }
+    Serial.printf("[EXPORT] Writing %s\n", path);
+    return true;
+}
+
+// Write the collected rows as a batch and push it to flash - a new file is
+// started once the current one has reached its size
+void columnarFlush() {
+    if (!columnarFile) {
+        return;
+    }
+    columnarExport.flush();
+    fflush(columnarFile);
+    if (columnarExport.stats().bytes >= COLUMNAR_EXPORT_FILE_SIZE && !columnarOpen()) {
+        Serial.println("[EXPORT] Error opening export stream");
+    }
+}
+#endif
+
+#ifdef TIME_SERIES_STORE
+TimeSeriesStore history;
+#endif
+
+#ifdef ROLLUPS
+Rollups rollups;
+#endif
+
+#ifdef MQTT_PUBLISH
+WiFiClient    wifiClient;
+PubSubClient  mqttClient(wifiClient);
+MqttPublisher mqttPublisher;
+uint32_t      mqttReconnect;
+
+bool mqttPublish(const char *topic, const char *payload, unsigned len, void *ctx) {
+    return mqttClient.connected() && mqttClient.publish(topic, (const uint8_t *)payload, len);
+}
+
+void mqttLoop() {
+    if (!mqttClient.connected() && WiFi.status() == WL_CONNECTED && millis() - mqttReconnect > 5000) {
+        mqttReconnect = millis();
+        if (mqttClient.connect("bresser-cc1101")) {
+            Serial.println("[MQTT] Connected");
         }
     }
-    return sum;
+    mqttClient.loop();
+    if (mqttPublisher.flush(millis())) {
+        #ifdef _DEBUG_MODE_
+            const MqttStats &st = mqttPublisher.stats();
+            Serial.printf("[MQTT] %u frames, %u publishes (%.3f/s), %u bytes - naive: %u publishes, %u bytes\n",
+                st.frames, st.publishes, st.publishes * 1000.0 / millis(), st.bytes,
+                st.naive_publishes, st.naive_bytes);
+        #endif
+    }
 }
+#endif
 
-//
-// From from rtl_433 project - https://github.com/merbanan/rtl_433/blob/master/src/util.c
-//
-int add_bytes(uint8_t const message[], unsigned num_bytes)
-{
-    int result = 0;
-    for (unsigned i = 0; i < num_bytes; ++i) {
-        result += message[i];
+#ifdef HTTP_SERVER
+HttpServer httpServer;
+bool       httpStarted;
+
+void httpLoop() {
+    // Network stack is available once connected
+    if (!httpStarted && WiFi.status() == WL_CONNECTED) {
+        httpStarted = httpServer.begin(HTTP_PORT);
     }
-    return result;
+    httpServer.render();
+    httpServer.poll();
 }
+#endif
 
+#ifdef SENSOR_FILTER
+SensorFilter sensorFilter;
+const uint32_t sensorFilterIds[] = { SENSOR_FILTER_IDS };
+
+bool decoderAccept(uint32_t sensor_id, void *ctx) {
+    return sensorFilter.accept(sensor_id);
+}
+#endif
+
+#ifdef SENSOR_SCHEDULE
+SensorSchedule schedule;
+#endif
+
+#ifdef LOW_POWER_RX
+LowPowerRx lowPower;
+#endif
+
+#ifdef ADAPTIVE_LENGTH
+AdaptiveRx adaptiveRx;
+#endif
+
+#ifdef PROFILE_SCANNER
+ProfileScanner scanner;
+
+// The first profile is the one set up by initRadio()/radioImage
+constexpr CC1101Params scanParams[] = {
+    { RADIO_FREQUENCY, RADIO_BITRATE, RADIO_DEVIATION, RADIO_RX_BW, RADIO_POWER, RADIO_PREAMBLE, RECV_LENGTH },
+    { SCAN_FREQUENCY2, RADIO_BITRATE, RADIO_DEVIATION, RADIO_RX_BW, RADIO_POWER, RADIO_PREAMBLE, RECV_LENGTH }
+};
+constexpr CC1101Image scanImages[] = { cc1101Image(scanParams[0]), cc1101Image(scanParams[1]) };
+const char *scanNames[] = { xstr(RADIO_FREQUENCY), xstr(SCAN_FREQUENCY2) };
+static_assert(cc1101ImageValid(scanParams[0]) && cc1101ImageValid(scanParams[1]),
+              "Scan profile not supported by CC1101Image");
+#endif
+
+#ifdef POLLED_RX
+bool          radioListening;      // in RX, waiting for a sync word
+volatile bool radioSynced;         // sync word seen, packet being received
+uint32_t      radioFrameUs;        // micros() when the last packet was complete
+#endif
+
+#ifdef NOISE_FLOOR
+NoiseFloor noiseFloor;
+uint32_t   noiseSampled;
+bool       noiseApplied;           // thresholds written to the radio
+
+#ifdef HTTP_SERVER
+int renderNoise(char *buf, unsigned size, unsigned part, void *ctx) {
+    return (part == 0) ? noiseFloor.renderHistory(buf, size) : 0;
+}
+#endif
+#endif
+
+#ifdef FREQ_TRACKING
+FreqTracker freqTracker;
+int8_t      radioFreqEst;          // FREQEST of the last packet
 
-// Cribbed from rtl_433 project - but added extra checksum to verify uu
-//
-// Example input data:
-//   EA EC 7F EB 5F EE EF FA FE 76 BB FA FF 15 13 80 14 A0 11 10 05 01 89 44 05 00
-//   CC CC CC CC CC CC CC CC CC CC CC CC CC uu II SS GG DG WW  W TT  T HH RR  R Bt
-// - C = Check, inverted data of 13 byte further
-// - uu = checksum (number/count of set bits within bytes 14-25)
-// - I = station ID (maybe)
-// - G = wind gust in 1/10 m/s, normal binary coded, GGxG = 0x76D1 => 0x0176 = 256 + 118 = 374 => 37.4 m/s.  MSB is out of sequence.
-// - D = wind direction 0..F = N..NNE..E..S..W..NNW
-// - W = wind speed in 1/10 m/s, BCD coded, WWxW = 0x7512 => 0x0275 = 275 => 27.5 m/s. MSB is out of sequence.
-// - T = temperature in 1/10 °C, BCD coded, TTxT = 1203 => 31.2 °C
-// - t = temperature sign, minus if unequal 0
-// - H = humidity in percent, BCD coded, HH = 23 => 23 %
-// - R = rain in mm, BCD coded, RRxR = 1203 => 31.2 mm
-// - B = Battery. 0=Ok, 8=Low.
-// - S = sensor type, only low nibble used, 0x9 for Bresser Professional Rain Gauge
 //
-// Parameters:
+// FSCTRL0 to listen with: with SENSOR_SCHEDULE the offset of a tracked sensor
+// whose window is open, in between the nominal frequency (where sensors not
+// yet tracked are found) - else the centre of all offsets
 //
-// msg     - Pointer to message
-// msgSize - Size of message
-// pOut    - Pointer to WeatherData
+int8_t freqTarget(uint32_t now_ms) {
+    #ifdef SENSOR_SCHEDULE
+        uint32_t ids[FREQ_MAX_SENSORS];
+        unsigned n = freqTracker.sensors(ids, FREQ_MAX_SENSORS);
+        for (unsigned i = 0; i < n; i++) {
+            SchedulePrediction prediction;
+            if (schedule.predict(ids[i], &prediction) &&
+                (int32_t)(now_ms - (prediction.next_ms - prediction.window_ms)) >= 0 &&
+                (int32_t)(prediction.next_ms + prediction.window_ms - now_ms) >= 0) {
+                return freqTracker.compensation(ids[i]);
+            }
+        }
+        return 0;
+    #else
+        return freqTracker.compensation();
+    #endif
+}
+#endif
+
+#ifdef POLLED_RX
 //
-// Returns:
+// Receive without blocking - returns RadioLib status, RADIOLIB_ERR_RX_TIMEOUT
+// while no packet is complete. GDO0 (sync word/end of packet, as set by
+// startReceive()) is high while a packet is received. Between packets the
+// RSSI is sampled for the noise floor, the radio is switched to the next
+// scan profile, and retuned whenever the offset to listen with or the
+// thresholds change.
 //
-// DECODE_OK      - OK - WeatherData will contain the updated information
-// DECODE_PAR_ERR - Parity Error
-// DECODE_CHK_ERR - Checksum Error
+// The end of a packet (GDO0 falling) is latched by radioIsr(): a packet
+// received while the loop was busy for longer than the packet is read all
+// the same, and the radio re-armed.
 //
-DecodeStatus decodeBresser5In1Payload(uint8_t *msg, uint8_t msgSize, WeatherData *pOut) { 
-    // First 13 bytes need to match inverse of last 13 bytes
-    for (unsigned col = 0; col < msgSize / 2; ++col) {
-        if ((msg[col] ^ msg[col + 13]) != 0xff) {
-            Serial.printf("%s: Parity wrong at %u\n", __func__, col);
-            // MPr commented out
-            //return DECODE_PAR_ERR;
+int receivePolled(uint8_t *data) {
+    if (radioBus.gdo(0)) {
+        radioSynced = true;
+        return RADIOLIB_ERR_RX_TIMEOUT;
+    }
+    if (radioSynced) {
+        // End of packet - the radio is in IDLE
+        radioSynced    = false;
+        radioListening = false;
+        radioFrameUs   = micros();
+        int state = radio.readData(data, RECV_LENGTH);
+        #ifdef FREQ_TRACKING
+            radioFreqEst = (int8_t)radioBus.readStatus(CC1101_FREQEST);
+        #endif
+        return state;
+    }
+    bool rearm = !radioListening;
+    #ifdef PROFILE_SCANNER
+        // Switched in RX, no re-arming needed
+        if (radioListening && scanner.poll(millis())) {
+            #ifdef _DEBUG_MODE_
+                Serial.printf("[SCAN] Profile %s for %u ms, switch max. %u us, avg. %.0f us\n",
+                    scanner.name(scanner.current()), (unsigned)scanner.stats(scanner.current()).dwell_ms,
+                    (unsigned)scanner.stats().switch_max_us, scanner.switchLatency());
+            #endif
+        }
+    #endif
+    #ifdef NOISE_FLOOR
+        if (radioListening && millis() - noiseSampled >= NOISE_SAMPLE_MS) {
+            noiseSampled = millis();
+            noiseFloor.sample(radioBus.readStatus(CC1101_RSSI));
         }
+        if (noiseFloor.poll(millis())) {
+            noiseApplied = false;
+        }
+        rearm = rearm || !noiseApplied;
+    #endif
+    #ifdef FREQ_TRACKING
+        int8_t target = freqTarget(millis());
+        rearm = rearm || (target != freqTracker.fsctrl0());
+    #endif
+    if (rearm) {
+        radio.standby();
+        // A packet aborted by standby() is not read
+        radioSynced = false;
+        #ifdef FREQ_TRACKING
+            radioBus.writeReg(CC1101_FSCTRL0, (uint8_t)target);
+            freqTracker.retuned(target);
+        #endif
+        #ifdef NOISE_FLOOR
+            if (!noiseApplied) {
+                radioBus.writeReg(CC1101_AGCCTRL1, noiseFloor.agcctrl1(radioBus.readReg(CC1101_AGCCTRL1)));
+                radioBus.writeReg(CC1101_PKTCTRL1, noiseFloor.pktctrl1(radioBus.readReg(CC1101_PKTCTRL1)));
+                noiseApplied = true;
+            }
+        #endif
+        int state = radio.startReceive();
+        radioListening = (state == RADIOLIB_ERR_NONE);
+        return (state == RADIOLIB_ERR_NONE) ? RADIOLIB_ERR_RX_TIMEOUT : state;
     }
+    return RADIOLIB_ERR_RX_TIMEOUT;
+}
 
-    // Verify checksum (number number bits set in bytes 14-25)
-    uint8_t bitsSet = 0;
-    uint8_t expectedBitsSet = msg[13];
+#ifndef EVENT_LOOP
+// End of packet (GDO0 falling)
+void IRAM_ATTR radioIsr() {
+    radioSynced = true;
+}
+#endif
+#endif
 
-    for(uint8_t p = 14 ; p < msgSize ; p++) {
-      uint8_t currentByte = msg[p];
-      while(currentByte) {
-        bitsSet += (currentByte & 1);
-        currentByte >>= 1;
-      }
-    }
+#ifdef STATIC_POOLS
+ObjectPool<DecodedRecord, POOL_RECORDS> recordPool("records");
+#endif
 
-    if (bitsSet != expectedBitsSet) {
-       Serial.printf("%s: Checksum wrong actual [%02X] != expected [%02X]\n", __func__, bitsSet, expectedBitsSet);
-       //return DECODE_CHK_ERR;
-    }
+#ifdef EVENT_LOOP
+EventLoop events;
+int       radioTask;
+
+void receiveFrame();
+
+uint32_t IRAM_ATTR isrMicros() {
+    return micros();
+}
+
+// End of packet (GDO0 falling) - the packet is read by the radio task even
+// if it has not seen GDO0 high
+void IRAM_ATTR radioIsr() {
+    radioSynced = true;
+    events.signal(radioTask);
+}
+
+void radioTaskFn(void *ctx) {
+    receiveFrame();
+}
 
-    pOut->sensor_id = msg[14];
+#ifdef READING_LOG
+void logTaskFn(void *ctx) {
+    readingLog.flush();
+}
+#endif
 
-    int temp_raw = (msg[20] & 0x0f) + ((msg[20] & 0xf0) >> 4) * 10 + (msg[21] &0x0f) * 100;
-    if (msg[25] & 0x0f) {
-        temp_raw = -temp_raw;
+#ifdef COLUMNAR_EXPORT
+void exportTaskFn(void *ctx) {
+    columnarFlush();
+}
+#endif
+
+#ifdef MQTT_PUBLISH
+void mqttTaskFn(void *ctx) {
+    mqttLoop();
+}
+#endif
+
+#ifdef HTTP_SERVER
+void httpTaskFn(void *ctx) {
+    httpLoop();
+}
+#endif
+
+#ifdef SENSOR_SCHEDULE
+void scheduleTaskFn(void *ctx) {
+    schedule.poll(millis());
+}
+#endif
+#endif
+
+#ifdef SENSOR_EMULATOR
+SensorEmulator emulator;
+
+bool emulatorTransmit(const uint8_t *frame, uint8_t len, void *ctx) {
+    int state = radio.transmit((uint8_t *)frame, len);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.printf("[EMU] Transmit failed, code %d\n", state);
     }
-    pOut->temp_c = temp_raw * 0.1f;
+    return state == RADIOLIB_ERR_NONE;
+}
+#endif
 
-    pOut->humidity = (msg[22] & 0x0f) + ((msg[22] & 0xf0) >> 4) * 10;
+#ifdef METRICS
+Metrics metrics;
 
-    pOut->wind_direction_deg = ((msg[17] & 0xf0) >> 4) * 22.5f;
+static_assert(METRICS_PART_SIZE <= HTTP_DYNAMIC_SIZE, "METRICS_MAX_SENSORS too large for HTTP_DYNAMIC_SIZE");
 
-    int gust_raw = ((msg[17] & 0x0f) << 8) + msg[16];
-    pOut->wind_gust_meter_sec = gust_raw * 0.1f;
+// Errors tolerated by the 5-in-1 decoder are counted nevertheless
+void decoderTolerated(DecodeStatus status, void *ctx) {
+    metrics.decodeResult(METRIC_DECODER_5IN1, status);
+}
 
-    int wind_raw = (msg[18] & 0x0f) + ((msg[18] & 0xf0) >> 4) * 10 + (msg[19] & 0x0f) * 100;
-    pOut->wind_avg_meter_sec = wind_raw * 0.1f;
+// The parts of metrics, then one part per module
+int renderMetrics(char *buf, unsigned size, unsigned part, void *ctx) {
+    if (part < METRICS_PARTS) {
+        return metrics.render(buf, size, part);
+    }
+    part -= METRICS_PARTS;
+    #ifdef SENSOR_FILTER
+        if (part-- == 0) {
+            return sensorFilter.render(buf, size);
+        }
+    #endif
+    #ifdef SENSOR_SCHEDULE
+        if (part-- == 0) {
+            return schedule.render(buf, size);
+        }
+    #endif
+    #ifdef FREQ_TRACKING
+        if (part-- == 0) {
+            return freqTracker.render(buf, size);
+        }
+    #endif
+    #ifdef NOISE_FLOOR
+        if (part-- == 0) {
+            return noiseFloor.render(buf, size);
+        }
+    #endif
+    #ifdef PROFILE_SCANNER
+        if (part-- == 0) {
+            return scanner.render(buf, size);
+        }
+    #endif
+    #ifdef EVENT_LOOP
+        if (part-- == 0) {
+            return events.render(buf, size);
+        }
+    #endif
+    #if defined(STATIC_POOLS) || defined(HEAP_GUARD)
+        if (part-- == 0) {
+            return renderPools(buf, size);
+        }
+    #endif
+    return 0;
+}
 
-    int rain_raw = (msg[23] & 0x0f) + ((msg[23] & 0xf0) >> 4) * 10 + (msg[24] & 0x0f) * 100;
-    pOut->rain_mm = rain_raw * 0.1f;
+#ifdef READING_LOG
+uint32_t readingLogPending(void *ctx) {
+    return readingLog.pending();
+}
+#endif
 
-    pOut->battery_ok = (msg[25] & 0x80) ? false : true;
+#ifdef COLUMNAR_EXPORT
+uint32_t columnarPending(void *ctx) {
+    return columnarExport.pending();
+}
+#endif
 
-    return DECODE_OK;
+#ifdef MQTT_PUBLISH
+uint32_t mqttPending(void *ctx) {
+    return mqttPublisher.pending();
 }
+#endif
+#endif
 
 //
-// From from rtl_433 project - https://github.com/merbanan/rtl_433/blob/master/src/devices/bresser_6in1.c
+// Configure radio for Bresser frames - returns RadioLib status
 //
-/**
-Decoder for Bresser Weather Center 6-in-1.
-- also Bresser Weather Center 7-in-1 indoor sensor.
-- also Bresser new 5-in-1 sensors.
-- also Froggit WH6000 sensors.
-- also rebranded as Ventus C8488A (W835)
-- also Bresser 3-in-1 Professional Wind Gauge / Anemometer PN 7002531
-There are at least two different message types:
-- 24 seconds interval for temperature, hum, uv and rain (alternating messages)
-- 12 seconds interval for wind data (every message)
-Also Bresser Explore Scientific SM60020 Soil moisture Sensor.
-https://www.bresser.de/en/Weather-Time/Accessories/EXPLORE-SCIENTIFIC-Soil-Moisture-and-Soil-Temperature-Sensor.html
-Moisture:
-    f16e 187000e34 7 ffffff0000 252 2 16 fff 004 000 [25,2, 99%, CH 7]
-    DIGEST:8h8h ID?8h8h8h8h FLAGS:4h BATT:1b CH:3d 8h 8h8h 8h8h TEMP:12h 4h MOIST:8h TRAILER:8h8h8h8h4h
-Moisture is transmitted in the humidity field as index 1-16: 0, 7, 13, 20, 27, 33, 40, 47, 53, 60, 67, 73, 80, 87, 93, 99.
-{206}55555555545ba83e803100058631ff11fe6611ffffffff01cc00 [Hum 96% Temp 3.8 C Wind 0.7 m/s]
-{205}55555555545ba999263100058631fffffe66d006092bffe0cff8 [Hum 95% Temp 3.0 C Wind 0.0 m/s]
-{199}55555555545ba840523100058631ff77fe668000495fff0bbe [Hum 95% Temp 3.0 C Wind 0.4 m/s]
-{205}55555555545ba94d063100058631fffffe665006092bffe14ff8
-{206}55555555545ba860703100058631fffffe6651ffffffff0135fc [Hum 95% Temp 3.0 C Wind 0.0 m/s]
-{205}55555555545ba924d23100058631ff99fe68b004e92dffe073f8 [Hum 96% Temp 2.7 C Wind 0.4 m/s]
-{202}55555555545ba813403100058631ff77fe6810050929ffe1180 [Hum 94% Temp 2.8 C Wind 0.4 m/s]
-{205}55555555545ba98be83100058631fffffe6130050929ffe17800 [Hum 95% Temp 2.8 C Wind 0.8 m/s]
-                                          TEMP  HUM
-2dd4  1f 40 18 80 02 c3 18 ff 88 ff 33 08 ff ff ff ff 80 e6 00 [Hum 96% Temp 3.8 C Wind 0.7 m/s]
-2dd4  cc 93 18 80 02 c3 18 ff ff ff 33 68 03 04 95 ff f0 67 3f [Hum 95% Temp 3.0 C Wind 0.0 m/s]
-2dd4  20 29 18 80 02 c3 18 ff bb ff 33 40 00 24 af ff 85 df    [Hum 95% Temp 3.0 C Wind 0.4 m/s]
-2dd4  a6 83 18 80 02 c3 18 ff ff ff 33 28 03 04 95 ff f0 a7 3f
-2dd4  30 38 18 80 02 c3 18 ff ff ff 33 28 ff ff ff ff 80 9a 7f [Hum 95% Temp 3.0 C Wind 0.0 m/s]
-2dd4  92 69 18 80 02 c3 18 ff cc ff 34 58 02 74 96 ff f0 39 3f [Hum 96% Temp 2.7 C Wind 0.4 m/s]
-2dd4  09 a0 18 80 02 c3 18 ff bb ff 34 08 02 84 94 ff f0 8c 0  [Hum 94% Temp 2.8 C Wind 0.4 m/s]
-2dd4  c5 f4 18 80 02 c3 18 ff ff ff 30 98 02 84 94 ff f0 bc 00 [Hum 95% Temp 2.8 C Wind 0.8 m/s]
-{147} 5e aa 18 80 02 c3 18 fa 8f fb 27 68 11 84 81 ff f0 72 00 [Temp 11.8 C  Hum 81%]
-{149} ae d1 18 80 02 c3 18 fa 8d fb 26 78 ff ff ff fe 02 db f0
-{150} f8 2e 18 80 02 c3 18 fc c6 fd 26 38 11 84 81 ff f0 68 00 [Temp 11.8 C  Hum 81%]
-{149} c4 7d 18 80 02 c3 18 fc 78 fd 29 28 ff ff ff fe 03 97 f0
-{149} 28 1e 18 80 02 c3 18 fb b7 fc 26 58 ff ff ff fe 02 c3 f0
-{150} 21 e8 18 80 02 c3 18 fb 9c fc 33 08 11 84 81 ff f0 b7 f8 [Temp 11.8 C  Hum 81%]
-{149} 83 ae 18 80 02 c3 18 fc 78 fc 29 28 ff ff ff fe 03 98 00
-{150} 5c e4 18 80 02 c3 18 fb ba fc 26 98 11 84 81 ff f0 16 00 [Temp 11.8 C  Hum 81%]
-{148} d0 bd 18 80 02 c3 18 f9 ad fa 26 48 ff ff ff fe 02 ff f0
-Wind and Temperature/Humidity or Rain:
-    DIGEST:8h8h ID:8h8h8h8h FLAGS:4h BATT:1b CH:3d WSPEED:~8h~4h ~4h~8h WDIR:12h ?4h TEMP:8h.4h ?4h HUM:8h UV?~12h ?4h CHKSUM:8h
-    DIGEST:8h8h ID:8h8h8h8h FLAGS:4h BATT:1b CH:3d WSPEED:~8h~4h ~4h~8h WDIR:12h ?4h RAINFLAG:8h RAIN:8h8h UV:8h8h CHKSUM:8h
-Digest is LFSR-16 gen 0x8810 key 0x5412, excluding the add-checksum and trailer.
-Checksum is 8-bit add (with carry) to 0xff.
-Notes on different sensors:
-- 1910 084d 18 : RebeckaJohansson, VENTUS W835
-- 2030 088d 10 : mvdgrift, Wi-Fi Colour Weather Station with 5in1 Sensor, Art.No.: 7002580, ff 01 in the UV field is (obviously) invalid.
-- 1970 0d57 18 : danrhjones, bresser 5-in-1 model 7002580, no UV
-- 18b0 0301 18 : konserninjohtaja 6-in-1 outdoor sensor
-- 18c0 0f10 18 : rege245 BRESSER-PC-Weather-station-with-6-in-1-outdoor-sensor
-- 1880 02c3 18 : f4gqk 6-in-1
-- 18b0 0887 18 : npkap
-
-Parameters:
-
- msg     - Pointer to message
- msgSize - Size of message
- pOut    - Pointer to WeatherData
-
- Returns:
-
- DECODE_OK      - OK - WeatherData will contain the updated information
- DECODE_DIG_ERR - Digest Check Error
- DECODE_CHK_ERR - Checksum Error
+int initRadio(CC1101 &radio, float frequency) {
+    // carrier frequency:                   frequency (868.3 MHz)
+    // bit rate:                            8.22 kbps
+    // frequency deviation:                 57.136417 kHz
+    // Rx bandwidth:                        270.0 kHz 
+    // output power:                        10 dBm
+    // preamble length:                     32 bits
+    int state = radio.begin(frequency, RADIO_BITRATE, RADIO_DEVIATION, RADIO_RX_BW, RADIO_POWER, RADIO_PREAMBLE);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.printf("[CC1101] Error initialising: [%d]\n", state);
+        return state;
+    }
+    Serial.println("success!");
+    state = radio.setCrcFiltering(false);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.printf("[CC1101] Error disabling crc filtering: [%d]\n", state);
+        return state;
+    }
+    state = radio.fixedPacketLengthMode(RECV_LENGTH);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.printf("[CC1101] Error setting fixed packet length: [%d]\n", state);
+        return state;
+    }
+    // Preamble: AA AA AA AA AA
+    // Sync is: 2D D4 
+    // Preamble 40 bits but the CC1101 doesn't allow us to set that
+    // so we use a preamble of 32 bits and then use the sync as AA 2D
+    // which then uses the last byte of the preamble - we recieve the last sync byte
+    // as the 1st byte of the payload.
+    // With RADIO_CARRIER_SENSE the sync word only counts above the carrier
+    // sense threshold (see NOISE_FLOOR).
+    state = radio.setSyncWord(0xAA, 0x2D, 0, RADIO_CARRIER_SENSE);
+    if (state != RADIOLIB_ERR_NONE) {
+        Serial.printf("[CC1101] Error setting sync words: [%d]\n", state);
+    }
+    return state;
+}
 
-*/
-DecodeStatus decodeBresser6In1Payload(uint8_t *msg, uint8_t msgSize, WeatherData *pOut) {
-    int const moisture_map[] = {0, 7, 13, 20, 27, 33, 40, 47, 53, 60, 67, 73, 80, 87, 93, 99}; // scale is 20/3
-    
-    // LFSR-16 digest, generator 0x8810 init 0x5412
-    int chkdgst = (msg[0] << 8) | msg[1];
-    int digest  = lfsr_digest16(&msg[2], 15, 0x8810, 0x5412);
-    if (chkdgst != digest) {
-        //decoder_logf(decoder, 2, __func__, "Digest check failed %04x vs %04x", chkdgst, digest);
-        Serial.print("Digest check failed - ");
-        Serial.print(chkdgst, HEX);
-        Serial.print(" vs ");
-        Serial.println(digest, HEX);
-        return DECODE_DIG_ERR;
+#ifdef RADIO_IMAGE
+//
+// Configure radio from the register image - returns RadioLib status. Instead
+// of RadioLib's begin(): no reset delay, no register by register setup. The
+// setters at the end only let RadioLib know the configuration (packet
+// length mode and CRC for readData(), bit rate for its timeouts) - they
+// write the values the image already holds.
+//
+int initRadioImage(CC1101 &radio, Module &module, CC1101Bus &bus) {
+    module.init();
+    module.SPIreadCommand  = RADIOLIB_CC1101_CMD_READ;
+    module.SPIwriteCommand = RADIOLIB_CC1101_CMD_WRITE;
+    pinMode(PIN_CC1101_GDO0, INPUT);
+
+    uint8_t version = bus.readReg(CC1101_VERSION);
+    if (version != 0x04 && version != 0x14 && version != 0x17) {
+        Serial.printf("[CC1101] Error: unknown version 0x%02X\n", version);
+        return RADIOLIB_ERR_CHIP_NOT_FOUND;
     }
-    // Checksum, add with carry
-    int chksum = msg[17];
-    int sum    = add_bytes(&msg[2], 16); // msg[2] to msg[17]
-    if ((sum & 0xff) != 0xff) {
-        //decoder_logf(decoder, 2, __func__, "Checksum failed %04x vs %04x", chksum, sum);
-        Serial.print("Checksum failed - ");
-        Serial.print(chksum, HEX);
-        Serial.print(" vs ");
-        Serial.println(sum, HEX);
-        return DECODE_CHK_ERR;
+    unsigned differ = cc1101ApplyImage(&bus, radioImage);
+    if (differ) {
+        Serial.printf("[CC1101] Error: %u register(s) differ from image\n", differ);
+        return RADIOLIB_ERR_SPI_WRITE_FAILED;
     }
 
-    pOut->sensor_id  = ((uint32_t)msg[2] << 24) | (msg[3] << 16) | (msg[4] << 8) | (msg[5]);
-    pOut->s_type     = (msg[6] >> 4); // 1: weather station, 2: indoor?, 4: soil probe
-    pOut->battery_ok = (msg[6] >> 3) & 1;
-    pOut->chan       = (msg[6] & 0x7);
-
-    // temperature, humidity, shared with rain counter, only if valid BCD digits
-    pOut->temp_ok  = msg[12] <= 0x99 && (msg[13] & 0xf0) <= 0x90;
-    int temp_raw   = (msg[12] >> 4) * 100 + (msg[12] & 0x0f) * 10 + (msg[13] >> 4);
-    float temp_c   = temp_raw * 0.1f;
-    if (temp_raw > 600)
-        temp_c = (temp_raw - 1000) * 0.1f;
-    pOut->temp_c   = temp_c;
-    pOut->humidity = (msg[14] >> 4) * 10 + (msg[14] & 0x0f);
-
-    // apparently ff0(1) if not available
-    pOut->uv_ok  = msg[15] <= 0x99 && (msg[16] & 0xf0) <= 0x90;
-    int uv_raw = ((msg[15] & 0xf0) >> 4) * 100 + (msg[15] & 0x0f) * 10 + ((msg[16] & 0xf0) >> 4);
-    pOut->uv   = uv_raw * 0.1f;
-    int flags  = (msg[16] & 0x0f); // looks like some flags, not sure
-
-    //int unk_ok  = (msg[16] & 0xf0) == 0xf0;
-    //int unk_raw = ((msg[15] & 0xf0) >> 4) * 10 + (msg[15] & 0x0f);
-
-    // invert 3 bytes wind speeds
-    msg[7] ^= 0xff;
-    msg[8] ^= 0xff;
-    msg[9] ^= 0xff;
-    pOut->wind_ok = (msg[7] <= 0x99) && (msg[8] <= 0x99) && (msg[9] <= 0x99);
-
-    int gust_raw              = (msg[7] >> 4) * 100 + (msg[7] & 0x0f) * 10 + (msg[8] >> 4);
-    pOut->wind_gust_meter_sec = gust_raw * 0.1f;
-    int wavg_raw              = (msg[9] >> 4) * 100 + (msg[9] & 0x0f) * 10 + (msg[8] & 0x0f);
-    pOut->wind_avg_meter_sec  = wavg_raw * 0.1f;
-    pOut->wind_direction_deg  = (((msg[10] & 0xf0) >> 4) * 100 + (msg[10] & 0x0f) * 10 + ((msg[11] & 0xf0) >> 4)) * 1.0f;
-
-    // rain counter, inverted 3 bytes BCD, shared with temp/hum, only if valid digits
-    msg[12] ^= 0xff;
-    msg[13] ^= 0xff;
-    msg[14] ^= 0xff;
-    pOut->rain_ok   = msg[12] <= 0x99 && msg[13] <= 0x99 && msg[14] <= 0x99;
-    int rain_raw    = (msg[12] >> 4) * 100000 + (msg[12] & 0x0f) * 10000
-            + (msg[13] >> 4) * 1000 + (msg[13] & 0x0f) * 100
-            + (msg[14] >> 4) * 10 + (msg[14] & 0x0f);
-    pOut->rain_mm   = rain_raw * 0.1f;
-
-    pOut->moisture_ok = false;
-    if (pOut->s_type == 4 && pOut->temp_ok && pOut->humidity >= 1 && pOut->humidity <= 16) {
-        pOut->moisture_ok = true;
-        pOut->moisture = moisture_map[pOut->humidity - 1];
+    int state = radio.setFrequency(RADIO_FREQUENCY);
+    if (state == RADIOLIB_ERR_NONE) {
+        state = radio.setBitRate(RADIO_BITRATE);
     }
-    return DECODE_OK;
+    if (state == RADIOLIB_ERR_NONE) {
+        state = radio.setCrcFiltering(false);
+    }
+    if (state == RADIOLIB_ERR_NONE) {
+        state = radio.fixedPacketLengthMode(RECV_LENGTH);
+    }
+    return state;
 }
 
+//
+// Restore the radio configuration after a fault and resume receiving
+//
+void radioRecover() {
+    uint32_t start = micros();
+    unsigned differ = cc1101ApplyImage(&radioBus, radioImage);
+    #ifdef ADAPTIVE_LENGTH
+        #ifdef STREAM_CHECK
+            adaptiveRx.begin(&radioBus, true, true);
+        #else
+            adaptiveRx.begin(&radioBus);
+        #endif
+    #endif
+    #ifdef FREQ_TRACKING
+        // FSCTRL0 is 0 in the image - retuned by the next receivePolled()
+        freqTracker.retuned(0);
+    #endif
+    #ifdef NOISE_FLOOR
+        // Thresholds back to their defaults in the image
+        noiseApplied = false;
+    #endif
+    #ifdef PROFILE_SCANNER
+        // Back on the first profile
+        scanner.reconfigured(millis());
+    #endif
+    #ifdef POLLED_RX
+        radioListening = false;
+        radioSynced    = false;
+    #endif
+    Serial.printf("[CC1101] Reconfigured in %u us%s\n", (unsigned)(micros() - start),
+        differ ? " - registers differ from image" : "");
+}
+#endif
 
 void setup() {    
     Serial.begin(115200);
@@ -347,45 +871,177 @@ void setup() {
     // https://github.com/RFD-FHEM/RFFHEM/issues/607#issuecomment-830818445
     // Freq: 868.300 MHz, Bandwidth: 203 KHz, rAmpl: 33 dB, sens: 8 dB, DataRate: 8207.32 Baud
     Serial.println("[CC1101] Initializing ... ");
-    // carrier frequency:                   868.3 MHz
-    // bit rate:                            8.22 kbps
-    // frequency deviation:                 57.136417 kHz
-    // Rx bandwidth:                        270.0 kHz 
-    // output power:                        10 dBm
-    // preamble length:                     32 bits
-    int state = radio.begin(868.3, 8.21, 57.136417, 270, 10, 32);
-    if (state == RADIOLIB_ERR_NONE) {
-        Serial.println("success!");
-        state = radio.setCrcFiltering(false);
-        if (state != RADIOLIB_ERR_NONE) {
-            Serial.printf("[CC1101] Error disabling crc filtering: [%d]\n", state);
-            while (true)
-                ;
+    #ifdef _DEBUG_MODE_
+        // Radio bring-up time, to compare RADIO_IMAGE with RadioLib's setup
+        uint32_t t_init = micros();
+    #endif
+    #ifdef RADIO_IMAGE
+        if (initRadioImage(radio, radioModule, radioBus) != RADIOLIB_ERR_NONE) {
+            Serial.println("[CC1101] Falling back to RadioLib setup");
+            if (initRadio(radio, RADIO_FREQUENCY) != RADIOLIB_ERR_NONE) {
+                while (true)
+                    ;
+            }
         }
-        state = radio.fixedPacketLengthMode(27);
-        if (state != RADIOLIB_ERR_NONE) {
-            Serial.printf("[CC1101] Error setting fixed packet length: [%d]\n", state);
+        radioChecked = millis();
+    #else
+        if (initRadio(radio, RADIO_FREQUENCY) != RADIOLIB_ERR_NONE) {
             while (true)
                 ;
         }
-        // Preamble: AA AA AA AA AA
-        // Sync is: 2D D4 
-        // Preamble 40 bits but the CC1101 doesn't allow us to set that
-        // so we use a preamble of 32 bits and then use the sync as AA 2D
-        // which then uses the last byte of the preamble - we recieve the last sync byte
-        // as the 1st byte of the payload.
-        state = radio.setSyncWord(0xAA, 0x2D, 0, false);
-        if (state != RADIOLIB_ERR_NONE) {
-            Serial.printf("[CC1101] Error setting sync words: [%d]\n", state);
+    #endif
+    #ifdef _DEBUG_MODE_
+        Serial.printf("[CC1101] Configured in %u us, ready %u ms after boot\n",
+            (unsigned)(micros() - t_init), (unsigned)millis());
+    #endif
+    #ifdef MULTI_RADIO
+        Serial.println("[CC1101] Initializing radio 2 ... ");
+        if (initRadio(radio2, RADIO2_FREQUENCY) != RADIOLIB_ERR_NONE) {
             while (true)
                 ;
         }
-    } else {
-        Serial.printf("[CC1101] Error initialising: [%d]\n", state);
-        while (true)
-            ;
-    }
-    Serial.println("[CC1101] Setup complete - awaiting incoming messages...");
+        radios.add(&radioBus, PIN_CC1101_GDO0);
+        radios.add(&radio2Bus, PIN_RADIO2_GDO0);
+        radios.begin();
+    #endif
+    #ifdef SENSOR_EMULATOR
+        // Sensors evenly spread over the period
+        emulator.begin(emulatorTransmit, nullptr);
+        const unsigned emulated = EMULATOR_SENSORS_5IN1 + EMULATOR_SENSORS_6IN1;
+        for (unsigned i = 0; i < emulated; i++) {
+            uint32_t first_ms = millis() + i * EMULATOR_PERIOD_MS / emulated;
+            bool ok = (i < EMULATOR_SENSORS_5IN1) ?
+                emulator.add(BRESSER_5IN1, 0xE0 + i, EMULATOR_PERIOD_MS, first_ms) :
+                emulator.add(BRESSER_6IN1, 0xE0E00000 + i, EMULATOR_PERIOD_MS, first_ms);
+            if (!ok) {
+                Serial.printf("[EMU] Too many sensors - ignoring sensor %u\n", i);
+            }
+        }
+        Serial.println("[CC1101] Setup complete - transmitting emulated sensors...");
+    #else
+        Serial.println("[CC1101] Setup complete - awaiting incoming messages...");
+    #endif
+
+    #ifdef READING_LOG
+        // Timestamps are taken from time(), set by NTP (see below)
+        if (!LittleFS.begin(true) || !readingLog.begin(READING_LOG_DIR)) {
+            Serial.println("[LOG] Error opening reading log");
+        } else if (readingLog.stats().recovered) {
+            Serial.printf("[LOG] Recovered - dropped %u damaged record(s)\n", readingLog.stats().recovered);
+        }
+        readingLogFlushed = millis();
+    #endif
+
+    #ifdef COLUMNAR_EXPORT
+        if (!LittleFS.begin(true) || !columnarOpen()) {
+            Serial.println("[EXPORT] Error opening export stream");
+        }
+        columnarFlushed = millis();
+    #endif
+
+    #if defined(MQTT_PUBLISH) || defined(HTTP_SERVER) || defined(READING_LOG)
+        WiFi.mode(WIFI_STA);
+        WiFi.begin(WIFI_SSID, WIFI_PASS);
+    #endif
+    #ifdef READING_LOG
+        // SNTP sets the clock once WiFi is connected
+        configTime(0, 0, NTP_SERVER);
+    #endif
+    #ifdef MQTT_PUBLISH
+        mqttClient.setServer(MQTT_HOST, MQTT_PORT);
+        mqttClient.setBufferSize(MQTT_PAYLOAD_SIZE + MQTT_TOPIC_LEN + 8);
+        mqttPublisher.begin(MQTT_TOPIC, mqttPublish, nullptr);
+    #endif
+
+    #ifdef LOW_POWER_RX
+        lowPower.begin(&radioBus, &schedule, PIN_CC1101_GDO0, millis());
+    #endif
+    #ifdef ADAPTIVE_LENGTH
+        #ifdef STREAM_CHECK
+            adaptiveRx.begin(&radioBus, true, true);
+        #else
+            adaptiveRx.begin(&radioBus);
+        #endif
+    #endif
+
+    #if defined(SENSOR_FILTER) || defined(METRICS)
+        DecoderHooks hooks = { nullptr, nullptr, nullptr };
+        #ifdef SENSOR_FILTER
+            hooks.accept = decoderAccept;
+        #endif
+        #ifdef METRICS
+            hooks.tolerated = decoderTolerated;
+        #endif
+        setDecoderHooks(&hooks);
+    #endif
+
+    #ifdef SENSOR_FILTER
+        sensorFilter.setMode(SENSOR_FILTER_MODE);
+        for (unsigned i = 0; i < sizeof(sensorFilterIds) / sizeof(sensorFilterIds[0]); i++) {
+            if (!sensorFilter.add(sensorFilterIds[i])) {
+                Serial.printf("[FILTER] List full - ignoring ID %08X\n", (unsigned)sensorFilterIds[i]);
+            }
+        }
+    #endif
+
+    #ifdef PROFILE_SCANNER
+        for (unsigned i = 0; i < sizeof(scanImages) / sizeof(scanImages[0]); i++) {
+            scanner.add(scanNames[i], &scanImages[i]);
+        }
+        scanner.begin(&radioBus, millis());
+    #endif
+
+    #ifdef NOISE_FLOOR
+        noiseFloor.begin(millis());
+        noiseSampled = millis();
+        #ifdef HTTP_SERVER
+            httpServer.route("/noise", "application/json", renderNoise, nullptr);
+        #endif
+    #endif
+
+    #ifdef EVENT_LOOP
+        // Radio first, then output (HTTP), then housekeeping
+        events.setIsrClock(isrMicros);
+        radioTask = events.addTask("radio", radioTaskFn, nullptr, EVENT_PRIORITY_RADIO);
+        events.every(radioTask, EVENT_RADIO_POLL_MS);
+        #ifdef HTTP_SERVER
+            events.every(events.addTask("http", httpTaskFn, nullptr, EVENT_PRIORITY_OUTPUT), 10);
+        #endif
+        #ifdef MQTT_PUBLISH
+            events.every(events.addTask("mqtt", mqttTaskFn, nullptr, EVENT_PRIORITY_HOUSEKEEPING), 10);
+        #endif
+        #ifdef READING_LOG
+            events.every(events.addTask("log", logTaskFn, nullptr, EVENT_PRIORITY_HOUSEKEEPING), READING_LOG_FLUSH_INTERVAL);
+        #endif
+        #ifdef COLUMNAR_EXPORT
+            events.every(events.addTask("export", exportTaskFn, nullptr, EVENT_PRIORITY_HOUSEKEEPING), COLUMNAR_EXPORT_FLUSH_INTERVAL);
+        #endif
+        #ifdef SENSOR_SCHEDULE
+            events.every(events.addTask("schedule", scheduleTaskFn, nullptr, EVENT_PRIORITY_HOUSEKEEPING), 100);
+        #endif
+    #endif
+
+    #ifdef POLLED_RX
+        attachInterrupt(digitalPinToInterrupt(PIN_CC1101_GDO0), radioIsr, FALLING);
+    #endif
+
+    #ifdef METRICS
+        httpServer.route("/metrics", "text/plain; version=0.0.4", renderMetrics, nullptr);
+        #ifdef READING_LOG
+            metrics.addGauge("reading_log", readingLogPending, nullptr);
+        #endif
+        #ifdef COLUMNAR_EXPORT
+            metrics.addGauge("columnar_export", columnarPending, nullptr);
+        #endif
+        #ifdef MQTT_PUBLISH
+            metrics.addGauge("mqtt", mqttPending, nullptr);
+        #endif
+    #endif
+
+    #ifdef HEAP_GUARD
+        // From now on, memory comes from pools and static buffers only
+        heapGuardArm();
+    #endif
 }
 
 #ifdef _DEBUG_MODE_
@@ -398,10 +1054,128 @@ void printRawdata(uint8_t *msg, uint8_t msgSize) {
 }
 #endif
 
-void loop() {
-    uint8_t recvData[27];
-    int state = radio.receive(recvData, 27);
-    
+//
+// Receive a frame (if any), decode and output it
+//
+void receiveFrame() {
+    // Zero padded if fewer bytes are received
+    uint8_t recvData[27] = { 0 };
+
+    #ifdef METRICS
+        // Receive stage: from the frame being available to its bytes in
+        // recvData, not the wait for it
+        uint32_t t_stage = 0;
+    #endif
+
+    float   rssi = 0;
+    uint8_t lqi  = 0;
+    #ifdef BRESSER_6_IN_1
+        bool is6in1 = true;
+    #else
+        bool is6in1 = false;
+    #endif
+
+    #if defined(MULTI_RADIO)
+        // Frames of all radios, copies merged
+        int state = RADIOLIB_ERR_RX_TIMEOUT;
+        RadioFrame frame;
+        radios.service(millis());
+        #ifdef METRICS
+            t_stage = micros();
+        #endif
+        if (radios.read(&frame, millis())) {
+            memcpy(recvData, frame.data, sizeof(recvData));
+            rssi  = frame.rssi;
+            lqi   = frame.lqi;
+            state = RADIOLIB_ERR_NONE;
+            #ifdef _DEBUG_MODE_
+                Serial.printf("[CC1101] Radio %u, %u cop%s\n", frame.radio + 1, frame.copies,
+                    (frame.copies > 1) ? "ies" : "y");
+            #endif
+        }
+    #elif defined(ADAPTIVE_LENGTH)
+        // Both protocols, packet ended according to the protocol
+        int state = RADIOLIB_ERR_RX_TIMEOUT;
+        AdaptiveFrame frame;
+        if (adaptiveRx.poll(&frame, micros())) {
+            #ifdef METRICS
+                // Packet end to re-armed, as measured by AdaptiveRx
+                t_stage = micros() - frame.busy_us;
+            #endif
+            memcpy(recvData, frame.data, sizeof(recvData));
+            rssi   = frame.rssi;
+            lqi    = frame.lqi;
+            is6in1 = (frame.protocol == BRESSER_6IN1);
+            state  = RADIOLIB_ERR_NONE;
+            #ifdef _DEBUG_MODE_
+                Serial.printf("[CC1101] %u bytes, receive-to-rearm %u us (avg. %.0f us), %u aborted, %u rejected\n",
+                    frame.len, frame.busy_us, adaptiveRx.busyPerFrame(),
+                    adaptiveRx.stats().aborted, adaptiveRx.stats().rejected);
+            #endif
+        }
+    #elif defined(LOW_POWER_RX)
+        // Sleep until a frame has been received or the receive plan changes
+        int state = lowPower.waitForFrame() ? radio.readData(recvData, RECV_LENGTH) : RADIOLIB_ERR_RX_TIMEOUT;
+        #ifdef _DEBUG_MODE_
+            if (state == RADIOLIB_ERR_NONE) {
+                const LowPowerStats &st = lowPower.stats();
+                Serial.printf("[LP] Awake %.2f%%, RX %.2f%%, %u frames (%u in predicted windows)\n",
+                    lowPower.awakeFraction() * 100, lowPower.rxFraction() * 100, st.frames, st.frames_window);
+            }
+        #endif
+    #elif defined(POLLED_RX)
+        // Listening on the expected carrier or scan profile, noise rejected
+        // by the radio
+        int state = receivePolled(recvData);
+        #ifdef METRICS
+            t_stage = radioFrameUs;
+        #endif
+    #else
+        int state = radio.receive(recvData, RECV_LENGTH);
+    #endif
+    // Signal quality - two register reads per frame, only if something uses it
+    #if defined(_DEBUG_MODE_) || defined(METRICS) || defined(COLUMNAR_EXPORT)
+        #if !defined(MULTI_RADIO) && !defined(ADAPTIVE_LENGTH)
+            if (state == RADIOLIB_ERR_NONE) {
+                rssi = radio.getRSSI();
+                lqi  = radio.getLQI();
+            }
+        #endif
+    #else
+        (void)rssi;
+        (void)lqi;
+    #endif
+
+    #ifdef METRICS
+        if (state == RADIOLIB_ERR_NONE) {
+            metrics.observe(METRIC_STAGE_RECEIVE, micros() - t_stage);
+            metrics.inc(METRIC_FRAMES);
+            if (recvData[0] != 0xD4) {
+                metrics.inc(METRIC_SYNC_FAILURES);
+            }
+        } else if (state != RADIOLIB_ERR_RX_TIMEOUT) {
+            metrics.inc(METRIC_RECEIVE_ERRORS);
+        }
+    #endif
+
+    #ifdef RADIO_IMAGE
+        // Receive error, or radio reset (e.g. brown-out: modem registers back
+        // to their reset values)
+        if (state != RADIOLIB_ERR_NONE && state != RADIOLIB_ERR_RX_TIMEOUT) {
+            radioRecover();
+        } else if (millis() - radioChecked > RADIO_CHECK_INTERVAL) {
+            radioChecked = millis();
+            #ifdef PROFILE_SCANNER
+                const CC1101Image &image = scanner.image();
+            #else
+                const CC1101Image &image = radioImage;
+            #endif
+            if (cc1101VerifyImage(&radioBus, image, CC1101_FREQ2, CC1101_DEVIATN - CC1101_FREQ2 + 1)) {
+                radioRecover();
+            }
+        }
+    #endif
+
     if (state == RADIOLIB_ERR_NONE) {
         // Verify last syncword is 1st byte of payload (see above)
         if (recvData[0] == 0xD4) {
@@ -413,37 +1187,116 @@ void loop() {
                 }
                 Serial.println();
 
-                Serial.printf("[CC1101] R [0x%02X] RSSI: %f LQI: %d\n", recvData[0], radio.getRSSI(), radio.getLQI());
+                Serial.printf("[CC1101] R [0x%02X] RSSI: %f LQI: %d\n", recvData[0], rssi, lqi);
             #endif
 
             // Decode the information - skip the last sync byte we use to check the data is OK
-            WeatherData weatherData = { 0 };
+            #ifdef STATIC_POOLS
+                // Released once all outputs have taken the reading - if none
+                // is left, one was not (counted in /metrics)
+                DecodedRecord *record = recordPool.acquire();
+                if (!record) {
+                    Serial.printf("[POOL] No record left, frame dropped\n");
+                    return;
+                }
+                WeatherData &weatherData = record->data;
+            #else
+                WeatherData weatherData = { 0 };
+            #endif
 
             #ifdef _DEBUG_MODE_
                 printRawdata(&recvData[1], sizeof(recvData));
             #endif
 
-            #ifdef BRESSER_6_IN_1
-                bool decode_ok = (decodeBresser6In1Payload(&recvData[1], sizeof(recvData) - 1, &weatherData) == DECODE_OK);
-            #else
-                bool decode_ok = (decodeBresser5In1Payload(&recvData[1], sizeof(recvData) - 1, &weatherData) == DECODE_OK);
-          
+            #ifdef METRICS
+                t_stage = micros();
+            #endif
+
+            DecodeStatus decode_status;
+            if (is6in1) {
+                decode_status = decodeBresser6In1Payload(&recvData[1], sizeof(recvData) - 1, &weatherData);
+            } else {
+                decode_status = decodeBresser5In1Payload(&recvData[1], sizeof(recvData) - 1, &weatherData);
+
                 // Fixed set of data for 5-in-1 sensor
                 weatherData.temp_ok     = true;
                 weatherData.uv_ok       = false;
                 weatherData.wind_ok     = true;
                 weatherData.rain_ok     = true;
                 weatherData.moisture_ok = false;
+            }
+            bool decode_ok = (decode_status == DECODE_OK);
+            #ifdef NOISE_FLOOR
+                // Frames of sensors filtered out are not junk
+                noiseFloor.packet(decode_ok || decode_status == DECODE_SKIP);
+            #endif
+
+            #ifdef METRICS
+                metrics.observe(METRIC_STAGE_DECODE, micros() - t_stage);
+                metrics.decodeResult(is6in1 ? METRIC_DECODER_6IN1 : METRIC_DECODER_5IN1, decode_status);
+                t_stage = micros();
             #endif
           
             if (decode_ok) {
+                #ifdef METRICS
+                    metrics.sensorSignal(weatherData.sensor_id, rssi, lqi);
+                #endif
+                #ifdef FREQ_TRACKING
+                    freqTracker.update(weatherData.sensor_id, radioFreqEst);
+                    #ifdef _DEBUG_MODE_
+                        Serial.printf("[FREQ] Offset %.1f kHz (FSCTRL0 %d), average %.1f kHz\n",
+                            (freqTracker.fsctrl0() + radioFreqEst) * FREQ_STEP_HZ / 1000, freqTracker.fsctrl0(),
+                            freqTracker.globalOffset() * FREQ_STEP_HZ / 1000);
+                    #endif
+                #endif
+                #ifdef PROFILE_SCANNER
+                    scanner.frame();
+                #endif
+                #ifdef SENSOR_SCHEDULE
+                    schedule.arrival(weatherData.sensor_id, millis());
+                    #ifdef _DEBUG_MODE_
+                        SchedulePrediction prediction;
+                        if (schedule.predict(weatherData.sensor_id, &prediction)) {
+                            Serial.printf("[SCHED] Period %.1f ms, next in %d +- %u ms, loss %.1f%%\n",
+                                prediction.period_ms, (int)(prediction.next_ms - millis()), prediction.window_ms,
+                                schedule.lossRatio(weatherData.sensor_id) * 100);
+                        }
+                    #endif
+                #endif
+                #ifdef READING_LOG
+                    // Not before the clock is set - the log is searched by time
+                    if (time(nullptr) >= CLOCK_VALID_AFTER) {
+                        readingLog.append(&weatherData, (uint32_t)time(nullptr));
+                    }
+                #endif
+                #ifdef COLUMNAR_EXPORT
+                    if (columnarFile) {
+                        columnarExport.add(&weatherData, (uint32_t)time(nullptr), rssi, lqi);
+                    }
+                #endif
+                #ifdef TIME_SERIES_STORE
+                    history.add(&weatherData, (uint32_t)time(nullptr));
+                    #ifdef _DEBUG_MODE_
+                        Serial.printf("[TS] %u readings in %u bytes\n", history.storedReadings(), history.compressedBytes());
+                    #endif
+                #endif
+                #ifdef ROLLUPS
+                    rollups.add(&weatherData, (uint32_t)time(nullptr));
+                #endif
+                #ifdef MQTT_PUBLISH
+                    mqttPublisher.update(&weatherData, millis());
+                #endif
+                #ifdef HTTP_SERVER
+                    httpServer.update(&weatherData, (uint32_t)time(nullptr));
+                #endif
+
                 const float METERS_SEC_TO_MPH = 2.237;
                 printf("Id: [%8X] Battery: [%s] ",
                     weatherData.sensor_id,
                     weatherData.battery_ok ? "OK " : "Low");
-                #ifdef BRESSER_6_IN_1
+                if (is6in1) {
                     printf("Ch: [%d] ", weatherData.chan);
-                #endif
+                }
                 if (weatherData.temp_ok) {
                     printf("Temp: [%5.1fC] Hum: [%3d%%] ",
                         weatherData.temp_c,
@@ -470,15 +1323,21 @@ void loop() {
                         weatherData.moisture);
                 }
                 printf("\n");
+                #ifdef METRICS
+                    metrics.observe(METRIC_STAGE_OUTPUT, micros() - t_stage);
+                #endif
                 //printf("{\"sensor_type\": \"bresser-5-in-1\", \"sensor_id\": %d, \"battery\": \"%s\", \"temp_c\": %.1f, \"hum_pc\": %d, \"wind_gust_ms\": %.1f, \"wind_speed_ms\": %.1f, \"wind_dir\": %.1f, \"rain_mm\": %.1f}\n",
                 //       sensor_id, !battery_low ? "OK" : "Low",
                 //       temperature, humidity, wind_gust, wind_avg, wind_direction_deg, rain);
             } // if (decode_ok)
             else {
                 #ifdef _DEBUG_MODE_
-                    Serial.printf("[CC1101] R [0x%02X] RSSI: %f LQI: %d\n", recvData[0], radio.getRSSI(), radio.getLQI());
+                    Serial.printf("[CC1101] R [0x%02X] RSSI: %f LQI: %d\n", recvData[0], rssi, lqi);
                 #endif
             }
+            #ifdef STATIC_POOLS
+                recordPool.release(record);
+            #endif
         } // if (recvData[0] == 0xD4)
         else if (state == RADIOLIB_ERR_RX_TIMEOUT) {
             #ifdef _DEBUG_MODE_
@@ -487,7 +1346,59 @@ void loop() {
         } // if (state == RADIOLIB_ERR_RX_TIMEOUT)
         else {
             // some other error occurred
+            #ifdef NOISE_FLOOR
+                // Packet without the last sync byte
+                noiseFloor.packet(false);
+            #endif
             Serial.printf("[CC1101] Receive failed - failed, code %d\n", state);
         }
     } // if (state == RADIOLIB_ERR_NONE)
+} // receiveFrame()
+
+void loop() {
+    #ifdef EVENT_LOOP
+        // Radio and housekeeping run as tasks (see setup())
+        events.run();
+        return;
+    #endif
+
+    #ifdef READING_LOG
+        // Write partially filled page from time to time
+        if (millis() - readingLogFlushed > READING_LOG_FLUSH_INTERVAL) {
+            readingLog.flush();
+            readingLogFlushed = millis();
+        }
+    #endif
+
+    #ifdef COLUMNAR_EXPORT
+        if (millis() - columnarFlushed > COLUMNAR_EXPORT_FLUSH_INTERVAL) {
+            columnarFlush();
+            columnarFlushed = millis();
+        }
+    #endif
+
+    #ifdef MQTT_PUBLISH
+        mqttLoop();
+    #endif
+
+    #ifdef HTTP_SERVER
+        httpLoop();
+    #endif
+
+    #ifdef SENSOR_EMULATOR
+        // Transmit only
+        if (emulator.poll(millis())) {
+            #ifdef _DEBUG_MODE_
+                const EmulatorStats &st = emulator.stats();
+                Serial.printf("[EMU] %u sent, %u failed, %u skipped\n", st.sent, st.failed, st.skipped);
+            #endif
+        }
+        return;
+    #endif
+
+    #ifdef SENSOR_SCHEDULE
+        schedule.poll(millis());
+    #endif
+
+    receiveFrame();
 } // loop()
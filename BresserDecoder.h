@@ -0,0 +1,38 @@
+/*
+Bresser 5-in-1/6-in-1 payload decoders
+
+    DecodeStatus status = decodeBresser5In1Payload(&recvData[1], sizeof(recvData) - 1, &weatherData);
+
+The decoders do not depend on the sketch's options. Where the sketch needs
+to take part in decoding, it installs hooks:
+
+- accept: sensor ID filter, consulted right after the integrity checks -
+  returning false makes the decoder return DECODE_SKIP
+- tolerated: integrity errors which the 5-in-1 decoder ignores (parity,
+  bit count) are reported here, e.g. for counting them
+
+Log messages go to Serial on the target and are dropped on a host build.
+*/
+#ifndef BRESSER_DECODER_H
+#define BRESSER_DECODER_H
+
+#include <stdint.h>
+#include "WeatherData.h"
+
+struct DecoderHooks {
+    bool (*accept)(uint32_t sensor_id, void *ctx);      // nullptr: accept all
+    void (*tolerated)(DecodeStatus status, void *ctx);  // nullptr: ignore
+    void *ctx;
+};
+
+void setDecoderHooks(const DecoderHooks *hooks);
+
+uint16_t lfsr_digest16(uint8_t const message[], unsigned bytes, uint16_t gen, uint16_t key);
+int add_bytes(uint8_t const message[], unsigned num_bytes);
+
+DecodeStatus decodeBresser5In1Payload(uint8_t *msg, uint8_t msgSize, WeatherData *pOut);
+
+// Note: msg is modified (inverted fields)
+DecodeStatus decodeBresser6In1Payload(uint8_t *msg, uint8_t msgSize, WeatherData *pOut);
+
+#endif // BRESSER_DECODER_H
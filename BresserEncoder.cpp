@@ -0,0 +1,153 @@
+/*
+Bresser 5-in-1/6-in-1 payload encoders
+*/
+#include "BresserEncoder.h"
+#include "BresserDecoder.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Moisture is transmitted as index 1-16 in the humidity field
+static const int moisture_map[] = {0, 7, 13, 20, 27, 33, 40, 47, 53, 60, 67, 73, 80, 87, 93, 99};
+
+//
+// Value in units of 'scale', clamped to [lo, hi]
+//
+static int toRaw(float value, float scale, int lo, int hi)
+{
+    long raw = lroundf(value / scale);
+    return (raw < lo) ? lo : (raw > hi) ? hi : (int)raw;
+}
+
+// Two BCD digits
+static inline uint8_t bcd(int value)
+{
+    return ((value / 10 % 10) << 4) | (value % 10);
+}
+
+uint8_t encodeBresser5In1Payload(const WeatherData *pIn, uint8_t *msg)
+{
+    memset(msg, 0, BRESSER_5IN1_SIZE);
+
+    msg[14] = pIn->sensor_id & 0xff;
+    msg[15] = pIn->s_type & 0x0f;
+
+    int gust_raw = toRaw(pIn->wind_gust_meter_sec, 0.1f, 0, 0xfff);
+    int dir      = toRaw(pIn->wind_direction_deg, 22.5f, 0, 16) & 0x0f;
+    msg[16] = gust_raw & 0xff;
+    msg[17] = (dir << 4) | (gust_raw >> 8);
+
+    int wind_raw = toRaw(pIn->wind_avg_meter_sec, 0.1f, 0, 999);
+    msg[18] = bcd(wind_raw);
+    msg[19] = wind_raw / 100;
+
+    int temp_raw = toRaw(pIn->temp_c, 0.1f, -999, 999);
+    msg[20] = bcd(abs(temp_raw));
+    msg[21] = abs(temp_raw) / 100;
+
+    msg[22] = bcd(toRaw(pIn->humidity, 1, 0, 99));
+
+    int rain_raw = toRaw(pIn->rain_mm, 0.1f, 0, 999);
+    msg[23] = bcd(rain_raw);
+    msg[24] = rain_raw / 100;
+
+    msg[25] = (pIn->battery_ok ? 0 : 0x80) | ((temp_raw < 0) ? 0x01 : 0);
+
+    // Number of bits set in bytes 14-25
+    uint8_t bitsSet = 0;
+    for (uint8_t p = 14; p < BRESSER_5IN1_SIZE; p++) {
+        bitsSet += __builtin_popcount(msg[p]);
+    }
+    msg[13] = bitsSet;
+
+    // Inverted copy
+    for (unsigned col = 0; col < 13; col++) {
+        msg[col] = msg[col + 13] ^ 0xff;
+    }
+    return BRESSER_5IN1_SIZE;
+}
+
+uint8_t encodeBresser6In1Payload(const WeatherData *pIn, uint8_t *msg)
+{
+    memset(msg, 0, BRESSER_6IN1_SIZE);
+
+    msg[2] = pIn->sensor_id >> 24;
+    msg[3] = pIn->sensor_id >> 16;
+    msg[4] = pIn->sensor_id >> 8;
+    msg[5] = pIn->sensor_id;
+    msg[6] = (pIn->s_type << 4) | (pIn->battery_ok ? 0x08 : 0) | (pIn->chan & 0x07);
+
+    // Wind speeds, three digits each, sent inverted
+    if (pIn->wind_ok) {
+        int gust_raw = toRaw(pIn->wind_gust_meter_sec, 0.1f, 0, 999);
+        int wavg_raw = toRaw(pIn->wind_avg_meter_sec, 0.1f, 0, 999);
+        msg[7] = bcd(gust_raw / 10);
+        msg[8] = ((gust_raw % 10) << 4) | (wavg_raw % 10);
+        msg[9] = bcd(wavg_raw / 10);
+    } else {
+        msg[7] = msg[8] = msg[9] = 0xff;
+    }
+    msg[7] ^= 0xff;
+    msg[8] ^= 0xff;
+    msg[9] ^= 0xff;
+
+    int dir = toRaw(pIn->wind_direction_deg, 1, 0, 359);
+    msg[10] = ((dir / 100) << 4) | (dir / 10 % 10);
+    msg[11] = (dir % 10) << 4;
+
+    if (pIn->temp_ok) {
+        // Negative temperatures are offset by 100.0
+        int temp_raw = toRaw(pIn->temp_c, 0.1f, -399, 600);
+        if (temp_raw < 0) {
+            temp_raw += 1000;
+        }
+        int humidity = pIn->humidity;
+        if (pIn->s_type == 4 && pIn->moisture_ok) {
+            // Nearest moisture index
+            humidity = 1;
+            for (int i = 1; i < 16; i++) {
+                if (abs(moisture_map[i] - pIn->moisture) < abs(moisture_map[humidity - 1] - pIn->moisture)) {
+                    humidity = i + 1;
+                }
+            }
+        }
+        msg[12] = ((temp_raw / 100) << 4) | (temp_raw / 10 % 10);
+        msg[13] = (temp_raw % 10) << 4;
+        msg[14] = bcd(humidity < 0 ? 0 : humidity > 99 ? 99 : humidity);
+    } else {
+        // Rain counter, six digits, sent inverted
+        int rain_raw = toRaw(pIn->rain_mm, 0.1f, 0, 999999);
+        msg[12] = bcd(rain_raw / 10000) ^ 0xff;
+        msg[13] = bcd(rain_raw / 100) ^ 0xff;
+        msg[14] = bcd(rain_raw) ^ 0xff;
+    }
+
+    if (pIn->uv_ok) {
+        int uv_raw = toRaw(pIn->uv, 0.1f, 0, 999);
+        msg[15] = ((uv_raw / 100) << 4) | (uv_raw / 10 % 10);
+        msg[16] = (uv_raw % 10) << 4;
+    } else {
+        msg[15] = 0xff;
+        msg[16] = 0xf0;
+    }
+
+    // Add-checksum: bytes 2..17 sum up to 0xff
+    msg[17] = (0xff - add_bytes(&msg[2], 15)) & 0xff;
+
+    // LFSR-16 digest, generator 0x8810 init 0x5412
+    uint16_t digest = lfsr_digest16(&msg[2], 15, 0x8810, 0x5412);
+    msg[0] = digest >> 8;
+    msg[1] = digest & 0xff;
+    return BRESSER_6IN1_SIZE;
+}
+
+uint8_t encodeBresserFrame(BresserProtocol protocol, const WeatherData *pIn, uint8_t *frame)
+{
+    memset(frame, 0, BRESSER_FRAME_SIZE);
+    frame[0] = 0xD4;
+    if (protocol == BRESSER_5IN1) {
+        return 1 + encodeBresser5In1Payload(pIn, &frame[1]);
+    }
+    return 1 + encodeBresser6In1Payload(pIn, &frame[1]);
+}
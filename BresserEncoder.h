@@ -0,0 +1,50 @@
+/*
+Bresser 5-in-1/6-in-1 payload encoders - the inverse of the decoders in
+BresserDecoder.h
+
+    uint8_t msg[BRESSER_5IN1_SIZE];
+    encodeBresser5In1Payload(&weatherData, msg);
+    decodeBresser5In1Payload(msg, sizeof(msg), &decoded);   // == weatherData
+
+Values are rounded to the resolution of the protocol (0.1 for temperature,
+wind speed, rain and UV; 22.5 deg/1 deg for wind direction) and clamped to
+the range of their BCD/binary fields.
+
+5-in-1: 13 data bytes, bit count of the data bytes, inverted copy of all
+that in front. sensor_id is truncated to 8 bits, the sensor type is taken
+from the low nibble of s_type.
+
+6-in-1: LFSR-16 digest, 16 bytes of data and an add-checksum. Fields marked
+invalid (wind_ok, uv_ok false) are sent as the sensor does (all bits set
+before inversion). Temperature/humidity and rain share bytes 12..14: a frame
+carries temperature/humidity if temp_ok is set (moisture instead of humidity
+for soil sensors, s_type 4), otherwise rain - real sensors alternate.
+Bytes which the decoder does not evaluate are 0.
+*/
+#ifndef BRESSER_ENCODER_H
+#define BRESSER_ENCODER_H
+
+#include <stdint.h>
+#include "WeatherData.h"
+
+// Payload sizes (following the 0xD4 sync byte)
+#define BRESSER_5IN1_SIZE 26
+#define BRESSER_6IN1_SIZE 18
+
+// Frame following the sync word 0xAA 0x2D: 0xD4 and the payload, padded with
+// zeros (fixed packet length)
+#define BRESSER_FRAME_SIZE 27
+
+enum BresserProtocol {
+    BRESSER_5IN1, BRESSER_6IN1
+};
+
+// Encode reading into msg - returns the payload size
+uint8_t encodeBresser5In1Payload(const WeatherData *pIn, uint8_t *msg);
+uint8_t encodeBresser6In1Payload(const WeatherData *pIn, uint8_t *msg);
+
+// Encode reading into frame (BRESSER_FRAME_SIZE bytes) - returns the number
+// of bytes which carry data
+uint8_t encodeBresserFrame(BresserProtocol protocol, const WeatherData *pIn, uint8_t *frame);
+
+#endif // BRESSER_ENCODER_H
@@ -0,0 +1,114 @@
+/*
+CC1101Bus - direct CC1101 register, strobe and FIFO access
+*/
+#include "CC1101Bus.h"
+#include "Clock.h"
+
+uint8_t CC1101Bus::readStatus(uint8_t addr)
+{
+    uint8_t value = readReg(addr);
+    for (int i = 0; i < 4; i++) {
+        uint8_t again = readReg(addr);
+        if (again == value) {
+            break;
+        }
+        value = again;
+    }
+    return value;
+}
+
+bool CC1101Bus::waitGdo(int pin, bool level, uint32_t us)
+{
+    uint32_t start = clockMicros();
+    while (pin < 0 || gdo(pin) != level) {
+        if (clockMicros() - start >= us) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef ARDUINO
+
+// Chip ready (CHIP_RDYn) timeout after chip select (us)
+#define CC1101_READY_TIMEOUT 1000
+
+CC1101SpiBus::CC1101SpiBus(uint8_t cs, uint8_t gdo0, uint8_t gdo2, SPIClass &spi, uint32_t clock) :
+    _cs(cs), _gdo0(gdo0), _gdo2(gdo2), _spi(spi), _settings(clock, MSBFIRST, SPI_MODE0)
+{
+}
+
+//
+// Pull chip select low and wait until the chip is ready (SO low), which
+// takes a while if the chip has been sleeping (SPWD/SWOR)
+//
+void CC1101SpiBus::select()
+{
+    _spi.beginTransaction(_settings);
+    digitalWrite(_cs, LOW);
+    uint32_t start = micros();
+    while (digitalRead(MISO) && micros() - start < CC1101_READY_TIMEOUT)
+        ;
+}
+
+void CC1101SpiBus::deselect()
+{
+    digitalWrite(_cs, HIGH);
+    _spi.endTransaction();
+}
+
+uint8_t CC1101SpiBus::strobe(uint8_t cmd)
+{
+    select();
+    uint8_t status = _spi.transfer(cmd);
+    deselect();
+    return status;
+}
+
+uint8_t CC1101SpiBus::readReg(uint8_t addr)
+{
+    uint8_t header = addr | CC1101_READ;
+    if (addr >= CC1101_PARTNUM && addr <= CC1101_RCCTRL0_STATUS) {
+        header |= CC1101_BURST;
+    }
+    select();
+    _spi.transfer(header);
+    uint8_t value = _spi.transfer(0);
+    deselect();
+    return value;
+}
+
+void CC1101SpiBus::writeReg(uint8_t addr, uint8_t value)
+{
+    select();
+    _spi.transfer(addr);
+    _spi.transfer(value);
+    deselect();
+}
+
+void CC1101SpiBus::readBurst(uint8_t addr, uint8_t *buf, uint8_t len)
+{
+    select();
+    _spi.transfer(addr | CC1101_READ | CC1101_BURST);
+    for (uint8_t i = 0; i < len; i++) {
+        buf[i] = _spi.transfer(0);
+    }
+    deselect();
+}
+
+void CC1101SpiBus::writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+    select();
+    _spi.transfer(addr | CC1101_BURST);
+    for (uint8_t i = 0; i < len; i++) {
+        _spi.transfer(buf[i]);
+    }
+    deselect();
+}
+
+bool CC1101SpiBus::gdo(uint8_t pin)
+{
+    return digitalRead((pin == 0) ? _gdo0 : _gdo2);
+}
+
+#endif
@@ -0,0 +1,204 @@
+/*
+CC1101Bus - direct CC1101 register, strobe and FIFO access
+
+RadioLib configures the radio and reads packets, but keeps its low level
+register access protected. Features which need to touch registers directly
+(Wake-On-Radio, strobes, status registers) use this interface instead:
+
+    bus.strobe(CC1101_SIDLE);
+    bus.writeReg(CC1101_WORCTRL, 0x78);
+    uint8_t n = bus.readReg(CC1101_RXBYTES) & 0x7f;
+
+CC1101SpiBus talks to the chip via the Arduino SPI library, sharing the bus
+(and the chip select pin) with RadioLib. Other implementations (e.g. a
+simulated radio on a host) only have to provide the five transfer functions
+and the GDO pin levels.
+*/
+#ifndef CC1101_BUS_H
+#define CC1101_BUS_H
+
+#include <math.h>
+#include <stdint.h>
+
+// Configuration registers
+#define CC1101_IOCFG2    0x00
+#define CC1101_IOCFG1    0x01
+#define CC1101_IOCFG0    0x02
+#define CC1101_FIFOTHR   0x03
+#define CC1101_SYNC1     0x04
+#define CC1101_SYNC0     0x05
+#define CC1101_PKTLEN    0x06
+#define CC1101_PKTCTRL1  0x07
+#define CC1101_PKTCTRL0  0x08
+#define CC1101_ADDR      0x09
+#define CC1101_CHANNR    0x0A
+#define CC1101_FSCTRL1   0x0B
+#define CC1101_FSCTRL0   0x0C
+#define CC1101_FREQ2     0x0D
+#define CC1101_FREQ1     0x0E
+#define CC1101_FREQ0     0x0F
+#define CC1101_MDMCFG4   0x10
+#define CC1101_MDMCFG3   0x11
+#define CC1101_MDMCFG2   0x12
+#define CC1101_MDMCFG1   0x13
+#define CC1101_MDMCFG0   0x14
+#define CC1101_DEVIATN   0x15
+#define CC1101_MCSM2     0x16
+#define CC1101_MCSM1     0x17
+#define CC1101_MCSM0     0x18
+#define CC1101_FOCCFG    0x19
+#define CC1101_BSCFG     0x1A
+#define CC1101_AGCCTRL2  0x1B
+#define CC1101_AGCCTRL1  0x1C
+#define CC1101_AGCCTRL0  0x1D
+#define CC1101_WOREVT1   0x1E
+#define CC1101_WOREVT0   0x1F
+#define CC1101_WORCTRL   0x20
+#define CC1101_FREND1    0x21
+#define CC1101_FREND0    0x22
+#define CC1101_FSCAL3    0x23
+#define CC1101_FSCAL2    0x24
+#define CC1101_FSCAL1    0x25
+#define CC1101_FSCAL0    0x26
+#define CC1101_RCCTRL1   0x27
+#define CC1101_RCCTRL0   0x28
+#define CC1101_FSTEST    0x29
+#define CC1101_PTEST     0x2A
+#define CC1101_AGCTEST   0x2B
+#define CC1101_TEST2     0x2C
+#define CC1101_TEST1     0x2D
+#define CC1101_TEST0     0x2E
+#define CC1101_CONFIG_REGS 0x2F
+
+// Command strobes
+#define CC1101_SRES      0x30
+#define CC1101_SFSTXON   0x31
+#define CC1101_SXOFF     0x32
+#define CC1101_SCAL      0x33
+#define CC1101_SRX       0x34
+#define CC1101_STX       0x35
+#define CC1101_SIDLE     0x36
+#define CC1101_SWOR      0x38
+#define CC1101_SPWD      0x39
+#define CC1101_SFRX      0x3A
+#define CC1101_SFTX      0x3B
+#define CC1101_SWORRST   0x3C
+#define CC1101_SNOP      0x3D
+
+// Status registers (read with burst bit set)
+#define CC1101_PARTNUM   0x30
+#define CC1101_VERSION   0x31
+#define CC1101_FREQEST   0x32
+#define CC1101_LQI       0x33
+#define CC1101_RSSI      0x34
+#define CC1101_MARCSTATE 0x35
+#define CC1101_WORTIME1  0x36
+#define CC1101_WORTIME0  0x37
+#define CC1101_PKTSTATUS 0x38
+#define CC1101_VCO_VC_DAC 0x39
+#define CC1101_TXBYTES   0x3A
+#define CC1101_RXBYTES   0x3B
+#define CC1101_RCCTRL1_STATUS 0x3C
+#define CC1101_RCCTRL0_STATUS 0x3D
+
+#define CC1101_PATABLE   0x3E
+#define CC1101_FIFO      0x3F
+
+// Header byte flags
+#define CC1101_READ      0x80
+#define CC1101_BURST     0x40
+
+// Chip status byte
+#define CC1101_STATE(status) (((status) >> 4) & 0x07)
+#define CC1101_STATE_IDLE        0
+#define CC1101_STATE_RX          1
+#define CC1101_STATE_TX          2
+#define CC1101_STATE_FSTXON      3
+#define CC1101_STATE_CALIBRATE   4
+#define CC1101_STATE_SETTLING    5
+#define CC1101_STATE_RX_OVERFLOW 6
+#define CC1101_STATE_TX_UNDERFLOW 7
+
+// RXBYTES/TXBYTES
+#define CC1101_FIFO_BYTES(n) ((n) & 0x7f)
+#define CC1101_FIFO_OVERFLOW 0x80
+
+#define CC1101_FIFO_SIZE 64
+
+// Crystal frequency (Hz)
+#define CC1101_XOSC_HZ 26000000UL
+
+// MCSM1 RXOFF_MODE: state after a packet has been received
+#define CC1101_MCSM1_RXOFF_MASK 0x0C
+#define CC1101_MCSM1_RXOFF_RX   0x0C
+
+// RSSI offset at 868 MHz (dB)
+#define CC1101_RSSI_OFFSET 74
+
+// RSSI status register or appended status byte (0.5 dB steps, two's
+// complement) to dBm - and back, saturated
+static inline float cc1101RssiDbm(uint8_t raw) {
+    return ((raw >= 128) ? raw - 256 : raw) / 2.0f - CC1101_RSSI_OFFSET;
+}
+
+static inline uint8_t cc1101RssiRaw(float dbm) {
+    long raw = lroundf((dbm + CC1101_RSSI_OFFSET) * 2);
+    return (uint8_t)(int8_t)((raw > 127) ? 127 : (raw < -128) ? -128 : raw);
+}
+
+class CC1101Bus {
+public:
+    virtual ~CC1101Bus() {}
+
+    // Send command strobe - returns chip status byte
+    virtual uint8_t strobe(uint8_t cmd) = 0;
+
+    // Read configuration or status register (addr >= CC1101_PARTNUM: the
+    // burst bit which selects the status registers is added)
+    virtual uint8_t readReg(uint8_t addr) = 0;
+    virtual void    writeReg(uint8_t addr, uint8_t value) = 0;
+
+    // Burst access (consecutive registers, FIFO or PATABLE)
+    virtual void readBurst(uint8_t addr, uint8_t *buf, uint8_t len) = 0;
+    virtual void writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len) = 0;
+
+    // Level of GDO0 (pin 0) or GDO2 (pin 2)
+    virtual bool gdo(uint8_t pin) = 0;
+
+    // Wait up to us until GDO pin has level - returns false on timeout.
+    // pin < 0: just wait. The default polls the pin; a simulated radio
+    // advances its clock instead.
+    virtual bool waitGdo(int pin, bool level, uint32_t us);
+
+    // Read status register which is updated while being read (RXBYTES,
+    // TXBYTES, RSSI, ...) until two reads agree (see CC1101 errata)
+    uint8_t readStatus(uint8_t addr);
+};
+
+#ifdef ARDUINO
+#include <SPI.h>
+
+class CC1101SpiBus : public CC1101Bus {
+public:
+    CC1101SpiBus(uint8_t cs, uint8_t gdo0, uint8_t gdo2, SPIClass &spi = SPI, uint32_t clock = 4000000);
+
+    uint8_t strobe(uint8_t cmd) override;
+    uint8_t readReg(uint8_t addr) override;
+    void    writeReg(uint8_t addr, uint8_t value) override;
+    void    readBurst(uint8_t addr, uint8_t *buf, uint8_t len) override;
+    void    writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len) override;
+    bool    gdo(uint8_t pin) override;
+
+private:
+    void select();
+    void deselect();
+
+    uint8_t     _cs;
+    uint8_t     _gdo0;
+    uint8_t     _gdo2;
+    SPIClass   &_spi;
+    SPISettings _settings;
+};
+#endif
+
+#endif // CC1101_BUS_H
@@ -0,0 +1,47 @@
+/*
+CC1101Image - CC1101 register image computed at compile time
+*/
+#include "CC1101Image.h"
+
+unsigned cc1101ApplyImage(CC1101Bus *bus, const CC1101Image &image)
+{
+    // The next access waits for the chip to be ready again (SO low)
+    bus->strobe(CC1101_SRES);
+    bus->writeBurst(CC1101_IOCFG2, image.regs, CC1101_IMAGE_REGS);
+    bus->writeReg(CC1101_PATABLE, image.pa);
+    bus->strobe(CC1101_SFRX);
+    bus->strobe(CC1101_SFTX);
+    return cc1101VerifyImage(bus, image);
+}
+
+unsigned cc1101SwitchImage(CC1101Bus *bus, const CC1101Image &from, const CC1101Image &to)
+{
+    unsigned first = CC1101_IMAGE_REGS, last = 0;
+    for (unsigned i = 0; i < CC1101_IMAGE_REGS; i++) {
+        if (from.regs[i] != to.regs[i]) {
+            first = (i < first) ? i : first;
+            last  = i;
+        }
+    }
+    if (first == CC1101_IMAGE_REGS) {
+        return 0;
+    }
+    bus->writeBurst(first, &to.regs[first], last - first + 1);
+    return last - first + 1;
+}
+
+unsigned cc1101VerifyImage(CC1101Bus *bus, const CC1101Image &image, uint8_t first, uint8_t count)
+{
+    uint8_t regs[CC1101_IMAGE_REGS];
+    bus->readBurst(first, regs, count);
+    unsigned differ = 0;
+    for (unsigned i = 0; i < count; i++) {
+        if (regs[i] != image.regs[first + i]) {
+            differ++;
+        }
+    }
+    if (first == 0 && count == CC1101_IMAGE_REGS && bus->readReg(CC1101_PATABLE) != image.pa) {
+        differ++;
+    }
+    return differ;
+}
@@ -0,0 +1,174 @@
+/*
+CC1101Image - CC1101 register image computed at compile time
+
+RadioLib configures the radio one setter at a time: every setter computes
+its register values at runtime and writes them individually (read, modify,
+write, read back), after a reset and a generous delay. The image holds the
+result of initRadio() for the same parameters, computed by the compiler:
+
+    constexpr CC1101Image image = cc1101Image({ 868.3, 8.21, 57.136417, 270, 10, 32, 27 });
+    cc1101ApplyImage(&bus, image);        // reset, one burst, one read back
+
+Register values follow RadioLib 5.1 (same rounding, same tables) on top of
+the CC1101 reset values:
+
+- FREQ2..0, MDMCFG4/3 (data rate, channel filter bandwidth), DEVIATN,
+  MDMCFG1 (preamble) and PATABLE from the parameters
+- MCSM0 autocalibration IDLE->RX/TX, GDO0/GDO2 high impedance
+- packet mode: status bytes appended, no whitening, no CRC, fixed length
+- sync word 0xAA 0x2D (or as given), 16/16 bits, optionally qualified by
+  carrier sense
+
+The configuration registers up to RCCTRL0 are written, the test registers
+keep their reset values (as with RadioLib).
+*/
+#ifndef CC1101_IMAGE_H
+#define CC1101_IMAGE_H
+
+#include <stdint.h>
+#include "CC1101Bus.h"
+
+// Registers written by the image (IOCFG2..RCCTRL0)
+#define CC1101_IMAGE_REGS (CC1101_RCCTRL0 + 1)
+
+struct CC1101Params {
+    double   frequency_mhz;
+    double   bitrate_kbps;
+    double   deviation_khz;
+    double   rx_bandwidth_khz;
+    int8_t   power_dbm;            // -30, -20, -15, -10, 0, 5, 7 or 10
+    uint8_t  preamble_bits;        // 16, 24, 32, 48, 64, 96, 128 or 192
+    uint8_t  packet_length;        // fixed packet length
+    bool     carrier_sense;        // sync word only above the carrier sense threshold
+    uint16_t sync_word;            // 0: 0xAA2D
+};
+
+struct CC1101Image {
+    uint8_t regs[CC1101_IMAGE_REGS];
+    uint8_t pa;                    // PATABLE[0]
+};
+
+namespace cc1101 {
+
+constexpr uint8_t resetValues[CC1101_IMAGE_REGS] = {
+    0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,
+    0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+    0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00
+};
+
+constexpr double XOSC = CC1101_XOSC_HZ;
+
+// RadioLib's getExpMant(): largest exponent whose column starts at or below
+// target, mantissa truncated
+constexpr uint8_t exponent(double target, double origin, int e)
+{
+    return (e == 0 || target >= origin * (1UL << e)) ? e : exponent(target, origin, e - 1);
+}
+
+constexpr uint8_t mantissa(double target, double origin, uint8_t e, unsigned offset)
+{
+    return (uint8_t)((target - origin * (1UL << e)) / (origin * (1UL << e) / offset));
+}
+
+// Data rate: (256 + M) * 2^E * XOSC / 2^28
+constexpr double   drateOrigin() { return 256 * XOSC / (1UL << 28); }
+constexpr uint8_t  drateE(const CC1101Params &p) { return exponent(p.bitrate_kbps * 1000, drateOrigin(), 14); }
+constexpr uint8_t  drateM(const CC1101Params &p) { return mantissa(p.bitrate_kbps * 1000, drateOrigin(), drateE(p), 256); }
+
+// Deviation: (8 + M) * 2^E * XOSC / 2^17
+constexpr double   devOrigin() { return 8 * XOSC / (1UL << 17); }
+constexpr uint8_t  devE(const CC1101Params &p) { return exponent(p.deviation_khz * 1000, devOrigin(), 7); }
+constexpr uint8_t  devM(const CC1101Params &p) { return mantissa(p.deviation_khz * 1000, devOrigin(), devE(p), 8); }
+
+// Channel filter bandwidth: XOSC / (8 * (4 + M) * 2^E), first setting within
+// 1 kHz searching from E = M = 3 down - 0xff: none
+constexpr double bandwidth(unsigned em) { return XOSC / (8 * (4 + (em & 3)) * (1UL << (em >> 2))); }
+constexpr double distance(double a, double b) { return (a > b) ? a - b : b - a; }
+constexpr uint8_t bandwidthEM(double bw_hz, int em)
+{
+    return (em < 0) ? 0xff :
+           (distance(bw_hz, bandwidth(em)) <= 1000) ? em : bandwidthEM(bw_hz, em - 1);
+}
+constexpr uint8_t chanbw(const CC1101Params &p) { return bandwidthEM(p.rx_bandwidth_khz * 1000, 15); }
+
+constexpr uint16_t syncWord(const CC1101Params &p) { return p.sync_word ? p.sync_word : 0xAA2D; }
+
+// FREQ2..0: f * 2^16 / XOSC, truncated
+constexpr uint32_t freqWord(const CC1101Params &p) { return (uint32_t)(p.frequency_mhz * 65536 / 26.0); }
+
+// MDMCFG1 NUM_PREAMBLE - 0xff: not supported
+constexpr uint8_t preamble(uint8_t bits)
+{
+    return (bits == 16) ? 0 : (bits == 24) ? 1 : (bits == 32) ? 2 : (bits == 48) ? 3 :
+           (bits == 64) ? 4 : (bits == 96) ? 5 : (bits == 128) ? 6 : (bits == 192) ? 7 : 0xff;
+}
+
+// PATABLE value at 868 MHz (RadioLib's table) - 0: not supported
+constexpr uint8_t pa868(int8_t dbm)
+{
+    return (dbm == -30) ? 0x03 : (dbm == -20) ? 0x0F : (dbm == -15) ? 0x1E : (dbm == -10) ? 0x27 :
+           (dbm == 0) ? 0x50 : (dbm == 5) ? 0x81 : (dbm == 7) ? 0xCB : (dbm == 10) ? 0xC2 : 0;
+}
+
+constexpr uint8_t reg(const CC1101Params &p, unsigned addr)
+{
+    return (addr == CC1101_IOCFG2)   ? 0x2E :
+           (addr == CC1101_IOCFG0)   ? 0x2E :
+           (addr == CC1101_SYNC1)    ? (uint8_t)(syncWord(p) >> 8) :
+           (addr == CC1101_SYNC0)    ? (uint8_t)syncWord(p) :
+           (addr == CC1101_PKTLEN)   ? p.packet_length :
+           (addr == CC1101_PKTCTRL1) ? 0x04 :                  // APPEND_STATUS
+           (addr == CC1101_PKTCTRL0) ? 0x00 :                  // fixed length, no CRC, no whitening
+           (addr == CC1101_FREQ2)    ? (uint8_t)(freqWord(p) >> 16) :
+           (addr == CC1101_FREQ1)    ? (uint8_t)(freqWord(p) >> 8) :
+           (addr == CC1101_FREQ0)    ? (uint8_t)freqWord(p) :
+           (addr == CC1101_MDMCFG4)  ? (uint8_t)((chanbw(p) << 4) | drateE(p)) :
+           (addr == CC1101_MDMCFG3)  ? drateM(p) :
+           (addr == CC1101_MDMCFG2)  ? (p.carrier_sense ? 0x06 : 0x02) :  // 2-FSK, sync 16/16 (+ CS)
+           (addr == CC1101_MDMCFG1)  ? (uint8_t)((resetValues[addr] & 0x8f) | (preamble(p.preamble_bits) << 4)) :
+           (addr == CC1101_DEVIATN)  ? (uint8_t)((devE(p) << 4) | devM(p)) :
+           (addr == CC1101_MCSM0)    ? (uint8_t)((resetValues[addr] & 0xcf) | 0x10) :  // FS_AUTOCAL
+           resetValues[addr];
+}
+
+// Index sequence (C++11)
+template<unsigned... I> struct Indices {};
+template<unsigned N, unsigned... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
+template<unsigned... I> struct MakeIndices<0, I...> { typedef Indices<I...> type; };
+
+template<unsigned... I>
+constexpr CC1101Image image(const CC1101Params &p, Indices<I...>)
+{
+    return CC1101Image{ { reg(p, I)... }, pa868(p.power_dbm) };
+}
+
+} // namespace cc1101
+
+// Image for the parameters - check with cc1101ImageValid() in a static_assert
+constexpr CC1101Image cc1101Image(const CC1101Params &p)
+{
+    return cc1101::image(p, cc1101::MakeIndices<CC1101_IMAGE_REGS>::type());
+}
+
+constexpr bool cc1101ImageValid(const CC1101Params &p)
+{
+    return cc1101::chanbw(p) != 0xff && cc1101::preamble(p.preamble_bits) != 0xff &&
+           cc1101::pa868(p.power_dbm) != 0 && cc1101::drateE(p) <= 14 && cc1101::devE(p) <= 7;
+}
+
+// Reset the radio and write the image in one burst, read back and compare -
+// returns the number of registers which differ (0: OK). The radio is left
+// in IDLE with empty FIFOs.
+unsigned cc1101ApplyImage(CC1101Bus *bus, const CC1101Image &image);
+
+// Switch the radio (in IDLE) from one image to another: the registers which
+// differ are written in a single burst, from the first to the last of them -
+// returns the number of registers written
+unsigned cc1101SwitchImage(CC1101Bus *bus, const CC1101Image &from, const CC1101Image &to);
+
+// Compare count registers from first (all: incl. PATABLE) with the image -
+// returns the number of registers which differ
+unsigned cc1101VerifyImage(CC1101Bus *bus, const CC1101Image &image,
+                           uint8_t first = 0, uint8_t count = CC1101_IMAGE_REGS);
+
+#endif // CC1101_IMAGE_H
@@ -0,0 +1,841 @@
+/*
+CC1101Sim - software model of the CC1101 behind the CC1101Bus interface
+
+See CC1101Sim.h for what is modelled.
+*/
+#include "CC1101Sim.h"
+#include "Clock.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Register values after reset (CC1101 data sheet, table 43)
+static const uint8_t resetValues[CC1101_CONFIG_REGS] = {
+    0x29, 0x2E, 0x3F, 0x07, 0xD3, 0x91, 0xFF, 0x04, 0x45, 0x00, 0x00, 0x0F, 0x00, 0x1E, 0xC4, 0xEC,
+    0x8C, 0x22, 0x02, 0x22, 0xF8, 0x47, 0x07, 0x30, 0x04, 0x36, 0x6C, 0x03, 0x40, 0x91, 0x87, 0x6B,
+    0xF8, 0x56, 0x10, 0xA9, 0x0A, 0x20, 0x0D, 0x41, 0x00, 0x59, 0x7F, 0x3F, 0x88, 0x31, 0x0B
+};
+
+// MARCSTATE values
+#define MARC_SLEEP            0x00
+#define MARC_IDLE             0x01
+#define MARC_RX               0x0D
+#define MARC_RXFIFO_OVERFLOW  0x11
+#define MARC_TX               0x13
+#define MARC_TXFIFO_UNDERFLOW 0x16
+
+// GDOx_CFG signals
+#define GDO_RX_THR            0x00
+#define GDO_RX_THR_EOP        0x01
+#define GDO_SYNC_WORD         0x06
+#define GDO_CCA               0x09
+#define GDO_CARRIER_SENSE     0x0E
+#define GDO_CHIP_RDYN         0x29
+#define GDO_INV               0x40
+
+#define PKTCTRL1_APPEND_STATUS 0x04
+
+// Preamble bytes by MDMCFG1 NUM_PREAMBLE
+static const uint8_t preambleBytes[8] = {2, 3, 4, 6, 8, 12, 16, 24};
+
+// Link model: fraction of the channel filter bandwidth which is flat - a
+// signal reaching beyond it is attenuated by SIM_FILTER_SLOPE dB per
+// bandwidth
+#define SIM_FILTER_FLAT  0.8f
+#define SIM_FILTER_SLOPE 40.0f
+
+CC1101Sim::CC1101Sim() :
+    _now(0), _airFirst(0), _airEnd(0), _airNext(0), _noise(-100), _lfsr(0xACE1),
+    _linkModel(false), _rng(1), _noiseSyncUs(0), _txFn(nullptr), _txCtx(nullptr)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    reset();
+}
+
+void CC1101Sim::reset()
+{
+    memcpy(_regs, resetValues, sizeof(_regs));
+    memset(_patable, 0, sizeof(_patable));
+    _patable[0] = 0xC6;
+    _state      = SIM_IDLE;
+    _worStart   = _now;
+    _rxEndUs    = 0;
+    _rxHead     = 0;
+    _rxCount    = 0;
+    _txCount    = 0;
+    _receiving  = false;
+    _rxHasFrame = false;
+    _rxBytes    = 0;
+    _rxLen      = 0;
+    _freqEst    = 0;
+    _rxBer      = 0;
+    _rxRssi     = _noise;
+    _rxLqi      = 0;
+    _eop        = false;
+}
+
+//
+// Pulling CSn low wakes the chip from power down
+//
+void CC1101Sim::wake()
+{
+    _stats.spi_accesses++;
+    if (_state == SIM_SLEEP) {
+        _state = SIM_IDLE;
+    }
+}
+
+void CC1101Sim::setState(State s)
+{
+    if (s != SIM_RX && s != SIM_RX_OVERFLOW) {
+        _receiving  = false;
+        _rxHasFrame = false;
+    }
+    if (s == SIM_WOR) {
+        _worStart = _now;
+    }
+    _rxEndUs = 0;
+    _state   = s;
+}
+
+void CC1101Sim::enterRx()
+{
+    if (_state == SIM_IDLE || _state == SIM_TX || _state == SIM_WOR) {
+        setState(SIM_RX);
+        double timeout = rxTimeout();
+        _rxEndUs = (timeout > 0) ? _now + (uint64_t)ceil(timeout) : 0;
+    }
+}
+
+//
+// WOR EVENT0 period (us)
+//
+double CC1101Sim::worPeriod() const
+{
+    unsigned res    = _regs[CC1101_WORCTRL] & 0x03;
+    unsigned event0 = (_regs[CC1101_WOREVT1] << 8) | _regs[CC1101_WOREVT0];
+    return 750e6 / CC1101_XOSC_HZ * event0 * (1 << (5 * res));
+}
+
+//
+// Sync word search timeout (MCSM2 RX_TIME, us) - in WOR and in normal RX
+// alike; 0: none (RX_TIME 7)
+//
+double CC1101Sim::rxTimeout() const
+{
+    unsigned rxTime = _regs[CC1101_MCSM2] & 0x07;
+    return (rxTime == 7) ? 0 : worPeriod() * 0.125 / (1 << rxTime);
+}
+
+float CC1101Sim::dataRate() const
+{
+    unsigned e = _regs[CC1101_MDMCFG4] & 0x0f;
+    unsigned m = _regs[CC1101_MDMCFG3];
+    return (256.0f + m) * (float)(1UL << e) * (CC1101_XOSC_HZ / 268435456.0f);
+}
+
+float CC1101Sim::frequency() const
+{
+    uint32_t freq = ((uint32_t)_regs[CC1101_FREQ2] << 16) | (_regs[CC1101_FREQ1] << 8) | _regs[CC1101_FREQ0];
+    return freq * (CC1101_XOSC_HZ / 65536.0f) + (int8_t)_regs[CC1101_FSCTRL0] * (CC1101_XOSC_HZ / 16384.0f);
+}
+
+float CC1101Sim::bandwidth() const
+{
+    unsigned e = _regs[CC1101_MDMCFG4] >> 6;
+    unsigned m = (_regs[CC1101_MDMCFG4] >> 4) & 0x03;
+    return CC1101_XOSC_HZ / (8.0f * (4 + m) * (1 << e));
+}
+
+float CC1101Sim::deviation() const
+{
+    unsigned e = (_regs[CC1101_DEVIATN] >> 4) & 0x07;
+    unsigned m = _regs[CC1101_DEVIATN] & 0x07;
+    return (8.0f + m) * (float)(1 << e) * (CC1101_XOSC_HZ / 131072.0f);
+}
+
+uint32_t CC1101Sim::byteUs() const
+{
+    return lroundf(8e6f / dataRate());
+}
+
+uint64_t CC1101Sim::syncTime(const SimFrame *f) const
+{
+    unsigned bits = (f->preamble_bits ? f->preamble_bits : 32);
+    bits += ((_regs[CC1101_MDMCFG2] & 0x03) == 3) ? 32 : 16;
+    return f->start_us + (uint64_t)llroundf(bits * 1e6f / dataRate());
+}
+
+uint64_t CC1101Sim::endTime(const SimFrame *f) const
+{
+    return syncTime(f) + (uint64_t)f->len * byteUs();
+}
+
+uint8_t CC1101Sim::status() const
+{
+    uint8_t state;
+    switch (_state) {
+        case SIM_RX:           state = CC1101_STATE_RX; break;
+        case SIM_TX:           state = CC1101_STATE_TX; break;
+        case SIM_RX_OVERFLOW:  state = CC1101_STATE_RX_OVERFLOW; break;
+        case SIM_TX_UNDERFLOW: state = CC1101_STATE_TX_UNDERFLOW; break;
+        default:               state = CC1101_STATE_IDLE; break;
+    }
+    uint8_t rdy = (_state == SIM_SLEEP || _state == SIM_WOR) ? 0x80 : 0;
+    return rdy | (state << 4) | ((_rxCount > 15) ? 15 : _rxCount);
+}
+
+uint8_t CC1101Sim::marcState() const
+{
+    switch (_state) {
+        case SIM_IDLE:         return MARC_IDLE;
+        case SIM_RX:           return MARC_RX;
+        case SIM_RX_OVERFLOW:  return MARC_RXFIFO_OVERFLOW;
+        case SIM_TX:           return MARC_TX;
+        case SIM_TX_UNDERFLOW: return MARC_TXFIFO_UNDERFLOW;
+        default:               return MARC_SLEEP;
+    }
+}
+
+bool CC1101Sim::carrierSense() const
+{
+    if (_state != SIM_RX) {
+        return false;
+    }
+    if (_receiving && _rxHasFrame) {
+        return true;
+    }
+    for (uint32_t s = _airFirst; s != _airEnd; s++) {
+        const SimFrame *f = frame(s);
+        if (f->start_us <= _now && _now < endTime(f)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CC1101Sim::signal(uint8_t cfg) const
+{
+    bool     level = false;
+    unsigned thr   = 4 * ((_regs[CC1101_FIFOTHR] & 0x0f) + 1);
+
+    switch (cfg & 0x3f) {
+        case GDO_RX_THR:
+            level = _rxCount >= thr;
+            break;
+        case GDO_RX_THR_EOP:
+            level = _rxCount >= thr || (_eop && _rxCount > 0);
+            break;
+        case GDO_SYNC_WORD:
+            level = _receiving || (_state == SIM_TX && _now >= _txSyncUs);
+            break;
+        case GDO_CCA:
+            level = !carrierSense();
+            break;
+        case GDO_CARRIER_SENSE:
+            level = carrierSense();
+            break;
+        case GDO_CHIP_RDYN:
+            level = (_state == SIM_SLEEP || _state == SIM_WOR);
+            break;
+        default:
+            break;
+    }
+    return level != ((cfg & GDO_INV) != 0);
+}
+
+bool CC1101Sim::gdo(uint8_t pin)
+{
+    return signal(_regs[(pin == 0) ? CC1101_IOCFG0 : CC1101_IOCFG2]);
+}
+
+uint8_t CC1101Sim::statusReg(uint8_t addr)
+{
+    switch (addr) {
+        case CC1101_PARTNUM:
+            return 0x00;
+        case CC1101_VERSION:
+            return 0x14;
+        case CC1101_FREQEST:
+            return (uint8_t)_freqEst;
+        case CC1101_LQI:
+            return 0x80 | _rxLqi;
+        case CC1101_RSSI: {
+            float rssi = _noise;
+            if (_receiving && _rxHasFrame) {
+                rssi = _rxRssi;
+            } else if (carrierSense()) {
+                rssi = _rxRssi;
+            } else if (_linkModel) {
+                rssi += uniform(-SIM_NOISE_JITTER, SIM_NOISE_JITTER);
+            }
+            return cc1101RssiRaw(rssi);
+        }
+        case CC1101_MARCSTATE:
+            return marcState();
+        case CC1101_PKTSTATUS:
+            return 0x80 | (carrierSense() ? 0x40 : 0x10) | (_receiving ? 0x28 : 0) |
+                   (gdo(2) ? 0x04 : 0) | (gdo(0) ? 0x01 : 0);
+        case CC1101_TXBYTES:
+            return _txCount | ((_state == SIM_TX_UNDERFLOW) ? CC1101_FIFO_OVERFLOW : 0);
+        case CC1101_RXBYTES:
+            return _rxCount | ((_state == SIM_RX_OVERFLOW) ? CC1101_FIFO_OVERFLOW : 0);
+        default:
+            return 0;
+    }
+}
+
+uint8_t CC1101Sim::strobe(uint8_t cmd)
+{
+    wake();
+    if (_state == SIM_WOR && cmd != CC1101_SNOP && cmd != CC1101_SWORRST) {
+        setState(SIM_IDLE);
+    }
+
+    switch (cmd) {
+        case CC1101_SRES:
+            reset();
+            break;
+        case CC1101_SIDLE:
+            setState(SIM_IDLE);
+            break;
+        case CC1101_SRX:
+            enterRx();
+            break;
+        case CC1101_STX:
+            if (_state == SIM_IDLE || _state == SIM_RX) {
+                startTx();
+            }
+            break;
+        case CC1101_SFRX:
+            if (_state == SIM_IDLE || _state == SIM_RX_OVERFLOW) {
+                _rxHead  = 0;
+                _rxCount = 0;
+                _eop     = false;
+                setState(SIM_IDLE);
+            }
+            break;
+        case CC1101_SFTX:
+            if (_state == SIM_IDLE || _state == SIM_TX_UNDERFLOW) {
+                _txCount = 0;
+                setState(SIM_IDLE);
+            }
+            break;
+        case CC1101_SWOR:
+            if (_state == SIM_IDLE) {
+                setState(SIM_WOR);
+            }
+            break;
+        case CC1101_SWORRST:
+            _worStart = _now;
+            break;
+        case CC1101_SPWD:
+            if (_state == SIM_IDLE) {
+                setState(SIM_SLEEP);
+            }
+            break;
+        default:
+            // SFSTXON, SXOFF, SCAL, SNOP
+            break;
+    }
+    return status();
+}
+
+uint8_t CC1101Sim::readReg(uint8_t addr)
+{
+    uint8_t value;
+    readBurst(addr, &value, 1);
+    return value;
+}
+
+void CC1101Sim::writeReg(uint8_t addr, uint8_t value)
+{
+    writeBurst(addr, &value, 1);
+}
+
+void CC1101Sim::readBurst(uint8_t addr, uint8_t *buf, uint8_t len)
+{
+    wake();
+    for (uint8_t i = 0; i < len; i++) {
+        if (addr == CC1101_FIFO) {
+            if (_rxCount) {
+                buf[i] = _rxFifo[_rxHead];
+                _rxHead = (_rxHead + 1) % CC1101_FIFO_SIZE;
+                _rxCount--;
+            } else {
+                buf[i] = 0;
+            }
+            if (_rxCount == 0) {
+                _eop = false;
+            }
+        } else if (addr == CC1101_PATABLE) {
+            buf[i] = _patable[i % 8];
+        } else if (addr + i >= CC1101_PARTNUM) {
+            buf[i] = statusReg(addr + i);
+        } else {
+            buf[i] = _regs[addr + i];
+        }
+    }
+}
+
+void CC1101Sim::writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len)
+{
+    wake();
+    for (uint8_t i = 0; i < len; i++) {
+        if (addr == CC1101_FIFO) {
+            if (_txCount < CC1101_FIFO_SIZE) {
+                _txFifo[_txCount++] = buf[i];
+            }
+        } else if (addr == CC1101_PATABLE) {
+            _patable[i % 8] = buf[i];
+        } else if (addr + i < CC1101_CONFIG_REGS) {
+            _regs[addr + i] = buf[i];
+        }
+    }
+}
+
+bool CC1101Sim::inject(const SimFrame *f)
+{
+    if (_airEnd != _airFirst && f->start_us < frame(_airEnd - 1)->start_us) {
+        return false;
+    }
+    purge();
+    if (_airEnd - _airFirst >= SIM_AIR_FRAMES) {
+        return false;
+    }
+    _air[_airEnd % SIM_AIR_FRAMES] = *f;
+    _airEnd++;
+    _stats.on_air++;
+    return true;
+}
+
+bool CC1101Sim::injectHex(const char *hex, uint64_t start_us, float rssi)
+{
+    SimFrame f;
+    memset(&f, 0, sizeof(f));
+    f.start_us = start_us;
+    f.rssi     = rssi;
+    f.lqi      = 10;
+    f.sync     = (_regs[CC1101_SYNC1] << 8) | _regs[CC1101_SYNC0];
+    while (*hex && f.len < SIM_FRAME_SIZE) {
+        char *end;
+        char  digits[3] = {hex[0], (char)(hex[0] ? hex[1] : 0), 0};
+        long  b = strtol(digits, &end, 16);
+        if (end == digits + 2) {
+            f.data[f.len++] = b;
+            hex += 2;
+        } else {
+            hex++;                 // separator
+        }
+    }
+    return f.len > 0 && inject(&f);
+}
+
+//
+// Drop frames which are over and no longer needed
+//
+void CC1101Sim::purge()
+{
+    while (_airFirst != _airNext && endTime(frame(_airFirst)) < _now &&
+           !(_rxHasFrame && _rxSeq == _airFirst)) {
+        _airFirst++;
+    }
+}
+
+//
+// Is the radio listening when the sync word of f is complete? In WOR, an
+// EVENT0 RX slot must begin during the preamble.
+//
+bool CC1101Sim::listening(const SimFrame *f, uint64_t sync_us) const
+{
+    if (_state == SIM_RX) {
+        return true;
+    }
+    if (_state != SIM_WOR) {
+        return false;
+    }
+    double   period = worPeriod();
+    double   slot   = (rxTimeout() > 0) ? rxTimeout() : period;
+    double   from   = (double)(f->start_us - _worStart);
+    double   until  = (double)(sync_us - _worStart) - 8e6 / dataRate();
+    if (period <= 0 || f->start_us < _worStart) {
+        return false;
+    }
+    double k = ceil((from - slot) / period);
+    if (k < 0) {
+        k = 0;
+    }
+    return k * period <= until;
+}
+
+bool CC1101Sim::accept(const SimFrame *f)
+{
+    if (!listening(f, syncTime(f))) {
+        _stats.not_listening++;
+        return false;
+    }
+    unsigned mode = _regs[CC1101_MDMCFG2] & 0x07;
+    uint16_t sync = (_regs[CC1101_SYNC1] << 8) | _regs[CC1101_SYNC0];
+    unsigned errors = __builtin_popcount(f->sync ^ sync);
+    if (((mode & 3) == 1 && errors > 1) || ((mode & 3) == 2 && errors > 0) || ((mode & 3) == 3 && errors > 1)) {
+        _stats.sync_mismatch++;
+        return false;
+    }
+    _freqEst = 0;
+    float offset = 0;
+    if (f->frequency_hz != 0) {
+        offset = f->frequency_hz - frequency();
+        if (fabsf(offset) > bandwidth() / 2) {
+            _stats.off_channel++;
+            return false;
+        }
+        long est = lroundf(offset / (CC1101_XOSC_HZ / 16384.0f));
+        _freqEst = (est > 127) ? 127 : (est < -128) ? -128 : est;
+    }
+    if ((mode & 0x04) && f->rssi < csThreshold()) {
+        _stats.below_cs++;
+        return false;
+    }
+    _rxBer = 0;
+    if (_linkModel) {
+        // Sync word and the preamble bits needed for PQT
+        unsigned pqt = _regs[CC1101_PKTCTRL1] >> 5;
+        _rxBer = bitErrorRate(f, offset);
+        if (uniform(0, 1) >= powf(1 - _rxBer, 16 + 4 * pqt)) {
+            _stats.weak++;
+            return false;
+        }
+    }
+    if (_state == SIM_WOR) {
+        setState(SIM_RX);
+    }
+    return true;
+}
+
+//
+// Non-coherent 2-FSK: ber = 0.5 * exp(-snr / 2), scaled to SIM_SNR_1E3. The
+// signal occupies +-(deviation + data rate / 2) around its carrier; the part
+// outside of the flat section of the channel filter is attenuated.
+//
+float CC1101Sim::bitErrorRate(const SimFrame *f, float offset) const
+{
+    float edge = (fabsf(offset) + deviation() + dataRate() / 2) / (bandwidth() / 2);
+    float loss = (edge > SIM_FILTER_FLAT) ? (edge - SIM_FILTER_FLAT) * SIM_FILTER_SLOPE : 0;
+    float snr  = f->rssi - _noise - loss;
+    return 0.5f * expf(-6.2f * powf(10, (snr - SIM_SNR_1E3) / 10));
+}
+
+//
+// Carrier sense threshold (dBm) - CARRIER_SENSE_ABS_THR -8: disabled
+//
+float CC1101Sim::csThreshold() const
+{
+    int thr = _regs[CC1101_AGCCTRL1] & 0x0f;
+    thr = (thr >= 8) ? thr - 16 : thr;
+    return (thr == -8) ? -200.0f : SIM_CS_BASE_DBM + thr;
+}
+
+//
+// Sync words matched by noise per us: every bit completes a candidate, which
+// matches the 16-bit sync word with 2^-16, with up to one bit error (15/16)
+// with 17 * 2^-16; 30/32 is negligible
+//
+double CC1101Sim::noiseSyncRate() const
+{
+    unsigned mode = _regs[CC1101_MDMCFG2] & 0x03;
+    double   p    = (mode == 1) ? 17.0 / 65536 : (mode == 2) ? 1.0 / 65536 : 0;
+    return dataRate() * 1e-6 * p;
+}
+
+//
+// Noise matched the sync word - received as a packet unless rejected
+//
+void CC1101Sim::noiseSync()
+{
+    _stats.noise_syncs++;
+
+    // PQI reaches 4 * PQT only after as many alternating bits
+    unsigned pqt = _regs[CC1101_PKTCTRL1] >> 5;
+    if (pqt && uniform(0, 1) >= ldexpf(1, -4 * (int)pqt)) {
+        _stats.pqt_rejected++;
+        return;
+    }
+    if ((_regs[CC1101_MDMCFG2] & 0x04) &&
+        _noise + uniform(-SIM_NOISE_JITTER, SIM_NOISE_JITTER) < csThreshold()) {
+        _stats.cs_rejected++;
+        return;
+    }
+    _receiving  = true;
+    _rxEndUs    = 0;
+    _rxHasFrame = false;
+    _rxBytes    = 0;
+    _rxSyncUs   = _now;
+    _rxRssi     = _noise;
+    _rxLqi      = 0x7f;
+    _freqEst    = (int8_t)(random() % 64 - 32);
+}
+
+//
+// xorshift32
+//
+uint32_t CC1101Sim::random()
+{
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    return _rng;
+}
+
+float CC1101Sim::uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * (random() >> 8) * (1.0f / 16777216.0f);
+}
+
+void CC1101Sim::pushRx(uint8_t b)
+{
+    if (_rxCount == CC1101_FIFO_SIZE) {
+        _stats.overflows++;
+        setState(SIM_RX_OVERFLOW);
+        _receiving = false;
+        return;
+    }
+    _rxFifo[(_rxHead + _rxCount) % CC1101_FIFO_SIZE] = b;
+    _rxCount++;
+}
+
+void CC1101Sim::rxByte()
+{
+    uint8_t b;
+    const SimFrame *f = frame(_rxSeq);
+    if (_rxHasFrame && _rxBytes < f->len) {
+        b = f->data[_rxBytes];
+        for (unsigned bit = 0; _rxBer > 0 && bit < 8; bit++) {
+            if (uniform(0, 1) < _rxBer) {
+                b ^= 1 << bit;
+                _stats.bit_errors++;
+            }
+        }
+    } else {
+        _rxHasFrame = false;
+        _lfsr = (_lfsr >> 1) ^ (-(_lfsr & 1) & 0xB400);
+        b = _lfsr;
+    }
+    if (_rxHasFrame && _rxBytes + 1 == f->len) {
+        _rxHasFrame = false;
+    }
+    pushRx(b);
+    if (!_receiving) {
+        return;                    // overflow
+    }
+    if (_rxBytes++ == 0) {
+        _rxLen = b + 1;
+    }
+
+    // Packet length - PKTLEN may be changed while receiving
+    unsigned len;
+    switch (_regs[CC1101_PKTCTRL0] & 0x03) {
+        case 0:  len = _regs[CC1101_PKTLEN] ? _regs[CC1101_PKTLEN] : 256; break;
+        case 1:  len = _rxLen; break;
+        default: return;           // infinite
+    }
+    if (_rxBytes >= len) {
+        endOfPacket();
+    }
+}
+
+//
+// No sync word within RX_TIME: back to IDLE - with RX_TIME_QUAL, RX goes on
+// while a preamble is received (PQI)
+//
+void CC1101Sim::rxTimeoutReached()
+{
+    _rxEndUs = 0;
+    if (_receiving) {
+        return;
+    }
+    if ((_regs[CC1101_MCSM2] & 0x08) && _airNext != _airEnd && frame(_airNext)->start_us <= _now) {
+        return;
+    }
+    _stats.rx_timeouts++;
+    setState(SIM_IDLE);
+}
+
+void CC1101Sim::endOfPacket()
+{
+    _receiving  = false;
+    _rxHasFrame = false;
+    if (_regs[CC1101_PKTCTRL1] & PKTCTRL1_APPEND_STATUS) {
+        pushRx(cc1101RssiRaw(_rxRssi));
+        pushRx(0x80 | _rxLqi);
+    }
+    if (_state != SIM_RX) {
+        return;                    // overflow
+    }
+    _eop = true;
+    _stats.received++;
+
+    // RXOFF_MODE
+    if (((_regs[CC1101_MCSM1] >> 2) & 0x03) == 0x03) {
+        _state = SIM_RX;
+    } else {
+        setState(SIM_IDLE);
+    }
+}
+
+void CC1101Sim::startTx()
+{
+    unsigned len;
+    switch (_regs[CC1101_PKTCTRL0] & 0x03) {
+        case 0:  len = _regs[CC1101_PKTLEN] ? _regs[CC1101_PKTLEN] : 256; break;
+        case 1:  len = _txCount ? _txFifo[0] + 1 : 1; break;
+        default: len = _txCount; break;
+    }
+    unsigned mode     = _regs[CC1101_MDMCFG2] & 0x03;
+    unsigned preamble = preambleBytes[(_regs[CC1101_MDMCFG1] >> 4) & 0x07];
+    unsigned sync     = (mode == 0) ? 0 : (mode == 3) ? 4 : 2;
+
+    setState(SIM_TX);
+    _txLen      = len;
+    _txStartUs  = _now;
+    _txSyncUs   = _now + (uint64_t)(preamble + sync) * byteUs();
+    _txEndUs    = _txSyncUs + (uint64_t)len * byteUs();
+    _txNotified = false;
+
+    // Packet complete in the FIFO - announce it now, so a receiver model can
+    // be given the frame before its time on air has begun
+    if (_txCount >= _txLen) {
+        notifyTx(preamble);
+    }
+}
+
+void CC1101Sim::notifyTx(unsigned preamble)
+{
+    _txNotified = true;
+    if (!_txFn) {
+        return;
+    }
+    SimFrame f;
+    memset(&f, 0, sizeof(f));
+    f.start_us      = _txStartUs;
+    f.frequency_hz  = frequency();
+    f.rssi          = SIM_TX_RSSI;
+    f.lqi           = 3;
+    f.preamble_bits = preamble * 8;
+    f.sync          = (_regs[CC1101_SYNC1] << 8) | _regs[CC1101_SYNC0];
+    f.len           = _txLen;
+    memcpy(f.data, _txFifo, _txLen);
+    _txFn(&f, _txCtx);
+}
+
+void CC1101Sim::endTx()
+{
+    if (_txCount < _txLen) {
+        _stats.underflows++;
+        setState(SIM_TX_UNDERFLOW);
+        return;
+    }
+    if (!_txNotified) {
+        notifyTx(preambleBytes[(_regs[CC1101_MDMCFG1] >> 4) & 0x07]);
+    }
+    memmove(_txFifo, &_txFifo[_txLen], _txCount - _txLen);
+    _txCount -= _txLen;
+    _stats.transmitted++;
+
+    // TXOFF_MODE
+    switch (_regs[CC1101_MCSM1] & 0x03) {
+        case 2:  startTx(); break;
+        case 3:  setState(SIM_RX); break;
+        default: setState(SIM_IDLE); break;
+    }
+}
+
+uint64_t CC1101Sim::nextEvent() const
+{
+    uint64_t next = UINT64_MAX;
+    if (_state == SIM_TX) {
+        next = _txEndUs;
+    }
+    if (_receiving) {
+        uint64_t t = _rxSyncUs + (uint64_t)(_rxBytes + 1) * byteUs();
+        next = (t < next) ? t : next;
+    }
+    if (_airNext != _airEnd) {
+        uint64_t t = syncTime(frame(_airNext));
+        next = (t < next) ? t : next;
+    }
+    if (_linkModel && _noiseSyncUs < next) {
+        next = _noiseSyncUs;
+    }
+    if (_state == SIM_RX && _rxEndUs != 0 && _rxEndUs < next) {
+        next = _rxEndUs;
+    }
+    return next;
+}
+
+void CC1101Sim::step(uint64_t t)
+{
+    _now = (t > _now) ? t : _now;
+
+    if (_state == SIM_TX && _now >= _txEndUs) {
+        endTx();
+    }
+    if (_receiving && _now >= _rxSyncUs + (uint64_t)(_rxBytes + 1) * byteUs()) {
+        rxByte();
+    }
+    if (_airNext != _airEnd && _now >= syncTime(frame(_airNext))) {
+        const SimFrame *f = frame(_airNext);
+        if (_receiving) {
+            _stats.collisions++;
+        } else if (accept(f)) {
+            _receiving  = true;
+            _rxEndUs    = 0;
+            _rxHasFrame = true;
+            _rxSeq      = _airNext;
+            _rxBytes    = 0;
+            _rxSyncUs   = syncTime(f);
+            _rxRssi     = f->rssi;
+            _rxLqi      = f->lqi & 0x7f;
+        }
+        _airNext++;
+    }
+    if (_state == SIM_RX && _rxEndUs != 0 && _now >= _rxEndUs) {
+        rxTimeoutReached();
+    }
+    if (_linkModel && _now >= _noiseSyncUs) {
+        if (_state == SIM_RX && !_receiving && _noiseSyncUs != 0) {
+            noiseSync();
+        }
+        // Exponential intervals
+        double rate = noiseSyncRate();
+        double u    = (random() + 1.0) / 4294967296.0;
+        _noiseSyncUs = _now + ((rate > 0) ? (uint64_t)(-log(u) / rate) + 1 : 1000000);
+    }
+}
+
+void CC1101Sim::advance(uint64_t now_us)
+{
+    uint64_t next;
+    while ((next = nextEvent()) <= now_us) {
+        step(next);
+    }
+    _now = (now_us > _now) ? now_us : _now;
+    purge();
+#ifdef CLOCK_VIRTUAL
+    clockVirtualUs() = _now;
+#endif
+}
+
+bool CC1101Sim::waitGdo(int pin, bool level, uint32_t us)
+{
+    uint64_t deadline = _now + us;
+    while (pin < 0 || gdo(pin) != level) {
+        uint64_t next = nextEvent();
+        if (next > deadline) {
+            advance(deadline);
+            return pin >= 0 && gdo(pin) == level;
+        }
+        advance(next);
+    }
+    return true;
+}
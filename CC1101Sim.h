@@ -0,0 +1,246 @@
+/*
+CC1101Sim - software model of the CC1101 behind the CC1101Bus interface
+
+Allows the receive path (RadioArray, LowPowerRx, decoders, ...) to run on a
+host without hardware, at many times real-time:
+
+    CC1101Sim sim;
+    sim.writeReg(CC1101_PKTLEN, 27);            // or apply a register image
+    sim.strobe(CC1101_SRX);
+    SimFrame f = {...};                         // bytes following the sync word
+    sim.inject(&f);
+    sim.advance(now_us);                        // run the model up to now_us
+
+Modelled:
+- register file with reset values, PATABLE, status registers (MARCSTATE,
+  RXBYTES, TXBYTES, RSSI, LQI, FREQEST, PKTSTATUS)
+- states SLEEP, IDLE, RX, TX, WOR and FIFO overflow/underflow, with the
+  chip status byte returned by strobes
+- 64-byte RX and TX FIFOs, filled/drained at the configured data rate
+  (MDMCFG4/MDMCFG3), fixed, variable and infinite packet length (PKTLEN is
+  evaluated while receiving), appended RSSI/LQI (PKTCTRL1), RXOFF_MODE and
+  TXOFF_MODE (MCSM1)
+- sync word (MDMCFG2 SYNC_MODE, SYNC1/SYNC0), channel filter bandwidth
+  around FREQ + FSCTRL0 offset, overlapping frames (the later one is lost)
+- carrier sense qualified sync (SYNC_MODE 5..7): the RSSI must reach
+  SIM_CS_BASE_DBM + CARRIER_SENSE_ABS_THR (AGCCTRL1); preamble quality
+  threshold (PKTCTRL1 PQT)
+- GDO0/GDO2 signals 0x00, 0x01 (RX FIFO threshold), 0x06 (sync word/end of
+  packet), 0x0E (carrier sense), 0x29 (CHIP_RDYn), with GDOx_INV
+- Wake-On-Radio: a frame is caught if an EVENT0 RX slot starts during its
+  preamble
+- RX timeout (MCSM2 RX_TIME, RX_TIME_QUAL) in normal RX, too: without a sync
+  word the radio returns to IDLE
+- transmission (STX) with the configured preamble and sync word; packets
+  are handed to onTransmit(), e.g. to inject them into a second model
+
+- optional link model (setLinkModel()): the signal-to-noise ratio of a frame
+  (RSSI above the noise, less the attenuation of a signal shifted towards
+  the edge of the channel filter) gives a bit error rate; the sync word is
+  missed or the data bytes are corrupted accordingly. Noise matches the sync
+  word now and then (2^-16 per bit for 16/16, 17 * 2^-16 for 15/16) - a
+  packet of noise is received unless PQT or carrier sense reject it. The
+  RSSI read on noise varies by +-SIM_NOISE_JITTER dB.
+
+Not modelled: AGC, calibration timing, CRC, address filtering, whitening
+and Manchester coding. Without the link model, bit errors and collisions
+are the business of the traffic source.
+
+Time is a 64-bit microsecond counter set by advance(); with CLOCK_VIRTUAL
+defined it also drives clockMicros()/clockMillis(). waitGdo() advances the
+simulation instead of polling, so code waiting for the radio runs unchanged.
+*/
+#ifndef CC1101_SIM_H
+#define CC1101_SIM_H
+
+#include <stdint.h>
+#include "CC1101Bus.h"
+
+// Frames queued on air
+#ifndef SIM_AIR_FRAMES
+#define SIM_AIR_FRAMES 32
+#endif
+
+#define SIM_FRAME_SIZE 255
+
+struct SimFrame {
+    uint64_t start_us;             // start of preamble
+    float    frequency_hz;         // 0: exactly on the tuned frequency
+    float    rssi;                 // dBm
+    uint8_t  lqi;
+    uint8_t  preamble_bits;        // 0: 32
+    uint16_t sync;                 // sync word
+    uint8_t  len;
+    uint8_t  data[SIM_FRAME_SIZE]; // bytes following the sync word
+};
+
+// RSSI of transmitted frames at a receiver (dBm)
+#ifndef SIM_TX_RSSI
+#define SIM_TX_RSSI -50
+#endif
+
+// Link model: SNR (dB) for a bit error rate of 1e-3
+#ifndef SIM_SNR_1E3
+#define SIM_SNR_1E3 8.0f
+#endif
+
+// RSSI (dBm) at which carrier sense is asserted with CARRIER_SENSE_ABS_THR 0
+#ifndef SIM_CS_BASE_DBM
+#define SIM_CS_BASE_DBM -95.0f
+#endif
+
+// Link model: variation of the noise RSSI (dB, uniform +-)
+#ifndef SIM_NOISE_JITTER
+#define SIM_NOISE_JITTER 3.0f
+#endif
+
+// Transmitted packet, e.g. to be injected into the model of a receiver -
+// called on STX if the packet is complete in the TX FIFO, else at its end
+typedef void (*SimTxFn)(const SimFrame *frame, void *ctx);
+
+struct SimStats {
+    uint32_t on_air;               // frames injected
+    uint32_t received;             // packets completed
+    uint32_t not_listening;        // frames missed (not in RX)
+    uint32_t sync_mismatch;
+    uint32_t off_channel;          // outside of channel filter bandwidth
+    uint32_t weak;                 // sync word missed (link model)
+    uint32_t below_cs;             // frames below the carrier sense threshold
+    uint32_t noise_syncs;          // sync word matched by noise (link model)
+    uint32_t pqt_rejected;         // noise syncs rejected by PQT
+    uint32_t cs_rejected;          // noise syncs rejected by carrier sense
+    uint32_t bit_errors;           // bits flipped in received frames (link model)
+    uint32_t collisions;           // frames lost while receiving another one
+    uint32_t rx_timeouts;          // RX left without sync word (MCSM2 RX_TIME)
+    uint32_t overflows;            // RX FIFO overflows
+    uint32_t underflows;           // TX FIFO underflows
+    uint32_t transmitted;
+    uint32_t spi_accesses;         // strobes, register and burst accesses
+};
+
+class CC1101Sim : public CC1101Bus {
+public:
+    CC1101Sim();
+
+    // CC1101Bus
+    uint8_t strobe(uint8_t cmd) override;
+    uint8_t readReg(uint8_t addr) override;
+    void    writeReg(uint8_t addr, uint8_t value) override;
+    void    readBurst(uint8_t addr, uint8_t *buf, uint8_t len) override;
+    void    writeBurst(uint8_t addr, const uint8_t *buf, uint8_t len) override;
+    bool    gdo(uint8_t pin) override;
+    bool    waitGdo(int pin, bool level, uint32_t us) override;
+
+    // Queue frame - frames must be injected in order of start_us
+    bool inject(const SimFrame *frame);
+
+    // Queue frame given as hex string (e.g. a recorded frame "d4 2a af ..."),
+    // sync word taken from SYNC1/SYNC0
+    bool injectHex(const char *hex, uint64_t start_us, float rssi);
+
+    // Run the model up to now_us
+    void advance(uint64_t now_us);
+    uint64_t now() const { return _now; }
+
+    // Background RSSI (dBm)
+    void setNoise(float rssi) { _noise = rssi; }
+
+    // Bit errors from SNR and frequency offset
+    void setLinkModel(bool on) { _linkModel = on; }
+
+    void onTransmit(SimTxFn fn, void *ctx) { _txFn = fn; _txCtx = ctx; }
+
+    // Derived from the registers
+    float dataRate() const;        // bit/s
+    float frequency() const;       // Hz, incl. FSCTRL0 offset
+    float bandwidth() const;       // Hz
+    float deviation() const;       // Hz
+
+    const SimStats& stats() const { return _stats; }
+
+private:
+    enum State { SIM_SLEEP, SIM_IDLE, SIM_RX, SIM_RX_OVERFLOW, SIM_TX, SIM_TX_UNDERFLOW, SIM_WOR };
+
+    void     reset();
+    void     wake();
+    void     setState(State s);
+    void     enterRx();
+    uint8_t  status() const;
+    uint8_t  marcState() const;
+    uint8_t  statusReg(uint8_t addr);
+    uint32_t byteUs() const;
+    bool     signal(uint8_t cfg) const;
+    bool     carrierSense() const;
+    double   worPeriod() const;
+    double   rxTimeout() const;
+    void     rxTimeoutReached();
+    bool     listening(const SimFrame *f, uint64_t sync_us) const;
+    bool     accept(const SimFrame *f);
+    float    bitErrorRate(const SimFrame *f, float offset) const;
+    float    csThreshold() const;
+    double   noiseSyncRate() const;
+    void     noiseSync();
+    uint32_t random();
+    float    uniform(float lo, float hi);
+    void     purge();
+    uint64_t syncTime(const SimFrame *f) const;
+    uint64_t endTime(const SimFrame *f) const;
+    void     rxByte();
+    void     endOfPacket();
+    void     startTx();
+    void     endTx();
+    void     notifyTx(unsigned preamble);
+    void     pushRx(uint8_t b);
+    uint64_t nextEvent() const;
+    void     step(uint64_t t);
+    const SimFrame *frame(uint32_t seq) const { return &_air[seq % SIM_AIR_FRAMES]; }
+
+    uint8_t  _regs[CC1101_CONFIG_REGS];
+    uint8_t  _patable[8];
+    State    _state;
+    uint64_t _now;
+    uint64_t _worStart;            // WOR slots are counted from here
+    uint64_t _rxEndUs;             // RX_TIME timeout of the sync word search, 0: none
+
+    uint8_t  _rxFifo[CC1101_FIFO_SIZE];
+    unsigned _rxHead, _rxCount;
+    uint8_t  _txFifo[CC1101_FIFO_SIZE];
+    unsigned _txCount;
+
+    // Frames on air, numbered consecutively (slot: number % SIM_AIR_FRAMES)
+    SimFrame _air[SIM_AIR_FRAMES];
+    uint32_t _airFirst;            // oldest frame kept
+    uint32_t _airEnd;              // next frame to be injected
+    uint32_t _airNext;             // next frame whose sync has not been reached
+
+    // Packet being received
+    bool     _receiving;
+    bool     _rxHasFrame;          // false: frame is over, noise is received
+    uint32_t _rxSeq;               // frame number
+    unsigned _rxBytes;             // bytes received
+    unsigned _rxLen;               // variable packet length: length byte + 1
+    uint64_t _rxSyncUs;
+    float    _rxRssi;
+    uint8_t  _rxLqi;
+    int8_t   _freqEst;
+    float    _rxBer;               // bit error rate (link model)
+    bool     _eop;                 // end of packet reached, RX FIFO not yet empty
+
+    // Packet being transmitted
+    uint64_t _txStartUs;
+    uint64_t _txSyncUs;
+    uint64_t _txEndUs;
+    unsigned _txLen;
+    bool     _txNotified;
+
+    float    _noise;
+    uint16_t _lfsr;                // noise bytes
+    bool     _linkModel;
+    uint32_t _rng;                 // bit errors
+    uint64_t _noiseSyncUs;         // next sync word matched by noise
+    SimTxFn  _txFn;
+    void    *_txCtx;
+    SimStats _stats;
+};
+
+#endif // CC1101_SIM_H
@@ -0,0 +1,48 @@
+/*
+Portable millisecond/microsecond clock
+
+On the target these map to millis()/micros(); on a Linux host build
+(no ARDUINO defined) a monotonic clock is used instead, so modules
+using it can be compiled and run without the Arduino core.
+
+With CLOCK_VIRTUAL defined, time only advances when the program sets
+clockVirtualUs() (e.g. a simulation with CC1101Sim), so modules can be run
+at many times real-time and deterministically.
+*/
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+#if defined(CLOCK_VIRTUAL)
+
+// Virtual time (us) - one instance per program
+inline uint64_t& clockVirtualUs(void) {
+    static uint64_t us = 0;
+    return us;
+}
+
+static inline uint32_t clockMicros(void) { return (uint32_t)clockVirtualUs(); }
+static inline uint32_t clockMillis(void) { return (uint32_t)(clockVirtualUs() / 1000); }
+#elif defined(ARDUINO)
+#include <Arduino.h>
+
+static inline uint32_t clockMillis(void) { return millis(); }
+static inline uint32_t clockMicros(void) { return micros(); }
+#else
+#include <time.h>
+
+static inline uint32_t clockMicros(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000);
+}
+
+static inline uint32_t clockMillis(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000u + ts.tv_nsec / 1000000);
+}
+#endif
+
+#endif // CLOCK_H
@@ -0,0 +1,910 @@
+/*
+ColumnarExport - decoded readings as Arrow IPC (columnar, binary)
+
+See ColumnarExport.h. Format references: Arrow columnar format, "IPC
+Streaming Format" / "IPC File Format", and the FlatBuffers schemas
+Message.fbs, Schema.fbs and File.fbs (metadata version V5).
+*/
+#include "ColumnarExport.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__)
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "Columns are written in host byte order, declared little-endian");
+#endif
+static_assert(COLUMNAR_MAX_SENSORS <= 32767, "sensor_id indices are int16");
+static_assert(COLUMNAR_ROWS > 0, "COLUMNAR_ROWS must be positive");
+
+// Metadata version V5, MessageHeader and Type union members
+#define ARROW_VERSION_V5      4
+#define ARROW_SCHEMA          1
+#define ARROW_DICTIONARY      2
+#define ARROW_RECORD_BATCH    3
+#define ARROW_TYPE_INT        2
+#define ARROW_TYPE_FLOAT      3
+#define ARROW_TYPE_BOOL       6
+#define ARROW_TYPE_TIMESTAMP 10
+#define ARROW_FLOAT_SINGLE    1
+#define ARROW_UNIT_SECOND     0
+
+// Bytes of a Block struct in the footer
+#define ARROW_BLOCK_SIZE 24
+
+static const uint8_t ARROW_MAGIC[8] = { 'A', 'R', 'R', 'O', 'W', '1', 0, 0 };
+static const uint32_t ARROW_CONTINUATION = 0xFFFFFFFF;
+
+enum FieldKind { FIELD_TIME, FIELD_DICT, FIELD_U8, FIELD_BOOL, FIELD_F32 };
+
+static const struct {
+    const char *name;
+    FieldKind   kind;
+    bool        nullable;
+    uint8_t     width;             // bytes per value, 0: bits
+} FIELDS[COLUMNAR_COLUMNS] = {
+    { "time",                FIELD_TIME, false, 8 },
+    { "sensor_id",           FIELD_DICT, true,  2 },
+    { "chan",                FIELD_U8,   false, 1 },
+    { "battery_ok",          FIELD_BOOL, false, 0 },
+    { "temp_c",              FIELD_F32,  true,  4 },
+    { "humidity",            FIELD_U8,   true,  1 },
+    { "uv",                  FIELD_F32,  true,  4 },
+    { "wind_direction_deg",  FIELD_F32,  true,  4 },
+    { "wind_gust_meter_sec", FIELD_F32,  true,  4 },
+    { "wind_avg_meter_sec",  FIELD_F32,  true,  4 },
+    { "rain_mm",             FIELD_F32,  true,  4 },
+    { "moisture",            FIELD_U8,   true,  1 },
+    { "rssi",                FIELD_F32,  false, 4 },
+    { "lqi",                 FIELD_U8,   false, 1 }
+};
+
+static inline size_t pad8(size_t n)
+{
+    return (n + 7) & ~(size_t)7;
+}
+
+static inline size_t valueBytes(uint8_t width, uint32_t rows)
+{
+    return width ? (size_t)width * rows : (rows + 7) / 8;
+}
+
+static inline void setBit(uint8_t *bits, unsigned i)
+{
+    bits[i >> 3] |= 1 << (i & 7);
+}
+
+//
+// FlatBuffers builder on a fixed buffer - the buffer is filled from the end,
+// children before their parents. Offsets are counted from the end (used
+// bytes at the time an object was finished). On overflow, ok() turns false.
+//
+class FlatBuilder {
+public:
+    FlatBuilder(uint8_t *buf, size_t cap) : _buf(buf), _cap(cap), _used(0), _align(8), _ok(true), _objectStart(0), _slotCount(0) {}
+
+    bool ok() const { return _ok; }
+
+    // Finished buffer
+    const uint8_t *data() const { return _buf + _cap - _used; }
+    size_t size() const { return _used; }
+
+    template <typename T> void push(T v)
+    {
+        prep(sizeof(T), 0);
+        if (room(sizeof(T))) {
+            _used += sizeof(T);
+            memcpy(_buf + _cap - _used, &v, sizeof(T));
+        }
+    }
+
+    // Offset to ref, at the current position
+    void pushOffset(uint32_t ref)
+    {
+        prep(4, 0);
+        push<uint32_t>(_used + 4 - ref);
+    }
+
+    uint32_t createString(const char *s)
+    {
+        size_t len = strlen(s);
+        prep(4, len + 1);
+        push<uint8_t>(0);
+        if (room(len)) {
+            _used += len;
+            memcpy(_buf + _cap - _used, s, len);
+        }
+        push<uint32_t>(len);
+        return _used;
+    }
+
+    uint32_t createOffsets(const uint32_t *refs, unsigned n)
+    {
+        prep(4, 4 * n);
+        for (unsigned i = n; i-- > 0;) {
+            pushOffset(refs[i]);
+        }
+        push<uint32_t>(n);
+        return _used;
+    }
+
+    // Vector of structs of 64-bit members: elements pushed back to front
+    // between startStructs() and endStructs()
+    void startStructs(unsigned n, size_t structSize)
+    {
+        prep(4, n * structSize);
+        prep(8, n * structSize);
+    }
+
+    uint32_t endStructs(unsigned n)
+    {
+        push<uint32_t>(n);
+        return _used;
+    }
+
+    void startTable()
+    {
+        _objectStart = _used;
+        _slotCount   = 0;
+        memset(_slots, 0, sizeof(_slots));
+    }
+
+    template <typename T> void add(unsigned slot, T v)
+    {
+        push(v);
+        slotAt(slot);
+    }
+
+    void addOffset(unsigned slot, uint32_t ref)
+    {
+        pushOffset(ref);
+        slotAt(slot);
+    }
+
+    uint32_t endTable()
+    {
+        push<int32_t>(0);
+        uint32_t object = _used;
+        for (unsigned i = _slotCount; i-- > 0;) {
+            push<uint16_t>(_slots[i] ? object - _slots[i] : 0);
+        }
+        push<uint16_t>(object - _objectStart);
+        push<uint16_t>(4 + 2 * _slotCount);
+        if (_ok) {
+            int32_t soffset = _used - object;
+            memcpy(_buf + _cap - object, &soffset, 4);
+        }
+        return object;
+    }
+
+    void finish(uint32_t root)
+    {
+        prep(_align, 4);
+        pushOffset(root);
+    }
+
+private:
+    // Pad so that `size` is aligned after writing `extra` bytes
+    void prep(size_t size, size_t extra)
+    {
+        if (size > _align) {
+            _align = size;
+        }
+        size_t padding = (~(_used + extra) + 1) & (size - 1);
+        if (room(padding)) {
+            memset(_buf + _cap - _used - padding, 0, padding);
+            _used += padding;
+        }
+    }
+
+    bool room(size_t n)
+    {
+        if (_used + n > _cap) {
+            _ok = false;
+        }
+        return _ok;
+    }
+
+    void slotAt(unsigned slot)
+    {
+        if (slot >= sizeof(_slots) / sizeof(_slots[0])) {
+            _ok = false;
+            return;
+        }
+        _slots[slot] = _used;
+        if (slot + 1 > _slotCount) {
+            _slotCount = slot + 1;
+        }
+    }
+
+    uint8_t *_buf;
+    size_t   _cap;
+    size_t   _used;
+    size_t   _align;
+    bool     _ok;
+    size_t   _objectStart;
+    uint32_t _slots[8];
+    unsigned _slotCount;
+};
+
+static uint32_t createInt(FlatBuilder &fb, int32_t bitWidth, bool isSigned)
+{
+    fb.startTable();
+    fb.add<int32_t>(0, bitWidth);
+    fb.add<uint8_t>(1, isSigned);
+    return fb.endTable();
+}
+
+static uint32_t createSchema(FlatBuilder &fb)
+{
+    uint32_t fields[COLUMNAR_COLUMNS];
+    for (unsigned c = 0; c < COLUMNAR_COLUMNS; c++) {
+        uint32_t name = fb.createString(FIELDS[c].name);
+        uint32_t children = fb.createOffsets(nullptr, 0);
+        uint32_t dictionary = 0;
+        uint32_t type;
+        uint8_t  typeType;
+
+        switch (FIELDS[c].kind) {
+        case FIELD_TIME: {
+            uint32_t tz = fb.createString("UTC");
+            fb.startTable();
+            fb.add<int16_t>(0, ARROW_UNIT_SECOND);
+            fb.addOffset(1, tz);
+            type     = fb.endTable();
+            typeType = ARROW_TYPE_TIMESTAMP;
+            break;
+        }
+        case FIELD_DICT: {
+            uint32_t index = createInt(fb, 16, true);
+            fb.startTable();
+            fb.add<int64_t>(0, 0);
+            fb.addOffset(1, index);
+            fb.add<uint8_t>(2, false);
+            dictionary = fb.endTable();
+            type       = createInt(fb, 32, false);
+            typeType   = ARROW_TYPE_INT;
+            break;
+        }
+        case FIELD_U8:
+            type     = createInt(fb, 8, false);
+            typeType = ARROW_TYPE_INT;
+            break;
+        case FIELD_BOOL:
+            fb.startTable();
+            type     = fb.endTable();
+            typeType = ARROW_TYPE_BOOL;
+            break;
+        default:
+            fb.startTable();
+            fb.add<int16_t>(0, ARROW_FLOAT_SINGLE);
+            type     = fb.endTable();
+            typeType = ARROW_TYPE_FLOAT;
+            break;
+        }
+
+        fb.startTable();
+        fb.addOffset(0, name);
+        fb.add<uint8_t>(1, FIELDS[c].nullable);
+        fb.add<uint8_t>(2, typeType);
+        fb.addOffset(3, type);
+        if (dictionary) {
+            fb.addOffset(4, dictionary);
+        }
+        fb.addOffset(5, children);
+        fields[c] = fb.endTable();
+    }
+    uint32_t vec = fb.createOffsets(fields, COLUMNAR_COLUMNS);
+
+    fb.startTable();
+    fb.add<int16_t>(0, 0);             // little-endian
+    fb.addOffset(1, vec);
+    return fb.endTable();
+}
+
+// FieldNode { length, null_count } and Buffer { offset, length } structs
+static void pushPair(FlatBuilder &fb, int64_t first, int64_t second)
+{
+    fb.push<int64_t>(second);
+    fb.push<int64_t>(first);
+}
+
+static uint32_t createMessage(FlatBuilder &fb, uint8_t headerType, uint32_t header, uint64_t bodyLen)
+{
+    fb.startTable();
+    fb.add<int16_t>(0, ARROW_VERSION_V5);
+    fb.add<uint8_t>(1, headerType);
+    fb.addOffset(2, header);
+    fb.add<int64_t>(3, bodyLen);
+    return fb.endTable();
+}
+
+//
+// Writer
+//
+ColumnarWriter::ColumnarWriter() : _sink(nullptr), _ctx(nullptr), _file(false), _ok(false), _offset(0), _rows(0),
+                                   _dictWritten(0), _blockCount(0)
+{
+    memset(_valid, 0, sizeof(_valid));
+    memset(_nulls, 0, sizeof(_nulls));
+    memset(_battery, 0, sizeof(_battery));
+    memset(_slots, 0, sizeof(_slots));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool ColumnarWriter::begin(ColumnarSink sink, void *ctx, bool file)
+{
+    _sink        = sink;
+    _ctx         = ctx;
+    _file        = file;
+    _ok          = true;
+    _offset      = 0;
+    _rows        = 0;
+    _dictWritten = 0;
+    _blockCount  = 0;
+    memset(_valid, 0, sizeof(_valid));
+    memset(_nulls, 0, sizeof(_nulls));
+    memset(_battery, 0, sizeof(_battery));
+    memset(_slots, 0, sizeof(_slots));
+    memset(&_stats, 0, sizeof(_stats));
+
+    if (_file && !write(ARROW_MAGIC, sizeof(ARROW_MAGIC))) {
+        return false;
+    }
+    FlatBuilder fb(_meta, COLUMNAR_META_SIZE);
+    uint32_t schema = createSchema(fb);
+    fb.finish(createMessage(fb, ARROW_SCHEMA, schema, 0));
+    if (!fb.ok()) {
+        _ok = false;
+        return false;
+    }
+    return message(fb.data(), fb.size(), 0, MESSAGE_SCHEMA);
+}
+
+bool ColumnarWriter::write(const void *data, size_t len)
+{
+    if (!_ok || !_sink(static_cast<const uint8_t *>(data), len, _ctx)) {
+        _ok = false;
+        return false;
+    }
+    _offset       += len;
+    _stats.bytes  += len;
+    return true;
+}
+
+bool ColumnarWriter::pad(size_t len)
+{
+    static const uint8_t zeros[8] = { 0 };
+    return len == 0 || write(zeros, len);
+}
+
+//
+// Encapsulated message: continuation marker, metadata length, metadata
+// (padded to 8 bytes) - the body follows
+//
+bool ColumnarWriter::message(const uint8_t *meta, unsigned metaLen, uint64_t bodyLen, MessageKind kind)
+{
+    if (_file && kind != MESSAGE_SCHEMA) {
+        if (_blockCount == COLUMNAR_MAX_BLOCKS) {
+            _ok = false;
+            return false;
+        }
+        Block *b      = &_blocks[_blockCount++];
+        b->offset     = _offset;
+        b->meta_len   = 8 + pad8(metaLen);
+        b->body_len   = bodyLen;
+        b->dictionary = (kind == MESSAGE_DICTIONARY);
+    }
+    int32_t len = pad8(metaLen);
+    return write(&ARROW_CONTINUATION, 4) && write(&len, 4) && write(meta, metaLen) && pad(len - metaLen);
+}
+
+int ColumnarWriter::sensorIndex(uint32_t sensor_id)
+{
+    const unsigned size = sizeof(_slots) / sizeof(_slots[0]);
+    unsigned i = (sensor_id * 2654435761u) % size;
+    while (_slots[i]) {
+        if (_dict[_slots[i] - 1] == sensor_id) {
+            return _slots[i] - 1;
+        }
+        i = (i + 1) % size;
+    }
+    if (_stats.sensors == COLUMNAR_MAX_SENSORS) {
+        return -1;
+    }
+    _dict[_stats.sensors] = sensor_id;
+    _slots[i] = ++_stats.sensors;
+    return _slots[i] - 1;
+}
+
+void ColumnarWriter::valid(ColumnarColumn c, unsigned row, bool ok)
+{
+    if (ok) {
+        setBit(_valid[c], row);
+    } else {
+        _nulls[c]++;
+    }
+}
+
+bool ColumnarWriter::add(const WeatherData *pData, uint32_t timestamp, float rssi, uint8_t lqi)
+{
+    if (!_ok) {
+        return false;
+    }
+    unsigned r = _rows;
+
+    int index = sensorIndex(pData->sensor_id);
+    if (index < 0) {
+        _stats.unknown++;
+    }
+    _time[r]     = timestamp;
+    _sensor[r]   = (index < 0) ? 0 : index;
+    _chan[r]     = pData->chan;
+    if (pData->battery_ok) {
+        setBit(_battery, r);
+    }
+    _temp[r]     = pData->temp_ok ? pData->temp_c : 0;
+    _humidity[r] = pData->temp_ok ? pData->humidity : 0;
+    _uv[r]       = pData->uv_ok ? pData->uv : 0;
+    _windDir[r]  = pData->wind_ok ? pData->wind_direction_deg : 0;
+    _gust[r]     = pData->wind_ok ? pData->wind_gust_meter_sec : 0;
+    _windAvg[r]  = pData->wind_ok ? pData->wind_avg_meter_sec : 0;
+    _rain[r]     = pData->rain_ok ? pData->rain_mm : 0;
+    _moisture[r] = pData->moisture_ok ? pData->moisture : 0;
+    _rssi[r]     = rssi;
+    _lqi[r]      = lqi;
+
+    valid(COLUMNAR_TIME,           r, true);
+    valid(COLUMNAR_SENSOR_ID,      r, index >= 0);
+    valid(COLUMNAR_CHAN,           r, true);
+    valid(COLUMNAR_BATTERY_OK,     r, true);
+    valid(COLUMNAR_TEMP_C,         r, pData->temp_ok);
+    valid(COLUMNAR_HUMIDITY,       r, pData->temp_ok);
+    valid(COLUMNAR_UV,             r, pData->uv_ok);
+    valid(COLUMNAR_WIND_DIRECTION, r, pData->wind_ok);
+    valid(COLUMNAR_WIND_GUST,      r, pData->wind_ok);
+    valid(COLUMNAR_WIND_AVG,       r, pData->wind_ok);
+    valid(COLUMNAR_RAIN_MM,        r, pData->rain_ok);
+    valid(COLUMNAR_MOISTURE,       r, pData->moisture_ok);
+    valid(COLUMNAR_RSSI,           r, true);
+    valid(COLUMNAR_LQI,            r, true);
+
+    _rows++;
+    _stats.rows++;
+    return (_rows < COLUMNAR_ROWS) || flush();
+}
+
+//
+// Delta dictionary batch (the first one: the dictionary) of the IDs added
+// since the last batch
+//
+bool ColumnarWriter::writeDictionary()
+{
+    unsigned first = _dictWritten;
+    unsigned n     = _stats.sensors - first;
+    size_t   bytes = 4 * n;
+
+    FlatBuilder fb(_meta, COLUMNAR_META_SIZE);
+    fb.startStructs(2, 16);
+    pushPair(fb, 0, bytes);
+    pushPair(fb, 0, 0);
+    uint32_t buffers = fb.endStructs(2);
+    fb.startStructs(1, 16);
+    pushPair(fb, n, 0);
+    uint32_t nodes = fb.endStructs(1);
+    fb.startTable();
+    fb.add<int64_t>(0, n);
+    fb.addOffset(1, nodes);
+    fb.addOffset(2, buffers);
+    uint32_t data = fb.endTable();
+    fb.startTable();
+    fb.add<int64_t>(0, 0);
+    fb.addOffset(1, data);
+    fb.add<uint8_t>(2, first > 0);
+    uint32_t header = fb.endTable();
+    fb.finish(createMessage(fb, ARROW_DICTIONARY, header, pad8(bytes)));
+    if (!fb.ok()) {
+        _ok = false;
+        return false;
+    }
+    if (!message(fb.data(), fb.size(), pad8(bytes), MESSAGE_DICTIONARY) || !write(&_dict[first], bytes) ||
+        !pad(pad8(bytes) - bytes)) {
+        return false;
+    }
+    _dictWritten = _stats.sensors;
+    return true;
+}
+
+bool ColumnarWriter::flush()
+{
+    if (!_ok) {
+        return false;
+    }
+    if (_rows == 0) {
+        return true;
+    }
+    if (_dictWritten < _stats.sensors && !writeDictionary()) {
+        return false;
+    }
+
+    const void *values[COLUMNAR_COLUMNS] = {
+        _time, _sensor, _chan, _battery, _temp, _humidity, _uv, _windDir, _gust, _windAvg, _rain, _moisture, _rssi, _lqi
+    };
+    size_t validLen[COLUMNAR_COLUMNS];
+    size_t valueLen[COLUMNAR_COLUMNS];
+    uint64_t body = 0;
+    for (unsigned c = 0; c < COLUMNAR_COLUMNS; c++) {
+        validLen[c] = _nulls[c] ? (_rows + 7) / 8 : 0;
+        valueLen[c] = valueBytes(FIELDS[c].width, _rows);
+        body += pad8(validLen[c]) + pad8(valueLen[c]);
+    }
+
+    // Structs are pushed back to front
+    FlatBuilder fb(_meta, COLUMNAR_META_SIZE);
+    fb.startStructs(2 * COLUMNAR_COLUMNS, 16);
+    uint64_t offset = body;
+    for (unsigned c = COLUMNAR_COLUMNS; c-- > 0;) {
+        offset -= pad8(valueLen[c]);
+        pushPair(fb, offset, valueLen[c]);
+        offset -= pad8(validLen[c]);
+        pushPair(fb, offset, validLen[c]);
+    }
+    uint32_t buffers = fb.endStructs(2 * COLUMNAR_COLUMNS);
+    fb.startStructs(COLUMNAR_COLUMNS, 16);
+    for (unsigned c = COLUMNAR_COLUMNS; c-- > 0;) {
+        pushPair(fb, _rows, _nulls[c]);
+    }
+    uint32_t nodes = fb.endStructs(COLUMNAR_COLUMNS);
+    fb.startTable();
+    fb.add<int64_t>(0, _rows);
+    fb.addOffset(1, nodes);
+    fb.addOffset(2, buffers);
+    uint32_t header = fb.endTable();
+    fb.finish(createMessage(fb, ARROW_RECORD_BATCH, header, body));
+    if (!fb.ok()) {
+        _ok = false;
+        return false;
+    }
+
+    if (!message(fb.data(), fb.size(), body, MESSAGE_BATCH)) {
+        return false;
+    }
+    for (unsigned c = 0; c < COLUMNAR_COLUMNS; c++) {
+        if (!write(_valid[c], validLen[c]) || !pad(pad8(validLen[c]) - validLen[c]) ||
+            !write(values[c], valueLen[c]) || !pad(pad8(valueLen[c]) - valueLen[c])) {
+            return false;
+        }
+    }
+
+    _stats.batches++;
+    _rows = 0;
+    memset(_valid, 0, sizeof(_valid));
+    memset(_nulls, 0, sizeof(_nulls));
+    memset(_battery, 0, sizeof(_battery));
+    return true;
+}
+
+bool ColumnarWriter::finish()
+{
+    if (!flush()) {
+        return false;
+    }
+    const uint32_t eos[2] = { ARROW_CONTINUATION, 0 };
+    if (!write(eos, sizeof(eos))) {
+        return false;
+    }
+    if (_file) {
+        // Footer: schema and blocks of the dictionary and record batches
+        FlatBuilder fb(_meta, sizeof(_meta));
+        uint32_t vectors[2];
+        for (int dictionary = 1; dictionary >= 0; dictionary--) {
+            unsigned n = 0;
+            for (unsigned i = 0; i < _blockCount; i++) {
+                n += (_blocks[i].dictionary == (dictionary != 0));
+            }
+            fb.startStructs(n, ARROW_BLOCK_SIZE);
+            for (unsigned i = _blockCount; i-- > 0;) {
+                const Block *b = &_blocks[i];
+                if (b->dictionary == (dictionary != 0)) {
+                    fb.push<int64_t>(b->body_len);
+                    fb.push<int32_t>(0);
+                    fb.push<int32_t>(b->meta_len);
+                    fb.push<int64_t>(b->offset);
+                }
+            }
+            vectors[dictionary] = fb.endStructs(n);
+        }
+        uint32_t schema = createSchema(fb);
+        fb.startTable();
+        fb.add<int16_t>(0, ARROW_VERSION_V5);
+        fb.addOffset(1, schema);
+        fb.addOffset(2, vectors[1]);
+        fb.addOffset(3, vectors[0]);
+        fb.finish(fb.endTable());
+        if (!fb.ok()) {
+            _ok = false;
+            return false;
+        }
+        int32_t len = fb.size();
+        if (!write(fb.data(), len) || !write(&len, 4) || !write(ARROW_MAGIC, 6)) {
+            return false;
+        }
+    }
+    _ok = false;
+    return true;
+}
+
+//
+// Reader - FlatBuffers access with bounds checks against the file
+//
+struct FlatView {
+    const uint8_t *begin;
+    const uint8_t *end;
+
+    bool inside(const uint8_t *p, size_t n) const
+    {
+        return p && p >= begin && p <= end && n <= (size_t)(end - p);
+    }
+
+    template <typename T> T read(const uint8_t *p) const
+    {
+        T v;
+        memcpy(&v, p, sizeof(T));
+        return v;
+    }
+
+    // Target of the offset at p
+    const uint8_t *deref(const uint8_t *p) const
+    {
+        if (!inside(p, 4)) {
+            return nullptr;
+        }
+        const uint8_t *q = p + read<uint32_t>(p);
+        return inside(q, 4) ? q : nullptr;
+    }
+
+    // Address of a table field - nullptr if absent
+    const uint8_t *field(const uint8_t *table, unsigned slot, size_t n) const
+    {
+        if (!inside(table, 4)) {
+            return nullptr;
+        }
+        const uint8_t *vtable = table - read<int32_t>(table);
+        if (!inside(vtable, 4)) {
+            return nullptr;
+        }
+        uint16_t vsize = read<uint16_t>(vtable);
+        if (4 + 2 * slot + 2 > vsize || !inside(vtable, vsize)) {
+            return nullptr;
+        }
+        uint16_t off = read<uint16_t>(vtable + 4 + 2 * slot);
+        return (off && inside(table + off, n)) ? table + off : nullptr;
+    }
+
+    template <typename T> T scalar(const uint8_t *table, unsigned slot, T def) const
+    {
+        const uint8_t *p = field(table, slot, sizeof(T));
+        return p ? read<T>(p) : def;
+    }
+
+    const uint8_t *table(const uint8_t *table, unsigned slot) const
+    {
+        return deref(field(table, slot, 4));
+    }
+
+    // Elements of a vector field - nullptr if absent or out of bounds
+    const uint8_t *vector(const uint8_t *table, unsigned slot, size_t elemSize, unsigned *pCount) const
+    {
+        const uint8_t *v = this->table(table, slot);
+        if (!v) {
+            return nullptr;
+        }
+        uint32_t n = read<uint32_t>(v);
+        if (!inside(v + 4, (uint64_t)n * elemSize)) {
+            return nullptr;
+        }
+        *pCount = n;
+        return v + 4;
+    }
+};
+
+ColumnarReader::ColumnarReader() : _data(nullptr), _len(0), _dictBlocks(nullptr), _batchBlocks(nullptr), _dictionaries(0),
+                                   _batches(0)
+{
+}
+
+bool ColumnarReader::open(const uint8_t *data, size_t len)
+{
+    _dictionaries = _batches = 0;
+    if (len < 8 + 4 + 6 || memcmp(data, ARROW_MAGIC, 6) != 0 || memcmp(data + len - 6, ARROW_MAGIC, 6) != 0) {
+        return false;
+    }
+    FlatView v = { data, data + len };
+    int32_t footerLen = v.read<int32_t>(data + len - 10);
+    if (footerLen < 8 || (size_t)footerLen > len - 8 - 10) {
+        return false;
+    }
+    const uint8_t *footer = v.deref(data + len - 10 - footerLen);
+
+    // Written by ColumnarWriter?
+    unsigned n;
+    const uint8_t *fields = v.vector(v.table(footer, 1), 1, 4, &n);
+    if (!fields || n != COLUMNAR_COLUMNS) {
+        return false;
+    }
+    for (unsigned c = 0; c < COLUMNAR_COLUMNS; c++) {
+        const uint8_t *name = v.table(v.deref(fields + 4 * c), 0);
+        size_t nameLen = strlen(FIELDS[c].name);
+        if (!name || v.read<uint32_t>(name) != nameLen || !v.inside(name + 4, nameLen) ||
+            memcmp(name + 4, FIELDS[c].name, nameLen) != 0) {
+            return false;
+        }
+    }
+
+    _dictBlocks  = v.vector(footer, 2, ARROW_BLOCK_SIZE, &_dictionaries);
+    _batchBlocks = v.vector(footer, 3, ARROW_BLOCK_SIZE, &_batches);
+    if (!_dictBlocks) {
+        _dictionaries = 0;
+    }
+    if (!_batchBlocks) {
+        _batches = 0;
+    }
+    _data = data;
+    _len  = len;
+    return true;
+}
+
+//
+// Header of the message at a footer block, if of the type - its body
+//
+const uint8_t *ColumnarReader::message(const uint8_t *block, unsigned type, const uint8_t **pBody, uint64_t *pBodyLen) const
+{
+    FlatView v = { _data, _data + _len };
+    uint64_t offset   = v.read<uint64_t>(block);
+    uint32_t metaLen  = v.read<uint32_t>(block + 8);
+    uint64_t bodyLen  = v.read<uint64_t>(block + 16);
+    if (offset > _len || metaLen < 8 || metaLen > _len - offset || bodyLen > _len - offset - metaLen) {
+        return nullptr;
+    }
+    const uint8_t *p = _data + offset;
+    if (v.read<uint32_t>(p) != ARROW_CONTINUATION) {
+        return nullptr;
+    }
+    const uint8_t *msg = v.deref(p + 8);
+    if (!msg || v.scalar<uint8_t>(msg, 1, 0) != type) {
+        return nullptr;
+    }
+    *pBody    = p + metaLen;
+    *pBodyLen = bodyLen;
+    return v.table(msg, 2);
+}
+
+bool ColumnarReader::batch(unsigned i, ColumnarBatch *pBatch) const
+{
+    if (i >= _batches) {
+        return false;
+    }
+    FlatView v = { _data, _data + _len };
+    const uint8_t *body;
+    uint64_t bodyLen;
+    const uint8_t *rb = message(_batchBlocks + i * ARROW_BLOCK_SIZE, ARROW_RECORD_BATCH, &body, &bodyLen);
+    unsigned n;
+    const uint8_t *buffers = v.vector(rb, 2, 16, &n);
+    if (!buffers || n != 2 * COLUMNAR_COLUMNS) {
+        return false;
+    }
+    int64_t rows = v.scalar<int64_t>(rb, 0, 0);
+    if (rows < 0 || rows > 0xFFFFFFFF) {
+        return false;
+    }
+    pBatch->rows = rows;
+
+    for (unsigned c = 0; c < COLUMNAR_COLUMNS; c++) {
+        const uint8_t *buf[2];
+        for (unsigned k = 0; k < 2; k++) {
+            uint64_t off = v.read<uint64_t>(buffers + 16 * (2 * c + k));
+            uint64_t len = v.read<uint64_t>(buffers + 16 * (2 * c + k) + 8);
+            size_t   min = k ? valueBytes(FIELDS[c].width, rows) : (rows + 7) / 8;
+            if (k == 0 && len == 0) {
+                buf[k] = nullptr;
+                continue;
+            }
+            if (len < min || off > bodyLen || len > bodyLen - off) {
+                return false;
+            }
+            buf[k] = body + off;
+        }
+        pBatch->valid[c]  = buf[0];
+        pBatch->values[c] = buf[1];
+    }
+    return true;
+}
+
+unsigned ColumnarReader::dictionary(uint32_t *ids, unsigned max) const
+{
+    FlatView v = { _data, _data + _len };
+    unsigned count = 0;
+    for (unsigned i = 0; i < _dictionaries; i++) {
+        const uint8_t *body;
+        uint64_t bodyLen;
+        const uint8_t *db = message(_dictBlocks + i * ARROW_BLOCK_SIZE, ARROW_DICTIONARY, &body, &bodyLen);
+        const uint8_t *data = v.table(db, 1);
+        unsigned n;
+        const uint8_t *buffers = v.vector(data, 2, 16, &n);
+        if (!buffers || n != 2) {
+            continue;
+        }
+        if (!v.scalar<uint8_t>(db, 2, 0)) {
+            count = 0;                 // replacement
+        }
+        int64_t  length = v.scalar<int64_t>(data, 0, 0);
+        uint64_t off    = v.read<uint64_t>(buffers + 16);
+        uint64_t len    = v.read<uint64_t>(buffers + 24);
+        if (length < 0 || len < 4 * (uint64_t)length || off > bodyLen || len > bodyLen - off) {
+            continue;
+        }
+        for (int64_t k = 0; k < length; k++, count++) {
+            if (count < max) {
+                memcpy(&ids[count], body + off + 4 * k, 4);
+            }
+        }
+    }
+    return count;
+}
+
+//
+// Files
+//
+bool columnarFileSink(const uint8_t *data, size_t len, void *ctx)
+{
+    return fwrite(data, 1, len, static_cast<FILE *>(ctx)) == len;
+}
+
+//
+// Streams in dir: number, lowest number and one past the highest - false on
+// error
+//
+static bool scanStreams(const char *dir, unsigned *pCount, unsigned *pFirst, unsigned *pNext)
+{
+    DIR *d = opendir(dir);
+    if (!d) {
+        return false;
+    }
+    *pCount = 0;
+    *pFirst = 0;
+    *pNext  = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != nullptr) {
+        unsigned n;
+        char ext[7];
+        if (sscanf(de->d_name, "exp%5u.%6s", &n, ext) == 2 && strcmp(ext, "arrows") == 0) {
+            *pFirst = (*pCount == 0 || n < *pFirst) ? n : *pFirst;
+            *pNext  = (n >= *pNext) ? n + 1 : *pNext;
+            (*pCount)++;
+        }
+    }
+    closedir(d);
+    return true;
+}
+
+bool columnarNextPath(const char *dir, char *path, size_t size)
+{
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    unsigned count, first, next;
+    if (!scanStreams(dir, &count, &first, &next)) {
+        return false;
+    }
+    // Make room for the new one - oldest first
+    while (count >= COLUMNAR_MAX_FILES) {
+        snprintf(path, size, "%s/exp%05u.arrows", dir, first);
+        if (remove(path) != 0 || !scanStreams(dir, &count, &first, &next)) {
+            return false;
+        }
+    }
+    int len = snprintf(path, size, "%s/exp%05u.arrows", dir, next);
+    return len > 0 && (size_t)len < size;
+}
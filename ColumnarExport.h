@@ -0,0 +1,216 @@
+/*
+ColumnarExport - decoded readings as Arrow IPC (columnar, binary)
+
+Parsing the text lines printed for each reading costs analysis tools far
+more than the decoding did. The export writes the readings column by
+column in the Apache Arrow IPC format instead, which pyarrow, pandas,
+polars, DuckDB, ... load directly - from a file with memory mapping,
+without copying:
+
+    ColumnarWriter writer;
+    writer.begin(sink, ctx, false);              // stream (true: file)
+    writer.add(&weatherData, time(nullptr), rssi, lqi);
+    ...
+    writer.finish();
+
+    pyarrow.ipc.open_stream("readings.arrows").read_all()
+    pyarrow.ipc.open_file(pyarrow.memory_map("readings.arrow")).read_all()
+
+- Rows are collected in fixed arrays and written as one record batch (row
+  group) every COLUMNAR_ROWS rows or on flush(), so a stream can be read
+  while it grows. Memory use is fixed - no allocation.
+- Every field is an array of one type; the *_ok flags become the validity
+  bitmaps of the fields they qualify (temp_ok: temp_c and humidity,
+  wind_ok: the wind fields, ...), so invalid values are nulls.
+- sensor_id is dictionary encoded (int16 indices into the IDs seen so
+  far); new IDs go out as a delta dictionary batch before the batch which
+  uses them. Beyond COLUMNAR_MAX_SENSORS IDs, sensor_id is null.
+- Stream format: schema, batches, end-of-stream marker - a stream cut off
+  (e.g. by a reset) is readable up to its last complete batch. File format
+  (host): the same framed by magic bytes, plus a footer with the position of
+  each batch (at most COLUMNAR_MAX_BLOCKS) for random access.
+
+The metadata are Arrow's FlatBuffers messages (format version V5), built
+by a small builder here - no FlatBuffers or Arrow library is needed.
+ColumnarReader maps the batches of a file written by ColumnarWriter
+(zero-copy), e.g. for checking and benchmarks; it does not read Arrow
+files in general.
+
+Schema: time timestamp[s, UTC], sensor_id dictionary<uint32, int16>,
+chan uint8, battery_ok bool, temp_c float32, humidity uint8, uv float32,
+wind_direction_deg float32, wind_gust_meter_sec float32,
+wind_avg_meter_sec float32, rain_mm float32, moisture uint8, rssi float32,
+lqi uint8.
+*/
+#ifndef COLUMNAR_EXPORT_H
+#define COLUMNAR_EXPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "WeatherData.h"
+
+// Rows per record batch
+#ifndef COLUMNAR_ROWS
+#define COLUMNAR_ROWS 64
+#endif
+
+// Sensor IDs in the dictionary (at most 32767 - int16 indices)
+#ifndef COLUMNAR_MAX_SENSORS
+#define COLUMNAR_MAX_SENSORS 64
+#endif
+
+// Batches listed in the footer of a file
+#ifndef COLUMNAR_MAX_BLOCKS
+#define COLUMNAR_MAX_BLOCKS 16
+#endif
+
+// Streams kept in a directory by columnarNextPath(), incl. the new one
+#ifndef COLUMNAR_MAX_FILES
+#define COLUMNAR_MAX_FILES 4
+#endif
+
+// Metadata of one message (bytes)
+#ifndef COLUMNAR_META_SIZE
+#define COLUMNAR_META_SIZE 2048
+#endif
+
+enum ColumnarColumn {
+    COLUMNAR_TIME, COLUMNAR_SENSOR_ID, COLUMNAR_CHAN, COLUMNAR_BATTERY_OK, COLUMNAR_TEMP_C, COLUMNAR_HUMIDITY,
+    COLUMNAR_UV, COLUMNAR_WIND_DIRECTION, COLUMNAR_WIND_GUST, COLUMNAR_WIND_AVG, COLUMNAR_RAIN_MM,
+    COLUMNAR_MOISTURE, COLUMNAR_RSSI, COLUMNAR_LQI,
+    COLUMNAR_COLUMNS
+};
+
+// Write bytes - returns false on error
+typedef bool (*ColumnarSink)(const uint8_t *data, size_t len, void *ctx);
+
+struct ColumnarStats {
+    uint32_t rows;
+    uint32_t batches;
+    uint32_t sensors;              // dictionary entries
+    uint32_t unknown;              // rows with sensor_id null (dictionary full)
+    uint64_t bytes;
+};
+
+class ColumnarWriter {
+public:
+    ColumnarWriter();
+
+    // Start stream (file: Arrow file format) - writes the schema
+    bool begin(ColumnarSink sink, void *ctx, bool file);
+
+    // Add reading - writes a batch when COLUMNAR_ROWS rows are collected
+    bool add(const WeatherData *pData, uint32_t timestamp, float rssi, uint8_t lqi);
+
+    // Write the rows collected so far as a batch
+    bool flush();
+
+    // Flush, end the stream (and write the footer)
+    bool finish();
+
+    // Rows waiting for flush()
+    unsigned pending() const { return _rows; }
+
+    const ColumnarStats& stats() const { return _stats; }
+
+private:
+    enum MessageKind { MESSAGE_SCHEMA, MESSAGE_DICTIONARY, MESSAGE_BATCH };
+
+    bool write(const void *data, size_t len);
+    bool pad(size_t len);
+    bool message(const uint8_t *meta, unsigned metaLen, uint64_t bodyLen, MessageKind kind);
+    bool writeDictionary();
+    int  sensorIndex(uint32_t sensor_id);
+    void valid(ColumnarColumn c, unsigned row, bool ok);
+
+    ColumnarSink _sink;
+    void        *_ctx;
+    bool         _file;
+    bool         _ok;
+    uint64_t     _offset;          // bytes written
+
+    // Rows of the current batch
+    unsigned _rows;
+    int64_t  _time[COLUMNAR_ROWS];
+    int16_t  _sensor[COLUMNAR_ROWS];
+    uint8_t  _chan[COLUMNAR_ROWS];
+    uint8_t  _battery[(COLUMNAR_ROWS + 7) / 8];
+    float    _temp[COLUMNAR_ROWS];
+    uint8_t  _humidity[COLUMNAR_ROWS];
+    float    _uv[COLUMNAR_ROWS];
+    float    _windDir[COLUMNAR_ROWS];
+    float    _gust[COLUMNAR_ROWS];
+    float    _windAvg[COLUMNAR_ROWS];
+    float    _rain[COLUMNAR_ROWS];
+    uint8_t  _moisture[COLUMNAR_ROWS];
+    float    _rssi[COLUMNAR_ROWS];
+    uint8_t  _lqi[COLUMNAR_ROWS];
+    uint8_t  _valid[COLUMNAR_COLUMNS][(COLUMNAR_ROWS + 7) / 8];
+    uint32_t _nulls[COLUMNAR_COLUMNS];
+
+    // Dictionary: IDs by index, open addressing table of index + 1
+    uint32_t _dict[COLUMNAR_MAX_SENSORS];
+    uint16_t _slots[2 * COLUMNAR_MAX_SENSORS];
+    unsigned _dictWritten;
+
+    // Batches of a file, for the footer
+    struct Block {
+        uint64_t offset;
+        uint32_t meta_len;
+        uint64_t body_len;
+        bool     dictionary;
+    };
+    Block    _blocks[COLUMNAR_MAX_BLOCKS];
+    unsigned _blockCount;
+
+    // Metadata of a message, or the footer with its blocks
+    uint8_t       _meta[COLUMNAR_META_SIZE + 24 * COLUMNAR_MAX_BLOCKS];
+    ColumnarStats _stats;
+};
+
+// One batch as read - values[c] points to the column's values (bits for
+// battery_ok), valid[c] to its validity bitmap (nullptr: no nulls)
+struct ColumnarBatch {
+    uint32_t       rows;
+    const void    *values[COLUMNAR_COLUMNS];
+    const uint8_t *valid[COLUMNAR_COLUMNS];
+};
+
+class ColumnarReader {
+public:
+    ColumnarReader();
+
+    // File written by ColumnarWriter (file format), e.g. memory-mapped -
+    // returns false if it is not one
+    bool open(const uint8_t *data, size_t len);
+
+    unsigned batches() const { return _batches; }
+
+    // Batch i - pointers into the file
+    bool batch(unsigned i, ColumnarBatch *pBatch) const;
+
+    // Sensor IDs of the dictionary, in index order - returns their number
+    // (entries beyond max are not stored)
+    unsigned dictionary(uint32_t *ids, unsigned max) const;
+
+private:
+    const uint8_t *message(const uint8_t *block, unsigned type, const uint8_t **pBody, uint64_t *pBodyLen) const;
+
+    const uint8_t *_data;
+    size_t         _len;
+    const uint8_t *_dictBlocks;    // vectors of Block structs in the footer
+    const uint8_t *_batchBlocks;
+    unsigned       _dictionaries;
+    unsigned       _batches;
+};
+
+// Sink writing to a stdio FILE * (ctx)
+bool columnarFileSink(const uint8_t *data, size_t len, void *ctx);
+
+// Path of a new stream in dir (created if missing): <dir>/exp<n>.arrows,
+// n one past the highest present. The oldest streams are deleted, so that
+// at most COLUMNAR_MAX_FILES remain with the new one - returns false on
+// error
+bool columnarNextPath(const char *dir, char *path, size_t size);
+
+#endif // COLUMNAR_EXPORT_H
@@ -0,0 +1,277 @@
+/*
+EventLoop - cooperative scheduler with a timer wheel and priority ready queues
+
+See EventLoop.h for the model.
+*/
+#include "EventLoop.h"
+#include "Clock.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static_assert((EVENT_WHEEL_SLOTS & (EVENT_WHEEL_SLOTS - 1)) == 0, "EVENT_WHEEL_SLOTS must be a power of 2");
+static_assert(EVENT_MAX_TASKS <= 32, "EVENT_MAX_TASKS: at most 32 (signal bits)");
+
+#define SLOT(ms) ((ms) & (EVENT_WHEEL_SLOTS - 1))
+
+EventLoop::EventLoop() :
+    _taskCount(0), _tick(0), _started(false), _signals(0), _isrClock(nullptr)
+{
+    memset(_tasks, 0, sizeof(_tasks));
+    for (int i = 0; i < EVENT_MAX_TIMERS; i++) {
+        _timers[i].task = -1;
+        _timers[i].next = -1;
+    }
+    for (int i = 0; i < EVENT_WHEEL_SLOTS; i++) {
+        _wheel[i] = -1;
+    }
+    for (int i = 0; i < EVENT_MAX_TASKS; i++) {
+        _signalUs[i] = 0;
+    }
+    memset(_ready, 0, sizeof(_ready));
+    memset(_prio, 0, sizeof(_prio));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int EventLoop::addTask(const char *name, EventFn fn, void *ctx, uint8_t priority)
+{
+    if (_taskCount >= EVENT_MAX_TASKS || priority >= EVENT_PRIORITIES) {
+        return -1;
+    }
+    Task *t = &_tasks[_taskCount];
+    t->name     = name;
+    t->fn       = fn;
+    t->ctx      = ctx;
+    t->priority = priority;
+    return _taskCount++;
+}
+
+//
+// Insert timer into the slot of its due time - it expires on the visit of
+// the slot after its rounds have counted down
+//
+void EventLoop::schedule(int timer, uint32_t due_ms)
+{
+    Timer *tm = &_timers[timer];
+    uint32_t delta = due_ms - _tick;
+    tm->due_ms = due_ms;
+    tm->rounds = (delta - 1) / EVENT_WHEEL_SLOTS;
+    tm->next   = _wheel[SLOT(due_ms)];
+    _wheel[SLOT(due_ms)] = timer;
+}
+
+int EventLoop::every(int task, uint32_t period_ms)
+{
+    if (!_started) {
+        _tick    = clockMillis();
+        _started = true;
+    }
+    for (int i = 0; i < EVENT_MAX_TIMERS; i++) {
+        if (_timers[i].task < 0) {
+            _timers[i].task      = task;
+            _timers[i].period_ms = period_ms ? period_ms : 1;
+            schedule(i, _tick + _timers[i].period_ms);
+            return i;
+        }
+    }
+    return -1;
+}
+
+int EventLoop::after(int task, uint32_t delay_ms)
+{
+    int timer = every(task, delay_ms);
+    if (timer >= 0) {
+        _timers[timer].period_ms = 0;
+    }
+    return timer;
+}
+
+void EventLoop::cancel(int timer)
+{
+    if (timer < 0 || _timers[timer].task < 0) {
+        return;
+    }
+    int16_t *link = &_wheel[SLOT(_timers[timer].due_ms)];
+    while (*link >= 0 && *link != timer) {
+        link = &_timers[*link].next;
+    }
+    if (*link == timer) {
+        *link = _timers[timer].next;
+    }
+    _timers[timer].task = -1;
+    _timers[timer].next = -1;
+}
+
+void EventLoop::enqueue(int task, uint32_t ready_us)
+{
+    Task *t = &_tasks[task];
+    _stats.posts++;
+    if (t->queued) {
+        return;
+    }
+    Queue *q = &_ready[t->priority];
+    q->ids[(q->head + q->count) % EVENT_MAX_TASKS] = task;
+    q->count++;
+    t->queued   = true;
+    t->ready_us = ready_us;
+}
+
+void EventLoop::post(int task)
+{
+    enqueue(task, clockMicros());
+}
+
+//
+// Process the wheel slots up to now - expired timers make their task ready
+// as of their due time
+//
+void EventLoop::advance(uint32_t now_ms)
+{
+    if (!_started) {
+        _tick    = now_ms;
+        _started = true;
+        return;
+    }
+    while ((int32_t)(now_ms - _tick) > 0) {
+        _tick++;
+        _stats.ticks++;
+        // Detach the slot's list - timers staying in it are inserted again
+        int16_t i = _wheel[SLOT(_tick)];
+        _wheel[SLOT(_tick)] = -1;
+        while (i >= 0) {
+            Timer  *tm   = &_timers[i];
+            int16_t next = tm->next;
+            if (tm->rounds) {
+                tm->rounds--;
+                tm->next = _wheel[SLOT(_tick)];
+                _wheel[SLOT(_tick)] = i;
+            } else {
+                _stats.expirations++;
+                enqueue(tm->task, clockMicros() - (now_ms - tm->due_ms) * 1000);
+                if (tm->period_ms) {
+                    schedule(i, tm->due_ms + tm->period_ms);
+                } else {
+                    tm->task = -1;
+                    tm->next = -1;
+                }
+            }
+            i = next;
+        }
+    }
+}
+
+void EventLoop::fold()
+{
+    uint32_t signals = _signals.exchange(0, std::memory_order_acquire);
+    while (signals) {
+        int task = __builtin_ctz(signals);
+        signals &= signals - 1;
+        _stats.signals++;
+        enqueue(task, _isrClock ? _signalUs[task] : clockMicros());
+    }
+}
+
+unsigned EventLoop::run()
+{
+    unsigned n = 0;
+
+    // Bounded, so that the caller's loop() returns regularly
+    while (n < EVENT_MAX_TASKS) {
+        advance(clockMillis());
+        fold();
+
+        unsigned p = 0;
+        while (p < EVENT_PRIORITIES && _ready[p].count == 0) {
+            p++;
+        }
+        if (p == EVENT_PRIORITIES) {
+            break;
+        }
+        Queue *q = &_ready[p];
+        Task  *t = &_tasks[q->ids[q->head]];
+        q->head = (q->head + 1) % EVENT_MAX_TASKS;
+        q->count--;
+        t->queued = false;
+
+        uint32_t start   = clockMicros();
+        uint32_t latency = start - t->ready_us;
+        latency = ((int32_t)latency < 0) ? 0 : latency;
+        _prio[p].dispatches++;
+        _prio[p].latency_us    += latency;
+        _prio[p].latency_max_us = (latency > _prio[p].latency_max_us) ? latency : _prio[p].latency_max_us;
+
+        t->fn(t->ctx);
+
+        uint32_t us = clockMicros() - start;
+        t->stats.runs++;
+        t->stats.busy_us += us;
+        t->stats.max_us   = (us > t->stats.max_us) ? us : t->stats.max_us;
+        n++;
+    }
+    return n;
+}
+
+uint32_t EventLoop::idleMs() const
+{
+    if (_signals.load(std::memory_order_relaxed)) {
+        return 0;
+    }
+    for (unsigned p = 0; p < EVENT_PRIORITIES; p++) {
+        if (_ready[p].count) {
+            return 0;
+        }
+    }
+    uint32_t now  = clockMillis();
+    uint32_t idle = EVENT_WHEEL_SLOTS;
+    for (int i = 0; i < EVENT_MAX_TIMERS; i++) {
+        if (_timers[i].task >= 0) {
+            int32_t left = _timers[i].due_ms - now;
+            left = (left < 0) ? 0 : left;
+            idle = ((uint32_t)left < idle) ? left : idle;
+        }
+    }
+    return idle;
+}
+
+float EventLoop::latency(unsigned priority) const
+{
+    const EventPriorityStats *s = &_prio[priority];
+    return s->dispatches ? (float)s->latency_us / s->dispatches : 0;
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int EventLoop::render(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    APPEND("# TYPE bresser_event_dispatches_total counter\n");
+    for (unsigned p = 0; p < EVENT_PRIORITIES; p++) {
+        APPEND("bresser_event_dispatches_total{priority=\"%u\"} %u\n", p, (unsigned)_prio[p].dispatches);
+    }
+    APPEND("# TYPE bresser_event_latency_us gauge\n");
+    for (unsigned p = 0; p < EVENT_PRIORITIES; p++) {
+        APPEND("bresser_event_latency_us{priority=\"%u\"} %.0f\n", p, latency(p));
+    }
+    APPEND("# TYPE bresser_event_latency_max_us gauge\n");
+    for (unsigned p = 0; p < EVENT_PRIORITIES; p++) {
+        APPEND("bresser_event_latency_max_us{priority=\"%u\"} %u\n", p, (unsigned)_prio[p].latency_max_us);
+    }
+    APPEND("# TYPE bresser_task_busy_us_total counter\n");
+    for (unsigned i = 0; i < _taskCount; i++) {
+        APPEND("bresser_task_busy_us_total{task=\"%s\"} %llu\n", _tasks[i].name,
+               (unsigned long long)_tasks[i].stats.busy_us);
+    }
+    APPEND("# TYPE bresser_task_max_us gauge\n");
+    for (unsigned i = 0; i < _taskCount; i++) {
+        APPEND("bresser_task_max_us{task=\"%s\"} %u\n", _tasks[i].name, (unsigned)_tasks[i].stats.max_us);
+    }
+
+    return (len < size) ? (int)len : -1;
+}
@@ -0,0 +1,177 @@
+/*
+EventLoop - cooperative scheduler with a timer wheel and priority ready queues
+
+loop() used to receive, decode and print in strict sequence; periodic work
+(publishing, flushing the log, schedule bookkeeping) had to be squeezed in
+between. With the event loop, all work is done by tasks:
+
+    int radioTask = events.addTask("radio", onRadio, nullptr, EVENT_PRIORITY_RADIO);
+    int mqttTask  = events.addTask("mqtt", onMqtt, nullptr, EVENT_PRIORITY_HOUSEKEEPING);
+    events.every(mqttTask, 100);
+    attachInterrupt(..., isr, FALLING);       // isr: events.signal(radioTask)
+    ...
+    void loop() { events.run(); }
+
+- A task is made ready by post(), by signal() (from an interrupt handler),
+  or by a timer expiring. It is queued at most once, however often it is
+  made ready before it runs.
+- run() dispatches the ready tasks, highest priority (lowest number) first,
+  FIFO within a priority. After every task the timers and signals are
+  checked again, so a radio event waits for at most the one task running
+  when it arrived - it preempts all housekeeping still queued. Tasks must
+  not block.
+- Timers live in a hashed timer wheel (EVENT_WHEEL_SLOTS slots of 1 ms):
+  starting, cancelling and expiring a timer is O(1); timers further out than
+  one revolution wait for their number of rounds.
+- Tasks, timers and queues are fixed arrays: no allocation at all.
+
+Time comes from Clock.h, so with CLOCK_VIRTUAL the scheduler runs on a host
+deterministically, driven by a simulated clock.
+
+The dispatch latency (ready to running: posted, signalled or timer due) is
+measured per priority, and the run time per task.
+*/
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Number of tasks (at most 32 - signal bits)
+#ifndef EVENT_MAX_TASKS
+#define EVENT_MAX_TASKS 16
+#endif
+
+// Number of timers
+#ifndef EVENT_MAX_TIMERS
+#define EVENT_MAX_TIMERS 16
+#endif
+
+// Slots of the timer wheel (power of 2), 1 ms each
+#ifndef EVENT_WHEEL_SLOTS
+#define EVENT_WHEEL_SLOTS 256
+#endif
+
+// Number of priorities (0: highest)
+#ifndef EVENT_PRIORITIES
+#define EVENT_PRIORITIES 3
+#endif
+
+#define EVENT_PRIORITY_RADIO        0
+#define EVENT_PRIORITY_OUTPUT       1
+#define EVENT_PRIORITY_HOUSEKEEPING 2
+
+// Task function
+typedef void (*EventFn)(void *ctx);
+
+struct EventPriorityStats {
+    uint32_t dispatches;
+    uint64_t latency_us;           // total ready-to-running time
+    uint32_t latency_max_us;
+};
+
+struct EventTaskStats {
+    uint32_t runs;
+    uint64_t busy_us;
+    uint32_t max_us;
+};
+
+struct EventStats {
+    uint32_t posts;                // made ready (incl. already queued)
+    uint32_t signals;
+    uint32_t expirations;          // timers expired
+    uint32_t ticks;                // wheel slots processed
+};
+
+class EventLoop {
+public:
+    EventLoop();
+
+    // Add task - returns its ID or -1
+    int addTask(const char *name, EventFn fn, void *ctx, uint8_t priority);
+
+    // Run task every period_ms / once after delay_ms - returns the timer ID
+    // or -1 if none is free
+    int  every(int task, uint32_t period_ms);
+    int  after(int task, uint32_t delay_ms);
+    void cancel(int timer);
+
+    // Make task ready - not from interrupt context
+    void post(int task);
+
+    // Make task ready from interrupt context
+    inline void signal(int task) {
+        _signalUs[task] = _isrClock ? _isrClock() : 0;
+        _signals.fetch_or(1UL << task, std::memory_order_release);
+    }
+
+    // Microsecond clock readable in interrupt context (micros() on the
+    // target) - without it, signal latency is not measured
+    void setIsrClock(uint32_t (*clock)(void)) { _isrClock = clock; }
+
+    // Expire timers, dispatch all ready tasks - returns the number run
+    unsigned run();
+
+    // Time until the next timer expires (ms, capped at one revolution of the
+    // wheel) - 0 if tasks are ready
+    uint32_t idleMs() const;
+
+    const char *name(int task) const { return _tasks[task].name; }
+    unsigned    taskCount() const { return _taskCount; }
+
+    // Average dispatch latency of priority (us)
+    float latency(unsigned priority) const;
+
+    const EventPriorityStats& stats(unsigned priority) const { return _prio[priority]; }
+    const EventTaskStats& taskStats(int task) const { return _tasks[task].stats; }
+    const EventStats& stats() const { return _stats; }
+
+    // Prometheus text: dispatches and latency per priority, run time per
+    // task - returns length or -1 if buf is too small
+    int render(char *buf, unsigned size) const;
+
+private:
+    struct Task {
+        const char    *name;
+        EventFn        fn;
+        void          *ctx;
+        uint8_t        priority;
+        bool           queued;
+        uint32_t       ready_us;   // made ready (due time for timers)
+        EventTaskStats stats;
+    };
+
+    struct Timer {
+        int16_t  task;             // -1: free
+        int16_t  next;             // in the slot's list, -1: last
+        uint32_t period_ms;        // 0: one-shot
+        uint32_t rounds;           // revolutions left
+        uint32_t due_ms;
+    };
+
+    struct Queue {
+        uint8_t  ids[EVENT_MAX_TASKS];
+        unsigned head;
+        unsigned count;
+    };
+
+    void enqueue(int task, uint32_t ready_us);
+    void schedule(int timer, uint32_t due_ms);
+    void advance(uint32_t now_ms);
+    void fold();
+
+    Task                  _tasks[EVENT_MAX_TASKS];
+    unsigned              _taskCount;
+    Timer                 _timers[EVENT_MAX_TIMERS];
+    int16_t               _wheel[EVENT_WHEEL_SLOTS];
+    uint32_t              _tick;   // last slot processed (ms)
+    bool                  _started;
+    Queue                 _ready[EVENT_PRIORITIES];
+    std::atomic<uint32_t> _signals;
+    volatile uint32_t     _signalUs[EVENT_MAX_TASKS];
+    uint32_t            (*_isrClock)(void);
+    EventPriorityStats    _prio[EVENT_PRIORITIES];
+    EventStats            _stats;
+};
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,108 @@
+/*
+FrameCheck - integrity checks of a Bresser frame, byte by byte as it arrives
+*/
+#include "FrameCheck.h"
+
+#include <string.h>
+
+// Frame offsets (0xD4 at 0, payload from 1)
+#define OFS_5IN1_INVERTED 14       // first byte of the non-inverted half
+#define OFS_5IN1_BITCOUNT 14       // bit count of bytes 15..26
+#define OFS_6IN1_DIGEST   1        // digest of bytes 3..17
+#define OFS_6IN1_DATA     3
+#define OFS_6IN1_CHECKSUM 18       // bytes 3..18 add up to 0xff
+
+// LFSR-16 digest parameters (see decodeBresser6In1Payload())
+#define DIGEST_GEN 0x8810
+#define DIGEST_KEY 0x5412
+
+// Bytes needed to identify the protocol
+#define IDENTIFY_BYTES 16
+
+FrameCheck::FrameCheck()
+{
+    reset();
+}
+
+void FrameCheck::reset()
+{
+    memset(_data, 0, sizeof(_data));
+    _count        = 0;
+    _result       = CHECK_MORE;
+    _protocol     = BRESSER_5IN1;
+    _len          = 0;
+    _digest       = 0;
+    _key          = DIGEST_KEY;
+    _sum          = 0;
+    _parityErrors = 0;
+    _bitCount     = 0;
+}
+
+CheckResult FrameCheck::feed(const uint8_t *data, unsigned n)
+{
+    for (unsigned i = 0; i < n && _result == CHECK_MORE; i++) {
+        _result = byte(data[i]);
+    }
+    return _result;
+}
+
+//
+// Process byte _count - lfsr_digest16() and add_bytes() unrolled to one
+// byte at a time
+//
+CheckResult FrameCheck::byte(uint8_t b)
+{
+    unsigned i = _count++;
+    _data[i] = b;
+
+    if (i == 0) {
+        return (b == 0xD4) ? CHECK_MORE : CHECK_NO_SYNC;
+    }
+
+    // 6-in-1 digest and checksum
+    if (i >= OFS_6IN1_DATA && i < OFS_6IN1_CHECKSUM) {
+        for (int bit = 7; bit >= 0; --bit) {
+            if ((b >> bit) & 1) {
+                _digest ^= _key;
+            }
+            _key = (_key & 1) ? (_key >> 1) ^ DIGEST_GEN : (_key >> 1);
+        }
+    }
+    if (i >= OFS_6IN1_DATA && i <= OFS_6IN1_CHECKSUM) {
+        _sum += b;
+    }
+
+    // 5-in-1 inverted pairs and bit count
+    if (i >= OFS_5IN1_INVERTED) {
+        if ((_data[i - OFS_5IN1_INVERTED + 1] ^ b) != 0xff) {
+            _parityErrors++;
+        }
+        if (i > OFS_5IN1_BITCOUNT) {
+            _bitCount += __builtin_popcount(b);
+        }
+    }
+
+    if (i == IDENTIFY_BYTES - 1) {
+        bool inverted = ((_data[1] ^ _data[14]) == 0xff) || ((_data[2] ^ _data[15]) == 0xff);
+        _protocol = inverted ? BRESSER_5IN1 : BRESSER_6IN1;
+        _len      = inverted ? 1 + BRESSER_5IN1_SIZE : 1 + BRESSER_6IN1_SIZE;
+    }
+    if (!_len) {
+        return CHECK_MORE;
+    }
+
+    if (_protocol == BRESSER_5IN1) {
+        if (_parityErrors > FRAME_CHECK_PARITY_ERRORS) {
+            return CHECK_PARITY;
+        }
+    } else {
+        if (i == OFS_6IN1_CHECKSUM - 1 &&
+            _digest != (((uint16_t)_data[OFS_6IN1_DIGEST] << 8) | _data[OFS_6IN1_DIGEST + 1])) {
+            return CHECK_DIGEST;
+        }
+        if (i == OFS_6IN1_CHECKSUM && _sum != 0xff) {
+            return CHECK_CHECKSUM;
+        }
+    }
+    return (_count >= _len) ? CHECK_OK : CHECK_MORE;
+}
@@ -0,0 +1,86 @@
+/*
+FrameCheck - integrity checks of a Bresser frame, byte by byte as it arrives
+
+The decoders check a frame once it is complete. FrameCheck is fed the bytes
+following the sync word (0xD4 + payload) in chunks while they are read from
+the RX FIFO, and keeps the checks up to date:
+
+    check.reset();
+    while (...) {
+        CheckResult r = check.feed(chunk, n);
+        if (r == CHECK_MORE) continue;       // identified() - length() known
+        ...                                  // CHECK_OK: frame complete
+    }
+
+- byte 0: must be 0xD4, else CHECK_NO_SYNC
+- bytes 1..15: the LFSR-16 digest and add-checksum of a 6-in-1 frame are
+  accumulated in advance; with byte 15 the protocol is identified as in
+  AdaptiveRx (5-in-1 if one of the first two inverted pairs matches)
+- 5-in-1: every byte from 14 on completes an inverted pair; more than
+  FRAME_CHECK_PARITY_ERRORS mismatches give CHECK_PARITY. The bit count is
+  tolerated, as by decodeBresser5In1Payload().
+- 6-in-1: the digest is complete with byte 17 (CHECK_DIGEST), the checksum
+  with byte 18 (CHECK_CHECKSUM)
+
+So a frame can be rejected while it is still on air, and validation is done
+when its last byte has arrived. Bytes beyond length() are ignored.
+*/
+#ifndef FRAME_CHECK_H
+#define FRAME_CHECK_H
+
+#include <stdint.h>
+#include "BresserEncoder.h"
+
+// 5-in-1: inverted pairs which may mismatch (of 13) - the decoder tolerates
+// all of them, a frame rejected here never reaches it
+#ifndef FRAME_CHECK_PARITY_ERRORS
+#define FRAME_CHECK_PARITY_ERRORS 3
+#endif
+
+enum CheckResult {
+    CHECK_MORE,                    // frame incomplete, no error so far
+    CHECK_OK,                      // frame complete and valid
+    CHECK_NO_SYNC,                 // no 0xD4 after the sync word
+    CHECK_PARITY,                  // 5-in-1 inverted pairs
+    CHECK_DIGEST,                  // 6-in-1 LFSR-16 digest
+    CHECK_CHECKSUM                 // 6-in-1 add-checksum
+};
+
+class FrameCheck {
+public:
+    FrameCheck();
+
+    // Start a new frame
+    void reset();
+
+    // Next bytes of the frame - the result is final once it is not CHECK_MORE
+    CheckResult feed(const uint8_t *data, unsigned n);
+
+    bool            identified() const { return _len != 0; }
+    BresserProtocol protocol() const { return _protocol; }
+    uint8_t         length() const { return _len; }      // 0 until identified
+    unsigned        received() const { return _count; }
+    const uint8_t  *data() const { return _data; }
+    uint8_t         parityErrors() const { return _parityErrors; }
+    bool            bitCountOk() const { return _bitCount == _data[14]; }
+
+private:
+    CheckResult byte(uint8_t b);
+
+    uint8_t         _data[BRESSER_FRAME_SIZE];
+    unsigned        _count;
+    CheckResult     _result;
+    BresserProtocol _protocol;
+    uint8_t         _len;
+
+    // 6-in-1
+    uint16_t        _digest;
+    uint16_t        _key;
+    uint8_t         _sum;
+
+    // 5-in-1
+    uint8_t         _parityErrors;
+    uint8_t         _bitCount;
+};
+
+#endif // FRAME_CHECK_H
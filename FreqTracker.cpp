@@ -0,0 +1,170 @@
+/*
+FreqTracker - carrier frequency offset tracking from the CC1101's FREQEST
+
+See FreqTracker.h for the model.
+*/
+#include "FreqTracker.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+FreqTracker::FreqTracker() :
+    _global(0), _fsctrl0(0)
+{
+    memset(_sensors, 0, sizeof(_sensors));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int FreqTracker::findSensor(uint32_t sensor_id) const
+{
+    for (int i = 0; i < FREQ_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].sensor_id == sensor_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//
+// FSCTRL0 value for an offset (steps) - the current one within the hysteresis
+//
+int8_t FreqTracker::steps(float offset) const
+{
+    if (fabsf(offset - _fsctrl0) <= FREQ_HYSTERESIS) {
+        return _fsctrl0;
+    }
+    long n = lroundf(offset);
+    return (n > 127) ? 127 : (n < -128) ? -128 : n;
+}
+
+//
+// Entry for a new sensor: a free one, else the least recently heard
+// unconfirmed sensor, else a stale one - -1: none
+//
+int FreqTracker::victim() const
+{
+    int best = -1;
+    for (int i = 0; i < FREQ_MAX_SENSORS; i++) {
+        const Sensor *s = &_sensors[i];
+        if (!s->used) {
+            return i;
+        }
+        bool confirmed = s->estimates >= FREQ_MIN_ESTIMATES;
+        if (confirmed && _stats.estimates - s->seq < FREQ_STALE_ESTIMATES) {
+            continue;
+        }
+        bool bestConfirmed = (best >= 0) && _sensors[best].estimates >= FREQ_MIN_ESTIMATES;
+        if (best < 0 || (!confirmed && bestConfirmed) ||
+            (confirmed == bestConfirmed && s->seq < _sensors[best].seq)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void FreqTracker::update(uint32_t sensor_id, int8_t freqest)
+{
+    float offset = _fsctrl0 + freqest;
+    _stats.estimates++;
+
+    int i = findSensor(sensor_id);
+    if (i >= 0) {
+        _sensors[i].offset += FREQ_SMOOTHING * (offset - _sensors[i].offset);
+    } else {
+        i = victim();
+        if (i < 0) {
+            _stats.untracked++;
+            return;
+        }
+        if (_sensors[i].used) {
+            _stats.evictions++;
+        }
+        _sensors[i].used      = true;
+        _sensors[i].sensor_id = sensor_id;
+        _sensors[i].estimates = 0;
+        _sensors[i].offset    = offset;
+    }
+    _sensors[i].seq = _stats.estimates;
+    _sensors[i].estimates++;
+
+    // Centre of the offsets - keeps the outermost sensors in the channel
+    float lo = 0, hi = 0;
+    bool  any = false;
+    for (i = 0; i < FREQ_MAX_SENSORS; i++) {
+        const Sensor *s = &_sensors[i];
+        if (s->used && s->estimates >= FREQ_MIN_ESTIMATES) {
+            lo  = (!any || s->offset < lo) ? s->offset : lo;
+            hi  = (!any || s->offset > hi) ? s->offset : hi;
+            any = true;
+        }
+    }
+    _global = (lo + hi) / 2;
+}
+
+bool FreqTracker::offset(uint32_t sensor_id, float *pSteps) const
+{
+    int i = findSensor(sensor_id);
+    if (i < 0 || _sensors[i].estimates < FREQ_MIN_ESTIMATES) {
+        return false;
+    }
+    *pSteps = _sensors[i].offset;
+    return true;
+}
+
+unsigned FreqTracker::sensors(uint32_t *ids, unsigned max) const
+{
+    unsigned n = 0;
+    for (int i = 0; i < FREQ_MAX_SENSORS && n < max; i++) {
+        if (_sensors[i].used && _sensors[i].estimates >= FREQ_MIN_ESTIMATES) {
+            ids[n++] = _sensors[i].sensor_id;
+        }
+    }
+    return n;
+}
+
+int8_t FreqTracker::compensation(uint32_t sensor_id) const
+{
+    float offset;
+    return this->offset(sensor_id, &offset) ? steps(offset) : 0;
+}
+
+int8_t FreqTracker::compensation() const
+{
+    return steps(_global);
+}
+
+void FreqTracker::retuned(int8_t fsctrl0)
+{
+    if (fsctrl0 != _fsctrl0) {
+        _fsctrl0 = fsctrl0;
+        _stats.retunes++;
+    }
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int FreqTracker::render(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    APPEND("# TYPE bresser_sensor_freq_offset_hz gauge\n");
+    for (int i = 0; i < FREQ_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].estimates >= FREQ_MIN_ESTIMATES) {
+            APPEND("bresser_sensor_freq_offset_hz{id=\"%08x\"} %.0f\n",
+                   (unsigned)_sensors[i].sensor_id, _sensors[i].offset * FREQ_STEP_HZ);
+        }
+    }
+    APPEND("# TYPE bresser_freq_offset_hz gauge\n");
+    APPEND("bresser_freq_offset_hz %.0f\n", _global * FREQ_STEP_HZ);
+    APPEND("# TYPE bresser_freq_retunes_total counter\n");
+    APPEND("bresser_freq_retunes_total %u\n", (unsigned)_stats.retunes);
+
+    return (len < size) ? (int)len : -1;
+}
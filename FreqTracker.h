@@ -0,0 +1,129 @@
+/*
+FreqTracker - carrier frequency offset tracking from the CC1101's FREQEST
+
+The crystals of the sensors and of the receiver are off by some 10 ppm, and
+drift with temperature - at 868 MHz that moves a sensor's carrier by tens of
+kHz. A signal shifted towards the edge of the channel filter loses
+sensitivity long before it is lost completely.
+
+After each good packet the demodulator's estimate (FREQEST, two's
+complement, in steps of XOSC/2^14 = 1587 Hz) is read. It is relative to the
+frequency in effect, so the carrier offset is FSCTRL0 + FREQEST. The offset
+is smoothed per sensor (exponential moving average). The global offset is
+the centre between the lowest and the highest sensor offset, so that a
+sensor heard more often than the others does not pull the receiver away
+from the rest:
+
+    tracker.update(sensor_id, (int8_t)bus.readReg(CC1101_FREQEST));
+    int8_t fsctrl0 = tracker.compensation(next_sensor_id);   // or compensation()
+    if (fsctrl0 != tracker.fsctrl0()) {
+        bus.writeReg(CC1101_FSCTRL0, fsctrl0);                // radio in IDLE
+        tracker.retuned(fsctrl0);
+    }
+
+FSCTRL0 shifts the synthesizer, so the radio listens right on the expected
+carrier - of the sensor due next (see SensorSchedule), or the centre of all.
+Only sensors which have been heard count: with sensors spread wider than
+the channel filter allows, the global compensation may settle on those
+heard first and lose the others for good. Between predicted transmissions,
+listening on the nominal frequency (FSCTRL0 0) avoids this.
+
+A sensor counts once FREQ_MIN_ESTIMATES packets have been received from it -
+a frame decoded with a corrupted ID makes up a sensor which is never heard
+again. When all entries are in use, the least recently heard unconfirmed
+sensor is replaced, or a confirmed one which has not been heard for
+FREQ_STALE_ESTIMATES packets - else the new sensor is not tracked.
+*/
+#ifndef FREQ_TRACKER_H
+#define FREQ_TRACKER_H
+
+#include <stdint.h>
+
+// Number of sensors tracked
+#ifndef FREQ_MAX_SENSORS
+#define FREQ_MAX_SENSORS 8
+#endif
+
+// Weight of a new estimate of a sensor (first estimate taken as is)
+#ifndef FREQ_SMOOTHING
+#define FREQ_SMOOTHING 0.25f
+#endif
+
+// Packets until a sensor's offset is used
+#ifndef FREQ_MIN_ESTIMATES
+#define FREQ_MIN_ESTIMATES 2
+#endif
+
+// Packets of other sensors after which a confirmed sensor may be replaced
+#ifndef FREQ_STALE_ESTIMATES
+#define FREQ_STALE_ESTIMATES (8 * FREQ_MAX_SENSORS)
+#endif
+
+// Change FSCTRL0 only if the offset is further than this from it (steps) -
+// keeps an offset halfway between two steps from retuning on every packet
+#ifndef FREQ_HYSTERESIS
+#define FREQ_HYSTERESIS 0.75f
+#endif
+
+// FREQEST/FSCTRL0 step (Hz)
+#define FREQ_STEP_HZ (26e6f / 16384)
+
+struct FreqStats {
+    uint32_t estimates;            // packets with an offset estimate
+    uint32_t retunes;              // FSCTRL0 changes
+    uint32_t evictions;            // sensors replaced
+    uint32_t untracked;            // estimates of sensors without an entry
+};
+
+class FreqTracker {
+public:
+    FreqTracker();
+
+    // Offset estimate read after a good packet of sensor (FREQEST)
+    void update(uint32_t sensor_id, int8_t freqest);
+
+    // Smoothed offset of sensor (steps) - returns false if unknown or unconfirmed
+    bool offset(uint32_t sensor_id, float *pSteps) const;
+
+    // IDs of the confirmed sensors - returns their number
+    unsigned sensors(uint32_t *ids, unsigned max) const;
+
+    // Centre of the offsets of the confirmed sensors (steps), 0 if there is none
+    float globalOffset() const { return _global; }
+
+    // FSCTRL0 for receiving sensor - its own offset, 0 (nominal) if unknown
+    int8_t compensation(uint32_t sensor_id) const;
+
+    // FSCTRL0 for receiving any sensor (centre of all offsets)
+    int8_t compensation() const;
+
+    // FSCTRL0 written to the radio (e.g. 0 after a reset)
+    void   retuned(int8_t fsctrl0);
+    int8_t fsctrl0() const { return _fsctrl0; }
+
+    const FreqStats& stats() const { return _stats; }
+
+    // Prometheus text: offset per sensor and overall (Hz) - returns length or
+    // -1 if buf is too small
+    int render(char *buf, unsigned size) const;
+
+private:
+    struct Sensor {
+        bool     used;
+        uint32_t sensor_id;
+        uint32_t seq;              // update number of the latest estimate
+        uint32_t estimates;
+        float    offset;           // steps
+    };
+
+    int    findSensor(uint32_t sensor_id) const;
+    int    victim() const;
+    int8_t steps(float offset) const;
+
+    Sensor    _sensors[FREQ_MAX_SENSORS];
+    float     _global;
+    int8_t    _fsctrl0;
+    FreqStats _stats;
+};
+
+#endif // FREQ_TRACKER_H
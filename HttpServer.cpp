@@ -0,0 +1,495 @@
+/*
+HttpServer - minimal HTTP endpoint serving the current per-sensor readings
+
+See HttpServer.h for the buffering scheme.
+*/
+#include "HttpServer.h"
+#include "Clock.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+// Room for the chunk size line in front of a part rendered into _scratch
+#define CHUNK_HEAD 10
+
+// Do not raise SIGPIPE if the client has gone away (Linux)
+#ifdef MSG_NOSIGNAL
+#define HTTP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define HTTP_SEND_FLAGS 0
+#endif
+
+// Header template of a 200 response - body follows
+static const char headerFmt[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Content-Type: application/json\r\n"
+    "Content-Length: %u\r\n"
+    "ETag: %s\r\n"
+    "Cache-Control: no-cache\r\n"
+    "Connection: close\r\n"
+    "\r\n";
+
+static const char notFound[] =
+    "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+static const char serverError[] =
+    "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+
+// End of a chunked body
+static const char lastChunk[] = "0\r\n\r\n";
+
+//
+// FNV-1a, 32 bit
+//
+static uint32_t fnv1a(const char *data, unsigned len)
+{
+    uint32_t h = 0x811c9dc5;
+    for (unsigned i = 0; i < len; i++) {
+        h ^= (uint8_t)data[i];
+        h *= 0x01000193;
+    }
+    return h;
+}
+
+//
+// Value of header field name in request (NUL terminated copy) - nullptr if
+// not found
+//
+static const char *headerValue(const char *req, const char *name, char *value, unsigned size)
+{
+    unsigned nameLen = strlen(name);
+    const char *line = strstr(req, "\r\n");
+    while (line && line[2] != '\r' && line[2] != '\0') {
+        line += 2;
+        const char *end = strstr(line, "\r\n");
+        if (!end) {
+            end = line + strlen(line);
+        }
+        if (strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':') {
+            const char *v = line + nameLen + 1;
+            while (*v == ' ') {
+                v++;
+            }
+            unsigned len = end - v;
+            if (len >= size) {
+                len = size - 1;
+            }
+            memcpy(value, v, len);
+            value[len] = '\0';
+            return value;
+        }
+        line = (*end) ? end : nullptr;
+    }
+    return nullptr;
+}
+
+HttpServer::HttpServer() :
+    _listen(-1), _rendered(~0u), _active(0), _routeCount(0), _scratchOwner(nullptr)
+{
+    memset(&_stats, 0, sizeof(_stats));
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        _conns[i].fd    = -1;
+        _conns[i].state = CONN_FREE;
+    }
+    for (int i = 0; i < 2; i++) {
+        _response[i].len     = 0;
+        _response[i].etag[0] = '\0';
+        _response[i].readers = 0;
+    }
+}
+
+HttpServer::~HttpServer()
+{
+    end();
+}
+
+bool HttpServer::begin(uint16_t port)
+{
+    struct sockaddr_in addr;
+    int one = 1;
+
+    end();
+    _listen = socket(AF_INET, SOCK_STREAM, 0);
+    if (_listen < 0) {
+        return false;
+    }
+    setsockopt(_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(_listen, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(_listen, 4) != 0) {
+        end();
+        return false;
+    }
+    fcntl(_listen, F_SETFL, fcntl(_listen, F_GETFL, 0) | O_NONBLOCK);
+    render();
+    return true;
+}
+
+void HttpServer::end()
+{
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        if (_conns[i].state != CONN_FREE) {
+            closeConn(&_conns[i]);
+        }
+    }
+    if (_listen >= 0) {
+        close(_listen);
+        _listen = -1;
+    }
+}
+
+bool HttpServer::route(const char *path, const char *contentType, HttpRenderFn fn, void *ctx)
+{
+    if (_routeCount >= HTTP_MAX_ROUTES) {
+        return false;
+    }
+    _routes[_routeCount].path        = path;
+    _routes[_routeCount].contentType = contentType;
+    _routes[_routeCount].fn          = fn;
+    _routes[_routeCount].ctx         = ctx;
+    _routeCount++;
+    return true;
+}
+
+//
+// Field by field - memcmp() would compare the padding, too
+//
+static bool sameReading(const WeatherData *a, const WeatherData *b)
+{
+    return a->s_type == b->s_type && a->sensor_id == b->sensor_id && a->chan == b->chan &&
+           a->temp_ok == b->temp_ok && a->temp_c == b->temp_c && a->humidity == b->humidity &&
+           a->uv_ok == b->uv_ok && a->uv == b->uv && a->wind_ok == b->wind_ok &&
+           a->wind_direction_deg == b->wind_direction_deg && a->wind_gust_meter_sec == b->wind_gust_meter_sec &&
+           a->wind_avg_meter_sec == b->wind_avg_meter_sec && a->rain_ok == b->rain_ok &&
+           a->rain_mm == b->rain_mm && a->battery_ok == b->battery_ok && a->moisture_ok == b->moisture_ok &&
+           a->moisture == b->moisture;
+}
+
+void HttpServer::update(const WeatherData *pData, uint32_t timestamp)
+{
+    WeatherData old;
+    if (_sensors.find(pData->sensor_id, &old, nullptr) && sameReading(&old, pData)) {
+        // Only the timestamp would change - keep the cached response ("ts"
+        // is the time of the latest change)
+        return;
+    }
+    _sensors.write(pData, timestamp);
+}
+
+int HttpServer::renderBody(char *buf, unsigned size)
+{
+    unsigned len = snprintf(buf, size, "{\"sensors\":[");
+    bool first = true;
+
+    WeatherData data;
+    uint32_t    timestamp;
+    for (unsigned i = 0; _sensors.read(i, &data, &timestamp) && len < size; i++) {
+        const WeatherData *d = &data;
+        len += snprintf(&buf[len], size - len, "%s{\"id\":\"%08x\",\"ts\":%u,\"ch\":%u,\"battery_ok\":%s",
+                        first ? "" : ",", (unsigned)d->sensor_id, (unsigned)timestamp,
+                        d->chan, d->battery_ok ? "true" : "false");
+        first = false;
+        if (d->temp_ok && len < size) {
+            len += snprintf(&buf[len], size - len, ",\"temp_c\":%.1f", d->temp_c);
+            if (!d->moisture_ok && len < size) {
+                len += snprintf(&buf[len], size - len, ",\"hum\":%d", d->humidity);
+            }
+        }
+        if (d->uv_ok && len < size) {
+            len += snprintf(&buf[len], size - len, ",\"uv\":%.1f", d->uv);
+        }
+        if (d->wind_ok && len < size) {
+            len += snprintf(&buf[len], size - len, ",\"wind_gust\":%.1f,\"wind_avg\":%.1f,\"wind_dir\":%.1f",
+                            d->wind_gust_meter_sec, d->wind_avg_meter_sec, d->wind_direction_deg);
+        }
+        if (d->rain_ok && len < size) {
+            len += snprintf(&buf[len], size - len, ",\"rain\":%.1f", d->rain_mm);
+        }
+        if (d->moisture_ok && len < size) {
+            len += snprintf(&buf[len], size - len, ",\"moisture\":%d", d->moisture);
+        }
+        if (len < size) {
+            len += snprintf(&buf[len], size - len, "}");
+        }
+    }
+    if (len < size) {
+        len += snprintf(&buf[len], size - len, "]}\n");
+    }
+    return (len < size) ? (int)len : -1;
+}
+
+void HttpServer::render()
+{
+    char body[HTTP_RESPONSE_SIZE];
+
+    // Updates from now on are rendered next time
+    uint32_t version = _sensors.version();
+    if (version == _rendered) {
+        return;
+    }
+    int active = _active.load();
+    Response *r = &_response[1 - active];
+    if (r->readers.load() > 0) {
+        // Inactive buffer still being sent - try again later
+        _stats.render_skipped++;
+        return;
+    }
+
+    int bodyLen = renderBody(body, sizeof(body));
+    if (bodyLen < 0) {
+        return;
+    }
+    char etag[sizeof(r->etag)];
+    snprintf(etag, sizeof(etag), "\"%08x\"", (unsigned)fnv1a(body, bodyLen));
+    int hdrLen = snprintf(r->data, sizeof(r->data), headerFmt, (unsigned)bodyLen, etag);
+    if (hdrLen < 0 || hdrLen + bodyLen > (int)sizeof(r->data)) {
+        return;
+    }
+    memcpy(&r->data[hdrLen], body, bodyLen);
+    memcpy(r->etag, etag, sizeof(etag));
+    r->len = hdrLen + bodyLen;
+
+    _active.store(1 - active);
+    _rendered = version;
+    _stats.renders++;
+}
+
+void HttpServer::poll()
+{
+    if (_listen < 0) {
+        return;
+    }
+    uint32_t now = clockMillis();
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        Connection *c = &_conns[i];
+        if (c->state == CONN_FREE) {
+            continue;
+        }
+        if (now - c->accepted >= HTTP_TIMEOUT_MS) {
+            _stats.timeouts++;
+            closeConn(c);
+            continue;
+        }
+        advance(c);
+    }
+    for (int i = 0; i < HTTP_MAX_CONNECTIONS; i++) {
+        Connection *c = &_conns[i];
+        if (c->state != CONN_FREE) {
+            continue;
+        }
+        int fd = accept(_listen, nullptr, nullptr);
+        if (fd < 0) {
+            return;
+        }
+        // Accepted sockets do not inherit O_NONBLOCK on every stack
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        c->fd       = fd;
+        c->state    = CONN_REQUEST;
+        c->accepted = now;
+        c->reqLen   = 0;
+        c->outLen   = 0;
+        c->nextLen  = 0;
+        c->pinned   = nullptr;
+        c->route    = nullptr;
+        advance(c);
+    }
+}
+
+//
+// Read request, send response - returns when the socket would block, at
+// most one part of a route's body being rendered
+//
+void HttpServer::advance(Connection *c)
+{
+    if (c->state == CONN_REQUEST) {
+        receive(c);
+    }
+    bool rendered = false;
+    while (c->state == CONN_RESPONSE && sendPending(c)) {
+        if (!c->route) {
+            // Response complete
+            closeConn(c);
+        } else if (rendered || !nextPart(c)) {
+            return;
+        } else {
+            rendered = true;
+        }
+    }
+}
+
+void HttpServer::receive(Connection *c)
+{
+    while (c->state == CONN_REQUEST) {
+        int n = recv(c->fd, &c->req[c->reqLen], sizeof(c->req) - 1 - c->reqLen, 0);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                closeConn(c);
+            }
+            return;
+        }
+        c->reqLen += n;
+        c->req[c->reqLen] = '\0';
+        // Complete header, truncated request or client done sending
+        if (n == 0 || c->reqLen == sizeof(c->req) - 1 || strstr(c->req, "\r\n\r\n")) {
+            dispatch(c);
+        }
+    }
+}
+
+//
+// Send out, then next - returns true when both have been sent, false if the
+// socket would block or the connection was closed on error
+//
+bool HttpServer::sendPending(Connection *c)
+{
+    while (c->outLen > 0 || c->nextLen > 0) {
+        if (c->outLen == 0) {
+            c->out     = c->next;
+            c->outLen  = c->nextLen;
+            c->nextLen = 0;
+            continue;
+        }
+        int n = send(c->fd, c->out, c->outLen, HTTP_SEND_FLAGS);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return false;
+        }
+        if (n <= 0) {
+            closeConn(c);
+            return false;
+        }
+        c->out    += n;
+        c->outLen -= n;
+    }
+    return true;
+}
+
+void HttpServer::closeConn(Connection *c)
+{
+    if (c->pinned) {
+        c->pinned->readers--;
+        c->pinned = nullptr;
+    }
+    if (_scratchOwner == c) {
+        _scratchOwner = nullptr;
+    }
+    close(c->fd);
+    c->fd    = -1;
+    c->state = CONN_FREE;
+}
+
+//
+// Choose response to the request received - sent by advance()
+//
+void HttpServer::dispatch(Connection *c)
+{
+    const char *req = c->req;
+    _stats.requests++;
+    c->state = CONN_RESPONSE;
+
+    char method[8];
+    char path[64];
+    bool ok = sscanf(req, "%7s %63s", method, path) == 2 && strcmp(method, "GET") == 0;
+    for (unsigned i = 0; ok && i < _routeCount; i++) {
+        if (strcmp(path, _routes[i].path) == 0) {
+            // Body rendered by nextPart()
+            c->route = &_routes[i];
+            c->part  = 0;
+            return;
+        }
+    }
+    if (!ok || (strcmp(path, "/") != 0 && strcmp(path, "/readings") != 0)) {
+        _stats.not_found++;
+        c->out    = notFound;
+        c->outLen = sizeof(notFound) - 1;
+        return;
+    }
+
+    // Pin active buffer - re-check, as it may have been switched meanwhile
+    Response *r;
+    for (;;) {
+        int active = _active.load();
+        r = &_response[active];
+        r->readers++;
+        if (_active.load() == active) {
+            break;
+        }
+        r->readers--;
+    }
+    c->pinned = r;
+
+    char inm[64];
+    if (r->etag[0] && headerValue(req, "If-None-Match", inm, sizeof(inm)) && strstr(inm, r->etag)) {
+        _stats.not_modified++;
+        c->out    = c->hdr;
+        c->outLen = snprintf(c->hdr, sizeof(c->hdr),
+                             "HTTP/1.1 304 Not Modified\r\nETag: %s\r\nConnection: close\r\n\r\n", r->etag);
+    } else {
+        c->out    = r->data;
+        c->outLen = r->len;
+    }
+}
+
+//
+// Render the next part of a route's body into _scratch, framed as a chunk,
+// to be sent - returns false if _scratch is still being sent by another
+// connection
+//
+bool HttpServer::nextPart(Connection *c)
+{
+    const Route *r = c->route;
+    if (_scratchOwner && _scratchOwner != c) {
+        return false;
+    }
+    _scratchOwner = c;
+
+    char *body = &_scratch[CHUNK_HEAD];
+    int len = r->fn(body, sizeof(_scratch) - CHUNK_HEAD - 2, c->part, r->ctx);
+    if (len < 0) {
+        _stats.route_errors++;
+        if (c->part > 0) {
+            // Cut off (no last chunk), so the client sees an incomplete
+            // response
+            closeConn(c);
+            return true;
+        }
+        c->out    = serverError;
+        c->outLen = sizeof(serverError) - 1;
+        c->route  = nullptr;
+        _scratchOwner = nullptr;
+        return true;
+    }
+
+    const char *chunk = lastChunk;
+    unsigned chunkLen = sizeof(lastChunk) - 1;
+    if (len > 0) {
+        char head[CHUNK_HEAD + 1];
+        int n = snprintf(head, sizeof(head), "%x\r\n", len);
+        memcpy(body - n, head, n);
+        memcpy(&body[len], "\r\n", 2);
+        chunk    = body - n;
+        chunkLen = n + len + 2;
+    } else {
+        c->route      = nullptr;
+        _scratchOwner = nullptr;
+    }
+    if (c->part == 0) {
+        c->out    = c->hdr;
+        c->outLen = snprintf(c->hdr, sizeof(c->hdr),
+                             "HTTP/1.1 200 OK\r\nContent-Type: %s\r\nTransfer-Encoding: chunked\r\n"
+                             "Connection: close\r\n\r\n", r->contentType);
+        c->next    = chunk;
+        c->nextLen = chunkLen;
+    } else {
+        c->out    = chunk;
+        c->outLen = chunkLen;
+    }
+    c->part++;
+    return true;
+}
@@ -0,0 +1,176 @@
+/*
+HttpServer - minimal HTTP endpoint serving the current per-sensor readings
+
+GET / (or /readings) returns the latest reading of each sensor as JSON:
+
+    {"sensors":[{"id":"fa5e1c20","ts":1650000000,"battery_ok":true,"temp_c":12.3,...}]}
+
+"ts" is the time of the latest change of the sensor's reading: a reading
+equal to the previous one leaves the table (and the ETag) unchanged.
+
+The complete response (status line, headers and body) is pre-rendered and
+only rebuilt by render() when the sensor table has changed. Two response
+buffers are used: render() writes the inactive one and then switches the
+active index, while requests are served from the active buffer. A request
+pins the buffer it sends from, and render() skips (and retries on the next
+call) instead of overwriting a pinned buffer - so neither side ever waits
+for the other, even when requests are served from another task.
+
+The sensor table is a SensorSnapshots: update() may be called from the
+decode task while render() runs in another one (SNAPSHOT_MAX_SENSORS
+sensors, junk IDs replaced).
+
+Each response carries an ETag (hash of the body); a request with a matching
+If-None-Match header gets a "304 Not Modified" without body.
+
+Additional paths can be registered with route(); their responses are
+rendered on request (e.g. /metrics), i.e. they cost nothing until requested.
+The body is rendered part by part into a buffer of HTTP_DYNAMIC_SIZE bytes
+and each part is sent as it is rendered (chunked transfer encoding), so the
+body may be longer than the buffer - only each part must fit.
+
+poll() never waits for a client: up to HTTP_MAX_CONNECTIONS connections are
+served at the same time, each by a small state machine (read request, send
+response, render and send next part) on non-blocking sockets. Each call
+receives what has arrived, sends what the socket takes and renders at most
+one part of a route's body per connection, so it returns after a bounded
+amount of work even with a stalled client. A connection not completed
+within HTTP_TIMEOUT_MS of its accept is closed. Parts of route responses
+are rendered into a single buffer, so a second route response waits until
+the first one has been sent.
+
+The server uses BSD sockets (lwIP on the ESP32), so it runs unchanged on a
+Linux host and can be exercised with e.g. curl -i http://localhost:8080/
+*/
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <stdint.h>
+#include <atomic>
+#include "WeatherData.h"
+#include "SensorSnapshots.h"
+
+// Size of a pre-rendered response (bytes)
+#ifndef HTTP_RESPONSE_SIZE
+#define HTTP_RESPONSE_SIZE 2048
+#endif
+
+// Size of request buffer (bytes) - longer requests are truncated
+#define HTTP_REQUEST_SIZE 512
+
+// Size of a part of a response rendered on request (bytes)
+#ifndef HTTP_DYNAMIC_SIZE
+#define HTTP_DYNAMIC_SIZE 4096
+#endif
+
+#define HTTP_MAX_ROUTES 2
+
+// Connections served at the same time - further ones wait in the listen
+// backlog
+#ifndef HTTP_MAX_CONNECTIONS
+#define HTTP_MAX_CONNECTIONS 4
+#endif
+
+// A connection not completed within this time is closed (ms)
+#ifndef HTTP_TIMEOUT_MS
+#define HTTP_TIMEOUT_MS 5000
+#endif
+
+// Render callback of a route - renders part (0, 1, ...) of the body into buf,
+// returns its length, 0 after the last part or -1 on error (e.g. buf too
+// small); parts before the last must not be empty
+typedef int (*HttpRenderFn)(char *buf, unsigned size, unsigned part, void *ctx);
+
+struct HttpStats {
+    uint32_t requests;
+    uint32_t not_modified;         // 304 responses
+    uint32_t not_found;
+    uint32_t renders;              // response buffer rebuilds
+    uint32_t render_skipped;       // rebuilds postponed (buffer in use)
+    uint32_t route_errors;         // responses of routes failed or cut off
+    uint32_t timeouts;             // connections closed by HTTP_TIMEOUT_MS
+};
+
+class HttpServer {
+public:
+    HttpServer();
+    ~HttpServer();
+
+    // Listen on port
+    bool begin(uint16_t port);
+    void end();
+
+    // Serve path with body rendered by fn on each request
+    bool route(const char *path, const char *contentType, HttpRenderFn fn, void *ctx);
+
+    // Update sensor table - cheap, no rendering; ignored if the reading
+    // equals the sensor's previous one (timestamp not updated)
+    void update(const WeatherData *pData, uint32_t timestamp);
+
+    // Sensor table, for reading from other tasks
+    const SensorSnapshots& snapshots() const { return _sensors; }
+
+    // Rebuild response if sensor table has changed
+    void render();
+
+    // Accept connections and advance each one as far as possible without
+    // waiting
+    void poll();
+
+    const HttpStats& stats() const { return _stats; }
+
+private:
+    struct Response {
+        char     data[HTTP_RESPONSE_SIZE];
+        unsigned len;
+        char     etag[12];
+        std::atomic<int> readers;
+    };
+
+    struct Route {
+        const char  *path;
+        const char  *contentType;
+        HttpRenderFn fn;
+        void        *ctx;
+    };
+
+    enum ConnState { CONN_FREE, CONN_REQUEST, CONN_RESPONSE };
+
+    struct Connection {
+        int          fd;
+        ConnState    state;
+        uint32_t     accepted;     // clockMillis() of accept
+        char         req[HTTP_REQUEST_SIZE];
+        unsigned     reqLen;
+        const char  *out;          // being sent
+        unsigned     outLen;
+        const char  *next;         // sent after out
+        unsigned     nextLen;
+        Response    *pinned;       // cached response sent from
+        const Route *route;        // route whose body is being sent
+        unsigned     part;         // next part of the route's body
+        char         hdr[160];     // headers not in a response buffer
+    };
+
+    void advance(Connection *c);
+    void receive(Connection *c);
+    void dispatch(Connection *c);
+    bool sendPending(Connection *c);
+    bool nextPart(Connection *c);
+    void closeConn(Connection *c);
+    int  renderBody(char *buf, unsigned size);
+
+    int               _listen;
+    SensorSnapshots   _sensors;
+    uint32_t          _rendered;     // version of _sensors in the response
+    Response          _response[2];
+    std::atomic<int>  _active;
+    Route             _routes[HTTP_MAX_ROUTES];
+    unsigned          _routeCount;
+    Connection        _conns[HTTP_MAX_CONNECTIONS];
+    Connection       *_scratchOwner; // connection sending from _scratch
+    char              _scratch[HTTP_DYNAMIC_SIZE];
+    HttpStats         _stats;
+};
+
+#endif // HTTP_SERVER_H
@@ -0,0 +1,225 @@
+/*
+LowPowerRx - duty-cycled receive with light sleep between predicted transmissions
+*/
+#include "LowPowerRx.h"
+#include "Clock.h"
+
+#include <string.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <Arduino.h>
+#include <esp_sleep.h>
+#include <driver/gpio.h>
+#endif
+
+// WOR EVENT0 period: 750 / fXOSC * EVENT0 (WOR_RES = 0)
+#define WOR_EVENT0 ((uint32_t)LOW_POWER_WOR_EVENT0_US * (CC1101_XOSC_HZ / 1000) / 750000)
+static_assert(WOR_EVENT0 >= 1 && WOR_EVENT0 <= 0xffff, "LOW_POWER_WOR_EVENT0_US out of range");
+
+// MCSM2: RX_TIME_QUAL (stay in RX if PQI is set), RX_TIME
+#define WOR_MCSM2    (0x08 | (LOW_POWER_WOR_RX_TIME & 0x07))
+// MCSM2 default: no RX timeout
+#define RX_MCSM2     0x07
+// WORCTRL: RC oscillator on, EVENT1 = 7, RC_CAL, WOR_RES = 0
+#define WOR_WORCTRL  0x78
+
+// GDO0: asserted on sync word, de-asserted at end of packet
+#define GDO0_SYNC_WORD 0x06
+
+LowPowerRx::LowPowerRx() :
+    _bus(nullptr), _schedule(nullptr), _gdo0Pin(-1), _radio(RADIO_UNKNOWN),
+    _discoveryStart(0), _inWindow(false), _lastUs(0)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void LowPowerRx::begin(CC1101Bus *bus, SensorSchedule *schedule, int gdo0Pin, uint32_t now_ms)
+{
+    _bus            = bus;
+    _schedule       = schedule;
+    _gdo0Pin        = gdo0Pin;
+    _radio          = RADIO_UNKNOWN;
+    _discoveryStart = now_ms;
+    _inWindow       = false;
+    _lastUs         = clockMicros();
+    _bus->writeReg(CC1101_IOCFG0, GDO0_SYNC_WORD);
+}
+
+void LowPowerRx::plan(uint32_t now_ms, LowPowerPlan *pOut)
+{
+    if (now_ms - _discoveryStart >= LOW_POWER_DISCOVERY_INTERVAL_MS) {
+        _discoveryStart = now_ms;
+    }
+    uint32_t toDiscovery = _discoveryStart + LOW_POWER_DISCOVERY_INTERVAL_MS - now_ms;
+    uint32_t since       = now_ms - _discoveryStart;
+
+    pOut->listen    = true;
+    pOut->discovery = true;
+    pOut->sleep_ms  = LOW_POWER_MAX_SLEEP_MS;
+
+    SchedulePrediction p;
+    if (since < LOW_POWER_DISCOVERY_MS) {
+        pOut->sleep_ms = LOW_POWER_DISCOVERY_MS - since;
+    } else if (_schedule->next(now_ms, &p)) {
+        // Arrival times refer to the end of a frame
+        int32_t start = p.next_ms - p.window_ms - LOW_POWER_FRAME_MS - LOW_POWER_GUARD_MS - now_ms;
+        int32_t end   = p.next_ms + p.window_ms - now_ms;
+        pOut->discovery = false;
+        if (start <= 0) {
+            pOut->sleep_ms = (end > 0) ? end : 0;
+        } else {
+            pOut->listen   = false;
+            pOut->sleep_ms = start;
+        }
+    }
+    // else: no sensor known - keep listening
+
+    if (pOut->sleep_ms > LOW_POWER_MAX_SLEEP_MS) {
+        pOut->sleep_ms = LOW_POWER_MAX_SLEEP_MS;
+    }
+    if (!pOut->discovery && pOut->sleep_ms > toDiscovery) {
+        pOut->sleep_ms = toDiscovery;
+    }
+}
+
+void LowPowerRx::setRadio(RadioState state)
+{
+    if (state == _radio) {
+        return;
+    }
+    _bus->strobe(CC1101_SIDLE);
+    if (state != RADIO_IDLE) {
+        _bus->strobe(CC1101_SFRX);
+    }
+    switch (state) {
+        case RADIO_RX:
+            // MCSM2 may still hold the WOR RX timeout, e.g. after a frame
+            // caught by WOR (the radio is idle then, not in WOR)
+            _bus->writeReg(CC1101_MCSM2, RX_MCSM2);
+            _bus->strobe(CC1101_SRX);
+            break;
+        case RADIO_WOR:
+            _bus->writeReg(CC1101_MCSM2, WOR_MCSM2);
+            _bus->writeReg(CC1101_WOREVT1, WOR_EVENT0 >> 8);
+            _bus->writeReg(CC1101_WOREVT0, WOR_EVENT0 & 0xff);
+            _bus->writeReg(CC1101_WORCTRL, WOR_WORCTRL);
+            _bus->strobe(CC1101_SWORRST);
+            _bus->strobe(CC1101_SWOR);
+            break;
+        case RADIO_OFF:
+            _bus->strobe(CC1101_SPWD);
+            break;
+        default:
+            break;
+    }
+    _radio = state;
+}
+
+void LowPowerRx::account()
+{
+    uint32_t now = clockMicros();
+    uint32_t d   = now - _lastUs;
+    _lastUs = now;
+    _stats.total_us += d;
+    if (_radio == RADIO_RX) {
+        _stats.rx_us += d;
+    }
+}
+
+//
+// Sleep for ms or until GDO0 is asserted (gpio) - returns true on GDO0
+//
+bool LowPowerRx::sleep(uint32_t ms, bool gpio)
+{
+    bool woken = false;
+    _stats.sleeps++;
+
+#ifdef ARDUINO_ARCH_ESP32
+    uint32_t start = clockMicros();
+    Serial.flush();
+    esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000);
+    if (gpio) {
+        gpio_wakeup_enable((gpio_num_t)_gdo0Pin, GPIO_INTR_HIGH_LEVEL);
+        esp_sleep_enable_gpio_wakeup();
+    } else {
+        esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_GPIO);
+    }
+    esp_light_sleep_start();
+    woken = (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_GPIO);
+    if (gpio) {
+        gpio_wakeup_disable((gpio_num_t)_gdo0Pin);
+    }
+    _stats.asleep_us += clockMicros() - start;
+#else
+    // No sleep mode - wait actively
+    woken = _bus->waitGdo(gpio ? 0 : -1, true, ms * 1000);
+#endif
+
+    if (woken) {
+        _stats.gpio_wakeups++;
+    } else {
+        _stats.timer_wakeups++;
+    }
+    return woken;
+}
+
+bool LowPowerRx::waitForFrame()
+{
+    account();
+
+    LowPowerPlan p;
+    plan(clockMillis(), &p);
+
+    if (p.listen) {
+        if (!p.discovery && !_inWindow) {
+            _stats.windows++;
+        }
+        _inWindow = !p.discovery;
+        setRadio(RADIO_RX);
+    } else {
+        _inWindow = false;
+        #ifdef LOW_POWER_WOR
+            setRadio(RADIO_WOR);
+        #else
+            setRadio(RADIO_OFF);
+        #endif
+    }
+
+    bool gpio  = (_radio == RADIO_RX || _radio == RADIO_WOR);
+    bool frame = gpio && _bus->gdo(0);
+    if (!frame && p.sleep_ms > 0) {
+        frame = sleep(p.sleep_ms, gpio);
+    }
+    if (!frame) {
+        account();
+        return false;
+    }
+
+    // Sync word received - wait for the end of the packet, then the radio
+    // is idle (RXOFF_MODE) with the packet in the FIFO
+    _bus->waitGdo(0, false, 2 * LOW_POWER_FRAME_MS * 1000);
+    account();
+    _radio = RADIO_IDLE;
+
+    _stats.frames++;
+    if (_inWindow) {
+        _stats.frames_window++;
+    }
+    return true;
+}
+
+float LowPowerRx::awakeFraction() const
+{
+    if (_stats.total_us == 0) {
+        return 1;
+    }
+    return 1 - (float)_stats.asleep_us / _stats.total_us;
+}
+
+float LowPowerRx::rxFraction() const
+{
+    if (_stats.total_us == 0) {
+        return 1;
+    }
+    return (float)_stats.rx_us / _stats.total_us;
+}
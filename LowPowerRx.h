@@ -0,0 +1,127 @@
+/*
+LowPowerRx - duty-cycled receive with light sleep between predicted transmissions
+
+Instead of polling the radio in a busy loop, the MCU sleeps until either the
+CC1101 signals a received sync word on GDO0 or a timer expires:
+
+- While a receive window of a known sensor is open (predicted by
+  SensorSchedule, widened by LOW_POWER_GUARD_MS), the radio is in RX and the
+  MCU sleeps with GDO0 wake-up enabled.
+- Between windows the radio is powered down - or, with LOW_POWER_WOR, put
+  into Wake-On-Radio so it still catches unknown sensors - and the MCU
+  sleeps until the next window opens.
+- For LOW_POWER_DISCOVERY_MS after start and then every
+  LOW_POWER_DISCOVERY_INTERVAL_MS the radio listens continuously, so that
+  new sensors are learned and lost schedules are re-acquired.
+
+On the ESP32 the MCU enters light sleep (esp_light_sleep_start()); the radio
+keeps receiving and RAM, timers and peripherals are preserved. Elsewhere the
+wait is a busy loop, which keeps the logic usable (e.g. on a host with a
+simulated radio) but saves no power.
+
+The packet itself is read by the caller (e.g. radio.readData()) after
+waitForFrame() returned true. stats() gives the fraction of time the MCU was
+awake and the radio was receiving, and the number of frames caught inside
+predicted windows - compare frames and SensorSchedule's lost counts with an
+always-on receiver to get the capture rate.
+*/
+#ifndef LOW_POWER_RX_H
+#define LOW_POWER_RX_H
+
+#include <stdint.h>
+#include "CC1101Bus.h"
+#include "SensorSchedule.h"
+
+// Start receiving this long before a window opens (ms) - covers wake-up,
+// calibration and the preamble
+#ifndef LOW_POWER_GUARD_MS
+#define LOW_POWER_GUARD_MS 20
+#endif
+
+// Duration of a frame incl. preamble (ms) - 27 bytes at 8.21 kbps
+#ifndef LOW_POWER_FRAME_MS
+#define LOW_POWER_FRAME_MS 35
+#endif
+
+// Maximum sleep duration (ms) - the caller's loop runs at least this often
+#ifndef LOW_POWER_MAX_SLEEP_MS
+#define LOW_POWER_MAX_SLEEP_MS 10000
+#endif
+
+// Continuous receive for sensor discovery (ms)
+#ifndef LOW_POWER_DISCOVERY_MS
+#define LOW_POWER_DISCOVERY_MS 60000
+#endif
+#ifndef LOW_POWER_DISCOVERY_INTERVAL_MS
+#define LOW_POWER_DISCOVERY_INTERVAL_MS 3600000
+#endif
+
+// Wake-On-Radio: RX is started every EVENT0 period for a fraction of it
+// (RX_TIME 0..6: 12.5% .. 0.195%) and kept on if a preamble is detected.
+// The Bresser preamble (~5 ms) limits EVENT0 to a few ms, so the savings
+// are moderate and some frames may be missed - check stats.
+#ifndef LOW_POWER_WOR_EVENT0_US
+#define LOW_POWER_WOR_EVENT0_US 3000
+#endif
+#ifndef LOW_POWER_WOR_RX_TIME
+#define LOW_POWER_WOR_RX_TIME 0
+#endif
+
+struct LowPowerPlan {
+    bool     listen;               // radio in RX
+    bool     discovery;            // continuous receive for discovery
+    uint32_t sleep_ms;             // until the plan changes
+};
+
+struct LowPowerStats {
+    uint64_t total_us;
+    uint64_t asleep_us;            // MCU sleeping
+    uint64_t rx_us;                // radio in RX (WOR not included)
+    uint32_t sleeps;
+    uint32_t gpio_wakeups;
+    uint32_t timer_wakeups;
+    uint32_t windows;              // predicted windows opened
+    uint32_t frames;               // frames received
+    uint32_t frames_window;        // ... inside a predicted window
+};
+
+class LowPowerRx {
+public:
+    LowPowerRx();
+
+    // gdo0Pin is the MCU pin connected to GDO0 (wake-up source)
+    void begin(CC1101Bus *bus, SensorSchedule *schedule, int gdo0Pin, uint32_t now_ms);
+
+    // What to do at now_ms
+    void plan(uint32_t now_ms, LowPowerPlan *pOut);
+
+    // Set up the radio and sleep - returns true if a frame has been
+    // received (radio idle, FIFO holds the frame), false on timeout
+    bool waitForFrame();
+
+    const LowPowerStats& stats() const { return _stats; }
+
+    // Fraction of time the MCU has been awake
+    float awakeFraction() const;
+
+    // Fraction of time the radio has been receiving continuously
+    float rxFraction() const;
+
+private:
+    enum RadioState { RADIO_UNKNOWN, RADIO_IDLE, RADIO_RX, RADIO_WOR, RADIO_OFF };
+
+    void setRadio(RadioState state);
+    bool sleep(uint32_t ms, bool gpio);
+    void account();
+
+    CC1101Bus      *_bus;
+    SensorSchedule *_schedule;
+    int             _gdo0Pin;
+    RadioState      _radio;
+    uint32_t        _discoveryStart;
+    bool            _inWindow;
+    uint32_t        _lastUs;       // last accounting (clockMicros)
+    LowPowerStats   _stats;
+};
+
+#endif // LOW_POWER_RX_H
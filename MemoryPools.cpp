@@ -0,0 +1,224 @@
+/*
+MemoryPools - fixed-capacity typed object pools, and a guard against heap
+use after setup()
+
+See MemoryPools.h for the model.
+*/
+#include "MemoryPools.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HEAP_GUARD
+#ifdef ARDUINO
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+extern "C" int ets_printf(const char *fmt, ...);
+#else
+#include <unistd.h>
+#endif
+#endif
+
+// End of the list of released objects
+#define POOL_NONE 0xffff
+
+// Allocations printed by the heap guard (the rest is only counted)
+#define HEAP_GUARD_REPORTS 8
+
+Pool *Pool::_first = nullptr;
+
+Pool::Pool(const char *name, uint8_t *storage, std::atomic<uint16_t> *links, unsigned capacity, unsigned size) :
+    _name(name), _storage(storage), _links(links), _capacity(capacity), _size(size),
+    _head(POOL_NONE), _fresh(0), _used(0), _highWater(0), _acquired(0), _exhausted(0), _next(nullptr)
+{
+    // Pools are static objects - constructed before setup(), in one task
+    Pool **link = &_first;
+    while (*link) {
+        link = &(*link)->_next;
+    }
+    *link = this;
+}
+
+void *Pool::take()
+{
+    int slot = -1;
+
+    // Released object - the tag changes with every push and pop, so a head
+    // popped and pushed again in between fails the exchange
+    uint32_t head = _head.load(std::memory_order_acquire);
+    while ((head & 0xffff) != POOL_NONE) {
+        uint16_t i    = head & 0xffff;
+        uint32_t next = ((head + 0x10000) & 0xffff0000) | _links[i].load(std::memory_order_relaxed);
+        if (_head.compare_exchange_weak(head, next, std::memory_order_acquire, std::memory_order_acquire)) {
+            slot = i;
+            break;
+        }
+    }
+
+    // Else one never used
+    if (slot < 0) {
+        uint16_t fresh = _fresh.load(std::memory_order_relaxed);
+        while (fresh < _capacity) {
+            if (_fresh.compare_exchange_weak(fresh, fresh + 1, std::memory_order_relaxed)) {
+                slot = fresh;
+                break;
+            }
+        }
+    }
+
+    if (slot < 0) {
+        _exhausted.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    _acquired.fetch_add(1, std::memory_order_relaxed);
+    uint16_t used = _used.fetch_add(1, std::memory_order_relaxed) + 1;
+    uint16_t high = _highWater.load(std::memory_order_relaxed);
+    while (used > high && !_highWater.compare_exchange_weak(high, used, std::memory_order_relaxed))
+        ;
+    return &_storage[slot * _size];
+}
+
+void Pool::give(void *p)
+{
+    uint16_t i = ((uint8_t *)p - _storage) / _size;
+
+    _used.fetch_sub(1, std::memory_order_relaxed);
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    do {
+        _links[i].store(head & 0xffff, std::memory_order_relaxed);
+    } while (!_head.compare_exchange_weak(head, ((head + 0x10000) & 0xffff0000) | i,
+                                          std::memory_order_release, std::memory_order_relaxed));
+}
+
+PoolStats Pool::stats() const
+{
+    PoolStats s;
+    s.acquired   = _acquired.load(std::memory_order_relaxed);
+    s.exhausted  = _exhausted.load(std::memory_order_relaxed);
+    s.used       = _used.load(std::memory_order_relaxed);
+    s.high_water = _highWater.load(std::memory_order_relaxed);
+    return s;
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int renderPools(char *buf, unsigned size)
+{
+    unsigned len = 0;
+
+    APPEND("# TYPE bresser_pool_capacity gauge\n");
+    for (const Pool *p = Pool::first(); p; p = p->next()) {
+        APPEND("bresser_pool_capacity{pool=\"%s\"} %u\n", p->name(), p->capacity());
+    }
+    APPEND("# TYPE bresser_pool_used gauge\n");
+    for (const Pool *p = Pool::first(); p; p = p->next()) {
+        APPEND("bresser_pool_used{pool=\"%s\"} %u\n", p->name(), p->used());
+    }
+    APPEND("# TYPE bresser_pool_high_water gauge\n");
+    for (const Pool *p = Pool::first(); p; p = p->next()) {
+        APPEND("bresser_pool_high_water{pool=\"%s\"} %u\n", p->name(), p->highWater());
+    }
+    APPEND("# TYPE bresser_pool_exhausted_total counter\n");
+    for (const Pool *p = Pool::first(); p; p = p->next()) {
+        APPEND("bresser_pool_exhausted_total{pool=\"%s\"} %u\n", p->name(), (unsigned)p->stats().exhausted);
+    }
+    #ifdef HEAP_GUARD
+        APPEND("# TYPE bresser_heap_allocations_total counter\n");
+        APPEND("bresser_heap_allocations_total %u\n", (unsigned)heapGuardViolations());
+    #endif
+
+    return (len < size) ? (int)len : -1;
+}
+
+#ifdef HEAP_GUARD
+//
+// malloc, calloc and realloc are wrapped by the linker
+// (-Wl,--wrap=malloc ...): __wrap_x is called instead of x, __real_x is x
+//
+extern "C" {
+    void *__real_malloc(size_t size);
+    void *__real_calloc(size_t n, size_t size);
+    void *__real_realloc(void *p, size_t size);
+}
+
+static std::atomic<bool>     heapArmed(false);
+static std::atomic<uint32_t> heapAllocations(0);
+#ifdef ARDUINO
+static TaskHandle_t          heapTask;
+#endif
+
+static void heapCheck(void *caller, size_t size)
+{
+    if (!heapArmed.load(std::memory_order_relaxed)) {
+        return;
+    }
+    #ifdef ARDUINO
+        if (xTaskGetCurrentTaskHandle() != heapTask) {
+            return;
+        }
+    #endif
+    uint32_t n = heapAllocations.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (!HEAP_GUARD_ABORT && n > HEAP_GUARD_REPORTS) {
+        return;
+    }
+    // Reported without allocating
+    #ifdef ARDUINO
+        ets_printf("[HEAP] Allocation of %u bytes after setup() from %p\n", (unsigned)size, caller);
+    #else
+        char msg[80];
+        int  len = snprintf(msg, sizeof(msg), "[HEAP] Allocation of %u bytes after setup() from %p\n", (unsigned)size, caller);
+        ssize_t written = write(2, msg, len);
+        (void)written;
+    #endif
+    if (HEAP_GUARD_ABORT) {
+        abort();
+    }
+}
+
+extern "C" void *__wrap_malloc(size_t size)
+{
+    heapCheck(__builtin_return_address(0), size);
+    return __real_malloc(size);
+}
+
+extern "C" void *__wrap_calloc(size_t n, size_t size)
+{
+    heapCheck(__builtin_return_address(0), n * size);
+    return __real_calloc(n, size);
+}
+
+extern "C" void *__wrap_realloc(void *p, size_t size)
+{
+    heapCheck(__builtin_return_address(0), size);
+    return __real_realloc(p, size);
+}
+
+void heapGuardArm(void)
+{
+    #ifdef ARDUINO
+        heapTask = xTaskGetCurrentTaskHandle();
+    #endif
+    heapArmed.store(true, std::memory_order_release);
+}
+
+uint32_t heapGuardViolations(void)
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+#else
+void heapGuardArm(void)
+{
+}
+
+uint32_t heapGuardViolations(void)
+{
+    return 0;
+}
+#endif
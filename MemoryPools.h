@@ -0,0 +1,178 @@
+/*
+MemoryPools - fixed-capacity typed object pools, and a guard against heap
+use after setup()
+
+A device running for months must not fragment its heap. The receive path
+uses stack buffers and fixed arrays; pipeline stages which pass objects
+between tasks (frame queues, log writers, publishers) take them from a pool
+instead of new/malloc:
+
+    ObjectPool<RawFrame, POOL_FRAMES> framePool("frames");
+    ...
+    RawFrame *frame = framePool.acquire();      // nullptr if exhausted
+    ...
+    framePool.release(frame);
+
+- Storage is a static array of N objects. Released objects are linked by
+  index (Treiber stack with a tag against ABA), objects never used yet are
+  taken in order, so acquire() and release() are O(1) and lock-free - a
+  frame may be acquired by the radio task and released by another one.
+- acquire() constructs the object (value-initialized), release() destroys
+  it.
+- Each pool counts the objects in use, their high-water mark and the
+  failed acquisitions; all pools are listed in renderPools().
+
+With HEAP_GUARD defined (a build flag, see platformio.ini - it needs the
+linker to wrap malloc, calloc and realloc), every allocation after
+heapGuardArm() is reported: the caller's address is printed and, with
+HEAP_GUARD_ABORT (default), the program aborts. On the target only the
+arming task (loop()) is checked - WiFi and lwIP allocate in their own
+tasks, but connections made or accepted from loop() allocate in it
+(WiFiClient, lwIP socket calls), so the sketch refuses HEAP_GUARD with
+MQTT_PUBLISH and HTTP_SERVER. operator new is covered, as it uses malloc.
+*/
+#ifndef MEMORY_POOLS_H
+#define MEMORY_POOLS_H
+
+#include <stdint.h>
+#include <new>
+#include <atomic>
+#include "WeatherData.h"
+
+// Objects of the default pools
+#ifndef POOL_FRAMES
+#define POOL_FRAMES 8
+#endif
+#ifndef POOL_RECORDS
+#define POOL_RECORDS 8
+#endif
+#ifndef POOL_EVENTS
+#define POOL_EVENTS 16
+#endif
+
+// Raw frame incl. the last sync byte
+#ifndef POOL_FRAME_SIZE
+#define POOL_FRAME_SIZE 27
+#endif
+
+// Text of a log event incl. NUL
+#ifndef POOL_EVENT_TEXT
+#define POOL_EVENT_TEXT 48
+#endif
+
+#ifndef HEAP_GUARD_ABORT
+#define HEAP_GUARD_ABORT 1
+#endif
+
+// Frame as received
+struct RawFrame {
+    uint8_t  data[POOL_FRAME_SIZE];
+    uint8_t  len;
+    uint8_t  lqi;
+    float    rssi;                 // dBm
+    uint32_t time_ms;
+};
+
+// Decoded reading
+struct DecodedRecord {
+    WeatherData data;
+    uint32_t    timestamp;         // s since epoch
+    float       rssi;
+};
+
+// Line for the log
+struct LogEvent {
+    uint32_t time_ms;
+    uint8_t  level;
+    char     text[POOL_EVENT_TEXT];
+};
+
+struct PoolStats {
+    uint32_t acquired;
+    uint32_t exhausted;            // acquire() failed
+    uint16_t used;
+    uint16_t high_water;
+};
+
+//
+// Untyped part: free list of N slots of a fixed size
+//
+class Pool {
+public:
+    const char *name() const { return _name; }
+    unsigned    capacity() const { return _capacity; }
+    unsigned    used() const { return _used.load(std::memory_order_relaxed); }
+    unsigned    highWater() const { return _highWater.load(std::memory_order_relaxed); }
+
+    // Statistics (snapshot)
+    PoolStats stats() const;
+
+    // First pool / next pool - all pools constructed so far
+    static Pool *first() { return _first; }
+    Pool *next() const { return _next; }
+
+protected:
+    Pool(const char *name, uint8_t *storage, std::atomic<uint16_t> *links, unsigned capacity, unsigned size);
+
+    void *take();
+    void  give(void *p);
+
+private:
+    Pool(const Pool&);
+    Pool& operator=(const Pool&);
+
+    const char            *_name;
+    uint8_t               *_storage;
+    std::atomic<uint16_t> *_links;
+    uint16_t               _capacity;
+    uint16_t               _size;
+    std::atomic<uint32_t>  _head;      // tag << 16 | index of first released
+    std::atomic<uint16_t>  _fresh;     // objects never used: _fresh..capacity-1
+    std::atomic<uint16_t>  _used;
+    std::atomic<uint16_t>  _highWater;
+    std::atomic<uint32_t>  _acquired;
+    std::atomic<uint32_t>  _exhausted;
+    Pool                  *_next;
+
+    static Pool           *_first;
+};
+
+template<typename T, unsigned N>
+class ObjectPool : public Pool {
+    static_assert(N > 0 && N < 0xffff, "ObjectPool: 1..65534 objects");
+
+public:
+    explicit ObjectPool(const char *name) :
+        Pool(name, _storage, _links, N, sizeof(T))
+    {}
+
+    // Object (value-initialized) - nullptr if all are in use
+    T *acquire() {
+        void *p = take();
+        return p ? new (p) T() : nullptr;
+    }
+
+    // Return object (from this pool)
+    void release(T *obj) {
+        if (obj) {
+            obj->~T();
+            give(obj);
+        }
+    }
+
+private:
+    alignas(T) uint8_t    _storage[N * sizeof(T)];
+    std::atomic<uint16_t> _links[N];
+};
+
+// Prometheus text: objects in use, high-water mark and failed acquisitions
+// of all pools - returns length or -1 if buf is too small
+int renderPools(char *buf, unsigned size);
+
+// Report allocations from now on (HEAP_GUARD builds; else no-op)
+void heapGuardArm(void);
+
+// Allocations since heapGuardArm()
+uint32_t heapGuardViolations(void);
+
+#endif // MEMORY_POOLS_H
@@ -0,0 +1,177 @@
+/*
+Metrics - receiver health and RF quality metrics in Prometheus text format
+
+See Metrics.h for the list of metrics.
+*/
+#include "Metrics.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+const uint32_t Metrics::bucketBounds[METRICS_BUCKETS] = {
+    10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 1000000
+};
+
+static const char *const counterNames[METRIC_COUNTERS] = {
+    "bresser_frames_received_total", "bresser_sync_failures_total", "bresser_receive_errors_total"
+};
+
+static const char *const decoderNames[METRIC_DECODERS] = {"5in1", "6in1"};
+static const char *const resultNames[METRIC_RESULTS]   = {"ok", "parity", "checksum", "digest", "filtered"};
+static const char *const stageNames[METRIC_STAGES]     = {"receive", "decode", "output"};
+
+Metrics::Metrics() :
+    _sensorCount(0), _gaugeCount(0)
+{
+    for (int i = 0; i < METRIC_COUNTERS; i++) {
+        _counters[i] = 0;
+    }
+    for (int d = 0; d < METRIC_DECODERS; d++) {
+        for (int r = 0; r < METRIC_RESULTS; r++) {
+            _decode[d][r] = 0;
+        }
+    }
+    for (int s = 0; s < METRIC_STAGES; s++) {
+        for (int b = 0; b <= METRICS_BUCKETS; b++) {
+            _hist[s].buckets[b] = 0;
+        }
+        _hist[s].sum_us = 0;
+    }
+    for (int i = 0; i < METRICS_MAX_SENSORS; i++) {
+        _sensors[i].sensor_id = 0;
+        _sensors[i].rssi_x10  = 0;
+        _sensors[i].lqi       = 0;
+        _sensors[i].frames    = 0;
+    }
+    memset(_gauges, 0, sizeof(_gauges));
+}
+
+//
+// Entries are only ever added by the receiving task; readers only look at
+// the first _sensorCount entries
+//
+void Metrics::sensorSignal(uint32_t sensor_id, float rssi, uint8_t lqi)
+{
+    unsigned n = _sensorCount.load(std::memory_order_acquire);
+    unsigned i;
+    for (i = 0; i < n; i++) {
+        if (_sensors[i].sensor_id.load(std::memory_order_relaxed) == sensor_id) {
+            break;
+        }
+    }
+    if (i == n) {
+        if (n >= METRICS_MAX_SENSORS) {
+            return;
+        }
+        _sensors[i].sensor_id.store(sensor_id, std::memory_order_relaxed);
+        _sensorCount.store(n + 1, std::memory_order_release);
+    }
+    _sensors[i].rssi_x10.store(lroundf(rssi * 10), std::memory_order_relaxed);
+    _sensors[i].lqi.store(lqi, std::memory_order_relaxed);
+    _sensors[i].frames.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Metrics::addGauge(const char *queue, MetricGaugeFn fn, void *ctx)
+{
+    if (_gaugeCount >= METRICS_MAX_GAUGES) {
+        return false;
+    }
+    _gauges[_gaugeCount].queue = queue;
+    _gauges[_gaugeCount].fn    = fn;
+    _gauges[_gaugeCount].ctx   = ctx;
+    _gaugeCount++;
+    return true;
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+//
+// One metric family (group) per part, so that a scrape can be sent in
+// chunks of a fixed buffer
+//
+int Metrics::render(char *buf, unsigned size, unsigned part)
+{
+    unsigned len = 0;
+    unsigned n   = _sensorCount.load(std::memory_order_acquire);
+
+    switch (part) {
+    case 0:
+        for (int i = 0; i < METRIC_COUNTERS; i++) {
+            APPEND("# TYPE %s counter\n%s %u\n", counterNames[i], counterNames[i],
+                   (unsigned)_counters[i].load(std::memory_order_relaxed));
+        }
+        APPEND("# TYPE bresser_decode_total counter\n");
+        for (int d = 0; d < METRIC_DECODERS; d++) {
+            for (int r = 0; r < METRIC_RESULTS; r++) {
+                APPEND("bresser_decode_total{decoder=\"%s\",result=\"%s\"} %u\n", decoderNames[d], resultNames[r],
+                       (unsigned)_decode[d][r].load(std::memory_order_relaxed));
+            }
+        }
+        break;
+
+    case 1:
+        APPEND("# TYPE bresser_sensor_rssi_dbm gauge\n");
+        for (unsigned i = 0; i < n; i++) {
+            int32_t rssi = _sensors[i].rssi_x10.load(std::memory_order_relaxed);
+            APPEND("bresser_sensor_rssi_dbm{id=\"%08x\"} %.1f\n",
+                   (unsigned)_sensors[i].sensor_id.load(std::memory_order_relaxed), rssi / 10.0);
+        }
+        break;
+
+    case 2:
+        APPEND("# TYPE bresser_sensor_lqi gauge\n");
+        for (unsigned i = 0; i < n; i++) {
+            APPEND("bresser_sensor_lqi{id=\"%08x\"} %u\n",
+                   (unsigned)_sensors[i].sensor_id.load(std::memory_order_relaxed),
+                   (unsigned)_sensors[i].lqi.load(std::memory_order_relaxed));
+        }
+        break;
+
+    case 3:
+        APPEND("# TYPE bresser_sensor_frames_total counter\n");
+        for (unsigned i = 0; i < n; i++) {
+            APPEND("bresser_sensor_frames_total{id=\"%08x\"} %u\n",
+                   (unsigned)_sensors[i].sensor_id.load(std::memory_order_relaxed),
+                   (unsigned)_sensors[i].frames.load(std::memory_order_relaxed));
+        }
+        if (_gaugeCount) {
+            APPEND("# TYPE bresser_queue_depth gauge\n");
+            for (unsigned i = 0; i < _gaugeCount; i++) {
+                APPEND("bresser_queue_depth{queue=\"%s\"} %u\n", _gauges[i].queue,
+                       (unsigned)_gauges[i].fn(_gauges[i].ctx));
+            }
+        }
+        break;
+
+    case 4:
+        APPEND("# TYPE bresser_stage_latency_seconds histogram\n");
+        for (int s = 0; s < METRIC_STAGES; s++) {
+            uint32_t cumulative = 0;
+            for (int b = 0; b < METRICS_BUCKETS; b++) {
+                cumulative += _hist[s].buckets[b].load(std::memory_order_relaxed);
+                APPEND("bresser_stage_latency_seconds_bucket{stage=\"%s\",le=\"%g\"} %u\n",
+                       stageNames[s], bucketBounds[b] / 1e6, (unsigned)cumulative);
+            }
+            cumulative += _hist[s].buckets[METRICS_BUCKETS].load(std::memory_order_relaxed);
+            APPEND("bresser_stage_latency_seconds_bucket{stage=\"%s\",le=\"+Inf\"} %u\n",
+                   stageNames[s], (unsigned)cumulative);
+            APPEND("bresser_stage_latency_seconds_sum{stage=\"%s\"} %.6f\n",
+                   stageNames[s], _hist[s].sum_us.load(std::memory_order_relaxed) / 1e6);
+            APPEND("bresser_stage_latency_seconds_count{stage=\"%s\"} %u\n",
+                   stageNames[s], (unsigned)cumulative);
+        }
+        break;
+
+    default:
+        return 0;
+    }
+
+    return (len < size) ? (int)len : -1;
+}
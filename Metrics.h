@@ -0,0 +1,141 @@
+/*
+Metrics - receiver health and RF quality metrics in Prometheus text format
+
+Updating a metric on the hot path costs a few relaxed atomic operations:
+
+    metrics.inc(METRIC_FRAMES);
+    metrics.decodeResult(METRIC_DECODER_5IN1, status);
+    metrics.observe(METRIC_STAGE_DECODE, elapsed_us);
+    metrics.sensorSignal(sensor_id, rssi, lqi);
+
+Nothing is formatted until render() is called by a scrape (e.g. HTTP GET
+/metrics), so an idle scraper costs nothing. render() formats one part (a
+group of metric families) at a time, at most METRICS_PART_SIZE bytes, so a
+response can be sent in chunks from a fixed buffer. Queue depths are gauges which
+are read via callbacks, also only on scrape.
+
+Exposed metrics:
+
+    bresser_frames_received_total
+    bresser_sync_failures_total                 recvData[0] != 0xD4
+    bresser_receive_errors_total                radio.receive() errors
+    bresser_decode_total{decoder,result}        ok/parity/checksum/digest/filtered
+                                                (the 5-in-1 decoder tolerates parity and
+                                                checksum errors, they are counted anyway)
+    bresser_sensor_rssi_dbm{id}, bresser_sensor_lqi{id}, bresser_sensor_frames_total{id}
+    bresser_queue_depth{queue}
+    bresser_stage_latency_seconds{stage}        histogram
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <atomic>
+#include "WeatherData.h"
+
+// Number of sensors with signal quality gauges
+#ifndef METRICS_MAX_SENSORS
+#define METRICS_MAX_SENSORS 8
+#endif
+
+// Number of queue depth gauges
+#define METRICS_MAX_GAUGES 4
+
+// Histogram bucket upper bounds (us)
+#define METRICS_BUCKETS 10
+
+// Parts of render() and the size of the largest one (bytes): lines are
+// shorter than 80 bytes (queue names up to 32 characters); the latency
+// histogram or the family with a line per sensor is the longest part
+#define METRICS_PARTS 5
+#define METRICS_PART_LINES_FIXED (METRIC_STAGES * (METRICS_BUCKETS + 3) + 1)
+#define METRICS_PART_LINES_SENSORS (METRICS_MAX_SENSORS + METRICS_MAX_GAUGES + 2)
+#define METRICS_PART_SIZE (80 * (METRICS_PART_LINES_FIXED > METRICS_PART_LINES_SENSORS ? \
+                                 METRICS_PART_LINES_FIXED : METRICS_PART_LINES_SENSORS))
+
+enum MetricCounter {
+    METRIC_FRAMES, METRIC_SYNC_FAILURES, METRIC_RECEIVE_ERRORS, METRIC_COUNTERS
+};
+
+enum MetricDecoder {
+    METRIC_DECODER_5IN1, METRIC_DECODER_6IN1, METRIC_DECODERS
+};
+
+// Number of DecodeStatus values
+#define METRIC_RESULTS (DECODE_SKIP + 1)
+
+enum MetricStage {
+    METRIC_STAGE_RECEIVE,          // frame available -> read from the radio (not the wait)
+    METRIC_STAGE_DECODE,           // integrity checks and field extraction
+    METRIC_STAGE_OUTPUT,           // printing, logging, publishing
+    METRIC_STAGES
+};
+
+// Gauge callback - returns current value
+typedef uint32_t (*MetricGaugeFn)(void *ctx);
+
+class Metrics {
+public:
+    Metrics();
+
+    inline void inc(MetricCounter c) {
+        _counters[c].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    inline void decodeResult(MetricDecoder decoder, DecodeStatus status) {
+        if ((unsigned)status < METRIC_RESULTS) {
+            _decode[decoder][status].fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    inline void observe(MetricStage stage, uint32_t us) {
+        unsigned b = 0;
+        while (b < METRICS_BUCKETS && us > bucketBounds[b]) {
+            b++;
+        }
+        _hist[stage].buckets[b].fetch_add(1, std::memory_order_relaxed);
+        _hist[stage].sum_us.fetch_add(us, std::memory_order_relaxed);
+    }
+
+    void sensorSignal(uint32_t sensor_id, float rssi, uint8_t lqi);
+
+    // Register queue depth gauge (at setup time)
+    bool addGauge(const char *queue, MetricGaugeFn fn, void *ctx);
+
+    // Render part (0 .. METRICS_PARTS - 1) of the metrics - returns length,
+    // 0 if there is no such part or -1 if buf is too small
+    int render(char *buf, unsigned size, unsigned part);
+
+    static const uint32_t bucketBounds[METRICS_BUCKETS];
+
+private:
+    struct Histogram {
+        std::atomic<uint32_t> buckets[METRICS_BUCKETS + 1]; // last: +Inf
+        // 32 bit - 64 bit atomics are not lock-free on the ESP32; wraps
+        // after 71 min of summed latency (a counter reset to Prometheus)
+        std::atomic<uint32_t> sum_us;
+    };
+
+    struct SensorSignal {
+        std::atomic<uint32_t> sensor_id;
+        std::atomic<int32_t>  rssi_x10;
+        std::atomic<uint32_t> lqi;
+        std::atomic<uint32_t> frames;
+    };
+
+    struct Gauge {
+        const char   *queue;
+        MetricGaugeFn fn;
+        void         *ctx;
+    };
+
+    std::atomic<uint32_t> _counters[METRIC_COUNTERS];
+    std::atomic<uint32_t> _decode[METRIC_DECODERS][METRIC_RESULTS];
+    Histogram             _hist[METRIC_STAGES];
+    SensorSignal          _sensors[METRICS_MAX_SENSORS];
+    std::atomic<uint32_t> _sensorCount;
+    Gauge                 _gauges[METRICS_MAX_GAUGES];
+    unsigned              _gaugeCount;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,281 @@
+/*
+MqttPublisher - batched report-by-exception publishing of decoded readings
+
+See MqttPublisher.h for the message format.
+*/
+#include "MqttPublisher.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const fieldNames[MQTT_FIELDS] = {
+    "temp_c", "hum", "uv", "wind_gust", "wind_avg", "wind_dir", "rain", "moisture", "battery_ok"
+};
+
+// Decimal places used for rendering
+static const uint8_t fieldDecimals[MQTT_FIELDS] = {1, 0, 1, 1, 1, 1, 1, 0, 0};
+
+const MqttConfig MqttPublisher::defaultConfig = {
+    10000,                         // flush_ms
+    300000,                        // refresh_ms
+    // temp  hum   uv    gust  avg   dir    rain  moist batt
+    { 0.1f, 1.0f, 0.1f, 0.1f, 0.1f, 22.5f, 0.1f, 1.0f, 0.5f }
+};
+
+#define ALL_FIELDS ((1 << MQTT_FIELDS) - 1)
+
+MqttPublisher::MqttPublisher() :
+    _publish(nullptr), _ctx(nullptr), _flushed(0)
+{
+    _topic[0] = '\0';
+    _config = defaultConfig;
+    memset(_sensors, 0, sizeof(_sensors));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void MqttPublisher::begin(const char *topic, MqttPublishFn publish, void *ctx, const MqttConfig *config)
+{
+    snprintf(_topic, sizeof(_topic), "%s", topic);
+    _publish = publish;
+    _ctx     = ctx;
+    if (config) {
+        _config = *config;
+    }
+}
+
+MqttPublisher::SensorState *MqttPublisher::findSensor(uint32_t sensor_id)
+{
+    for (int i = 0; i < MQTT_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].sensor_id == sensor_id) {
+            return &_sensors[i];
+        }
+    }
+    return nullptr;
+}
+
+//
+// Entry for a new sensor: a free one, else the least recently heard
+// unconfirmed sensor, else the least recently heard stale one - nullptr: none
+//
+MqttPublisher::SensorState *MqttPublisher::victim(uint32_t now)
+{
+    SensorState *best = nullptr;
+    for (int i = 0; i < MQTT_MAX_SENSORS; i++) {
+        SensorState *s = &_sensors[i];
+        if (!s->used) {
+            return s;
+        }
+        bool confirmed = s->readings >= MQTT_MIN_READINGS;
+        if (confirmed && now - s->heard_at < MQTT_STALE_MS) {
+            continue;
+        }
+        bool bestConfirmed = best && best->readings >= MQTT_MIN_READINGS;
+        if (!best || (!confirmed && bestConfirmed) ||
+            (confirmed == bestConfirmed && now - s->heard_at > now - best->heard_at)) {
+            best = s;
+        }
+    }
+    return best;
+}
+
+//
+// Change of a field value - the wind direction is compared on the circle
+//
+static float change(int f, float a, float b)
+{
+    float d = fabsf(a - b);
+    if (f == MQTT_WIND_DIR && d > 180) {
+        d = 360 - d;
+    }
+    return d;
+}
+
+void MqttPublisher::values(const WeatherData *pData, float *v, bool *valid)
+{
+    v[MQTT_TEMP]          = pData->temp_c;
+    v[MQTT_HUM]           = pData->humidity;
+    v[MQTT_UV]            = pData->uv;
+    v[MQTT_WIND_GUST]     = pData->wind_gust_meter_sec;
+    v[MQTT_WIND_AVG]      = pData->wind_avg_meter_sec;
+    v[MQTT_WIND_DIR]      = pData->wind_direction_deg;
+    v[MQTT_RAIN]          = pData->rain_mm;
+    v[MQTT_MOISTURE]      = pData->moisture;
+    v[MQTT_BATTERY]       = pData->battery_ok ? 1 : 0;
+    valid[MQTT_TEMP]      = pData->temp_ok;
+    valid[MQTT_HUM]       = pData->temp_ok && !pData->moisture_ok;
+    valid[MQTT_UV]        = pData->uv_ok;
+    valid[MQTT_WIND_GUST] = pData->wind_ok;
+    valid[MQTT_WIND_AVG]  = pData->wind_ok;
+    valid[MQTT_WIND_DIR]  = pData->wind_ok;
+    valid[MQTT_RAIN]      = pData->rain_ok;
+    valid[MQTT_MOISTURE]  = pData->moisture_ok;
+    valid[MQTT_BATTERY]   = true;
+}
+
+//
+// Render JSON object of the fields in mask - returns length or -1 if the
+// buffer is too small
+//
+int MqttPublisher::render(char *buf, unsigned size, uint32_t sensor_id, const float *v,
+                          const bool *valid, uint16_t mask)
+{
+    int len = snprintf(buf, size, "{\"id\":\"%08x\"", (unsigned)sensor_id);
+    for (int f = 0; f < MQTT_FIELDS && len >= 0 && (unsigned)len < size; f++) {
+        if (!(mask & (1 << f)) || !valid[f]) {
+            continue;
+        }
+        if (f == MQTT_BATTERY) {
+            len += snprintf(&buf[len], size - len, ",\"%s\":%s", fieldNames[f], v[f] ? "true" : "false");
+        } else {
+            len += snprintf(&buf[len], size - len, ",\"%s\":%.*f", fieldNames[f], fieldDecimals[f], v[f]);
+        }
+    }
+    if (len >= 0 && (unsigned)len < size) {
+        len += snprintf(&buf[len], size - len, "}");
+    }
+    return (len >= 0 && (unsigned)len < size) ? len : -1;
+}
+
+void MqttPublisher::update(const WeatherData *pData, uint32_t now)
+{
+    float v[MQTT_FIELDS];
+    bool  valid[MQTT_FIELDS];
+    char  naive[MQTT_PAYLOAD_SIZE];
+
+    values(pData, v, valid);
+    _stats.frames++;
+
+    // Cost of publishing this frame on its own
+    int len = render(naive, sizeof(naive), pData->sensor_id, v, valid, ALL_FIELDS);
+    if (len > 0) {
+        _stats.naive_publishes++;
+        _stats.naive_bytes += strlen(_topic) + len;
+    }
+
+    SensorState *s = findSensor(pData->sensor_id);
+    if (!s) {
+        s = victim(now);
+        if (!s) {
+            _stats.untracked++;
+            return;
+        }
+        if (s->used) {
+            _stats.evictions++;
+        }
+        memset(s, 0, sizeof(SensorState));
+        s->used      = true;
+        s->sensor_id = pData->sensor_id;
+    }
+    s->readings++;
+    s->heard_at = now;
+    if (now - s->published_at >= _config.refresh_ms) {
+        s->refresh = true;
+    }
+    for (int f = 0; f < MQTT_FIELDS; f++) {
+        s->valid[f]   = valid[f];
+        s->current[f] = v[f];
+        if (!valid[f]) {
+            continue;
+        }
+        if (s->refresh || !s->ever[f] || change(f, v[f], s->published[f]) >= _config.deadband[f]) {
+            s->changed |= (1 << f);
+        } else if (!(s->changed & (1 << f))) {
+            _stats.suppressed++;
+        }
+    }
+}
+
+unsigned MqttPublisher::pending() const
+{
+    unsigned n = 0;
+    for (int i = 0; i < MQTT_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].changed) {
+            n++;
+        }
+    }
+    return n;
+}
+
+bool MqttPublisher::publish(const char *payload, unsigned len)
+{
+    if (!_publish || !_publish(_topic, payload, len, _ctx)) {
+        _stats.failed++;
+        return false;
+    }
+    _stats.publishes++;
+    _stats.bytes += strlen(_topic) + len;
+    return true;
+}
+
+//
+// Close and publish batch - on failure, the sensors contained are marked for
+// a complete re-publish with the next flush
+//
+bool MqttPublisher::sendBatch(unsigned len, bool *batched)
+{
+    memcpy(&_payload[len], "]}", 3);
+    bool ok = publish(_payload, len + 2);
+    for (int i = 0; i < MQTT_MAX_SENSORS; i++) {
+        if (batched[i] && !ok) {
+            _sensors[i].changed = ALL_FIELDS;
+        }
+        batched[i] = false;
+    }
+    return ok;
+}
+
+unsigned MqttPublisher::flush(uint32_t now, bool force)
+{
+    static const char head[] = "{\"sensors\":[";
+    char item[MQTT_PAYLOAD_SIZE - sizeof(head) - 2];
+    bool batched[MQTT_MAX_SENSORS] = {false};
+    unsigned messages = 0;
+    unsigned len = 0;
+
+    if (!force && now - _flushed < _config.flush_ms) {
+        return 0;
+    }
+    _flushed = now;
+
+    for (int i = 0; i < MQTT_MAX_SENSORS; i++) {
+        SensorState *s = &_sensors[i];
+        if (!s->used || !s->changed) {
+            continue;
+        }
+        int n = render(item, sizeof(_payload) - sizeof(head) - 2, s->sensor_id, s->current, s->valid, s->changed);
+        if (n < 0) {
+            continue;
+        }
+        // Batch full - publish and start a new one ("]}" + NUL must fit)
+        if (len && len + 1 + n + 3 > sizeof(_payload)) {
+            messages += sendBatch(len, batched) ? 1 : 0;
+            len = 0;
+        }
+        if (len == 0) {
+            memcpy(_payload, head, sizeof(head) - 1);
+            len = sizeof(head) - 1;
+        } else {
+            _payload[len++] = ',';
+        }
+        memcpy(&_payload[len], item, n);
+        len += n;
+        batched[i] = true;
+
+        for (int f = 0; f < MQTT_FIELDS; f++) {
+            if (s->changed & (1 << f)) {
+                s->published[f] = s->current[f];
+                s->ever[f]      = true;
+            }
+        }
+        if (s->refresh) {
+            s->published_at = now;
+            s->refresh      = false;
+        }
+        s->changed = 0;
+    }
+    if (len) {
+        messages += sendBatch(len, batched) ? 1 : 0;
+    }
+    return messages;
+}
@@ -0,0 +1,135 @@
+/*
+MqttPublisher - batched report-by-exception publishing of decoded readings
+
+Readings are not published per frame. Instead, update() records the latest
+reading of each sensor and marks the fields which changed by at least their
+deadband since they were last published. flush() - called periodically -
+collects all changed fields of all sensors into a single JSON message:
+
+    {"sensors":[{"id":"fa5e1c20","temp_c":12.3,"hum":56},{"id":"0012c300","wind_gust":3.4}]}
+
+A sensor's complete reading is re-published after refresh_ms, even if
+nothing changed, so consumers recover from missed messages.
+
+The publisher is independent of the MQTT client: messages are passed to a
+callback, e.g. wrapping PubSubClient::publish().
+
+A new sensor takes a free entry, else the least recently heard one which
+is unconfirmed (fewer than MQTT_MIN_READINGS readings, e.g. an ID decoded
+from a corrupted frame), else the least recently heard one which is stale
+(not heard for MQTT_STALE_MS) - otherwise its readings are not published.
+
+The wind direction deadband is applied to the difference on the circle,
+so 355 deg -> 5 deg is a change of 10 deg.
+
+For comparison, the size of a naive publish of every frame (full JSON
+message per reading) is accounted in MqttStats.
+*/
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <stdint.h>
+#include "WeatherData.h"
+
+// Number of sensors tracked
+#ifndef MQTT_MAX_SENSORS
+#define MQTT_MAX_SENSORS 8
+#endif
+
+// Readings after which a sensor is no longer replaced by new ones
+#ifndef MQTT_MIN_READINGS
+#define MQTT_MIN_READINGS 3
+#endif
+
+// A sensor not heard for this long may be replaced by a new one (ms)
+#ifndef MQTT_STALE_MS
+#define MQTT_STALE_MS 600000
+#endif
+
+// Maximum size of a batch message (bytes)
+#ifndef MQTT_PAYLOAD_SIZE
+#define MQTT_PAYLOAD_SIZE 512
+#endif
+
+#define MQTT_TOPIC_LEN 48
+
+enum MqttField {
+    MQTT_TEMP, MQTT_HUM, MQTT_UV, MQTT_WIND_GUST, MQTT_WIND_AVG, MQTT_WIND_DIR, MQTT_RAIN,
+    MQTT_MOISTURE, MQTT_BATTERY, MQTT_FIELDS
+};
+
+struct MqttConfig {
+    uint32_t flush_ms;             // batch interval
+    uint32_t refresh_ms;           // forced re-publish of unchanged values
+    float    deadband[MQTT_FIELDS];// minimum change to be reported
+};
+
+struct MqttStats {
+    uint32_t frames;               // readings passed to update()
+    uint32_t publishes;            // messages published
+    uint32_t bytes;                // topic + payload bytes published
+    uint32_t naive_publishes;      // messages when publishing every frame
+    uint32_t naive_bytes;          // bytes when publishing every frame
+    uint32_t suppressed;           // field values suppressed by deadband
+    uint32_t failed;               // publish callback errors
+    uint32_t evictions;            // sensors replaced
+    uint32_t untracked;            // readings of sensors without an entry
+};
+
+// Publish callback - returns false on error
+typedef bool (*MqttPublishFn)(const char *topic, const char *payload, unsigned len, void *ctx);
+
+class MqttPublisher {
+public:
+    MqttPublisher();
+
+    // Set topic, transport callback and (optional) configuration
+    void begin(const char *topic, MqttPublishFn publish, void *ctx, const MqttConfig *config = nullptr);
+
+    // Record reading - nothing is published here
+    void update(const WeatherData *pData, uint32_t now);
+
+    // Publish changed values if the flush interval has elapsed (or force)
+    // Returns number of messages published
+    unsigned flush(uint32_t now, bool force = false);
+
+    // Sensors with changes waiting for the next flush
+    unsigned pending() const;
+
+    const MqttStats& stats() const { return _stats; }
+
+    static const MqttConfig defaultConfig;
+
+private:
+    struct SensorState {
+        bool     used;
+        uint32_t sensor_id;
+        uint32_t readings;         // update() calls
+        uint32_t heard_at;         // last update()
+        uint32_t published_at;     // last complete publish
+        bool     refresh;          // complete publish due
+        uint16_t changed;          // bitmask of MqttField
+        bool     valid[MQTT_FIELDS];
+        float    current[MQTT_FIELDS];
+        float    published[MQTT_FIELDS];
+        bool     ever[MQTT_FIELDS]; // published at least once
+    };
+
+    SensorState *findSensor(uint32_t sensor_id);
+    SensorState *victim(uint32_t now);
+    static void values(const WeatherData *pData, float *v, bool *valid);
+    static int  render(char *buf, unsigned size, uint32_t sensor_id, const float *v, const bool *valid, uint16_t mask);
+    bool publish(const char *payload, unsigned len);
+    bool sendBatch(unsigned len, bool *batched);
+
+    char          _topic[MQTT_TOPIC_LEN];
+    MqttPublishFn _publish;
+    void         *_ctx;
+    MqttConfig    _config;
+    uint32_t      _flushed;
+    SensorState   _sensors[MQTT_MAX_SENSORS];
+    char          _payload[MQTT_PAYLOAD_SIZE];
+    MqttStats     _stats;
+};
+
+#endif // MQTT_PUBLISHER_H
@@ -0,0 +1,259 @@
+/*
+NoiseFloor - ambient noise floor tracking and adaptive sync word qualification
+
+See NoiseFloor.h for the model.
+*/
+#include "NoiseFloor.h"
+#include "CC1101Bus.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// CARRIER_SENSE_ABS_THR range (-8: disabled)
+#define CS_ABS_THR_MIN -7
+#define CS_ABS_THR_MAX 7
+
+P2Quantile::P2Quantile(float p) :
+    _p(p)
+{
+    reset();
+}
+
+void P2Quantile::reset()
+{
+    for (int i = 0; i < 5; i++) {
+        _q[i] = 0;
+        _n[i] = i;
+    }
+    _np[0] = 0;
+    _np[1] = 2 * _p;
+    _np[2] = 4 * _p;
+    _np[3] = 2 + 2 * _p;
+    _np[4] = 4;
+    _dn[0] = 0;
+    _dn[1] = _p / 2;
+    _dn[2] = _p;
+    _dn[3] = (1 + _p) / 2;
+    _dn[4] = 1;
+    _count = 0;
+}
+
+float P2Quantile::parabolic(int i, int d) const
+{
+    return _q[i] + d / (_n[i + 1] - _n[i - 1]) *
+           ((_n[i] - _n[i - 1] + d) * (_q[i + 1] - _q[i]) / (_n[i + 1] - _n[i]) +
+            (_n[i + 1] - _n[i] - d) * (_q[i] - _q[i - 1]) / (_n[i] - _n[i - 1]));
+}
+
+float P2Quantile::linear(int i, int d) const
+{
+    return _q[i] + d * (_q[i + d] - _q[i]) / (_n[i + d] - _n[i]);
+}
+
+void P2Quantile::add(float x)
+{
+    // The first five samples are the initial markers
+    if (_count < 5) {
+        int i = _count++;
+        for (; i > 0 && _q[i - 1] > x; i--) {
+            _q[i] = _q[i - 1];
+        }
+        _q[i] = x;
+        return;
+    }
+    _count++;
+
+    // Cell of x, extremes adjusted
+    int k;
+    if (x < _q[0]) {
+        _q[0] = x;
+        k = 0;
+    } else if (x >= _q[4]) {
+        _q[4] = x;
+        k = 3;
+    } else {
+        for (k = 0; x >= _q[k + 1]; k++)
+            ;
+    }
+    for (int i = k + 1; i < 5; i++) {
+        _n[i]++;
+    }
+    for (int i = 0; i < 5; i++) {
+        _np[i] += _dn[i];
+    }
+
+    // Move the middle markers towards their desired positions
+    for (int i = 1; i <= 3; i++) {
+        float d = _np[i] - _n[i];
+        if ((d >= 1 && _n[i + 1] - _n[i] > 1) || (d <= -1 && _n[i - 1] - _n[i] < -1)) {
+            int   s = (d > 0) ? 1 : -1;
+            float q = parabolic(i, s);
+            _q[i] = (_q[i - 1] < q && q < _q[i + 1]) ? q : linear(i, s);
+            _n[i] += s;
+        }
+    }
+}
+
+float P2Quantile::value() const
+{
+    if (_count == 0) {
+        return NAN;
+    }
+    if (_count < 5) {
+        return _q[(int)(_p * (_count - 1) + 0.5f)];
+    }
+    return _q[2];
+}
+
+NoiseFloor::NoiseFloor() :
+    _quantile(NOISE_PERCENTILE)
+{
+    begin(0);
+}
+
+void NoiseFloor::begin(uint32_t now_ms)
+{
+    _quantile.reset();
+    _start        = now_ms;
+    _historyCount = 0;
+    _historyNext  = 0;
+    _quiet        = 0;
+    _floor        = NAN;
+
+    // Until the floor is known: the most sensitive setting
+    _thresholds.cs_abs_thr = CS_ABS_THR_MIN;
+    _thresholds.pqt        = NOISE_PQT_MIN;
+    memset(&_current, 0, sizeof(_current));
+    _current.thresholds = _thresholds;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void NoiseFloor::sample(uint8_t rssi_raw)
+{
+    _quantile.add(cc1101RssiDbm(rssi_raw));
+    _stats.samples++;
+}
+
+void NoiseFloor::packet(bool valid)
+{
+    _current.packets++;
+    _stats.packets++;
+    if (!valid) {
+        _current.junk++;
+        _stats.junk++;
+    }
+}
+
+bool NoiseFloor::poll(uint32_t now_ms)
+{
+    if (now_ms - _start < NOISE_INTERVAL_MS) {
+        return false;
+    }
+    _start = now_ms;
+
+    // Close the interval
+    _current.floor_dbm = (_quantile.count() >= NOISE_MIN_SAMPLES) ? _quantile.value() : NAN;
+    _history[_historyNext] = _current;
+    _historyNext = (_historyNext + 1) % NOISE_HISTORY;
+    if (_historyCount < NOISE_HISTORY) {
+        _historyCount++;
+    }
+    _quantile.reset();
+
+    NoiseThresholds next = _thresholds;
+    if (!isnan(_current.floor_dbm)) {
+        _floor = _current.floor_dbm;
+        long thr = lroundf(_floor + NOISE_CS_MARGIN_DB - NOISE_CS_BASE_DBM);
+        next.cs_abs_thr = (thr < CS_ABS_THR_MIN) ? CS_ABS_THR_MIN : (thr > CS_ABS_THR_MAX) ? CS_ABS_THR_MAX : thr;
+    }
+    if (_current.junk > NOISE_JUNK_HIGH) {
+        _quiet = 0;
+        if (next.pqt < NOISE_PQT_MAX) {
+            next.pqt++;
+        }
+    } else if (_current.junk == 0 && ++_quiet >= NOISE_RELAX_INTERVALS) {
+        _quiet = 0;
+        if (next.pqt > NOISE_PQT_MIN) {
+            next.pqt--;
+        }
+    }
+
+    bool changed = (next.cs_abs_thr != _thresholds.cs_abs_thr || next.pqt != _thresholds.pqt);
+    if (changed) {
+        _thresholds = next;
+        _stats.changes++;
+    }
+    memset(&_current, 0, sizeof(_current));
+    _current.thresholds = _thresholds;
+    return changed;
+}
+
+uint8_t NoiseFloor::agcctrl1(uint8_t value) const
+{
+    return (value & 0xf0) | (_thresholds.cs_abs_thr & 0x0f);
+}
+
+uint8_t NoiseFloor::pktctrl1(uint8_t value) const
+{
+    return (value & 0x1f) | (_thresholds.pqt << 5);
+}
+
+bool NoiseFloor::history(unsigned i, NoiseInterval *pOut) const
+{
+    if (i >= _historyCount) {
+        return false;
+    }
+    *pOut = _history[(_historyNext + NOISE_HISTORY - 1 - i) % NOISE_HISTORY];
+    return true;
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int NoiseFloor::render(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    if (!isnan(_floor)) {
+        APPEND("# TYPE bresser_noise_floor_dbm gauge\n");
+        APPEND("bresser_noise_floor_dbm %.1f\n", _floor);
+    }
+    APPEND("# TYPE bresser_carrier_sense_threshold_dbm gauge\n");
+    APPEND("bresser_carrier_sense_threshold_dbm %.0f\n", csThreshold());
+    APPEND("# TYPE bresser_preamble_quality_threshold gauge\n");
+    APPEND("bresser_preamble_quality_threshold %u\n", (unsigned)_thresholds.pqt * 4);
+    APPEND("# TYPE bresser_radio_packets_total counter\n");
+    APPEND("bresser_radio_packets_total %u\n", (unsigned)_stats.packets);
+    APPEND("# TYPE bresser_radio_junk_total counter\n");
+    APPEND("bresser_radio_junk_total %u\n", (unsigned)_stats.junk);
+
+    return (len < size) ? (int)len : -1;
+}
+
+int NoiseFloor::renderHistory(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    APPEND("{\"interval_s\":%u,\"history\":[", (unsigned)(NOISE_INTERVAL_MS / 1000));
+    NoiseInterval h;
+    for (unsigned i = 0; history(i, &h); i++) {
+        APPEND("%s{\"floor\":", i ? "," : "");
+        if (isnan(h.floor_dbm)) {
+            APPEND("null");
+        } else {
+            APPEND("%.1f", h.floor_dbm);
+        }
+        APPEND(",\"cs\":%d,\"pqt\":%u,\"packets\":%u,\"junk\":%u}",
+               NOISE_CS_BASE_DBM + h.thresholds.cs_abs_thr, (unsigned)h.thresholds.pqt,
+               (unsigned)h.packets, (unsigned)h.junk);
+    }
+    APPEND("]}");
+
+    return (len < size) ? (int)len : -1;
+}
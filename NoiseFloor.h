@@ -0,0 +1,180 @@
+/*
+NoiseFloor - ambient noise floor tracking and adaptive sync word qualification
+
+With a 16-bit sync word, noise alone matches it every few seconds (2^-16 per
+bit, about once in 8 s at 8.2 kbps); each match delivers a packet of junk
+which fails validation after it has been read and decoded. The CC1101 can
+reject such packets itself:
+
+- carrier sense qualified sync (MDMCFG2 SYNC_MODE 16/16 + carrier sense):
+  a sync word counts only while the RSSI is above the carrier sense
+  threshold (AGCCTRL1 CARRIER_SENSE_ABS_THR, -7..+7 dB around the level set
+  by MAGN_TARGET)
+- preamble quality threshold (PKTCTRL1 PQT): a sync word counts only after
+  4 * PQT bits of preamble
+
+A threshold too high rejects weak sensors, so both follow the environment:
+
+- The RSSI is sampled while the radio listens without a packet. A P²
+  estimator (Jain/Chlamtac: five markers, O(1) per sample, no sample
+  buffer) gives the NOISE_PERCENTILE percentile of each NOISE_INTERVAL_MS
+  interval - the noise floor.
+- The carrier sense threshold is set NOISE_CS_MARGIN_DB above the floor.
+- PQT is raised while junk still gets through (more than NOISE_JUNK_HIGH
+  packets in an interval), and lowered again after NOISE_RELAX_INTERVALS
+  intervals without junk.
+
+Each interval is kept in the history (floor, packets, junk, thresholds).
+*/
+#ifndef NOISE_FLOOR_H
+#define NOISE_FLOOR_H
+
+#include <stdint.h>
+
+// Percentile of the RSSI samples taken as the noise floor
+#ifndef NOISE_PERCENTILE
+#define NOISE_PERCENTILE 0.5f
+#endif
+
+// Length of an interval (ms) - one history entry each
+#ifndef NOISE_INTERVAL_MS
+#define NOISE_INTERVAL_MS 60000
+#endif
+
+// Intervals kept in the history
+#ifndef NOISE_HISTORY
+#define NOISE_HISTORY 60
+#endif
+
+// Samples needed for a noise floor estimate
+#ifndef NOISE_MIN_SAMPLES
+#define NOISE_MIN_SAMPLES 20
+#endif
+
+// Carrier sense threshold above the noise floor (dB)
+#ifndef NOISE_CS_MARGIN_DB
+#define NOISE_CS_MARGIN_DB 6
+#endif
+
+// RSSI at which carrier sense is asserted with CARRIER_SENSE_ABS_THR 0 and
+// the default MAGN_TARGET (33 dB) - depends on the board (see DN022)
+#ifndef NOISE_CS_BASE_DBM
+#define NOISE_CS_BASE_DBM -95
+#endif
+
+// PQT range
+#ifndef NOISE_PQT_MIN
+#define NOISE_PQT_MIN 0
+#endif
+#ifndef NOISE_PQT_MAX
+#define NOISE_PQT_MAX 4
+#endif
+
+// Junk packets per interval which raise PQT
+#ifndef NOISE_JUNK_HIGH
+#define NOISE_JUNK_HIGH 2
+#endif
+
+// Intervals without junk before PQT is lowered
+#ifndef NOISE_RELAX_INTERVALS
+#define NOISE_RELAX_INTERVALS 30
+#endif
+
+//
+// Streaming quantile estimate (P² algorithm)
+//
+class P2Quantile {
+public:
+    explicit P2Quantile(float p = 0.5f);
+
+    void     reset();
+    void     add(float x);
+    float    value() const;        // exact while fewer than 5 samples
+    uint32_t count() const { return _count; }
+
+private:
+    float    parabolic(int i, int d) const;
+    float    linear(int i, int d) const;
+
+    float    _p;
+    float    _q[5];                // marker heights
+    float    _n[5];                // marker positions
+    float    _np[5];               // desired positions
+    float    _dn[5];               // increments of the desired positions
+    uint32_t _count;
+};
+
+struct NoiseThresholds {
+    int8_t  cs_abs_thr;            // AGCCTRL1 CARRIER_SENSE_ABS_THR (-7..7)
+    uint8_t pqt;                   // PKTCTRL1 PQT (0..7)
+};
+
+struct NoiseInterval {
+    float           floor_dbm;     // NAN: too few samples
+    uint32_t        packets;       // packets read from the radio
+    uint32_t        junk;          // of them failing validation
+    NoiseThresholds thresholds;    // in effect
+};
+
+struct NoiseStats {
+    uint32_t samples;
+    uint32_t packets;
+    uint32_t junk;
+    uint32_t changes;              // thresholds changed
+};
+
+class NoiseFloor {
+public:
+    NoiseFloor();
+
+    void begin(uint32_t now_ms);
+
+    // RSSI register value sampled while listening without a packet
+    void sample(uint8_t rssi_raw);
+
+    // Packet read from the radio - valid: passed validation
+    void packet(bool valid);
+
+    // Close the interval when it is over - returns true if the thresholds
+    // have changed and are to be written to the radio
+    bool poll(uint32_t now_ms);
+
+    // Latest noise floor (dBm), NAN if not yet known
+    float floor() const { return _floor; }
+
+    // Carrier sense threshold (dBm)
+    float csThreshold() const { return NOISE_CS_BASE_DBM + _thresholds.cs_abs_thr; }
+
+    const NoiseThresholds& thresholds() const { return _thresholds; }
+
+    // Register values with the thresholds applied
+    uint8_t agcctrl1(uint8_t value) const;
+    uint8_t pktctrl1(uint8_t value) const;
+
+    // Interval i (0: latest) - returns false if there is none
+    bool history(unsigned i, NoiseInterval *pOut) const;
+
+    const NoiseStats& stats() const { return _stats; }
+
+    // Prometheus text: floor, thresholds, packets/junk - returns length or -1
+    // if buf is too small
+    int render(char *buf, unsigned size) const;
+
+    // JSON: history, latest first (floor and carrier sense threshold in dBm) -
+    // returns length or -1 if buf is too small
+    int renderHistory(char *buf, unsigned size) const;
+
+private:
+    P2Quantile      _quantile;
+    uint32_t        _start;        // of the current interval
+    NoiseInterval   _current;
+    NoiseInterval   _history[NOISE_HISTORY];
+    unsigned        _historyCount;
+    unsigned        _historyNext;
+    unsigned        _quiet;        // intervals without junk
+    float           _floor;
+    NoiseThresholds _thresholds;
+    NoiseStats      _stats;
+};
+
+#endif // NOISE_FLOOR_H
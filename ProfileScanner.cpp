@@ -0,0 +1,169 @@
+/*
+ProfileScanner - time-sliced receive on several radio profiles
+
+See ProfileScanner.h for the policy.
+*/
+#include "ProfileScanner.h"
+#include "Clock.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// MARCSTATE in RX
+#define MARCSTATE_RX 0x0D
+
+ProfileScanner::ProfileScanner() :
+    _bus(nullptr), _count(0), _current(0), _since(0), _deferring(false)
+{
+    memset(_profiles, 0, sizeof(_profiles));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int ProfileScanner::add(const char *name, const CC1101Image *image)
+{
+    if (_count >= SCAN_MAX_PROFILES) {
+        return -1;
+    }
+    _profiles[_count].name  = name;
+    _profiles[_count].image = image;
+    return _count++;
+}
+
+void ProfileScanner::begin(CC1101Bus *bus, uint32_t now_ms)
+{
+    _bus = bus;
+    plan();
+    reconfigured(now_ms);
+}
+
+void ProfileScanner::reconfigured(uint32_t now_ms)
+{
+    _current   = 0;
+    _since     = now_ms;
+    _deferring = false;
+    _profiles[0].stats.visits++;
+}
+
+bool ProfileScanner::poll(uint32_t now_ms)
+{
+    if (_count < 2 || now_ms - _since < _profiles[_current].stats.dwell_ms) {
+        return false;
+    }
+    if (_bus->gdo(0)) {
+        // Sync word seen - switch after the packet
+        if (!_deferring) {
+            _deferring = true;
+            _stats.deferred++;
+        }
+        return false;
+    }
+    switchTo((_current + 1) % _count, now_ms);
+    return true;
+}
+
+void ProfileScanner::frame()
+{
+    _profiles[_current].cycle_frames++;
+    _profiles[_current].stats.frames++;
+}
+
+//
+// Write the registers which differ and resume receiving - the latency
+// includes the calibration on IDLE->RX
+//
+void ProfileScanner::switchTo(unsigned next, uint32_t now_ms)
+{
+    Profile *p = &_profiles[_current];
+    p->cycle_ms        += now_ms - _since;
+    p->stats.listen_ms += now_ms - _since;
+
+    uint32_t start = clockMicros();
+    _bus->strobe(CC1101_SIDLE);
+    _stats.registers += cc1101SwitchImage(_bus, *p->image, *_profiles[next].image);
+    _bus->strobe(CC1101_SFRX);
+    _bus->strobe(CC1101_SRX);
+    unsigned reads = 0;
+    while ((_bus->readReg(CC1101_MARCSTATE) & 0x1f) != MARCSTATE_RX && ++reads < SCAN_SETTLE_READS)
+        ;
+    if (reads >= SCAN_SETTLE_READS) {
+        _stats.unsettled++;
+    }
+    uint32_t us = clockMicros() - start;
+    _stats.switch_us    += us;
+    _stats.switch_max_us = (us > _stats.switch_max_us) ? us : _stats.switch_max_us;
+    _stats.switches++;
+
+    _current   = next;
+    _since     = now_ms;
+    _deferring = false;
+    _profiles[next].stats.visits++;
+    if (next == 0) {
+        _stats.cycles++;
+        plan();
+    }
+}
+
+//
+// Dwell times of the next cycle: SCAN_MIN_DWELL_MS each, the rest in
+// proportion to the frame rates (equal shares while nothing is known)
+//
+void ProfileScanner::plan()
+{
+    float sum = 0;
+    for (unsigned i = 0; i < _count; i++) {
+        Profile *p = &_profiles[i];
+        if (p->cycle_ms) {
+            float rate = 1000.0f * p->cycle_frames / p->cycle_ms;
+            p->stats.rate += SCAN_SMOOTHING * (rate - p->stats.rate);
+        }
+        p->cycle_frames = 0;
+        p->cycle_ms     = 0;
+        sum += p->stats.rate;
+    }
+    uint32_t fixed = _count * SCAN_MIN_DWELL_MS;
+    uint32_t spare = (SCAN_CYCLE_MS > fixed) ? SCAN_CYCLE_MS - fixed : 0;
+    for (unsigned i = 0; i < _count; i++) {
+        Profile *p = &_profiles[i];
+        float share = (sum > 0) ? p->stats.rate / sum : 1.0f / _count;
+        p->stats.dwell_ms = SCAN_MIN_DWELL_MS + (uint32_t)(spare * share);
+    }
+}
+
+float ProfileScanner::switchLatency() const
+{
+    return _stats.switches ? (float)_stats.switch_us / _stats.switches : 0;
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int ProfileScanner::render(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    APPEND("# TYPE bresser_scan_dwell_ms gauge\n");
+    for (unsigned i = 0; i < _count; i++) {
+        APPEND("bresser_scan_dwell_ms{profile=\"%s\"} %u\n", _profiles[i].name, (unsigned)_profiles[i].stats.dwell_ms);
+    }
+    APPEND("# TYPE bresser_scan_frames_total counter\n");
+    for (unsigned i = 0; i < _count; i++) {
+        APPEND("bresser_scan_frames_total{profile=\"%s\"} %u\n", _profiles[i].name, (unsigned)_profiles[i].stats.frames);
+    }
+    APPEND("# TYPE bresser_scan_frame_rate gauge\n");
+    for (unsigned i = 0; i < _count; i++) {
+        APPEND("bresser_scan_frame_rate{profile=\"%s\"} %.4f\n", _profiles[i].name, _profiles[i].stats.rate);
+    }
+    APPEND("# TYPE bresser_scan_switches_total counter\n");
+    APPEND("bresser_scan_switches_total %u\n", (unsigned)_stats.switches);
+    APPEND("# TYPE bresser_scan_switch_us gauge\n");
+    APPEND("bresser_scan_switch_us %.0f\n", switchLatency());
+    APPEND("# TYPE bresser_scan_switch_max_us gauge\n");
+    APPEND("bresser_scan_switch_max_us %u\n", (unsigned)_stats.switch_max_us);
+
+    return (len < size) ? (int)len : -1;
+}
@@ -0,0 +1,140 @@
+/*
+ProfileScanner - time-sliced receive on several radio profiles
+
+A CC1101 listens on one frequency, with one data rate and one sync word at a
+time. To receive sensors which differ in any of them (other members of the
+Bresser family, the 915 MHz variants), the radio dwells on each profile in
+turn:
+
+    constexpr CC1101Image profiles[] = { cc1101Image({ 868.3, ... }), cc1101Image({ 915.0, ... }) };
+    scanner.add("868", &profiles[0]);
+    scanner.add("915", &profiles[1]);
+    scanner.begin(&bus, millis());      // radio configured with profiles[0], in RX
+    ...
+    scanner.poll(millis());             // between packets
+    scanner.frame();                    // after a good packet
+
+The profiles are register images computed at compile time (CC1101Image).
+Switching writes only the registers which differ between the two images, in
+a single burst (SIDLE, burst, SFRX, SRX - four SPI transactions), instead of
+RadioLib's setter-by-setter reconfiguration. The switch latency is measured
+from SIDLE until the radio is back in RX, i.e. including the synthesizer
+calibration (FS_AUTOCAL).
+
+A cycle visits every profile once. Each profile gets SCAN_MIN_DWELL_MS, so
+that sensors not yet heard are found; the rest of SCAN_CYCLE_MS is shared in
+proportion to the traffic learned per profile (good frames per second of
+listening, smoothed over cycles). The radio is not switched while a packet
+is being received (GDO0 high: sync word seen).
+
+SCAN_CYCLE_MS should not be a divisor or multiple of the sensors' transmit
+period (12 s) - else a sensor may keep transmitting while another profile is
+active.
+*/
+#ifndef PROFILE_SCANNER_H
+#define PROFILE_SCANNER_H
+
+#include <stdint.h>
+#include "CC1101Bus.h"
+#include "CC1101Image.h"
+
+#ifndef SCAN_MAX_PROFILES
+#define SCAN_MAX_PROFILES 4
+#endif
+
+// Duration of a cycle over all profiles (ms)
+#ifndef SCAN_CYCLE_MS
+#define SCAN_CYCLE_MS 7000
+#endif
+
+// Dwell time each profile gets at least (ms) - a frame lasts ~35 ms
+#ifndef SCAN_MIN_DWELL_MS
+#define SCAN_MIN_DWELL_MS 500
+#endif
+
+// Weight of a cycle's frame rate in the traffic estimate
+#ifndef SCAN_SMOOTHING
+#define SCAN_SMOOTHING 0.2f
+#endif
+
+// MARCSTATE reads waiting for RX after a switch (~10 us each)
+#ifndef SCAN_SETTLE_READS
+#define SCAN_SETTLE_READS 200
+#endif
+
+struct ScanProfileStats {
+    uint32_t frames;               // good frames received
+    uint32_t visits;
+    uint32_t listen_ms;            // total dwell time
+    uint32_t dwell_ms;             // current dwell time per visit
+    float    rate;                 // frames per second of listening (smoothed)
+};
+
+struct ScanStats {
+    uint32_t cycles;
+    uint32_t switches;
+    uint32_t deferred;             // switches delayed by a packet being received
+    uint32_t registers;            // registers written by switches
+    uint32_t switch_us;            // total switch latency
+    uint32_t switch_max_us;
+    uint32_t unsettled;            // radio not in RX after SCAN_SETTLE_READS
+};
+
+class ProfileScanner {
+public:
+    ProfileScanner();
+
+    // Add profile (image kept by reference) - returns its index or -1
+    int add(const char *name, const CC1101Image *image);
+
+    // Start scanning - the radio is configured with the first profile and
+    // receiving (RX, GDO0: sync word/end of packet)
+    void begin(CC1101Bus *bus, uint32_t now_ms);
+
+    // Radio reconfigured with the first profile (e.g. after a fault)
+    void reconfigured(uint32_t now_ms);
+
+    // Switch to the next profile when the dwell time is over - returns true
+    // if switched. Call between packets (packet read, radio in RX).
+    bool poll(uint32_t now_ms);
+
+    // Good frame received on the current profile
+    void frame();
+
+    unsigned           count() const { return _count; }
+    unsigned           current() const { return _current; }
+    const char        *name(unsigned i) const { return _profiles[i].name; }
+    const CC1101Image& image() const { return *_profiles[_current].image; }
+
+    // Average switch latency (us)
+    float switchLatency() const;
+
+    const ScanProfileStats& stats(unsigned i) const { return _profiles[i].stats; }
+    const ScanStats& stats() const { return _stats; }
+
+    // Prometheus text: dwell time, frames and rate per profile, switch
+    // latency - returns length or -1 if buf is too small
+    int render(char *buf, unsigned size) const;
+
+private:
+    struct Profile {
+        const char        *name;
+        const CC1101Image *image;
+        uint32_t           cycle_frames;
+        uint32_t           cycle_ms;
+        ScanProfileStats   stats;
+    };
+
+    void switchTo(unsigned next, uint32_t now_ms);
+    void plan();
+
+    CC1101Bus *_bus;
+    Profile    _profiles[SCAN_MAX_PROFILES];
+    unsigned   _count;
+    unsigned   _current;
+    uint32_t   _since;             // current profile active since (ms)
+    bool       _deferring;
+    ScanStats  _stats;
+};
+
+#endif // PROFILE_SCANNER_H
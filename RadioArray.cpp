@@ -0,0 +1,215 @@
+/*
+RadioArray - several CC1101 radios on a shared SPI bus
+*/
+#include "RadioArray.h"
+
+#include <string.h>
+
+#ifdef ARDUINO_ARCH_ESP32
+#include <Arduino.h>
+#endif
+
+static_assert((RADIO_RING_SIZE & (RADIO_RING_SIZE - 1)) == 0, "RADIO_RING_SIZE must be a power of 2");
+
+// Payload + appended RSSI and LQI/CRC_OK
+#define FIFO_FRAME_SIZE(len) ((len) + 2)
+
+// GDO0: asserted on sync word, de-asserted at end of packet
+#define GDO0_SYNC_WORD 0x06
+
+#ifdef ARDUINO_ARCH_ESP32
+struct RadioIsrArg {
+    RadioArray *array;
+    unsigned    radio;
+};
+
+static RadioIsrArg isrArgs[RADIO_MAX];
+
+static void IRAM_ATTR radioIsr(void *arg)
+{
+    RadioIsrArg *a = (RadioIsrArg *)arg;
+    a->array->interrupt(a->radio);
+}
+#endif
+
+RadioArray::RadioArray() :
+    _count(0), _next(0)
+{
+    for (int i = 0; i < RADIO_MAX; i++) {
+        _radios[i].bus     = nullptr;
+        _radios[i].gdo0Pin = -1;
+        _radios[i].len     = RADIO_FRAME_SIZE;
+        _radios[i].pending = false;
+        _radios[i].head    = 0;
+        _radios[i].tail    = 0;
+        memset(&_radios[i].stats, 0, sizeof(RadioStats));
+    }
+    memset(_pending, 0, sizeof(_pending));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int RadioArray::add(CC1101Bus *bus, int gdo0Pin)
+{
+    if (_count >= RADIO_MAX) {
+        return -1;
+    }
+    int i = _count++;
+    _radios[i].bus     = bus;
+    _radios[i].gdo0Pin = gdo0Pin;
+
+#ifdef ARDUINO_ARCH_ESP32
+    if (gdo0Pin >= 0) {
+        isrArgs[i].array = this;
+        isrArgs[i].radio = i;
+        attachInterruptArg(digitalPinToInterrupt(gdo0Pin), radioIsr, &isrArgs[i], FALLING);
+    }
+#endif
+    return i;
+}
+
+void RadioArray::begin()
+{
+    for (unsigned i = 0; i < _count; i++) {
+        CC1101Bus *bus = _radios[i].bus;
+        bus->strobe(CC1101_SIDLE);
+        // Packet length as configured (e.g. 19 for 6-in-1 only)
+        uint8_t len = bus->readReg(CC1101_PKTLEN);
+        _radios[i].len = (len > 0 && len < RADIO_FRAME_SIZE) ? len : RADIO_FRAME_SIZE;
+        bus->writeReg(CC1101_IOCFG0, GDO0_SYNC_WORD);
+        uint8_t mcsm1 = bus->readReg(CC1101_MCSM1);
+        bus->writeReg(CC1101_MCSM1, (mcsm1 & ~CC1101_MCSM1_RXOFF_MASK) | CC1101_MCSM1_RXOFF_RX);
+        bus->strobe(CC1101_SFRX);
+        bus->strobe(CC1101_SRX);
+    }
+}
+
+//
+// Read one frame from the FIFO of radio into its ring
+//
+bool RadioArray::readFifo(unsigned radio, uint32_t now_ms)
+{
+    Radio  *r       = &_radios[radio];
+    uint8_t size    = FIFO_FRAME_SIZE(r->len);
+    uint8_t rxbytes = r->bus->readStatus(CC1101_RXBYTES);
+
+    if (rxbytes & CC1101_FIFO_OVERFLOW) {
+        r->stats.overflows++;
+        r->bus->strobe(CC1101_SIDLE);
+        r->bus->strobe(CC1101_SFRX);
+        r->bus->strobe(CC1101_SRX);
+        return false;
+    }
+    if (CC1101_FIFO_BYTES(rxbytes) < size) {
+        return false;
+    }
+
+    uint8_t buf[FIFO_FRAME_SIZE(RADIO_FRAME_SIZE)];
+    r->bus->readBurst(CC1101_FIFO, buf, size);
+    if (CC1101_FIFO_BYTES(rxbytes) >= 2 * size) {
+        // Another frame is waiting - next round
+        r->pending.store(true, std::memory_order_relaxed);
+    }
+
+    uint32_t head = r->head.load(std::memory_order_relaxed);
+    if (head - r->tail.load(std::memory_order_acquire) >= RADIO_RING_SIZE) {
+        r->stats.ring_full++;
+        return false;
+    }
+    RadioFrame *f = &r->ring[head & (RADIO_RING_SIZE - 1)];
+    memcpy(f->data, buf, r->len);
+    memset(&f->data[r->len], 0, RADIO_FRAME_SIZE - r->len);
+    uint8_t rssi_raw = buf[r->len];
+    f->rssi      = cc1101RssiDbm(rssi_raw);
+    f->lqi       = buf[r->len + 1] & 0x7f;
+    f->radio     = radio;
+    f->copies    = 1;
+    f->timestamp = now_ms;
+    r->head.store(head + 1, std::memory_order_release);
+    r->stats.frames++;
+    return true;
+}
+
+unsigned RadioArray::service(uint32_t now_ms)
+{
+    unsigned n = 0;
+    for (unsigned k = 0; k < _count; k++) {
+        unsigned i  = (_next + k) % _count;
+        Radio   *r  = &_radios[i];
+        bool signalled = r->pending.exchange(false, std::memory_order_acquire);
+        if (signalled) {
+            r->stats.interrupts++;
+        }
+        if ((signalled || r->gdo0Pin < 0) && readFifo(i, now_ms)) {
+            n++;
+        }
+    }
+    if (_count) {
+        _next = (_next + 1) % _count;
+    }
+    return n;
+}
+
+bool RadioArray::read(RadioFrame *pOut, uint32_t now_ms)
+{
+    // Move frames from the rings into the merge queue
+    bool full = false;
+    for (unsigned i = 0; i < _count && !full; i++) {
+        Radio   *r    = &_radios[i];
+        uint32_t tail = r->tail.load(std::memory_order_relaxed);
+        while (tail != r->head.load(std::memory_order_acquire)) {
+            const RadioFrame *f = &r->ring[tail & (RADIO_RING_SIZE - 1)];
+            Pending *free = nullptr;
+            Pending *same = nullptr;
+            for (int p = 0; p < RADIO_PENDING; p++) {
+                int32_t age = f->timestamp - _pending[p].frame.timestamp;
+                if (!_pending[p].used) {
+                    free = free ? free : &_pending[p];
+                } else if (age <= RADIO_DIVERSITY_MS && age >= -RADIO_DIVERSITY_MS &&
+                           memcmp(f->data, _pending[p].frame.data, RADIO_FRAME_SIZE) == 0) {
+                    same = &_pending[p];
+                    break;
+                }
+            }
+            if (same) {
+                same->frame.copies++;
+                _stats.duplicates++;
+                if (f->rssi > same->frame.rssi) {
+                    same->frame.radio = f->radio;
+                    same->frame.rssi  = f->rssi;
+                    same->frame.lqi   = f->lqi;
+                }
+            } else if (free) {
+                free->used  = true;
+                free->frame = *f;
+            } else {
+                full = true;
+                break;
+            }
+            tail++;
+            r->tail.store(tail, std::memory_order_release);
+        }
+    }
+
+    // Release the oldest frame once no more copies are expected
+    Pending *oldest = nullptr;
+    for (int p = 0; p < RADIO_PENDING; p++) {
+        if (_pending[p].used &&
+            (!oldest || (int32_t)(_pending[p].frame.timestamp - oldest->frame.timestamp) < 0)) {
+            oldest = &_pending[p];
+        }
+    }
+    if (!oldest) {
+        return false;
+    }
+    if (_count > 1 && !full && now_ms - oldest->frame.timestamp < RADIO_DIVERSITY_MS) {
+        return false;
+    }
+    if (full) {
+        _stats.pending_full++;
+    }
+    *pOut = oldest->frame;
+    oldest->used = false;
+    _radios[pOut->radio].stats.best++;
+    _stats.frames++;
+    return true;
+}
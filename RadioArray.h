@@ -0,0 +1,128 @@
+/*
+RadioArray - several CC1101 radios on a shared SPI bus
+
+Each radio has its own chip select and GDO0 line, e.g. a second module on
+another frequency, or two modules on the same frequency with separate
+antennas (diversity). All radios are configured by RadioLib as usual; the
+array then takes over the receive path:
+
+- GDO0 signals the end of a packet. The interrupt handler only sets a flag
+  for its radio - SPI is never used from interrupt context.
+- service() reads the FIFO of each signalled radio in a single burst
+  transfer (payload + appended RSSI/LQI). The radio stays in RX
+  (RXOFF_MODE = RX), so no strobes are needed for re-arming. Radios are
+  served round-robin, one burst each, so a busy radio can delay another one
+  by at most one short transaction.
+- Frames go into a ring per radio (single producer/single consumer), so
+  service() may run in its own task.
+- read() merges identical frames received by several radios within
+  RADIO_DIVERSITY_MS and returns the copy with the best RSSI.
+
+Radios without a usable GDO0 interrupt (gdo0Pin < 0) are polled via RXBYTES.
+*/
+#ifndef RADIO_ARRAY_H
+#define RADIO_ARRAY_H
+
+#include <stdint.h>
+#include <atomic>
+#include "CC1101Bus.h"
+
+#ifndef RADIO_MAX
+#define RADIO_MAX 4
+#endif
+
+// Frame length incl. the last sync byte (fixed packet length mode) - shorter
+// packets (PKTLEN) are zero padded
+#ifndef RADIO_FRAME_SIZE
+#define RADIO_FRAME_SIZE 27
+#endif
+
+// Frames per radio ring (power of 2)
+#ifndef RADIO_RING_SIZE
+#define RADIO_RING_SIZE 8
+#endif
+
+// Copies of a frame received within this time are merged (ms)
+#ifndef RADIO_DIVERSITY_MS
+#define RADIO_DIVERSITY_MS 50
+#endif
+
+// Frames waiting for further copies
+#define RADIO_PENDING 8
+
+struct RadioFrame {
+    uint8_t  data[RADIO_FRAME_SIZE];
+    uint8_t  radio;                // radio with best RSSI
+    uint8_t  copies;               // number of radios which received the frame
+    uint8_t  lqi;
+    float    rssi;                 // dBm
+    uint32_t timestamp;            // ms
+};
+
+struct RadioStats {
+    uint32_t interrupts;
+    uint32_t frames;               // frames read from FIFO
+    uint32_t best;                 // frames where this radio had the best RSSI
+    uint32_t overflows;            // RX FIFO overflows
+    uint32_t ring_full;            // frames dropped (ring full)
+};
+
+struct RadioArrayStats {
+    uint32_t frames;               // merged frames returned by read()
+    uint32_t duplicates;           // copies merged
+    uint32_t pending_full;         // frames released early (merge queue full)
+};
+
+class RadioArray {
+public:
+    RadioArray();
+
+    // Add radio (already configured by RadioLib) - returns its index or -1
+    int add(CC1101Bus *bus, int gdo0Pin);
+
+    // Stay in RX after a packet and start receiving on all radios
+    void begin();
+
+    // End of packet on radio (interrupt context)
+    inline void interrupt(unsigned radio) {
+        _radios[radio].pending.store(true, std::memory_order_release);
+    }
+
+    // Read FIFOs of signalled radios - returns number of frames read
+    unsigned service(uint32_t now_ms);
+
+    // Next merged frame - returns false if none is ready
+    bool read(RadioFrame *pOut, uint32_t now_ms);
+
+    unsigned count() const { return _count; }
+    const RadioStats& stats(unsigned radio) const { return _radios[radio].stats; }
+    const RadioArrayStats& stats() const { return _stats; }
+
+private:
+    struct Radio {
+        CC1101Bus            *bus;
+        int                   gdo0Pin;
+        uint8_t               len;   // packet length (PKTLEN)
+        std::atomic<bool>     pending;
+        RadioFrame            ring[RADIO_RING_SIZE];
+        std::atomic<uint32_t> head;  // written by service()
+        std::atomic<uint32_t> tail;  // written by read()
+        RadioStats            stats;
+    };
+
+    struct Pending {
+        bool       used;
+        RadioFrame frame;
+    };
+
+    bool readFifo(unsigned radio, uint32_t now_ms);
+    void merge(const RadioFrame *f);
+
+    Radio            _radios[RADIO_MAX];
+    unsigned         _count;
+    unsigned         _next;          // round-robin start
+    Pending          _pending[RADIO_PENDING];
+    RadioArrayStats  _stats;
+};
+
+#endif // RADIO_ARRAY_H
@@ -0,0 +1,543 @@
+/*
+ReadingLog - persistent append-only log of decoded readings
+
+See ReadingLog.h for the file layout and recovery strategy.
+*/
+#include "ReadingLog.h"
+#include "Clock.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <math.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(LogRecord) == 32, "LogRecord must be 32 bytes");
+static_assert(LOG_PAGE_SIZE % sizeof(LogRecord) == 0, "LOG_PAGE_SIZE must be a multiple of the record size");
+static_assert(LOG_SEGMENT_SIZE % LOG_PAGE_SIZE == 0, "LOG_SEGMENT_SIZE must be a multiple of LOG_PAGE_SIZE");
+static_assert(LOG_RECORDS_PER_SEGMENT <= 0x10000, "record number must fit into LogIndexEntry.record");
+
+//
+// CRC-8, polynomial 0x07, init 0x00
+//
+static uint8_t crc8(const uint8_t *data, unsigned len)
+{
+    uint8_t crc = 0;
+    for (unsigned i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static bool recordValid(const LogRecord *rec)
+{
+    return crc8((const uint8_t *)rec, sizeof(LogRecord) - 1) == rec->crc;
+}
+
+static long fileSize(const char *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0) {
+        return -1;
+    }
+    return st.st_size;
+}
+
+void logRecordFromWeatherData(const WeatherData *pIn, uint32_t timestamp, LogRecord *pOut)
+{
+    memset(pOut, 0, sizeof(LogRecord));
+    pOut->timestamp     = timestamp;
+    pOut->sensor_id     = pIn->sensor_id;
+    pOut->rain_x10      = (uint32_t)lroundf(pIn->rain_mm * 10);
+    pOut->temp_x10      = (int16_t)lroundf(pIn->temp_c * 10);
+    pOut->uv_x10        = (uint16_t)lroundf(pIn->uv * 10);
+    pOut->wind_dir_x10  = (uint16_t)lroundf(pIn->wind_direction_deg * 10);
+    pOut->wind_gust_x10 = (uint16_t)lroundf(pIn->wind_gust_meter_sec * 10);
+    pOut->wind_avg_x10  = (uint16_t)lroundf(pIn->wind_avg_meter_sec * 10);
+    pOut->s_type        = pIn->s_type;
+    pOut->chan          = pIn->chan;
+    pOut->humidity      = (uint8_t)pIn->humidity;
+    pOut->moisture      = (uint8_t)pIn->moisture;
+    pOut->flags         = (pIn->temp_ok     ? LOG_FLAG_TEMP_OK     : 0) |
+                          (pIn->uv_ok       ? LOG_FLAG_UV_OK       : 0) |
+                          (pIn->wind_ok     ? LOG_FLAG_WIND_OK     : 0) |
+                          (pIn->rain_ok     ? LOG_FLAG_RAIN_OK     : 0) |
+                          (pIn->battery_ok  ? LOG_FLAG_BATTERY_OK  : 0) |
+                          (pIn->moisture_ok ? LOG_FLAG_MOISTURE_OK : 0);
+    pOut->crc           = crc8((const uint8_t *)pOut, sizeof(LogRecord) - 1);
+}
+
+void weatherDataFromLogRecord(const LogRecord *pIn, WeatherData *pOut)
+{
+    memset(pOut, 0, sizeof(WeatherData));
+    pOut->sensor_id           = pIn->sensor_id;
+    pOut->s_type              = pIn->s_type;
+    pOut->chan                = pIn->chan;
+    pOut->temp_ok             = pIn->flags & LOG_FLAG_TEMP_OK;
+    pOut->temp_c              = pIn->temp_x10 * 0.1f;
+    pOut->humidity            = pIn->humidity;
+    pOut->uv_ok               = pIn->flags & LOG_FLAG_UV_OK;
+    pOut->uv                  = pIn->uv_x10 * 0.1f;
+    pOut->wind_ok             = pIn->flags & LOG_FLAG_WIND_OK;
+    pOut->wind_direction_deg  = pIn->wind_dir_x10 * 0.1f;
+    pOut->wind_gust_meter_sec = pIn->wind_gust_x10 * 0.1f;
+    pOut->wind_avg_meter_sec  = pIn->wind_avg_x10 * 0.1f;
+    pOut->rain_ok             = pIn->flags & LOG_FLAG_RAIN_OK;
+    pOut->rain_mm             = pIn->rain_x10 * 0.1f;
+    pOut->battery_ok          = pIn->flags & LOG_FLAG_BATTERY_OK;
+    pOut->moisture_ok         = pIn->flags & LOG_FLAG_MOISTURE_OK;
+    pOut->moisture            = pIn->moisture;
+}
+
+ReadingLog::ReadingLog() :
+    _file(nullptr), _index(nullptr), _firstSegment(0), _segment(0), _record(0), _lastTimestamp(0),
+    _pageFill(0), _hasPending(false)
+{
+    _dir[0] = '\0';
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+ReadingLog::~ReadingLog()
+{
+    end();
+}
+
+void ReadingLog::segmentPath(uint16_t segment, char *path) const
+{
+    snprintf(path, LOG_PATH_LEN + 16, "%s/seg%05u.log", _dir, (unsigned)segment);
+}
+
+bool ReadingLog::begin(const char *dir)
+{
+    end();
+    if (strlen(dir) >= LOG_PATH_LEN) {
+        return false;
+    }
+    strcpy(_dir, dir);
+    if (mkdir(_dir, 0755) != 0 && errno != EEXIST) {
+        return false;
+    }
+    _pageFill      = 0;
+    _hasPending    = false;
+    _lastTimestamp = 0;
+    return recover();
+}
+
+void ReadingLog::end()
+{
+    if (_file) {
+        flush();
+        fclose(_file);
+        _file = nullptr;
+    }
+    if (_index) {
+        fclose(_index);
+        _index = nullptr;
+    }
+}
+
+bool ReadingLog::openWriteSegment(uint16_t segment)
+{
+    char path[LOG_PATH_LEN + 16];
+
+    if (_file) {
+        fclose(_file);
+    }
+    segmentPath(segment, path);
+    _file = fopen(path, "ab");
+    if (!_file) {
+        return false;
+    }
+    // Pages are written with a single fwrite() - no need for stdio buffering
+    setvbuf(_file, nullptr, _IONBF, 0);
+    _segment = segment;
+    return true;
+}
+
+//
+// Count valid records at the beginning of a segment - stops at the first
+// partial record or CRC mismatch; *pLast is set to the timestamp of the last
+// valid record
+//
+uint32_t ReadingLog::validRecords(uint16_t segment, uint32_t *pLast)
+{
+    char path[LOG_PATH_LEN + 16];
+    LogRecord rec;
+    uint32_t n = 0;
+
+    segmentPath(segment, path);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return 0;
+    }
+    while (fread(&rec, sizeof(rec), 1, f) == 1 && recordValid(&rec)) {
+        if (pLast) {
+            *pLast = rec.timestamp;
+        }
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+bool ReadingLog::recover()
+{
+    char path[LOG_PATH_LEN + 16];
+    char tmpPath[LOG_PATH_LEN + 16];
+    bool found = false;
+    unsigned first = 0xffff;
+    unsigned last  = 0;
+
+    DIR *d = opendir(_dir);
+    if (!d) {
+        return false;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != nullptr) {
+        unsigned seg;
+        char ext[4];
+        if (sscanf(de->d_name, "seg%5u.%3s", &seg, ext) == 2 && strcmp(ext, "log") == 0) {
+            found = true;
+            if (seg < first) first = seg;
+            if (seg > last)  last  = seg;
+        }
+    }
+    closedir(d);
+
+    snprintf(path, sizeof(path), "%s/index", _dir);
+    snprintf(tmpPath, sizeof(tmpPath), "%s/index.tmp", _dir);
+
+    if (!found) {
+        _firstSegment = 0;
+        _record       = 0;
+        _index = fopen(path, "wb");
+        return _index && openWriteSegment(0);
+    }
+    _firstSegment = first;
+
+    // Valid records in last segment - anything behind is a torn write
+    char segPath[LOG_PATH_LEN + 16];
+    uint32_t valid = validRecords(last, &_lastTimestamp);
+    segmentPath(last, segPath);
+    long size = fileSize(segPath);
+    bool torn = (size != (long)(valid * sizeof(LogRecord)));
+    if (torn) {
+        _stats.recovered += (size + sizeof(LogRecord) - 1) / sizeof(LogRecord) - valid;
+    }
+
+    // Latest timestamp - the last segment may have been started without
+    // records
+    for (unsigned s = last; valid == 0 && s > first; s--) {
+        if (validRecords(s - 1, &_lastTimestamp)) {
+            break;
+        }
+    }
+
+    // Merge old index with segment data: keep matching entries, rebuild
+    // missing ones, drop entries pointing to lost data
+    FILE *oldIdx = fopen(path, "rb");
+    FILE *newIdx = fopen(tmpPath, "wb");
+    if (!newIdx) {
+        if (oldIdx) fclose(oldIdx);
+        return false;
+    }
+    LogIndexEntry e;
+    bool have = oldIdx && fread(&e, sizeof(e), 1, oldIdx) == 1;
+    for (unsigned s = first; s <= last; s++) {
+        segmentPath(s, segPath);
+        long segSize = fileSize(segPath);
+        uint32_t n = (s == last) ? valid : (segSize > 0 ? segSize / sizeof(LogRecord) : 0);
+        bool counted = (s == last);
+        FILE *seg = nullptr;
+
+        for (uint32_t r = 0; r < n; r += LOG_RECORDS_PER_PAGE) {
+            while (have && (e.segment < s || (e.segment == s && e.record < r))) {
+                have = fread(&e, sizeof(e), 1, oldIdx) == 1;
+            }
+            LogIndexEntry out;
+            if (have && e.segment == s && e.record == r) {
+                out = e;
+            } else {
+                // An older segment may have a damaged tail as well - readers
+                // stop there, so no entries behind it
+                if (!counted) {
+                    n = validRecords(s);
+                    counted = true;
+                    if (r >= n) {
+                        break;
+                    }
+                }
+                LogRecord rec;
+                if (!seg) {
+                    seg = fopen(segPath, "rb");
+                }
+                if (!seg || fseek(seg, r * sizeof(LogRecord), SEEK_SET) != 0 ||
+                    fread(&rec, sizeof(rec), 1, seg) != 1 || !recordValid(&rec)) {
+                    continue;
+                }
+                out.timestamp = rec.timestamp;
+                out.segment   = s;
+                out.record    = r;
+            }
+            fwrite(&out, sizeof(out), 1, newIdx);
+        }
+        if (seg) {
+            fclose(seg);
+        }
+    }
+    if (oldIdx) {
+        fclose(oldIdx);
+    }
+    fclose(newIdx);
+    remove(path);
+    if (rename(tmpPath, path) != 0) {
+        return false;
+    }
+    _index = fopen(path, "ab");
+    if (!_index) {
+        return false;
+    }
+
+    // Never append behind a damaged tail - continue in a fresh segment
+    if (torn || valid >= LOG_RECORDS_PER_SEGMENT) {
+        _segment = last;
+        _record  = LOG_RECORDS_PER_SEGMENT;
+        return rotate();
+    }
+    _record = valid;
+    return openWriteSegment(last);
+}
+
+bool ReadingLog::writeIndex(const LogIndexEntry *entries, unsigned count)
+{
+    if (fwrite(entries, sizeof(LogIndexEntry), count, _index) != count) {
+        return false;
+    }
+    fflush(_index);
+    fsync(fileno(_index));
+    _stats.bytes += count * sizeof(LogIndexEntry);
+    return true;
+}
+
+//
+// Remove index entries of deleted segments
+//
+bool ReadingLog::compactIndex()
+{
+    char path[LOG_PATH_LEN + 16];
+    char tmpPath[LOG_PATH_LEN + 16];
+    LogIndexEntry e;
+
+    snprintf(path, sizeof(path), "%s/index", _dir);
+    snprintf(tmpPath, sizeof(tmpPath), "%s/index.tmp", _dir);
+    fclose(_index);
+    _index = nullptr;
+
+    FILE *oldIdx = fopen(path, "rb");
+    FILE *newIdx = fopen(tmpPath, "wb");
+    if (oldIdx && newIdx) {
+        while (fread(&e, sizeof(e), 1, oldIdx) == 1) {
+            if (e.segment >= _firstSegment) {
+                fwrite(&e, sizeof(e), 1, newIdx);
+            }
+        }
+    }
+    if (oldIdx) fclose(oldIdx);
+    if (newIdx) fclose(newIdx);
+    if (newIdx) {
+        remove(path);
+        rename(tmpPath, path);
+    }
+    _index = fopen(path, "ab");
+    return newIdx && _index;
+}
+
+bool ReadingLog::rotate()
+{
+    if (!openWriteSegment(_segment + 1)) {
+        return false;
+    }
+    _record = 0;
+
+    if (_segment - _firstSegment + 1 > LOG_MAX_SEGMENTS) {
+        char path[LOG_PATH_LEN + 16];
+        segmentPath(_firstSegment, path);
+        remove(path);
+        _firstSegment++;
+        return compactIndex();
+    }
+    return true;
+}
+
+bool ReadingLog::append(const LogRecord *rec)
+{
+    if (!_file) {
+        return false;
+    }
+    LogRecord *dst = (LogRecord *)&_page[_pageFill * sizeof(LogRecord)];
+    memcpy(dst, rec, sizeof(LogRecord));
+    // Keep the log sorted by time if the clock has been set back
+    if (dst->timestamp < _lastTimestamp) {
+        dst->timestamp = _lastTimestamp;
+        _stats.clamped++;
+    }
+    _lastTimestamp = dst->timestamp;
+    dst->crc = crc8((const uint8_t *)dst, sizeof(LogRecord) - 1);
+
+    if (_record % LOG_RECORDS_PER_PAGE == 0) {
+        _pending.timestamp = dst->timestamp;
+        _pending.segment   = _segment;
+        _pending.record    = _record;
+        _hasPending        = true;
+    }
+    _pageFill++;
+    _record++;
+    _stats.records++;
+
+    // Write as soon as the page is complete
+    if (_record % LOG_RECORDS_PER_PAGE == 0) {
+        return flush();
+    }
+    return true;
+}
+
+bool ReadingLog::append(const WeatherData *pData, uint32_t timestamp)
+{
+    LogRecord rec;
+    logRecordFromWeatherData(pData, timestamp, &rec);
+    return append(&rec);
+}
+
+bool ReadingLog::flush()
+{
+    if (!_file || _pageFill == 0) {
+        return true;
+    }
+    uint32_t start = clockMicros();
+    size_t len = _pageFill * sizeof(LogRecord);
+    bool ok = fwrite(_page, 1, len, _file) == len;
+    ok = ok && fflush(_file) == 0;
+    fsync(fileno(_file));
+    _pageFill = 0;
+
+    // Index entry only after its data is on flash
+    if (ok && _hasPending) {
+        ok = writeIndex(&_pending, 1);
+        _hasPending = false;
+    }
+    uint32_t elapsed = clockMicros() - start;
+    _stats.pages++;
+    _stats.bytes    += len;
+    _stats.write_us += elapsed;
+    if (elapsed > _stats.write_us_max) {
+        _stats.write_us_max = elapsed;
+    }
+
+    if (ok && _record >= LOG_RECORDS_PER_SEGMENT) {
+        ok = rotate();
+    }
+    return ok;
+}
+
+//
+// Binary search for the last index entry with timestamp < from
+//
+bool ReadingLog::findIndex(uint32_t from, LogIndexEntry *pEntry)
+{
+    char path[LOG_PATH_LEN + 16];
+    snprintf(path, sizeof(path), "%s/index", _dir);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    long count = ftell(f) / sizeof(LogIndexEntry);
+    if (count <= 0) {
+        fclose(f);
+        return false;
+    }
+
+    long lo = 0;
+    long hi = count;
+    LogIndexEntry e;
+    while (lo < hi) {
+        long mid = lo + (hi - lo) / 2;
+        fseek(f, mid * sizeof(LogIndexEntry), SEEK_SET);
+        if (fread(&e, sizeof(e), 1, f) != 1) {
+            break;
+        }
+        if (e.timestamp < from) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    // lo: first entry with timestamp >= from - records >= from may start in
+    // the page before
+    long pos = (lo > 0) ? lo - 1 : 0;
+    fseek(f, pos * sizeof(LogIndexEntry), SEEK_SET);
+    bool ok = fread(pEntry, sizeof(LogIndexEntry), 1, f) == 1;
+    fclose(f);
+    return ok;
+}
+
+bool ReadingLog::seek(uint32_t from, Cursor *cursor)
+{
+    LogIndexEntry e;
+
+    cursor->close();
+    cursor->_log  = this;
+    cursor->_from = from;
+    if (!findIndex(from, &e) || e.segment < _firstSegment) {
+        e.segment = _firstSegment;
+        e.record  = 0;
+    }
+    return cursor->openSegment(e.segment, e.record);
+}
+
+bool ReadingLog::Cursor::openSegment(uint16_t segment, uint16_t record)
+{
+    char path[LOG_PATH_LEN + 16];
+
+    if (_file) {
+        fclose(_file);
+    }
+    _segment = segment;
+    _log->segmentPath(segment, path);
+    _file = fopen(path, "rb");
+    if (!_file) {
+        return false;
+    }
+    return fseek(_file, (long)record * sizeof(LogRecord), SEEK_SET) == 0;
+}
+
+bool ReadingLog::Cursor::next(LogRecord *pOut)
+{
+    while (_log) {
+        if (_file && fread(pOut, sizeof(LogRecord), 1, _file) == 1 && recordValid(pOut)) {
+            if (pOut->timestamp < _from) {
+                continue;
+            }
+            return true;
+        }
+        // End of segment (or damaged tail) - continue with next one
+        if (_segment >= _log->_segment) {
+            break;
+        }
+        openSegment(_segment + 1, 0);
+    }
+    close();
+    return false;
+}
+
+void ReadingLog::Cursor::close()
+{
+    if (_file) {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
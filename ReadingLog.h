@@ -0,0 +1,171 @@
+/*
+ReadingLog - persistent append-only log of decoded readings
+
+Readings are stored as fixed-size (32 byte) binary records in segment files
+<dir>/seg00000.log, <dir>/seg00001.log, ... A segment is closed and a new one
+started when it reaches the configured size limit; the oldest segments are
+deleted when the configured number of segments is exceeded.
+
+Records are collected in a RAM buffer and written as one page (LOG_PAGE_SIZE
+bytes) at a time to limit flash wear and write latency. After a forced flush()
+the remainder of the page is written as soon as it is complete, so writes stay
+page aligned. For every page, an entry (timestamp of first record, segment,
+record number) is appended to <dir>/index, which allows seeking by time with a
+binary search.
+
+Only POSIX stdio/dirent calls are used. On the ESP32 these go through the VFS
+layer to LittleFS (mounted with LittleFS.begin(), base path "/littlefs"), on a
+Linux host to the native file system.
+
+Crash recovery (begin()):
+- a torn or corrupted tail (partial record or CRC mismatch) of the last
+  segment is ignored by readers and appending continues in a new segment
+- index entries pointing past the valid data are dropped and missing entries
+  for the last segment are rebuilt from its records
+
+Timestamps must be non-decreasing (e.g. seconds since epoch, once the clock
+is set), the index search relies on it: a record older than the one before
+(clock set back) is stored with the timestamp of the one before and counted
+in LogStats.clamped. The latest timestamp is recovered by begin().
+*/
+#ifndef READING_LOG_H
+#define READING_LOG_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "WeatherData.h"
+
+// Write granularity (bytes) - must be a multiple of the record size
+#ifndef LOG_PAGE_SIZE
+#define LOG_PAGE_SIZE 256
+#endif
+
+// Segment file size limit (bytes) - must be a multiple of LOG_PAGE_SIZE
+#ifndef LOG_SEGMENT_SIZE
+#define LOG_SEGMENT_SIZE (64 * 1024)
+#endif
+
+// Maximum number of segment files kept
+#ifndef LOG_MAX_SEGMENTS
+#define LOG_MAX_SEGMENTS 16
+#endif
+
+#define LOG_PATH_LEN 48
+
+// LogRecord.flags
+#define LOG_FLAG_TEMP_OK     0x01
+#define LOG_FLAG_UV_OK       0x02
+#define LOG_FLAG_WIND_OK     0x04
+#define LOG_FLAG_RAIN_OK     0x08
+#define LOG_FLAG_BATTERY_OK  0x10
+#define LOG_FLAG_MOISTURE_OK 0x20
+
+struct __attribute__((packed)) LogRecord {
+    uint32_t timestamp;
+    uint32_t sensor_id;
+    uint32_t rain_x10;             // rain in 1/10 mm
+    int16_t  temp_x10;             // temperature in 1/10 °C
+    uint16_t uv_x10;               // UV index * 10
+    uint16_t wind_dir_x10;         // wind direction in 1/10 deg
+    uint16_t wind_gust_x10;        // wind gust in 1/10 m/s
+    uint16_t wind_avg_x10;         // wind speed in 1/10 m/s
+    uint8_t  s_type;
+    uint8_t  chan;
+    uint8_t  flags;                // LOG_FLAG_*
+    uint8_t  humidity;
+    uint8_t  moisture;
+    uint8_t  reserved[4];
+    uint8_t  crc;                  // CRC-8 of all preceding bytes
+};
+
+#define LOG_RECORD_SIZE sizeof(LogRecord)
+#define LOG_RECORDS_PER_PAGE (LOG_PAGE_SIZE / LOG_RECORD_SIZE)
+#define LOG_RECORDS_PER_SEGMENT (LOG_SEGMENT_SIZE / LOG_RECORD_SIZE)
+
+struct __attribute__((packed)) LogIndexEntry {
+    uint32_t timestamp;            // timestamp of first record in page
+    uint16_t segment;
+    uint16_t record;               // record number within segment
+};
+
+struct LogStats {
+    uint32_t records;              // records appended
+    uint32_t pages;                // page writes
+    uint32_t bytes;                // bytes written (data + index)
+    uint32_t write_us;             // accumulated write time
+    uint32_t write_us_max;         // longest page write
+    uint32_t recovered;            // records dropped during crash recovery
+    uint32_t clamped;              // records stored with a later timestamp
+};
+
+void logRecordFromWeatherData(const WeatherData *pIn, uint32_t timestamp, LogRecord *pOut);
+void weatherDataFromLogRecord(const LogRecord *pIn, WeatherData *pOut);
+
+class ReadingLog {
+public:
+    class Cursor {
+    public:
+        Cursor() : _log(nullptr), _file(nullptr), _segment(0), _from(0) {}
+        ~Cursor() { close(); }
+
+        // Get next record - returns false at end of log
+        bool next(LogRecord *pOut);
+        void close();
+
+    private:
+        friend class ReadingLog;
+        bool openSegment(uint16_t segment, uint16_t record);
+
+        ReadingLog *_log;
+        FILE       *_file;
+        uint16_t    _segment;
+        uint32_t    _from;
+    };
+
+    ReadingLog();
+    ~ReadingLog();
+
+    // Open log in directory dir (created if needed) and recover from crash
+    bool begin(const char *dir);
+    void end();
+
+    // Append record - written to flash when a page is complete
+    bool append(const LogRecord *rec);
+    bool append(const WeatherData *pData, uint32_t timestamp);
+
+    // Write partially filled page (e.g. periodically or before reset)
+    bool flush();
+
+    // Position cursor at first record with timestamp >= from
+    bool seek(uint32_t from, Cursor *cursor);
+
+    // Records waiting in the page buffer
+    unsigned pending() const { return _pageFill; }
+
+    const LogStats& stats() const { return _stats; }
+
+private:
+    void segmentPath(uint16_t segment, char *path) const;
+    bool openWriteSegment(uint16_t segment);
+    bool rotate();
+    bool recover();
+    uint32_t validRecords(uint16_t segment, uint32_t *pLast = nullptr);
+    bool writeIndex(const LogIndexEntry *entries, unsigned count);
+    bool compactIndex();
+    bool findIndex(uint32_t from, LogIndexEntry *pEntry);
+
+    char      _dir[LOG_PATH_LEN];
+    FILE     *_file;               // current segment
+    FILE     *_index;
+    uint16_t  _firstSegment;
+    uint16_t  _segment;            // current segment
+    uint32_t  _record;             // next record number in current segment
+    uint32_t  _lastTimestamp;      // timestamp of last record appended
+    uint8_t   _page[LOG_PAGE_SIZE];
+    unsigned  _pageFill;           // records in page buffer
+    LogIndexEntry _pending;        // index entry waiting for its page
+    bool      _hasPending;
+    LogStats  _stats;
+};
+
+#endif // READING_LOG_H
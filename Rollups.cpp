@@ -0,0 +1,251 @@
+/*
+Rollups - incremental multi-resolution min/max/avg per sensor and field
+
+See Rollups.h for the levels and query strategy.
+*/
+#include "Rollups.h"
+
+#include <math.h>
+#include <string.h>
+
+struct RollupLevel {
+    uint32_t resolution;           // bucket width (s)
+    uint16_t slots;                // ring buffer size
+    uint16_t offset;               // first slot in bucket storage
+};
+
+static const RollupLevel levels[ROLLUP_LEVELS] = {
+    {    60, 60,   0},
+    {   600, 36,  60},
+    {  3600, 48,  96},
+    { 86400, 31, 144}
+};
+
+static_assert(ROLLUP_SLOTS == 144 + 31, "ROLLUP_SLOTS does not match level table");
+
+// Integer value of field -> physical unit
+static const float scale[ROLLUP_FIELDS] = {0.1f, 1.0f, 0.1f, 0.1f, 0.1f};
+
+Rollups::Rollups() :
+    _evictions(0), _untracked(0)
+{
+    memset(_sensors, 0, sizeof(_sensors));
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+uint32_t Rollups::resolution(unsigned level)
+{
+    return (level < ROLLUP_LEVELS) ? levels[level].resolution : 0;
+}
+
+int Rollups::findSensor(uint32_t sensor_id)
+{
+    for (int i = 0; i < ROLLUP_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].sensor_id == sensor_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//
+// Entry to be taken by a new sensor: a free one, else the least recently
+// heard unconfirmed one, else the least recently heard stale one - -1: none
+//
+int Rollups::victim(uint32_t timestamp) const
+{
+    int best = -1;
+    for (int i = 0; i < ROLLUP_MAX_SENSORS; i++) {
+        const SensorRollup *s = &_sensors[i];
+        if (!s->used) {
+            return i;
+        }
+        bool confirmed = s->readings >= ROLLUP_MIN_READINGS;
+        if (confirmed && (int32_t)(timestamp - s->last_ts) < ROLLUP_STALE_S) {
+            continue;
+        }
+        bool bestConfirmed = (best >= 0) && _sensors[best].readings >= ROLLUP_MIN_READINGS;
+        if (best < 0 || (!confirmed && bestConfirmed) ||
+            (confirmed == bestConfirmed && (int32_t)(s->last_ts - _sensors[best].last_ts) < 0)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+Rollups::Bucket *Rollups::bucket(int sensor, unsigned level, uint32_t n)
+{
+    return _buckets[sensor][levels[level].offset + n % levels[level].slots];
+}
+
+bool Rollups::add(const WeatherData *pData, uint32_t timestamp)
+{
+    int sensor = findSensor(pData->sensor_id);
+    if (sensor < 0) {
+        sensor = victim(timestamp);
+        if (sensor < 0) {
+            _untracked++;
+            return false;
+        }
+        SensorRollup *s = &_sensors[sensor];
+        if (s->used) {
+            _evictions++;
+        }
+        s->used      = true;
+        s->sensor_id = pData->sensor_id;
+        s->readings  = 0;
+        for (unsigned l = 0; l < ROLLUP_LEVELS; l++) {
+            s->head[l] = timestamp / levels[l].resolution;
+        }
+        memset(_buckets[sensor], 0, sizeof(_buckets[sensor]));
+    }
+
+    int32_t values[ROLLUP_FIELDS];
+    bool    valid[ROLLUP_FIELDS];
+    values[ROLLUP_TEMP]      = lroundf(pData->temp_c * 10);
+    values[ROLLUP_HUM]       = pData->humidity;
+    values[ROLLUP_WIND_GUST] = lroundf(pData->wind_gust_meter_sec * 10);
+    values[ROLLUP_WIND_AVG]  = lroundf(pData->wind_avg_meter_sec * 10);
+    values[ROLLUP_RAIN]      = lroundf(pData->rain_mm * 10);
+    valid[ROLLUP_TEMP]       = pData->temp_ok;
+    valid[ROLLUP_HUM]        = pData->temp_ok && !pData->moisture_ok;
+    valid[ROLLUP_WIND_GUST]  = pData->wind_ok;
+    valid[ROLLUP_WIND_AVG]   = pData->wind_ok;
+    valid[ROLLUP_RAIN]       = pData->rain_ok;
+
+    SensorRollup *s = &_sensors[sensor];
+    s->readings++;
+    if (s->readings == 1 || timestamp > s->last_ts) {
+        s->last_ts = timestamp;
+    }
+    for (unsigned l = 0; l < ROLLUP_LEVELS; l++) {
+        uint32_t n = timestamp / levels[l].resolution;
+
+        if (n > s->head[l]) {
+            // Clear slots skipped since the last reading (at most one lap)
+            uint32_t gap = n - s->head[l];
+            if (gap > levels[l].slots) {
+                gap = levels[l].slots;
+            }
+            for (uint32_t k = n - gap + 1; k <= n; k++) {
+                memset(bucket(sensor, l, k), 0, sizeof(Bucket) * ROLLUP_FIELDS);
+            }
+            s->head[l] = n;
+        } else if (s->head[l] - n >= levels[l].slots) {
+            // Older than the ring buffer
+            continue;
+        }
+
+        Bucket *b = bucket(sensor, l, n);
+        for (int f = 0; f < ROLLUP_FIELDS; f++) {
+            if (!valid[f]) {
+                continue;
+            }
+            if (b[f].count == 0 || values[f] < b[f].min) {
+                b[f].min = values[f];
+            }
+            if (b[f].count == 0 || values[f] > b[f].max) {
+                b[f].max = values[f];
+            }
+            int64_t sum = b[f].sum_hi * 0x100000000LL + b[f].sum_lo + values[f];
+            b[f].sum_lo = (uint32_t)sum;
+            b[f].sum_hi = (int16_t)(sum >> 32);
+            b[f].count++;
+        }
+    }
+    return true;
+}
+
+//
+// Coarsest level whose buckets are aligned to from, to and step and which
+// still holds from; falls back to the finest level holding from
+//
+int Rollups::selectLevel(int sensor, uint32_t from, uint32_t to, uint32_t step)
+{
+    int fallback = -1;
+    for (int l = ROLLUP_LEVELS - 1; l >= 0; l--) {
+        uint32_t res    = levels[l].resolution;
+        uint32_t head   = _sensors[sensor].head[l];
+        uint32_t oldest = (head >= levels[l].slots) ? head - levels[l].slots + 1 : 0;
+        if (from / res < oldest) {
+            continue;
+        }
+        if (from % res == 0 && to % res == 0 && step % res == 0) {
+            return l;
+        }
+        if (res <= step) {
+            fallback = l;
+        }
+    }
+    return fallback;
+}
+
+bool Rollups::aggregate(int sensor, unsigned level, RollupField field, uint32_t from, uint32_t to,
+                        RollupResult *pOut)
+{
+    uint32_t res  = levels[level].resolution;
+    uint32_t head = _sensors[sensor].head[level];
+    int64_t  sum  = 0;
+    int32_t  min  = 0;
+    int32_t  max  = 0;
+    uint32_t count = 0;
+
+    // Only buckets inside [from, to) - see Rollups.h
+    uint32_t first = from / res + (from % res != 0);
+    uint32_t end   = to / res + (to % res != 0 && _sensors[sensor].last_ts < to);
+    for (uint32_t n = first; n < end; n++) {
+        if (n > head || head - n >= levels[level].slots) {
+            continue;
+        }
+        const Bucket *b = &bucket(sensor, level, n)[field];
+        if (b->count == 0) {
+            continue;
+        }
+        if (count == 0 || b->min < min) {
+            min = b->min;
+        }
+        if (count == 0 || b->max > max) {
+            max = b->max;
+        }
+        sum   += b->sum_hi * 0x100000000LL + b->sum_lo;
+        count += b->count;
+    }
+
+    pOut->count = count;
+    pOut->min   = min * scale[field];
+    pOut->max   = max * scale[field];
+    pOut->avg   = count ? (float)sum / count * scale[field] : 0;
+    return count > 0;
+}
+
+bool Rollups::query(uint32_t sensor_id, RollupField field, uint32_t from, uint32_t to, RollupResult *pOut)
+{
+    memset(pOut, 0, sizeof(RollupResult));
+    int sensor = findSensor(sensor_id);
+    if (sensor < 0 || to <= from || field >= ROLLUP_FIELDS) {
+        return false;
+    }
+    int level = selectLevel(sensor, from, to, to - from);
+    if (level < 0) {
+        return false;
+    }
+    return aggregate(sensor, level, field, from, to, pOut);
+}
+
+unsigned Rollups::series(uint32_t sensor_id, RollupField field, uint32_t from, uint32_t to,
+                         uint32_t step, RollupResult *out, unsigned max)
+{
+    int sensor = findSensor(sensor_id);
+    if (sensor < 0 || to <= from || step == 0 || field >= ROLLUP_FIELDS) {
+        return 0;
+    }
+    int level = selectLevel(sensor, from, to, step);
+    if (level < 0) {
+        return 0;
+    }
+    unsigned n = 0;
+    for (uint32_t t = from; t < to && n < max; t += step, n++) {
+        aggregate(sensor, level, field, t, (to - t < step) ? to : t + step, &out[n]);
+    }
+    return n;
+}
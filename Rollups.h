@@ -0,0 +1,117 @@
+/*
+Rollups - incremental multi-resolution min/max/avg per sensor and field
+
+Each reading updates one bucket per resolution level (O(1)). Buckets are kept
+in fixed-size ring buffers, so every level covers a fixed period of time:
+
+    Level  Resolution  Buckets  Period
+    0      1 min       60       1 h
+    1      10 min      36       6 h
+    2      1 h         48       2 days
+    3      1 day       31       1 month
+
+Queries are answered from the coarsest level which is aligned to the
+requested window and still holds its beginning, e.g. "last 24 h, hourly"
+reads 24 buckets of level 2 instead of all raw readings. A window which is
+not aligned to any level is answered from the finest level holding it and
+narrowed to the buckets inside it: the bucket around from is left out, the
+one around to only taken if there is no reading at or after to (so a window
+ending now includes the latest readings).
+
+Values are kept as integers (temperature, wind and rain in 1/10 units).
+
+A sensor new to the table takes a free entry, else the least recently heard
+one which is unconfirmed (fewer than ROLLUP_MIN_READINGS readings, e.g. an
+ID decoded from a corrupted frame), else the least recently heard one which
+is stale (no reading for ROLLUP_STALE_S) - otherwise it is not rolled up.
+Each entry takes about 14 KB.
+*/
+#ifndef ROLLUPS_H
+#define ROLLUPS_H
+
+#include <stdint.h>
+#include "WeatherData.h"
+
+// Number of sensors tracked - allow for a spare entry taken by IDs of
+// corrupted frames
+#ifndef ROLLUP_MAX_SENSORS
+#define ROLLUP_MAX_SENSORS 4
+#endif
+
+// Readings after which a sensor is kept while it is heard
+#ifndef ROLLUP_MIN_READINGS
+#define ROLLUP_MIN_READINGS 3
+#endif
+
+// A sensor without readings for this long may be replaced by a new one (s)
+#ifndef ROLLUP_STALE_S
+#define ROLLUP_STALE_S 3600
+#endif
+
+#define ROLLUP_LEVELS 4
+#define ROLLUP_SLOTS (60 + 36 + 48 + 31)
+
+enum RollupField {
+    ROLLUP_TEMP, ROLLUP_HUM, ROLLUP_WIND_GUST, ROLLUP_WIND_AVG, ROLLUP_RAIN, ROLLUP_FIELDS
+};
+
+struct RollupResult {
+    uint32_t count;                // number of readings
+    float    min;
+    float    max;
+    float    avg;
+};
+
+class Rollups {
+public:
+    Rollups();
+
+    // Update all levels with reading
+    bool add(const WeatherData *pData, uint32_t timestamp);
+
+    // Aggregate of [from, to) - returns false if no data is available
+    bool query(uint32_t sensor_id, RollupField field, uint32_t from, uint32_t to, RollupResult *pOut);
+
+    // Aggregates of [from, to) in steps of step seconds (e.g. hourly for the
+    // last 24 h) - returns number of results written to out
+    unsigned series(uint32_t sensor_id, RollupField field, uint32_t from, uint32_t to,
+                    uint32_t step, RollupResult *out, unsigned max);
+
+    // Resolution (s) of a level
+    static uint32_t resolution(unsigned level);
+
+    // Sensors replaced by new ones, readings of sensors not tracked
+    uint32_t evictions() const { return _evictions; }
+    uint32_t untracked() const { return _untracked; }
+
+private:
+    // 48 bit sum in 4 byte aligned parts - 16 instead of 24 bytes
+    struct Bucket {
+        int32_t  min;
+        int32_t  max;
+        uint32_t sum_lo;
+        int16_t  sum_hi;
+        uint16_t count;
+    };
+
+    struct SensorRollup {
+        bool     used;
+        uint32_t sensor_id;
+        uint32_t readings;
+        uint32_t last_ts;             // timestamp of latest reading
+        uint32_t head[ROLLUP_LEVELS]; // bucket number (timestamp / resolution) of newest slot
+    };
+
+    int  findSensor(uint32_t sensor_id);
+    int  victim(uint32_t timestamp) const;
+    Bucket *bucket(int sensor, unsigned level, uint32_t n);
+    int  selectLevel(int sensor, uint32_t from, uint32_t to, uint32_t step);
+    bool aggregate(int sensor, unsigned level, RollupField field, uint32_t from, uint32_t to, RollupResult *pOut);
+
+    SensorRollup _sensors[ROLLUP_MAX_SENSORS];
+    Bucket       _buckets[ROLLUP_MAX_SENSORS][ROLLUP_SLOTS][ROLLUP_FIELDS];
+    uint32_t     _evictions;
+    uint32_t     _untracked;
+};
+
+#endif // ROLLUPS_H
@@ -0,0 +1,88 @@
+/*
+SensorEmulator - transmits frames of emulated Bresser 5-in-1/6-in-1 sensors
+*/
+#include "SensorEmulator.h"
+
+#include <string.h>
+
+SensorEmulator::SensorEmulator() :
+    _count(0), _fn(nullptr), _ctx(nullptr)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void SensorEmulator::begin(EmulatorTxFn fn, void *ctx)
+{
+    _fn    = fn;
+    _ctx   = ctx;
+    _count = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+bool SensorEmulator::add(BresserProtocol protocol, uint32_t sensor_id, uint32_t period_ms, uint32_t first_ms)
+{
+    if (_count >= EMULATOR_MAX_SENSORS || period_ms == 0) {
+        return false;
+    }
+    Sensor *s    = &_sensors[_count++];
+    s->protocol  = protocol;
+    s->id        = sensor_id;
+    s->period_ms = period_ms;
+    s->due_ms    = first_ms;
+    s->count     = 0;
+    s->rain      = 0;
+    return true;
+}
+
+bool SensorEmulator::poll(uint32_t now_ms)
+{
+    // Most overdue sensor
+    Sensor *s = nullptr;
+    for (unsigned i = 0; i < _count; i++) {
+        if ((int32_t)(now_ms - _sensors[i].due_ms) >= 0 &&
+            (!s || (int32_t)(_sensors[i].due_ms - s->due_ms) < 0)) {
+            s = &_sensors[i];
+        }
+    }
+    if (!s || !_fn) {
+        return false;
+    }
+
+    WeatherData w;
+    memset(&w, 0, sizeof(w));
+    w.sensor_id           = s->id;
+    w.s_type              = (s->protocol == BRESSER_6IN1) ? 1 : 0;
+    w.battery_ok          = true;
+    w.temp_c              = 20.0f;
+    w.humidity            = 50;
+    w.wind_ok             = true;
+    w.wind_direction_deg  = 90;
+    w.wind_gust_meter_sec = 3.0f;
+    w.wind_avg_meter_sec  = 2.0f;
+    w.uv_ok               = (s->protocol == BRESSER_6IN1);
+    w.uv                  = 1.0f;
+    // 6-in-1: temperature/humidity and rain alternate
+    w.temp_ok = (s->protocol == BRESSER_5IN1) || (s->count % 2 == 0);
+    w.rain_ok = (s->protocol == BRESSER_5IN1) || !w.temp_ok;
+    if (w.rain_ok) {
+        s->rain = (s->rain + 1) % ((s->protocol == BRESSER_5IN1) ? 1000 : 1000000);
+    }
+    w.rain_mm = s->rain * 0.1f;
+
+    uint8_t frame[BRESSER_FRAME_SIZE];
+    encodeBresserFrame(s->protocol, &w, frame);
+    if (_fn(frame, BRESSER_FRAME_SIZE, _ctx)) {
+        _stats.sent++;
+    } else {
+        _stats.failed++;
+    }
+    s->count++;
+
+    // Next frame - skip those which can no longer be sent in time
+    s->due_ms += s->period_ms;
+    while ((int32_t)(now_ms - s->due_ms) >= (int32_t)s->period_ms) {
+        s->due_ms += s->period_ms;
+        _stats.skipped++;
+    }
+    return true;
+}
@@ -0,0 +1,78 @@
+/*
+SensorEmulator - transmits frames of emulated Bresser 5-in-1/6-in-1 sensors
+
+Turns a board into a calibrated traffic source for measuring the capture
+rate of another receiver:
+
+    emulator.begin(transmit, nullptr);
+    emulator.add(BRESSER_5IN1, 0xE0, 12000, millis());
+    ...
+    emulator.poll(millis());        // in loop()
+
+Each sensor transmits every period_ms. Its rain counter advances by 0.1 mm
+per frame (6-in-1: per rain frame, as temperature/humidity and rain frames
+alternate), so the receiver can tell lost frames from the gaps - besides its
+own schedule based loss counting. The other values are constant.
+
+Frames are encoded with encodeBresserFrame() (0xD4 + payload, padded to
+BRESSER_FRAME_SIZE) and handed to the transmit callback, e.g.
+radio.transmit() on the target or a CC1101Sim on the host. One frame is sent
+per poll(); frames which fall more than one period behind (callback too
+slow for the configured rate) are skipped and counted.
+*/
+#ifndef SENSOR_EMULATOR_H
+#define SENSOR_EMULATOR_H
+
+#include <stdint.h>
+#include "BresserEncoder.h"
+
+// Number of emulated sensors
+#ifndef EMULATOR_MAX_SENSORS
+#define EMULATOR_MAX_SENSORS 8
+#endif
+
+// Transmit frame - returns false on error
+typedef bool (*EmulatorTxFn)(const uint8_t *frame, uint8_t len, void *ctx);
+
+struct EmulatorStats {
+    uint32_t sent;
+    uint32_t failed;               // transmit callback failed
+    uint32_t skipped;              // not sent in time
+};
+
+class SensorEmulator {
+public:
+    SensorEmulator();
+
+    void begin(EmulatorTxFn fn, void *ctx);
+
+    // Add sensor, first frame at first_ms - returns false if the table is full
+    bool add(BresserProtocol protocol, uint32_t sensor_id, uint32_t period_ms, uint32_t first_ms);
+
+    // Transmit the frame which is most overdue - returns true if one was sent
+    bool poll(uint32_t now_ms);
+
+    // Frames sent by sensor
+    uint32_t frames(unsigned sensor) const { return _sensors[sensor].count; }
+    unsigned count() const { return _count; }
+
+    const EmulatorStats& stats() const { return _stats; }
+
+private:
+    struct Sensor {
+        BresserProtocol protocol;
+        uint32_t        id;
+        uint32_t        period_ms;
+        uint32_t        due_ms;
+        uint32_t        count;     // frames sent
+        uint32_t        rain;      // rain counter (0.1 mm)
+    };
+
+    Sensor        _sensors[EMULATOR_MAX_SENSORS];
+    unsigned      _count;
+    EmulatorTxFn  _fn;
+    void         *_ctx;
+    EmulatorStats _stats;
+};
+
+#endif // SENSOR_EMULATOR_H
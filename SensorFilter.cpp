@@ -0,0 +1,102 @@
+/*
+SensorFilter - sensor ID allowlist/denylist with per-ID rejection counters
+*/
+#include "SensorFilter.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static_assert((SENSOR_FILTER_SLOTS & (SENSOR_FILTER_SLOTS - 1)) == 0,
+              "SENSOR_FILTER_SLOTS must be a power of 2");
+
+#define SENSOR_FILTER_MAX_USED (SENSOR_FILTER_SLOTS * 3 / 4)
+
+// Fibonacci hashing
+static inline unsigned slotOf(uint32_t id)
+{
+    return (id * 2654435761u) & (SENSOR_FILTER_SLOTS - 1);
+}
+
+SensorFilter::SensorFilter() :
+    _mode(SENSOR_FILTER_OFF)
+{
+    clear();
+}
+
+void SensorFilter::clear()
+{
+    memset(_list, 0, sizeof(_list));
+    memset(_rejected, 0, sizeof(_rejected));
+    _listUsed     = 0;
+    _rejectedUsed = 0;
+    _other        = 0;
+    _filtered     = 0;
+}
+
+SensorFilter::Slot *SensorFilter::find(Slot *table, uint32_t id, bool insert, unsigned *used)
+{
+    unsigned i = slotOf(id);
+    while (table[i].used) {
+        if (table[i].id == id) {
+            return &table[i];
+        }
+        i = (i + 1) & (SENSOR_FILTER_SLOTS - 1);
+    }
+    if (!insert || *used >= SENSOR_FILTER_MAX_USED) {
+        return nullptr;
+    }
+    table[i].used  = true;
+    table[i].id    = id;
+    table[i].count = 0;
+    (*used)++;
+    return &table[i];
+}
+
+bool SensorFilter::add(uint32_t sensor_id)
+{
+    return find(_list, sensor_id, true, &_listUsed) != nullptr;
+}
+
+bool SensorFilter::accept(uint32_t sensor_id)
+{
+    if (_mode == SENSOR_FILTER_OFF) {
+        return true;
+    }
+    bool listed = find(_list, sensor_id, false, nullptr) != nullptr;
+    if (listed == (_mode == SENSOR_FILTER_ALLOW)) {
+        return true;
+    }
+
+    _filtered++;
+    Slot *s = find(_rejected, sensor_id, true, &_rejectedUsed);
+    if (s) {
+        s->count++;
+    } else {
+        _other++;
+    }
+    return false;
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int SensorFilter::render(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    APPEND("# TYPE bresser_filtered_frames_total counter\n");
+    for (int i = 0; i < SENSOR_FILTER_SLOTS; i++) {
+        if (_rejected[i].used) {
+            APPEND("bresser_filtered_frames_total{id=\"%08x\"} %u\n",
+                   (unsigned)_rejected[i].id, (unsigned)_rejected[i].count);
+        }
+    }
+    APPEND("bresser_filtered_frames_total{id=\"other\"} %u\n", (unsigned)_other);
+
+    return (len < size) ? (int)len : -1;
+}
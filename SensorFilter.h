@@ -0,0 +1,67 @@
+/*
+SensorFilter - sensor ID allowlist/denylist with per-ID rejection counters
+
+The decoders consult the filter as soon as the integrity check has passed
+(ID in msg[14] for 5-in-1, msg[2..5] for 6-in-1) and return DECODE_SKIP for
+unwanted sensors, so their frames skip field extraction and all output.
+
+IDs are kept in a small open addressing hash set (linear probing), so a
+lookup is a multiplication and typically a single compare. Rejected frames
+are counted per ID in a second table of the same kind; IDs which do not fit
+are counted as "other".
+*/
+#ifndef SENSOR_FILTER_H
+#define SENSOR_FILTER_H
+
+#include <stdint.h>
+
+// Hash table size (power of 2) - at most 3/4 are used
+#ifndef SENSOR_FILTER_SLOTS
+#define SENSOR_FILTER_SLOTS 32
+#endif
+
+enum SensorFilterMode {
+    SENSOR_FILTER_OFF,             // accept all
+    SENSOR_FILTER_ALLOW,           // accept listed IDs only
+    SENSOR_FILTER_DENY             // reject listed IDs
+};
+
+class SensorFilter {
+public:
+    SensorFilter();
+
+    void setMode(SensorFilterMode mode) { _mode = mode; }
+    SensorFilterMode mode() const { return _mode; }
+
+    // Add ID to list - returns false if the list is full
+    bool add(uint32_t sensor_id);
+    void clear();
+
+    // Check ID - rejected IDs are counted
+    bool accept(uint32_t sensor_id);
+
+    // Prometheus text: bresser_filtered_frames_total{id="..."}
+    // Returns length or -1 if buf is too small
+    int render(char *buf, unsigned size) const;
+
+    uint32_t filtered() const { return _filtered; }
+
+private:
+    struct Slot {
+        bool     used;
+        uint32_t id;
+        uint32_t count;
+    };
+
+    static Slot *find(Slot *table, uint32_t id, bool insert, unsigned *used);
+
+    SensorFilterMode _mode;
+    Slot     _list[SENSOR_FILTER_SLOTS];
+    unsigned _listUsed;
+    Slot     _rejected[SENSOR_FILTER_SLOTS];
+    unsigned _rejectedUsed;
+    uint32_t _other;               // rejected, not fitting into _rejected
+    uint32_t _filtered;            // all rejected frames
+};
+
+#endif // SENSOR_FILTER_H
@@ -0,0 +1,272 @@
+/*
+SensorSchedule - per-sensor transmit period/phase estimation and packet loss
+
+See SensorSchedule.h for the model.
+*/
+#include "SensorSchedule.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+SensorSchedule::SensorSchedule() :
+    _evictions(0), _untracked(0)
+{
+    memset(_sensors, 0, sizeof(_sensors));
+}
+
+int SensorSchedule::findSensor(uint32_t sensor_id) const
+{
+    for (int i = 0; i < SCHEDULE_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].sensor_id == sensor_id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//
+// Entry for a new sensor: a free one, else the least recently heard
+// unconfirmed sensor, else the least recently heard stale one - -1: none
+//
+int SensorSchedule::victim(uint32_t now_ms) const
+{
+    int best = -1;
+    for (int i = 0; i < SCHEDULE_MAX_SENSORS; i++) {
+        const Sensor *s = &_sensors[i];
+        if (!s->used) {
+            return i;
+        }
+        bool confirmed = s->stats.received >= SCHEDULE_MIN_ARRIVALS;
+        if (confirmed && now_ms - s->last_ms < SCHEDULE_STALE_MS) {
+            continue;
+        }
+        bool bestConfirmed = (best >= 0) && _sensors[best].stats.received >= SCHEDULE_MIN_ARRIVALS;
+        if (best < 0 || (!confirmed && bestConfirmed) ||
+            (confirmed == bestConfirmed && now_ms - s->last_ms > now_ms - _sensors[best].last_ms)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+//
+// Start a new fit with a single arrival at now_ms
+//
+void SensorSchedule::restart(Sensor *s, uint32_t now_ms, float period)
+{
+    s->last_ms = now_ms;
+    s->overdue = 0;
+    s->period  = period;
+    s->s0      = 1;
+    s->sk = s->st = s->skk = s->skt = s->stt = 0;
+}
+
+//
+// Slope of the weighted least squares line t(k)
+//
+void SensorSchedule::fit(Sensor *s)
+{
+    double den = s->s0 * s->skk - s->sk * s->sk;
+    if (den < 1e-6) {
+        return;
+    }
+    double period = (s->s0 * s->skt - s->sk * s->st) / den;
+    if (period >= SCHEDULE_MIN_PERIOD_MS) {
+        s->period = period;
+    }
+}
+
+void SensorSchedule::arrival(uint32_t sensor_id, uint32_t now_ms)
+{
+    int i = findSensor(sensor_id);
+    if (i < 0) {
+        i = victim(now_ms);
+        if (i < 0) {
+            _untracked++;
+            return;
+        }
+        if (_sensors[i].used) {
+            _evictions++;
+        }
+        Sensor *s = &_sensors[i];
+        memset(s, 0, sizeof(Sensor));
+        s->used      = true;
+        s->sensor_id = sensor_id;
+        restart(s, now_ms, 0);
+        s->stats.received = 1;
+        return;
+    }
+
+    Sensor  *s  = &_sensors[i];
+    uint32_t dt = now_ms - s->last_ms;
+    if (dt < SCHEDULE_MIN_PERIOD_MS) {
+        s->stats.duplicates++;
+        return;
+    }
+    s->stats.received++;
+
+    // Number of periods since the latest arrival
+    uint32_t steps = 1;
+    if (s->period > 0) {
+        steps = lroundf(dt / s->period);
+        float err = dt - steps * s->period;
+        if (steps == 0 || fabsf(err) > s->period / 4) {
+            // Off the schedule - the initial period may have been a multiple
+            // of the real one, or the sensor has been reset
+            s->stats.resyncs++;
+            restart(s, now_ms, (steps == 0) ? dt : s->period);
+            return;
+        }
+    }
+
+    // Frames in between are lost - some of them may have been flagged by poll()
+    s->stats.lost += (steps - 1);
+    s->stats.lost -= (s->overdue < s->stats.lost) ? s->overdue : s->stats.lost;
+
+    // Age the sums and move the origin to the new arrival (k = steps, t = dt)
+    const double f = SCHEDULE_FORGETTING;
+    double a  = steps;
+    double b  = dt;
+    double s0 = s->s0 * f, sk = s->sk * f, st = s->st * f;
+    double skk = s->skk * f, skt = s->skt * f, stt = s->stt * f;
+
+    s->skk = skk - 2 * a * sk + a * a * s0;
+    s->skt = skt - a * st - b * sk + a * b * s0;
+    s->stt = stt - 2 * b * st + b * b * s0;
+    s->sk  = sk - a * s0;
+    s->st  = st - b * s0;
+    s->s0  = s0 + 1;
+
+    s->last_ms = now_ms;
+    s->overdue = 0;
+    if (s->period == 0) {
+        s->period = dt;
+    } else {
+        fit(s);
+    }
+}
+
+//
+// Predict arrival k periods after the latest one
+//
+bool SensorSchedule::predict(const Sensor *s, uint32_t k, SchedulePrediction *pOut) const
+{
+    if (!s->used || s->period == 0) {
+        return false;
+    }
+
+    double b = s->period;
+    double a = (s->st - b * s->sk) / s->s0;   // fitted t at k = 0
+    double window = s->period / 4;
+
+    if (s->stats.received >= 3 && s->s0 > 2.5) {
+        double rss = s->stt - 2 * a * s->st - 2 * b * s->skt
+                   + a * a * s->s0 + 2 * a * b * s->sk + b * b * s->skk;
+        double var  = (rss > 0) ? rss / (s->s0 - 2) : 0;
+        double kbar = s->sk / s->s0;
+        double sxx  = s->skk - s->sk * kbar;
+        double se   = sqrt(var * (1 + 1 / s->s0 + ((k - kbar) * (k - kbar)) / sxx));
+        window = SCHEDULE_CONFIDENCE_Z * se;
+        if (window > s->period / 2) {
+            window = s->period / 2;
+        }
+    }
+    if (window < SCHEDULE_MIN_WINDOW_MS) {
+        window = SCHEDULE_MIN_WINDOW_MS;
+    }
+
+    pOut->sensor_id = s->sensor_id;
+    pOut->next_ms   = s->last_ms + (int32_t)lround(a + b * k);
+    pOut->window_ms = window;
+    pOut->period_ms = s->period;
+    return true;
+}
+
+bool SensorSchedule::predict(uint32_t sensor_id, SchedulePrediction *pOut) const
+{
+    int i = findSensor(sensor_id);
+    return (i >= 0) && predict(&_sensors[i], _sensors[i].overdue + 1, pOut);
+}
+
+void SensorSchedule::poll(uint32_t now_ms)
+{
+    for (int i = 0; i < SCHEDULE_MAX_SENSORS; i++) {
+        Sensor *s = &_sensors[i];
+        SchedulePrediction p;
+        while (predict(s, s->overdue + 1, &p) && (int32_t)(now_ms - (p.next_ms + p.window_ms)) > 0) {
+            s->overdue++;
+            s->stats.lost++;
+        }
+    }
+}
+
+bool SensorSchedule::next(uint32_t now_ms, SchedulePrediction *pOut) const
+{
+    bool    found = false;
+    int32_t best  = 0;
+    for (int i = 0; i < SCHEDULE_MAX_SENSORS; i++) {
+        const Sensor *s = &_sensors[i];
+        SchedulePrediction p;
+        if (!predict(s, s->overdue + 1, &p) || (int32_t)(p.next_ms + p.window_ms - now_ms) < 0) {
+            continue;
+        }
+        int32_t start = p.next_ms - p.window_ms - now_ms;
+        if (!found || start < best) {
+            best  = start;
+            *pOut = p;
+            found = true;
+        }
+    }
+    return found;
+}
+
+const ScheduleStats *SensorSchedule::stats(uint32_t sensor_id) const
+{
+    int i = findSensor(sensor_id);
+    return (i < 0) ? nullptr : &_sensors[i].stats;
+}
+
+float SensorSchedule::lossRatio(uint32_t sensor_id) const
+{
+    const ScheduleStats *st = stats(sensor_id);
+    if (!st || st->received + st->lost == 0) {
+        return 0;
+    }
+    return (float)st->lost / (st->received + st->lost);
+}
+
+// Append formatted text - keeps track of overflow in *len (> size)
+#define APPEND(...) \
+    do { \
+        if (len < size) { \
+            len += snprintf(&buf[len], size - len, __VA_ARGS__); \
+        } \
+    } while (0)
+
+int SensorSchedule::render(char *buf, unsigned size) const
+{
+    unsigned len = 0;
+
+    APPEND("# TYPE bresser_sensor_period_seconds gauge\n");
+    for (int i = 0; i < SCHEDULE_MAX_SENSORS; i++) {
+        if (_sensors[i].used && _sensors[i].period > 0) {
+            APPEND("bresser_sensor_period_seconds{id=\"%08x\"} %.3f\n",
+                   (unsigned)_sensors[i].sensor_id, _sensors[i].period / 1000.0);
+        }
+    }
+    APPEND("# TYPE bresser_sensor_frames_lost_total counter\n");
+    for (int i = 0; i < SCHEDULE_MAX_SENSORS; i++) {
+        if (_sensors[i].used) {
+            APPEND("bresser_sensor_frames_lost_total{id=\"%08x\"} %u\n",
+                   (unsigned)_sensors[i].sensor_id, (unsigned)_sensors[i].stats.lost);
+        }
+    }
+
+    APPEND("# TYPE bresser_schedule_evictions_total counter\n");
+    APPEND("bresser_schedule_evictions_total %u\n", (unsigned)_evictions);
+    APPEND("# TYPE bresser_schedule_untracked_total counter\n");
+    APPEND("bresser_schedule_untracked_total %u\n", (unsigned)_untracked);
+
+    return (len < size) ? (int)len : -1;
+}
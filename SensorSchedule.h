@@ -0,0 +1,136 @@
+/*
+SensorSchedule - per-sensor transmit period/phase estimation and packet loss
+
+Bresser sensors transmit periodically (e.g. every 12 s), so each arrival of
+sensor i is modelled as
+
+    t(k) = phase + period * k
+
+where k is the number of periods since the first arrival. The line is fitted
+by weighted least squares over all arrivals with exponential forgetting, so
+the estimate follows slow drift of the sensor's clock. The sums are kept
+relative to the latest arrival, which keeps them small and makes each update
+O(1).
+
+From the fit the next arrival is predicted together with a confidence
+window (+-SCHEDULE_CONFIDENCE_Z standard errors of the prediction). Frames
+not seen within their window are counted as lost; a gap of several periods
+between two arrivals counts the frames in between. Arrivals closer than
+SCHEDULE_MIN_PERIOD_MS to the previous one (repeated transmissions) are
+ignored.
+
+A new sensor takes a free entry, else the least recently heard one which
+is unconfirmed (fewer than SCHEDULE_MIN_ARRIVALS arrivals, e.g. an ID
+decoded from a corrupted frame), else the least recently heard one which
+is stale (not heard for SCHEDULE_STALE_MS) - otherwise it is not tracked.
+
+All functions take the current time as parameter (ms, wrapping), so the
+estimator can be driven by a simulated clock.
+*/
+#ifndef SENSOR_SCHEDULE_H
+#define SENSOR_SCHEDULE_H
+
+#include <stdint.h>
+
+// Number of sensors tracked
+#ifndef SCHEDULE_MAX_SENSORS
+#define SCHEDULE_MAX_SENSORS 8
+#endif
+
+// Forgetting factor per arrival (weight of an arrival n frames ago: f^n)
+#ifndef SCHEDULE_FORGETTING
+#define SCHEDULE_FORGETTING 0.98
+#endif
+
+// Half width of confidence window in standard errors
+#ifndef SCHEDULE_CONFIDENCE_Z
+#define SCHEDULE_CONFIDENCE_Z 3.0
+#endif
+
+// Minimum half width of confidence window (ms) - covers timestamp jitter
+#ifndef SCHEDULE_MIN_WINDOW_MS
+#define SCHEDULE_MIN_WINDOW_MS 50
+#endif
+
+// Arrivals closer than this are repetitions of the same frame (ms)
+#ifndef SCHEDULE_MIN_PERIOD_MS
+#define SCHEDULE_MIN_PERIOD_MS 2000
+#endif
+
+// Arrivals after which a sensor is no longer replaced by new ones
+#ifndef SCHEDULE_MIN_ARRIVALS
+#define SCHEDULE_MIN_ARRIVALS 3
+#endif
+
+// A sensor not heard for this long may be replaced by a new one (ms)
+#ifndef SCHEDULE_STALE_MS
+#define SCHEDULE_STALE_MS 600000
+#endif
+
+struct SchedulePrediction {
+    uint32_t sensor_id;
+    uint32_t next_ms;              // expected arrival
+    uint32_t window_ms;            // half width of confidence window
+    float    period_ms;
+};
+
+struct ScheduleStats {
+    uint32_t received;             // arrivals used for the fit
+    uint32_t lost;                 // missed frames
+    uint32_t duplicates;           // repetitions ignored
+    uint32_t resyncs;              // fit restarted (arrival far off the schedule)
+};
+
+class SensorSchedule {
+public:
+    SensorSchedule();
+
+    // Record arrival of a frame from sensor
+    void arrival(uint32_t sensor_id, uint32_t now_ms);
+
+    // Flag frames overdue at now_ms as lost - call periodically
+    void poll(uint32_t now_ms);
+
+    // Next expected arrival of sensor - returns false if not yet known
+    bool predict(uint32_t sensor_id, SchedulePrediction *pOut) const;
+
+    // Earliest window of all sensors which has not yet ended at now_ms
+    bool next(uint32_t now_ms, SchedulePrediction *pOut) const;
+
+    // Statistics of sensor - nullptr if unknown
+    const ScheduleStats *stats(uint32_t sensor_id) const;
+
+    // Lost / (received + lost) of sensor
+    float lossRatio(uint32_t sensor_id) const;
+
+    // Sensors replaced by new ones, sensors not tracked (no entry)
+    uint32_t evictions() const { return _evictions; }
+    uint32_t untracked() const { return _untracked; }
+
+    // Prometheus text: period, lost frames - returns length or -1 if buf is too small
+    int render(char *buf, unsigned size) const;
+
+private:
+    struct Sensor {
+        bool     used;
+        uint32_t sensor_id;
+        uint32_t last_ms;          // latest arrival (origin of the sums)
+        uint32_t overdue;          // frames flagged as lost since last arrival
+        float    period;           // current estimate (ms), 0: unknown
+        // Weighted sums of k and t (ms) relative to latest arrival
+        double   s0, sk, st, skk, skt, stt;
+        ScheduleStats stats;
+    };
+
+    int  findSensor(uint32_t sensor_id) const;
+    int  victim(uint32_t now_ms) const;
+    void restart(Sensor *s, uint32_t now_ms, float period);
+    void fit(Sensor *s);
+    bool predict(const Sensor *s, uint32_t k, SchedulePrediction *pOut) const;
+
+    Sensor _sensors[SCHEDULE_MAX_SENSORS];
+    uint32_t _evictions;
+    uint32_t _untracked;
+};
+
+#endif // SENSOR_SCHEDULE_H
@@ -0,0 +1,164 @@
+/*
+SensorSnapshots - latest reading per sensor, written by one task and read
+lock-free by any number of others
+*/
+#include "SensorSnapshots.h"
+
+#include <string.h>
+
+#ifdef ARDUINO
+#include <Arduino.h>
+// Lets lower priority tasks (a preempted writer) run
+#define SNAPSHOT_YIELD() delay(1)
+#else
+#include <thread>
+#define SNAPSHOT_YIELD() std::this_thread::yield()
+#endif
+
+SensorSnapshots::SensorSnapshots() :
+    _count(0), _version(0), _retries(0)
+{
+    for (int i = 0; i < SNAPSHOT_MAX_SENSORS; i++) {
+        _slots[i].seq.store(0, std::memory_order_relaxed);
+        _slots[i].sensor_id.store(0, std::memory_order_relaxed);
+        _slots[i].writes  = 0;
+        _slots[i].written = 0;
+        for (unsigned w = 0; w < WORDS; w++) {
+            _slots[i].words[w].store(0, std::memory_order_relaxed);
+        }
+    }
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void SensorSnapshots::store(Slot *slot, const Record *rec)
+{
+    uint32_t words[WORDS] = { 0 };
+    memcpy(words, rec, sizeof(Record));
+
+    uint32_t seq = slot->seq.load(std::memory_order_relaxed);
+    slot->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned w = 0; w < WORDS; w++) {
+        slot->words[w].store(words[w], std::memory_order_relaxed);
+    }
+    slot->seq.store(seq + 2, std::memory_order_release);
+}
+
+void SensorSnapshots::load(const Slot *slot, Record *rec) const
+{
+    uint32_t words[WORDS];
+    for (unsigned tries = 1; ; tries++) {
+        uint32_t seq = slot->seq.load(std::memory_order_acquire);
+        if ((seq & 1) == 0) {
+            for (unsigned w = 0; w < WORDS; w++) {
+                words[w] = slot->words[w].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot->seq.load(std::memory_order_relaxed) == seq) {
+                break;
+            }
+        }
+        _retries.fetch_add(1, std::memory_order_relaxed);
+        if (tries % SNAPSHOT_SPIN == 0) {
+            SNAPSHOT_YIELD();
+        }
+    }
+    memcpy(rec, words, sizeof(Record));
+}
+
+//
+// Slot for a new sensor once all are in use - the least recently written
+// unconfirmed sensor's, else the least recently written stale one's; -1 if
+// none
+//
+int SensorSnapshots::victim() const
+{
+    int best = -1;
+    for (int i = 0; i < SNAPSHOT_MAX_SENSORS; i++) {
+        const Slot *s = &_slots[i];
+        bool confirmed = s->writes >= SNAPSHOT_MIN_WRITES;
+        if (confirmed && _stats.writes - s->written < SNAPSHOT_STALE_WRITES) {
+            continue;
+        }
+        bool bestConfirmed = (best >= 0) && _slots[best].writes >= SNAPSHOT_MIN_WRITES;
+        if (best < 0 || (!confirmed && bestConfirmed) ||
+            (confirmed == bestConfirmed && (int32_t)(s->written - _slots[best].written) < 0)) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+bool SensorSnapshots::write(const WeatherData *pData, uint32_t timestamp)
+{
+    Record rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.data      = *pData;
+    rec.timestamp = timestamp;
+
+    // Only the writer changes the slots and their count
+    unsigned n = _count.load(std::memory_order_relaxed);
+    int i = 0;
+    while (i < (int)n && _slots[i].sensor_id.load(std::memory_order_relaxed) != pData->sensor_id) {
+        i++;
+    }
+    bool fresh = (i == (int)n);        // sensor without a slot
+    if (fresh && n == SNAPSHOT_MAX_SENSORS) {
+        i = victim();
+        if (i < 0) {
+            _stats.full++;
+            return false;
+        }
+        _stats.evictions++;
+    }
+    if (fresh) {
+        // The reading carries the ID as well, so a reader which matched a
+        // reused slot by the old ID rejects the copy
+        _slots[i].sensor_id.store(pData->sensor_id, std::memory_order_relaxed);
+        _slots[i].writes = 0;
+    }
+    store(&_slots[i], &rec);
+    if (i == (int)n) {
+        _count.store(n + 1, std::memory_order_release);
+    }
+    _stats.writes++;
+    _slots[i].writes++;
+    _slots[i].written = _stats.writes;
+    _version.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool SensorSnapshots::read(unsigned slot, WeatherData *pData, uint32_t *pTimestamp) const
+{
+    if (slot >= count()) {
+        return false;
+    }
+    Record rec;
+    load(&_slots[slot], &rec);
+    *pData = rec.data;
+    if (pTimestamp) {
+        *pTimestamp = rec.timestamp;
+    }
+    return true;
+}
+
+bool SensorSnapshots::find(uint32_t sensor_id, WeatherData *pData, uint32_t *pTimestamp) const
+{
+    unsigned n = count();
+    for (unsigned i = 0; i < n; i++) {
+        if (_slots[i].sensor_id.load(std::memory_order_relaxed) == sensor_id) {
+            // The slot may have been reused since - the copy tells
+            Record rec;
+            load(&_slots[i], &rec);
+            if (rec.data.sensor_id != sensor_id) {
+                return false;
+            }
+            *pData = rec.data;
+            if (pTimestamp) {
+                *pTimestamp = rec.timestamp;
+            }
+            return true;
+        }
+    }
+    return false;
+}
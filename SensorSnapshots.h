@@ -0,0 +1,120 @@
+/*
+SensorSnapshots - latest reading per sensor, written by one task and read
+lock-free by any number of others
+
+The decode task stores every reading; output, HTTP and MQTT tasks read the
+latest one of each sensor. A reading is a WeatherData (some 60 bytes) plus a
+timestamp - too large for one atomic access, and a reader must never see
+half of one reading and half of the next. Each slot is a seqlock:
+
+- The writer makes the slot's sequence number odd, stores the words of the
+  reading, and makes it even again. It never waits for readers.
+- A reader reads the sequence number, copies the words and reads the
+  sequence number again. If it was odd, or has changed, the copy may be
+  torn and is retried. After SNAPSHOT_SPIN retries the reader yields, so
+  that a writer preempted on the same core can finish.
+
+The words are std::atomic (relaxed), ordered by fences around the copy, so
+there is no data race in the C++ sense. Every field of a reading is observed
+from the same write.
+
+Slots are claimed by the writer on a sensor's first reading and published
+by the slot count. A corrupted frame which still decodes makes up a sensor
+which is never heard again, so once all slots are in use, the slot of the
+least recently written sensor with fewer than SNAPSHOT_MIN_WRITES readings
+is reused, or that of a sensor not written for SNAPSHOT_STALE_WRITES writes
+(of any sensor) - else the reading is dropped (stats().full). A reused slot
+is rewritten through its seqlock like any other write, with the sensor ID in
+the reading: a reader copies the old sensor's reading or the new one, never
+a mix, and find() only returns a copy with the ID asked for. version()
+counts the writes, so a reader can tell cheaply whether anything has
+changed.
+*/
+#ifndef SENSOR_SNAPSHOTS_H
+#define SENSOR_SNAPSHOTS_H
+
+#include <stdint.h>
+#include <atomic>
+#include "WeatherData.h"
+
+// Number of sensors
+#ifndef SNAPSHOT_MAX_SENSORS
+#define SNAPSHOT_MAX_SENSORS 8
+#endif
+
+// Readings until a sensor keeps its slot
+#ifndef SNAPSHOT_MIN_WRITES
+#define SNAPSHOT_MIN_WRITES 2
+#endif
+
+// Writes of other sensors after which a sensor's slot may be reused
+#ifndef SNAPSHOT_STALE_WRITES
+#define SNAPSHOT_STALE_WRITES (8 * SNAPSHOT_MAX_SENSORS)
+#endif
+
+// Torn reads retried before yielding
+#ifndef SNAPSHOT_SPIN
+#define SNAPSHOT_SPIN 100
+#endif
+
+struct SnapshotStats {
+    uint32_t writes;
+    uint32_t full;                 // readings dropped (no free slot)
+    uint32_t evictions;            // slots reused for another sensor
+};
+
+class SensorSnapshots {
+public:
+    SensorSnapshots();
+
+    // Writer (one task only): store reading as the latest of its sensor -
+    // returns false if there is no slot for it (see above)
+    bool write(const WeatherData *pData, uint32_t timestamp);
+
+    // Readers (any task)
+
+    // Number of slots in use
+    unsigned count() const { return _count.load(std::memory_order_acquire); }
+
+    // Latest reading of slot (< count()) / of sensor - returns false if there
+    // is none
+    bool read(unsigned slot, WeatherData *pData, uint32_t *pTimestamp) const;
+    bool find(uint32_t sensor_id, WeatherData *pData, uint32_t *pTimestamp) const;
+
+    // Number of writes so far
+    uint32_t version() const { return _version.load(std::memory_order_acquire); }
+
+    // Torn reads retried
+    uint32_t retries() const { return _retries.load(std::memory_order_relaxed); }
+
+    // Writer's statistics
+    const SnapshotStats& stats() const { return _stats; }
+
+private:
+    struct Record {
+        WeatherData data;
+        uint32_t    timestamp;
+    };
+
+    static const unsigned WORDS = (sizeof(Record) + 3) / 4;
+
+    struct Slot {
+        std::atomic<uint32_t> seq;         // odd while being written
+        std::atomic<uint32_t> sensor_id;
+        std::atomic<uint32_t> words[WORDS];
+        uint32_t              writes;      // readings of the sensor (writer only)
+        uint32_t              written;     // stats().writes at its latest one
+    };
+
+    int  victim() const;
+    void store(Slot *slot, const Record *rec);
+    void load(const Slot *slot, Record *rec) const;
+
+    Slot                          _slots[SNAPSHOT_MAX_SENSORS];
+    std::atomic<unsigned>         _count;
+    std::atomic<uint32_t>         _version;
+    mutable std::atomic<uint32_t> _retries;
+    SnapshotStats                 _stats;
+};
+
+#endif // SENSOR_SNAPSHOTS_H
@@ -0,0 +1,379 @@
+/*
+TimeSeriesStore - compressed per-sensor history of decoded readings in RAM
+
+See TimeSeriesStore.h for the encoding.
+*/
+#include "TimeSeriesStore.h"
+#include "Clock.h"
+
+#include <math.h>
+#include <string.h>
+
+// Worst case code length (bits)
+#define TS_MAX_CODE_BITS 36
+
+// Sealed chunk header: first_ts (4), count (2), bytes per column (1 each)
+#define TS_CHUNK_HEADER (6 + TS_COLUMNS)
+
+// Flags column
+#define TS_FLAG_TEMP_OK     0x01
+#define TS_FLAG_UV_OK       0x02
+#define TS_FLAG_WIND_OK     0x04
+#define TS_FLAG_RAIN_OK     0x08
+#define TS_FLAG_BATTERY_OK  0x10
+#define TS_FLAG_MOISTURE_OK 0x20
+
+static_assert(TS_COLUMN_SIZE <= 255, "column size must fit into chunk header");
+static_assert(TS_COLUMN_SIZE * 8 >= 2 * TS_MAX_CODE_BITS, "column size too small");
+
+static void putBits(uint8_t *buf, uint16_t *pos, uint32_t value, unsigned n)
+{
+    for (int i = n - 1; i >= 0; i--) {
+        unsigned byte = *pos >> 3;
+        unsigned bit  = 7 - (*pos & 7);
+        if ((value >> i) & 1) {
+            buf[byte] |= (1 << bit);
+        } else {
+            buf[byte] &= ~(1 << bit);
+        }
+        (*pos)++;
+    }
+}
+
+static uint32_t getBits(const uint8_t *buf, uint32_t *pos, unsigned n)
+{
+    uint32_t value = 0;
+    for (unsigned i = 0; i < n; i++) {
+        value = (value << 1) | ((buf[*pos >> 3] >> (7 - (*pos & 7))) & 1);
+        (*pos)++;
+    }
+    return value;
+}
+
+static inline uint32_t zigzag(int32_t v)
+{
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static inline int32_t unzigzag(uint32_t v)
+{
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void putDelta(uint8_t *buf, uint16_t *pos, int32_t delta)
+{
+    uint32_t zz = zigzag(delta);
+    if (zz == 0) {
+        putBits(buf, pos, 0x0, 1);
+    } else if (zz < (1u << 6)) {
+        putBits(buf, pos, 0x2, 2);
+        putBits(buf, pos, zz, 6);
+    } else if (zz < (1u << 10)) {
+        putBits(buf, pos, 0x6, 3);
+        putBits(buf, pos, zz, 10);
+    } else if (zz < (1u << 16)) {
+        putBits(buf, pos, 0xe, 4);
+        putBits(buf, pos, zz, 16);
+    } else {
+        putBits(buf, pos, 0xf, 4);
+        putBits(buf, pos, zz, 32);
+    }
+}
+
+static int32_t getDelta(const uint8_t *buf, uint32_t *pos)
+{
+    static const uint8_t width[] = {6, 10, 16, 32};
+    unsigned prefix = 0;
+    while (prefix < 4 && getBits(buf, pos, 1)) {
+        prefix++;
+    }
+    if (prefix == 0) {
+        return 0;
+    }
+    return unzigzag(getBits(buf, pos, width[prefix - 1]));
+}
+
+TimeSeriesStore::TimeSeriesStore()
+{
+    memset(_series, 0, sizeof(_series));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+void TimeSeriesStore::resetChunk(Series *s)
+{
+    s->count      = 0;
+    s->prev_delta = 0;
+    memset(s->prev, 0, sizeof(s->prev));
+    memset(s->bits, 0, sizeof(s->bits));
+}
+
+TimeSeriesStore::Series *TimeSeriesStore::findSeries(uint32_t sensor_id)
+{
+    for (int i = 0; i < TS_MAX_SENSORS; i++) {
+        if (_series[i].used && _series[i].sensor_id == sensor_id) {
+            return &_series[i];
+        }
+    }
+    return nullptr;
+}
+
+//
+// Series to be taken by a new sensor: a free one, else the least recently
+// heard unconfirmed one, else the least recently heard stale one - nullptr:
+// none
+//
+TimeSeriesStore::Series *TimeSeriesStore::victim(uint32_t timestamp)
+{
+    Series *best = nullptr;
+    bool bestConfirmed = false;
+    for (int i = 0; i < TS_MAX_SENSORS; i++) {
+        Series *s = &_series[i];
+        if (!s->used) {
+            return s;
+        }
+        bool confirmed = s->arena_readings + s->count >= TS_MIN_READINGS;
+        if (confirmed && (int32_t)(timestamp - s->prev_ts) < TS_STALE_S) {
+            continue;
+        }
+        if (!best || (!confirmed && bestConfirmed) ||
+            (confirmed == bestConfirmed && (int32_t)(s->prev_ts - best->prev_ts) < 0)) {
+            best          = s;
+            bestConfirmed = confirmed;
+        }
+    }
+    return best;
+}
+
+//
+// Pack open chunk into arena - oldest chunks are dropped if it does not fit
+//
+void TimeSeriesStore::seal(Series *s)
+{
+    if (s->count == 0) {
+        return;
+    }
+    uint8_t colBytes[TS_COLUMNS];
+    unsigned size = TS_CHUNK_HEADER;
+    for (int c = 0; c < TS_COLUMNS; c++) {
+        colBytes[c] = (s->bits[c] + 7) / 8;
+        size += colBytes[c];
+    }
+
+    while (s->arena_used + size > TS_ARENA_SIZE && s->arena_chunks > 0) {
+        uint16_t count;
+        unsigned oldest = TS_CHUNK_HEADER;
+        memcpy(&count, &s->arena[4], 2);
+        for (int c = 0; c < TS_COLUMNS; c++) {
+            oldest += s->arena[6 + c];
+        }
+        memmove(s->arena, &s->arena[oldest], s->arena_used - oldest);
+        s->arena_used     -= oldest;
+        s->arena_readings -= count;
+        s->arena_chunks--;
+        _stats.evicted++;
+    }
+
+    uint8_t *p = &s->arena[s->arena_used];
+    memcpy(p, &s->first_ts, 4);
+    memcpy(p + 4, &s->count, 2);
+    memcpy(p + 6, colBytes, TS_COLUMNS);
+    p += TS_CHUNK_HEADER;
+    for (int c = 0; c < TS_COLUMNS; c++) {
+        memcpy(p, s->cols[c], colBytes[c]);
+        p += colBytes[c];
+    }
+    s->arena_used     += size;
+    s->arena_chunks++;
+    s->arena_readings += s->count;
+    _stats.chunks++;
+    resetChunk(s);
+}
+
+bool TimeSeriesStore::add(const WeatherData *pData, uint32_t timestamp)
+{
+    uint32_t start = clockMicros();
+    Series *s = findSeries(pData->sensor_id);
+    if (!s) {
+        s = victim(timestamp);
+        if (!s) {
+            _stats.dropped++;
+            return false;
+        }
+        if (s->used) {
+            _stats.replaced++;
+        }
+        s->used           = true;
+        s->sensor_id      = pData->sensor_id;
+        s->arena_used     = 0;
+        s->arena_chunks   = 0;
+        s->arena_readings = 0;
+        resetChunk(s);
+    }
+    s->s_type = pData->s_type;
+    s->chan   = pData->chan;
+
+    // Seal chunk if any column might not take another value
+    for (int c = 0; c < TS_COLUMNS; c++) {
+        if (s->bits[c] + TS_MAX_CODE_BITS > TS_COLUMN_SIZE * 8) {
+            seal(s);
+            break;
+        }
+    }
+
+    int32_t v[TS_COLUMNS];
+    v[TS_COL_FLAGS] = (pData->temp_ok     ? TS_FLAG_TEMP_OK     : 0) |
+                      (pData->uv_ok       ? TS_FLAG_UV_OK       : 0) |
+                      (pData->wind_ok     ? TS_FLAG_WIND_OK     : 0) |
+                      (pData->rain_ok     ? TS_FLAG_RAIN_OK     : 0) |
+                      (pData->battery_ok  ? TS_FLAG_BATTERY_OK  : 0) |
+                      (pData->moisture_ok ? TS_FLAG_MOISTURE_OK : 0);
+
+    // Invalid fields repeat the previous value
+    v[TS_COL_TEMP]  = pData->temp_ok ? lroundf(pData->temp_c * 10) : s->prev[TS_COL_TEMP];
+    v[TS_COL_HUM]   = pData->temp_ok ? pData->humidity : s->prev[TS_COL_HUM];
+    v[TS_COL_UV]    = pData->uv_ok ? lroundf(pData->uv * 10) : s->prev[TS_COL_UV];
+    v[TS_COL_GUST]  = pData->wind_ok ? lroundf(pData->wind_gust_meter_sec * 10) : s->prev[TS_COL_GUST];
+    v[TS_COL_AVG]   = pData->wind_ok ? lroundf(pData->wind_avg_meter_sec * 10) : s->prev[TS_COL_AVG];
+    v[TS_COL_DIR]   = pData->wind_ok ? lroundf(pData->wind_direction_deg * 10) : s->prev[TS_COL_DIR];
+    v[TS_COL_RAIN]  = pData->rain_ok ? lroundf(pData->rain_mm * 10) : s->prev[TS_COL_RAIN];
+    v[TS_COL_MOIST] = pData->moisture_ok ? pData->moisture : s->prev[TS_COL_MOIST];
+
+    if (s->count == 0) {
+        s->first_ts   = timestamp;
+        s->prev_delta = 0;
+    } else {
+        int32_t delta = (int32_t)(timestamp - s->prev_ts);
+        putDelta(s->cols[TS_COL_TIME], &s->bits[TS_COL_TIME], delta - s->prev_delta);
+        s->prev_delta = delta;
+    }
+    s->prev_ts = timestamp;
+
+    for (int c = TS_COL_FLAGS; c < TS_COLUMNS; c++) {
+        putDelta(s->cols[c], &s->bits[c], v[c] - s->prev[c]);
+        s->prev[c] = v[c];
+    }
+    s->count++;
+    _stats.readings++;
+
+    if (s->count >= TS_CHUNK_READINGS) {
+        seal(s);
+    }
+    _stats.encode_us += clockMicros() - start;
+    return true;
+}
+
+unsigned TimeSeriesStore::decodeChunk(const Series *s, uint32_t first_ts, uint16_t count,
+                                      const uint8_t *cols[TS_COLUMNS], uint32_t from, uint32_t to,
+                                      TsVisitor visitor, void *ctx)
+{
+    uint32_t pos[TS_COLUMNS] = {0};
+    int32_t  v[TS_COLUMNS]   = {0};
+    uint32_t ts    = first_ts;
+    int32_t  delta = 0;
+    unsigned n = 0;
+    WeatherData wd;
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (i > 0) {
+            delta += getDelta(cols[TS_COL_TIME], &pos[TS_COL_TIME]);
+            ts    += delta;
+        }
+        for (int c = TS_COL_FLAGS; c < TS_COLUMNS; c++) {
+            v[c] += getDelta(cols[c], &pos[c]);
+        }
+        if (ts < from || ts > to) {
+            continue;
+        }
+        memset(&wd, 0, sizeof(wd));
+        wd.sensor_id           = s->sensor_id;
+        wd.s_type              = s->s_type;
+        wd.chan                = s->chan;
+        wd.temp_ok             = v[TS_COL_FLAGS] & TS_FLAG_TEMP_OK;
+        wd.uv_ok               = v[TS_COL_FLAGS] & TS_FLAG_UV_OK;
+        wd.wind_ok             = v[TS_COL_FLAGS] & TS_FLAG_WIND_OK;
+        wd.rain_ok             = v[TS_COL_FLAGS] & TS_FLAG_RAIN_OK;
+        wd.battery_ok          = v[TS_COL_FLAGS] & TS_FLAG_BATTERY_OK;
+        wd.moisture_ok         = v[TS_COL_FLAGS] & TS_FLAG_MOISTURE_OK;
+        wd.temp_c              = v[TS_COL_TEMP] * 0.1f;
+        wd.humidity            = v[TS_COL_HUM];
+        wd.uv                  = v[TS_COL_UV] * 0.1f;
+        wd.wind_gust_meter_sec = v[TS_COL_GUST] * 0.1f;
+        wd.wind_avg_meter_sec  = v[TS_COL_AVG] * 0.1f;
+        wd.wind_direction_deg  = v[TS_COL_DIR] * 0.1f;
+        wd.rain_mm             = v[TS_COL_RAIN] * 0.1f;
+        wd.moisture            = v[TS_COL_MOIST];
+        visitor(ts, &wd, ctx);
+        n++;
+    }
+    return n;
+}
+
+unsigned TimeSeriesStore::forEach(uint32_t sensor_id, uint32_t from, uint32_t to,
+                                  TsVisitor visitor, void *ctx)
+{
+    uint32_t start = clockMicros();
+    const uint8_t *cols[TS_COLUMNS];
+    unsigned n = 0;
+
+    Series *s = findSeries(sensor_id);
+    if (!s) {
+        return 0;
+    }
+
+    // Sealed chunks, oldest first
+    unsigned offs = 0;
+    for (unsigned k = 0; k < s->arena_chunks; k++) {
+        uint32_t first_ts;
+        uint16_t count;
+        const uint8_t *hdr = &s->arena[offs];
+        memcpy(&first_ts, hdr, 4);
+        memcpy(&count, hdr + 4, 2);
+        const uint8_t *p = hdr + TS_CHUNK_HEADER;
+        for (int c = 0; c < TS_COLUMNS; c++) {
+            cols[c] = p;
+            p += hdr[6 + c];
+        }
+        n += decodeChunk(s, first_ts, count, cols, from, to, visitor, ctx);
+        offs = p - s->arena;
+    }
+
+    // Open chunk
+    for (int c = 0; c < TS_COLUMNS; c++) {
+        cols[c] = s->cols[c];
+    }
+    n += decodeChunk(s, s->first_ts, s->count, cols, from, to, visitor, ctx);
+
+    _stats.decoded   += n;
+    _stats.decode_us += clockMicros() - start;
+    return n;
+}
+
+uint32_t TimeSeriesStore::compressedBytes() const
+{
+    uint32_t bytes = 0;
+    for (int i = 0; i < TS_MAX_SENSORS; i++) {
+        const Series *s = &_series[i];
+        if (!s->used) {
+            continue;
+        }
+        bytes += s->arena_used;
+        if (s->count) {
+            bytes += TS_CHUNK_HEADER;
+            for (int c = 0; c < TS_COLUMNS; c++) {
+                bytes += (s->bits[c] + 7) / 8;
+            }
+        }
+    }
+    return bytes;
+}
+
+uint32_t TimeSeriesStore::storedReadings() const
+{
+    uint32_t n = 0;
+    for (int i = 0; i < TS_MAX_SENSORS; i++) {
+        if (_series[i].used) {
+            n += _series[i].arena_readings + _series[i].count;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,139 @@
+/*
+TimeSeriesStore - compressed per-sensor history of decoded readings in RAM
+
+Readings are quantized to integers (temperature, UV, wind and rain in 1/10
+units, wind direction in 1/10 deg) and stored column by column - one bit
+stream per field - in chunks of up to TS_CHUNK_READINGS readings:
+
+- timestamps: delta-of-delta
+- measurements: delta to the previous value of the same field
+- flags (*_ok, battery): only stored if changed
+
+Deltas are zigzag mapped and bit packed with a variable length prefix code:
+
+    '0'                  0
+    '10'   +  6 bit      |d| < 32
+    '110'  + 10 bit      |d| < 512
+    '1110' + 16 bit      |d| < 32768
+    '1111' + 32 bit      anything else
+
+Data is encoded incrementally into the open chunk of a sensor as frames
+arrive. Complete chunks are packed into the sensor's arena (TS_ARENA_SIZE
+bytes); the oldest chunks are dropped when the arena is full.
+
+Invalid fields (e.g. temp_ok == false) repeat the previous value, so they cost
+a single bit.
+
+A sensor new to the table takes a free series, else the least recently heard
+one which is unconfirmed (fewer than TS_MIN_READINGS readings, e.g. an ID
+decoded from a corrupted frame), else the least recently heard one which is
+stale (no reading for TS_STALE_S) - otherwise its reading is dropped.
+*/
+#ifndef TIME_SERIES_STORE_H
+#define TIME_SERIES_STORE_H
+
+#include <stdint.h>
+#include "WeatherData.h"
+
+// Number of sensors tracked
+#ifndef TS_MAX_SENSORS
+#define TS_MAX_SENSORS 4
+#endif
+
+// Readings after which a sensor is kept while it is heard
+#ifndef TS_MIN_READINGS
+#define TS_MIN_READINGS 3
+#endif
+
+// A sensor without readings for this long may be replaced by a new one (s)
+#ifndef TS_STALE_S
+#define TS_STALE_S 3600
+#endif
+
+// Compressed history per sensor (bytes)
+#ifndef TS_ARENA_SIZE
+#define TS_ARENA_SIZE 4096
+#endif
+
+// Maximum number of readings per chunk
+#ifndef TS_CHUNK_READINGS
+#define TS_CHUNK_READINGS 64
+#endif
+
+// Open chunk buffer per column (bytes)
+#ifndef TS_COLUMN_SIZE
+#define TS_COLUMN_SIZE 96
+#endif
+
+enum TsColumn {
+    TS_COL_TIME, TS_COL_FLAGS, TS_COL_TEMP, TS_COL_HUM, TS_COL_UV, TS_COL_GUST,
+    TS_COL_AVG, TS_COL_DIR, TS_COL_RAIN, TS_COL_MOIST, TS_COLUMNS
+};
+
+struct TsStats {
+    uint32_t readings;             // readings encoded
+    uint32_t dropped;              // readings rejected (sensor table full)
+    uint32_t replaced;             // series replaced by a new sensor
+    uint32_t chunks;               // chunks sealed
+    uint32_t evicted;              // chunks dropped from arena
+    uint32_t encode_us;            // accumulated encoding time
+    uint32_t decoded;              // readings decoded by queries
+    uint32_t decode_us;            // accumulated decoding time
+};
+
+// Called for each reading found by TimeSeriesStore::forEach()
+typedef void (*TsVisitor)(uint32_t timestamp, const WeatherData *pData, void *ctx);
+
+class TimeSeriesStore {
+public:
+    TimeSeriesStore();
+
+    // Encode reading into the sensor's history
+    bool add(const WeatherData *pData, uint32_t timestamp);
+
+    // Decode readings of sensor_id with from <= timestamp <= to
+    // Returns the number of readings passed to visitor
+    unsigned forEach(uint32_t sensor_id, uint32_t from, uint32_t to, TsVisitor visitor, void *ctx);
+
+    // Compressed size of all stored readings and number of readings stored
+    uint32_t compressedBytes() const;
+    uint32_t storedReadings() const;
+
+    const TsStats& stats() const { return _stats; }
+
+private:
+    struct Series {
+        bool     used;
+        uint32_t sensor_id;
+        uint8_t  s_type;
+        uint8_t  chan;
+
+        // Open chunk
+        uint32_t first_ts;
+        uint16_t count;
+        uint32_t prev_ts;
+        int32_t  prev_delta;
+        int32_t  prev[TS_COLUMNS];
+        uint16_t bits[TS_COLUMNS];
+        uint8_t  cols[TS_COLUMNS][TS_COLUMN_SIZE];
+
+        // Sealed chunks
+        uint16_t arena_used;
+        uint16_t arena_chunks;
+        uint32_t arena_readings;
+        uint8_t  arena[TS_ARENA_SIZE];
+    };
+
+    Series *findSeries(uint32_t sensor_id);
+    Series *victim(uint32_t timestamp);
+    void seal(Series *s);
+    void resetChunk(Series *s);
+    unsigned decodeChunk(const Series *s, uint32_t first_ts, uint16_t count,
+                         const uint8_t *cols[TS_COLUMNS], uint32_t from, uint32_t to,
+                         TsVisitor visitor, void *ctx);
+
+    Series  _series[TS_MAX_SENSORS];
+    TsStats _stats;
+};
+
+#endif // TIME_SERIES_STORE_H
@@ -0,0 +1,347 @@
+/*
+TrafficGen - synthetic Bresser sensor traffic for load testing
+*/
+#include "TrafficGen.h"
+#include "BresserEncoder.h"
+#include "BresserDecoder.h"
+
+#include <math.h>
+#include <string.h>
+
+// Preamble and sync word (bits)
+#define AIR_OVERHEAD_BITS (32 + 16)
+
+// Last sync byte, received as first byte of the frame
+#define SYNC_BYTE 0xD4
+
+static const int moisture_map[] = {0, 7, 13, 20, 27, 33, 40, 47, 53, 60, 67, 73, 80, 87, 93, 99};
+
+// Value rounded to 0.1
+static inline float tenths(float value)
+{
+    return lroundf(value * 10) * 0.1f;
+}
+
+static inline float clamp(float value, float lo, float hi)
+{
+    return (value < lo) ? lo : (value > hi) ? hi : value;
+}
+
+TrafficGen::TrafficGen() :
+    _count(0), _lastEnd(0), _rng(1)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+//
+// xorshift32
+//
+uint32_t TrafficGen::random()
+{
+    _rng ^= _rng << 13;
+    _rng ^= _rng >> 17;
+    _rng ^= _rng << 5;
+    return _rng;
+}
+
+float TrafficGen::uniform(float lo, float hi)
+{
+    return lo + (hi - lo) * (random() >> 8) * (1.0f / 16777216.0f);
+}
+
+void TrafficGen::begin(const TrafficConfig &cfg, uint64_t start_us)
+{
+    _cfg     = cfg;
+    _count   = (cfg.sensors < TRAFFIC_MAX_SENSORS) ? cfg.sensors : TRAFFIC_MAX_SENSORS;
+    _lastEnd = 0;
+    _rng     = cfg.seed ? cfg.seed : 1;
+    memset(&_stats, 0, sizeof(_stats));
+
+    for (unsigned i = 0; i < _count; i++) {
+        Sensor *s = &_sensors[i];
+        memset(s, 0, sizeof(Sensor));
+        s->protocol   = (uniform(0, 1) < cfg.share_6in1) ? TRAFFIC_6IN1 : TRAFFIC_5IN1;
+        s->id         = (s->protocol == TRAFFIC_6IN1) ? random() : (random() & 0xff);
+        s->period_us  = TRAFFIC_PERIOD_MS * 1000.0 * (1 + uniform(-cfg.drift_ppm, cfg.drift_ppm) * 1e-6);
+        s->nominal_us = start_us + uniform(0, s->period_us);
+        s->next_us    = (uint64_t)s->nominal_us;
+        s->rssi       = uniform(cfg.rssi_min, cfg.rssi_max);
+        if (cfg.frequency_hz != 0) {
+            s->frequency_hz = cfg.frequency_hz + uniform(-cfg.freq_offset_hz, cfg.freq_offset_hz);
+            s->drift_hz     = uniform(-cfg.freq_drift_hz, cfg.freq_drift_hz);
+            s->drift_phase  = uniform(0, 2 * M_PI);
+        }
+
+        // Plausible start values
+        WeatherData *w = &s->weather;
+        w->sensor_id           = s->id;
+        w->s_type              = (s->protocol == TRAFFIC_6IN1) ? 1 : 0;
+        w->battery_ok          = uniform(0, 1) < 0.95f;
+        w->temp_c              = uniform(-10, 30);
+        w->humidity            = uniform(30, 90);
+        w->wind_avg_meter_sec  = uniform(0, 8);
+        w->wind_gust_meter_sec = w->wind_avg_meter_sec + uniform(0, 3);
+        w->wind_direction_deg  = uniform(0, 360);
+        w->rain_mm             = uniform(0, 50);
+        w->uv                  = uniform(0, 5);
+        _heap[i] = i;
+    }
+    for (unsigned i = _count / 2; i-- > 0; ) {
+        siftDown(i);
+    }
+}
+
+void TrafficGen::siftDown(unsigned i)
+{
+    for (;;) {
+        unsigned min = i;
+        unsigned l   = 2 * i + 1;
+        unsigned r   = l + 1;
+        if (l < _count && _sensors[_heap[l]].next_us < _sensors[_heap[min]].next_us) {
+            min = l;
+        }
+        if (r < _count && _sensors[_heap[r]].next_us < _sensors[_heap[min]].next_us) {
+            min = r;
+        }
+        if (min == i) {
+            return;
+        }
+        uint16_t tmp = _heap[i];
+        _heap[i]     = _heap[min];
+        _heap[min]   = tmp;
+        i = min;
+    }
+}
+
+//
+// Random walk of the weather values
+//
+void TrafficGen::update(Sensor *s)
+{
+    WeatherData *w = &s->weather;
+    w->temp_c              = clamp(w->temp_c + uniform(-0.1f, 0.1f), -39, 59);
+    w->humidity            = clamp(w->humidity + (int)(random() % 3) - 1, 10, 99);
+    w->wind_avg_meter_sec  = clamp(w->wind_avg_meter_sec + uniform(-0.5f, 0.5f), 0, 40);
+    w->wind_gust_meter_sec = w->wind_avg_meter_sec + uniform(0, 3);
+    w->wind_direction_deg  = fmodf(w->wind_direction_deg + uniform(-20, 20) + 360, 360);
+    w->uv                  = clamp(w->uv + uniform(-0.1f, 0.1f), 0, 12);
+    if (uniform(0, 1) < 0.02f) {
+        w->rain_mm += uniform(0.1f, 1);
+    }
+}
+
+uint32_t TrafficGen::airTime(uint8_t len) const
+{
+    return lroundf((AIR_OVERHEAD_BITS + len * 8) * 1e6f / _cfg.data_rate);
+}
+
+//
+// Flip each bit with probability ber - the gaps between errors are
+// geometrically distributed, so error-free frames cost one random number
+//
+unsigned TrafficGen::addBitErrors(uint8_t *data, unsigned len)
+{
+    if (_cfg.ber <= 0) {
+        return 0;
+    }
+    unsigned errors = 0;
+    double   scale  = 1 / log1p(-_cfg.ber);
+    for (double bit = 0; ; bit++) {
+        double u = (random() + 1.0) / 4294967296.0;
+        bit += floor(log(u) * scale);
+        if (bit >= len * 8) {
+            return errors;
+        }
+        unsigned b = (unsigned)bit;
+        data[b / 8] ^= 0x80 >> (b % 8);
+        errors++;
+    }
+}
+
+bool TrafficGen::next(SimFrame *pFrame, TrafficTruth *pTruth)
+{
+    if (_count == 0) {
+        return false;
+    }
+    unsigned i = _heap[0];
+    Sensor  *s = &_sensors[i];
+
+    // Reading as the protocol represents it
+    update(s);
+    WeatherData w = s->weather;
+    w.temp_c              = tenths(w.temp_c);
+    w.wind_avg_meter_sec  = tenths(w.wind_avg_meter_sec);
+    w.wind_gust_meter_sec = tenths(w.wind_gust_meter_sec);
+    w.rain_mm             = tenths(w.rain_mm);
+    w.uv                  = tenths(w.uv);
+
+    memset(pFrame, 0, sizeof(SimFrame));
+    pFrame->data[0] = SYNC_BYTE;
+    if (s->protocol == TRAFFIC_5IN1) {
+        w.wind_direction_deg = (lroundf(w.wind_direction_deg / 22.5f) & 0x0f) * 22.5f;
+        w.rain_mm            = tenths(fmodf(w.rain_mm, 100));
+        w.temp_ok = w.wind_ok = w.rain_ok = true;
+        pFrame->len = 1 + encodeBresser5In1Payload(&w, &pFrame->data[1]);
+    } else {
+        // Temperature/humidity and rain alternate
+        w.wind_direction_deg = lroundf(w.wind_direction_deg) % 360;
+        w.wind_ok = true;
+        w.temp_ok = w.uv_ok = (s->count % 2 == 0);
+        w.rain_ok = !w.temp_ok;
+        pFrame->len = 1 + encodeBresser6In1Payload(&w, &pFrame->data[1]);
+    }
+
+    pFrame->start_us     = s->next_us;
+    pFrame->frequency_hz = s->frequency_hz;
+    if (s->drift_hz != 0) {
+        pFrame->frequency_hz += s->drift_hz * sinf(2 * M_PI * (s->next_us * 1e-6f) / _cfg.freq_drift_s + s->drift_phase);
+    }
+    pFrame->rssi         = s->rssi;
+    pFrame->lqi          = (s->rssi > -80) ? 3 : (s->rssi > -95) ? 10 : 30;
+    pFrame->sync         = 0xAA2D;
+
+    pTruth->sensor     = i;
+    pTruth->protocol   = s->protocol;
+    pTruth->reading    = w;
+    pTruth->bit_errors = addBitErrors(pFrame->data, pFrame->len);
+    pTruth->overlap    = pFrame->start_us < _lastEnd;
+
+    uint64_t end = pFrame->start_us + airTime(pFrame->len);
+    _lastEnd = (end > _lastEnd) ? end : _lastEnd;
+
+    _stats.frames++;
+    _stats.overlaps   += pTruth->overlap;
+    _stats.corrupted  += (pTruth->bit_errors > 0);
+    _stats.bit_errors += pTruth->bit_errors;
+
+    // Schedule next transmission - jitter must not move it before this one
+    s->count++;
+    s->nominal_us += s->period_us;
+    double t = s->nominal_us + uniform(-_cfg.jitter_ms, _cfg.jitter_ms) * 1000;
+    s->next_us = (t > s->next_us) ? (uint64_t)t : s->next_us + 1;
+    siftDown(0);
+    return true;
+}
+
+//
+// Random reading covering the value range of the protocol, on its grid
+//
+void TrafficGen::randomReading(TrafficProtocol protocol, WeatherData *pOut)
+{
+    WeatherData *w = pOut;
+    memset(w, 0, sizeof(WeatherData));
+    w->battery_ok = random() & 1;
+
+    if (protocol == TRAFFIC_5IN1) {
+        w->sensor_id           = random() & 0xff;
+        w->temp_ok = w->wind_ok = w->rain_ok = true;
+        w->temp_c              = ((int)(random() % 1999) - 999) * 0.1f;
+        w->humidity            = random() % 100;
+        w->wind_direction_deg  = (random() % 16) * 22.5f;
+        w->wind_gust_meter_sec = (random() % 4096) * 0.1f;
+        w->wind_avg_meter_sec  = (random() % 1000) * 0.1f;
+        w->rain_mm             = (random() % 1000) * 0.1f;
+        return;
+    }
+
+    static const uint8_t types[] = {1, 2, 4};
+    w->sensor_id           = random();
+    w->s_type              = types[random() % 3];
+    w->chan                = random() % 8;
+    w->wind_ok             = random() & 1;
+    w->wind_gust_meter_sec = (random() % 1000) * 0.1f;
+    w->wind_avg_meter_sec  = (random() % 1000) * 0.1f;
+    w->wind_direction_deg  = random() % 360;
+    w->uv_ok               = random() & 1;
+    w->uv                  = (random() % 1000) * 0.1f;
+    w->temp_ok             = random() & 1;
+    w->rain_ok             = !w->temp_ok;
+    if (w->temp_ok) {
+        w->temp_c   = ((int)(random() % 1000) - 399) * 0.1f;
+        w->humidity = random() % 100;
+        if (w->s_type == 4) {
+            w->humidity    = 1 + random() % 16;
+            w->moisture_ok = true;
+            w->moisture    = moisture_map[w->humidity - 1];
+        }
+    } else {
+        w->rain_mm = (random() % 1000000) * 0.1f;
+    }
+}
+
+bool TrafficGen::same(TrafficProtocol protocol, const WeatherData *a, const WeatherData *b)
+{
+    #define SAME(field) (lroundf(a->field * 10) == lroundf(b->field * 10))
+
+    if (a->battery_ok != b->battery_ok) {
+        return false;
+    }
+    if (protocol == TRAFFIC_5IN1) {
+        return (a->sensor_id & 0xff) == b->sensor_id && SAME(temp_c) && a->humidity == b->humidity &&
+               SAME(wind_direction_deg) && SAME(wind_gust_meter_sec) && SAME(wind_avg_meter_sec) &&
+               SAME(rain_mm);
+    }
+
+    if (a->sensor_id != b->sensor_id || a->s_type != b->s_type || a->chan != b->chan ||
+        a->wind_ok != b->wind_ok || a->uv_ok != b->uv_ok || !SAME(wind_direction_deg)) {
+        return false;
+    }
+    if (a->wind_ok && !(SAME(wind_gust_meter_sec) && SAME(wind_avg_meter_sec))) {
+        return false;
+    }
+    if (a->uv_ok && !SAME(uv)) {
+        return false;
+    }
+    if (a->temp_ok) {
+        if (!b->temp_ok || !SAME(temp_c)) {
+            return false;
+        }
+        return a->moisture_ok ? (b->moisture_ok && a->moisture == b->moisture) : a->humidity == b->humidity;
+    }
+    return b->rain_ok && SAME(rain_mm);
+
+    #undef SAME
+}
+
+unsigned TrafficGen::roundTrip(unsigned n)
+{
+    unsigned mismatches = 0;
+    for (unsigned i = 0; i < 2 * n; i++) {
+        TrafficProtocol protocol = (i < n) ? TRAFFIC_5IN1 : TRAFFIC_6IN1;
+        WeatherData in, out;
+        uint8_t     msg[BRESSER_5IN1_SIZE];
+        uint8_t     copy[BRESSER_5IN1_SIZE];
+        uint8_t     again[BRESSER_5IN1_SIZE];
+        DecodeStatus status;
+
+        randomReading(protocol, &in);
+        memset(&out, 0, sizeof(out));
+        memset(msg, 0, sizeof(msg));
+        if (protocol == TRAFFIC_5IN1) {
+            encodeBresser5In1Payload(&in, msg);
+            memcpy(copy, msg, sizeof(msg));
+            status = decodeBresser5In1Payload(copy, BRESSER_5IN1_SIZE, &out);
+        } else {
+            encodeBresser6In1Payload(&in, msg);
+            memcpy(copy, msg, sizeof(msg));
+            status = decodeBresser6In1Payload(copy, BRESSER_5IN1_SIZE, &out);
+        }
+
+        bool ok = (status == DECODE_OK) && same(protocol, &in, &out);
+
+        // Re-encoding the decoded reading must give the same bytes (a 6-in-1
+        // frame decodes to both temperature and rain if all digits are valid)
+        out.temp_ok = in.temp_ok;
+        out.rain_ok = in.rain_ok;
+        memset(again, 0, sizeof(again));
+        if (protocol == TRAFFIC_5IN1) {
+            encodeBresser5In1Payload(&out, again);
+        } else {
+            encodeBresser6In1Payload(&out, again);
+        }
+        if (!ok || memcmp(msg, again, sizeof(msg)) != 0) {
+            mismatches++;
+        }
+    }
+    return mismatches;
+}
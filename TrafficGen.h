@@ -0,0 +1,141 @@
+/*
+TrafficGen - synthetic Bresser sensor traffic for load testing
+
+Simulates a population of 5-in-1 and 6-in-1 sensors and produces their
+frames in order of transmission time, ready for CC1101Sim::inject():
+
+    TrafficConfig cfg;
+    cfg.sensors = 2000;
+    cfg.ber     = 1e-4;
+    TrafficGen gen;
+    gen.begin(cfg, 0);
+    SimFrame frame;
+    TrafficTruth truth;
+    while (gen.next(&frame, &truth) && frame.start_us < end_us) {
+        sim.inject(&frame);
+        ...
+    }
+
+Each sensor has
+- a transmit period (12 s, as the real sensors) scaled by its crystal error
+  (+-drift_ppm), a random phase and a per-frame jitter
+- a carrier offset (+-freq_offset_hz) which drifts with the temperature of
+  its crystal (+-freq_drift_hz, over freq_drift_s), a fixed RSSI
+  (rssi_min..rssi_max)
+- slowly changing weather values (random walk), encoded with
+  encodeBresser5In1Payload()/encodeBresser6In1Payload(); 6-in-1 sensors
+  alternate between temperature/humidity and rain frames
+
+Frames of different sensors overlap in time as they would on air - the
+receiver model decides which one survives. Overlaps are counted in the
+stats and flagged in TrafficTruth. Bit errors are applied to each frame with
+the probability ber per bit.
+
+The generator is deterministic for a given seed. roundTrip() checks that
+the encoders and decoders agree on random readings across the whole value
+range.
+*/
+#ifndef TRAFFIC_GEN_H
+#define TRAFFIC_GEN_H
+
+#include <stdint.h>
+#include "WeatherData.h"
+#include "CC1101Sim.h"
+
+// Number of sensors simulated
+#ifndef TRAFFIC_MAX_SENSORS
+#define TRAFFIC_MAX_SENSORS 4096
+#endif
+
+// Transmit period of the sensors (ms)
+#define TRAFFIC_PERIOD_MS 12000
+
+enum TrafficProtocol {
+    TRAFFIC_5IN1, TRAFFIC_6IN1
+};
+
+struct TrafficConfig {
+    unsigned sensors        = 100;
+    float    share_6in1     = 0.5;     // fraction of 6-in-1 sensors
+    float    drift_ppm      = 100;     // crystal error, uniform +-
+    float    jitter_ms      = 2;       // per frame, uniform +-
+    float    frequency_hz   = 0;       // 0: on the receiver's frequency
+    float    freq_offset_hz = 0;       // carrier offset, uniform +- (needs frequency_hz)
+    float    freq_drift_hz  = 0;       // amplitude of the drift, uniform +-
+    float    freq_drift_s   = 3600;    // period of the drift (temperature cycle)
+    float    rssi_min       = -100;    // dBm
+    float    rssi_max       = -50;
+    float    data_rate      = 8210;    // bit/s, for the time on air
+    double   ber            = 0;       // bit error rate
+    uint32_t seed           = 1;
+};
+
+// What was sent
+struct TrafficTruth {
+    uint16_t        sensor;            // index
+    TrafficProtocol protocol;
+    WeatherData     reading;           // as encoded (values rounded to the protocol's resolution)
+    unsigned        bit_errors;
+    bool            overlap;           // overlaps with the previous frame on air
+};
+
+struct TrafficStats {
+    uint32_t frames;
+    uint32_t overlaps;                 // frames overlapping with their predecessor
+    uint32_t corrupted;                // frames with bit errors
+    uint32_t bit_errors;
+};
+
+class TrafficGen {
+public:
+    TrafficGen();
+
+    void begin(const TrafficConfig &cfg, uint64_t start_us);
+
+    // Next frame in order of start_us
+    bool next(SimFrame *pFrame, TrafficTruth *pTruth);
+
+    // Time on air of a frame incl. preamble and sync word (us)
+    uint32_t airTime(uint8_t len) const;
+
+    // Encode and decode n random readings per protocol - returns the number of
+    // mismatches
+    unsigned roundTrip(unsigned n);
+
+    const TrafficStats& stats() const { return _stats; }
+
+    // Compare the fields a frame of the protocol carries
+    static bool same(TrafficProtocol protocol, const WeatherData *a, const WeatherData *b);
+
+private:
+    struct Sensor {
+        uint32_t        id;
+        TrafficProtocol protocol;
+        double          nominal_us;    // next transmission without jitter
+        uint64_t        next_us;       // next transmission
+        double          period_us;
+        float           frequency_hz;
+        float           drift_hz;      // amplitude
+        float           drift_phase;   // rad
+        float           rssi;
+        uint32_t        count;         // frames sent
+        WeatherData     weather;       // current values
+    };
+
+    uint32_t random();
+    float    uniform(float lo, float hi);
+    void     randomReading(TrafficProtocol protocol, WeatherData *pOut);
+    void     update(Sensor *s);
+    unsigned addBitErrors(uint8_t *data, unsigned len);
+    void     siftDown(unsigned i);
+
+    TrafficConfig _cfg;
+    Sensor        _sensors[TRAFFIC_MAX_SENSORS];
+    uint16_t      _heap[TRAFFIC_MAX_SENSORS];   // sensors by next_us
+    unsigned      _count;
+    uint64_t      _lastEnd;                     // end of previous frame on air
+    uint32_t      _rng;
+    TrafficStats  _stats;
+};
+
+#endif // TRAFFIC_GEN_H
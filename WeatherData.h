@@ -0,0 +1,36 @@
+/*
+Common data types shared by the Bresser 5-in-1/6-in-1 decoders and the
+modules processing decoded readings (logging, storage, publishing).
+*/
+#ifndef WEATHER_DATA_H
+#define WEATHER_DATA_H
+
+#include <stdint.h>
+
+typedef enum DecodeStatus {
+    DECODE_OK, DECODE_PAR_ERR, DECODE_CHK_ERR, DECODE_DIG_ERR, DECODE_SKIP
+} DecodeStatus;
+
+struct WeatherData_S {
+    uint8_t  s_type;               // only 6-in1
+    uint32_t sensor_id;            // 5-in-1: 1 byte / 6-in-1: 4 bytes
+    uint8_t  chan;                 // only 6-in-1
+    bool     temp_ok;              // only 6-in-1
+    float    temp_c;
+    int      humidity;
+    bool     uv_ok;                // only 6-in-1
+    float    uv;                   // only 6-in-1
+    bool     wind_ok;              // only 6-in-1
+    float    wind_direction_deg;
+    float    wind_gust_meter_sec;
+    float    wind_avg_meter_sec;
+    bool     rain_ok;              // only 6-in-1
+    float    rain_mm;
+    bool     battery_ok;
+    bool     moisture_ok;          // only 6-in-1
+    int      moisture;             // only 6-in-1
+};
+
+typedef struct WeatherData_S WeatherData;
+
+#endif // WEATHER_DATA_H
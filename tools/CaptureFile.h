@@ -0,0 +1,44 @@
+/*
+CaptureFile - archive format of raw frames, for offline (re)decoding
+
+A capture file is a header followed by fixed-size records, one per frame as
+received (the bytes following the sync word 0xAA 0x2D, i.e. 0xD4 and the
+payload, zero padded):
+
+    CaptureHeader                  16 bytes
+    CaptureRecord[n]               40 bytes each
+
+All fields are little-endian. With fixed-size records a file can be split
+at any record boundary, so a reader maps it and hands out ranges of
+records without parsing. The number of records follows from the file size;
+a partially written last record is ignored.
+*/
+#ifndef CAPTURE_FILE_H
+#define CAPTURE_FILE_H
+
+#include <stdint.h>
+#include "../BresserEncoder.h"
+
+#define CAPTURE_MAGIC "BRSCAP01"
+
+struct CaptureHeader {
+    char     magic[8];             // CAPTURE_MAGIC, not NUL terminated
+    uint32_t record_size;          // sizeof(CaptureRecord)
+    uint32_t reserved;
+};
+
+struct CaptureRecord {
+    uint32_t time_s;               // s since epoch
+    uint16_t time_ms;              // ms within the second
+    int8_t   rssi;                 // dBm
+    uint8_t  lqi;
+    uint8_t  protocol;             // BresserProtocol
+    uint8_t  len;                  // bytes received (<= BRESSER_FRAME_SIZE)
+    uint8_t  data[BRESSER_FRAME_SIZE];
+    uint8_t  reserved[3];
+};
+
+static_assert(sizeof(CaptureHeader) == 16, "CaptureHeader: 16 bytes");
+static_assert(sizeof(CaptureRecord) == 40, "CaptureRecord: 40 bytes");
+
+#endif // CAPTURE_FILE_H
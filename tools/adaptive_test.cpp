@@ -0,0 +1,221 @@
+/*
+adaptive_test - AdaptiveRx receive-to-rearm time and capture (Linux host)
+
+    adaptive_test [--seed n]
+
+TrafficGen frames are received by AdaptiveRx through CC1101Sim, polled
+every 100 us on the virtual clock, 10 minutes per case. For each mix of
+protocols the radio time per frame (sync word to listening again) and the
+share of frames decoded are printed with fixed packet length 27, adaptive
+length and adaptive length with streaming checks:
+
+- 6-in-1 frames end after 19 bytes: with adaptive length the radio is
+  re-armed sooner and more frames are caught; 5-in-1 only is unchanged
+- every frame handed out decodes (no bit errors on air, so no frame is
+  taken for the wrong protocol)
+- 20000 6-in-1 frames carrying random bytes after their 19 bytes, one at a
+  time: none is handed out as a reading of another sensor, although some
+  start like a 5-in-1 frame (re-identified by their parity)
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -DCLOCK_VIRTUAL -o adaptive_test tools/adaptive_test.cpp AdaptiveRx.cpp FrameCheck.cpp \
+        TrafficGen.cpp CC1101Sim.cpp CC1101Bus.cpp BresserEncoder.cpp BresserDecoder.cpp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../AdaptiveRx.h"
+#include "../BresserDecoder.h"
+#include "../Clock.h"
+#include "../TrafficGen.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define RUN_US  600000000ull
+#define STEP_US 100
+
+enum Mode { FIXED, ADAPTIVE, STREAMING };
+
+static const char *modeNames[] = {"fixed 27", "adaptive", "streaming"};
+
+struct Result {
+    float    busy_us;              // radio time per frame
+    unsigned sent;
+    unsigned decoded;
+    unsigned bad;                  // handed out, not decoded
+};
+
+// As RadioLib configures the radio for the sketch (fixed length 27,
+// appended status bytes)
+static void configure(CC1101Sim *sim)
+{
+    clockVirtualUs() = 0;
+    sim->writeReg(CC1101_PKTCTRL0, 0x00);
+    sim->writeReg(CC1101_PKTCTRL1, 0x04);
+    sim->writeReg(CC1101_PKTLEN, BRESSER_FRAME_SIZE);
+    sim->writeReg(CC1101_SYNC1, 0xAA);
+    sim->writeReg(CC1101_SYNC0, 0x2D);
+    sim->writeReg(CC1101_MDMCFG4, 0x88);
+    sim->writeReg(CC1101_MDMCFG3, 0x83);
+}
+
+static DecodeStatus decode(const AdaptiveFrame *frame, WeatherData *pOut)
+{
+    uint8_t msg[BRESSER_5IN1_SIZE];
+    memset(pOut, 0, sizeof(WeatherData));
+    memcpy(msg, &frame->data[1], sizeof(msg));
+    return (frame->protocol == BRESSER_6IN1) ? decodeBresser6In1Payload(msg, sizeof(msg), pOut) :
+                                                decodeBresser5In1Payload(msg, sizeof(msg), pOut);
+}
+
+static Result run(unsigned sensors, float share_6in1, Mode mode, uint32_t seed)
+{
+    static TrafficGen gen;
+    CC1101Sim sim;
+    configure(&sim);
+    AdaptiveRx rx;
+    rx.begin(&sim, mode != FIXED, mode == STREAMING);
+    TrafficConfig cfg;
+    cfg.sensors    = sensors;
+    cfg.share_6in1 = share_6in1;
+    cfg.data_rate  = sim.dataRate();
+    cfg.seed       = seed;
+    gen.begin(cfg, 0);
+
+    Result r = {0, 0, 0, 0};
+    SimFrame frame;
+    TrafficTruth truth;
+    bool pending = gen.next(&frame, &truth);
+    for (uint64_t now = 0; now < RUN_US; now += STEP_US) {
+        while (pending && frame.start_us < now + STEP_US) {
+            sim.inject(&frame);
+            r.sent++;
+            pending = gen.next(&frame, &truth);
+        }
+        sim.advance(now);
+        AdaptiveFrame af;
+        if (rx.poll(&af, (uint32_t)now)) {
+            WeatherData w;
+            if (decode(&af, &w) == DECODE_OK) {
+                r.decoded++;
+            } else {
+                r.bad++;
+            }
+        }
+    }
+    r.busy_us = rx.busyPerFrame();
+    return r;
+}
+
+static void mix(const char *name, unsigned sensors, float share_6in1, uint32_t seed)
+{
+    Result r[3];
+    printf("%-22s", name);
+    for (int m = FIXED; m <= STREAMING; m++) {
+        r[m] = run(sensors, share_6in1, (Mode)m, seed);
+        printf("  %5.1f ms %5.1f%%", r[m].busy_us / 1000, 100.0 * r[m].decoded / r[m].sent);
+        CHECK(r[m].bad == 0, "%s, %s: %u frames handed out not decoded", name, modeNames[m], r[m].bad);
+    }
+    printf("\n");
+    for (int m = ADAPTIVE; m <= STREAMING; m++) {
+        if (share_6in1 > 0) {
+            CHECK(r[m].busy_us < r[FIXED].busy_us - 2000 && r[m].decoded > r[FIXED].decoded,
+                  "%s, %s: %.0f us per frame, %u decoded (fixed: %.0f us, %u)", name, modeNames[m], r[m].busy_us,
+                  r[m].decoded, r[FIXED].busy_us, r[FIXED].decoded);
+        } else {
+            CHECK(r[m].busy_us < r[FIXED].busy_us + 100 && r[m].decoded == r[FIXED].decoded,
+                  "%s, %s: %.0f us per frame, %u decoded (fixed: %.0f us, %u)", name, modeNames[m], r[m].busy_us,
+                  r[m].decoded, r[FIXED].busy_us, r[FIXED].decoded);
+        }
+    }
+}
+
+// 6-in-1 frames with random bytes behind them, one every 60 ms
+static void identification(uint32_t seed)
+{
+    CC1101Sim sim;
+    configure(&sim);
+    AdaptiveRx rx;
+    rx.begin(&sim);
+    srand(seed);
+    unsigned sent = 0, right = 0, wrong = 0, as5in1 = 0;
+    uint64_t now = 0;
+    for (int n = 0; n < 20000; n++) {
+        WeatherData w;
+        memset(&w, 0, sizeof(w));
+        w.sensor_id           = rand();
+        w.temp_ok             = true;
+        w.temp_c              = (rand() % 800) / 10.0f - 20;
+        w.humidity            = rand() % 100;
+        w.wind_ok             = true;
+        w.wind_gust_meter_sec = (rand() % 300) / 10.0f;
+        w.wind_avg_meter_sec  = (rand() % 300) / 10.0f;
+        w.wind_direction_deg  = rand() % 360;
+        SimFrame f;
+        memset(&f, 0, sizeof(f));
+        f.start_us = now + 1000;
+        f.rssi     = -60;
+        f.sync     = 0xAA2D;
+        f.len      = encodeBresserFrame(BRESSER_6IN1, &w, f.data);
+        for (int j = f.len; j < BRESSER_FRAME_SIZE; j++) {
+            f.data[j] = rand();
+        }
+        f.len = BRESSER_FRAME_SIZE;
+        sim.inject(&f);
+        sent++;
+        for (uint64_t end = now + 60000; now < end; now += STEP_US) {
+            sim.advance(now);
+            AdaptiveFrame af;
+            WeatherData d;
+            if (rx.poll(&af, (uint32_t)now) && decode(&af, &d) == DECODE_OK) {
+                as5in1 += (af.protocol == BRESSER_5IN1);
+                if (d.sensor_id == w.sensor_id) {
+                    right++;
+                } else {
+                    wrong++;
+                }
+            }
+        }
+    }
+    printf("6-in-1 frames with random tails: %u sent, %u decoded, %u false readings, %u handed out as 5-in-1, "
+           "%u re-identified\n", sent, right, wrong, as5in1, (unsigned)rx.stats().reidentified);
+    CHECK(wrong == 0 && as5in1 == 0, "%u false readings, %u frames handed out as 5-in-1", wrong, as5in1);
+    CHECK(right == sent, "%u of %u frames decoded", right, sent);
+    CHECK(rx.stats().reidentified > 0, "no frame started like a 5-in-1 frame");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--seed n]\n", argv[0]);
+            return 2;
+        }
+    }
+    printf("radio time per frame, frames decoded:\n");
+    printf("%-22s  %-16s  %-16s  %-16s\n", "", modeNames[FIXED], modeNames[ADAPTIVE], modeNames[STREAMING]);
+    mix("100 sensors, 6-in-1", 100, 1, seed);
+    mix("100 sensors, mixed", 100, 0.5f, seed);
+    mix("100 sensors, 5-in-1", 100, 0, seed);
+    mix("1000 sensors, mixed", 1000, 0.5f, seed);
+    identification(seed);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
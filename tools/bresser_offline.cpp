@@ -0,0 +1,1192 @@
+/*
+bresser_offline - decode capture archives on a Linux host
+
+    bresser_offline generate <capture> <frames> [--sensors n] [--ber x] [--seed s]
+    bresser_offline decode <out-dir> <capture>... [--threads n] [--chunk n] [--batch [--isa name]] [--arrow file]
+    bresser_offline bench [frames] [--seed s]
+    bresser_offline export-bench [readings] [--seed s]
+
+generate writes a capture file (CaptureFile.h) of synthetic traffic from
+TrafficGen, e.g. for benchmarks. decode runs the firmware's decoders
+(BresserDecoder.cpp, unchanged) on all frames of the capture files and
+writes the results column by column:
+
+- The capture files are memory-mapped and cut into chunks of --chunk
+  records (default 65536); a chunk never spans two files.
+- Each worker thread (default: one per core) starts with an equal share of
+  the chunks, a range of chunk numbers. It takes chunks from the front of
+  its own range; when that is empty, it steals the back half of the largest
+  range left. Ranges are single 64-bit words changed by compare-and-swap,
+  so there are no locks - a slow chunk (e.g. a page fault) only delays the
+  worker which has it.
+- Row i of the output is frame i of the input (files in the given order),
+  so workers write their rows straight into the memory-mapped columns and
+  the output does not depend on the number of threads.
+- With --batch, the 5-in-1 frames of a chunk are transposed and decoded
+  by the batch decoder (BatchDecoder.h, SIMD kernels of the CPU or --isa
+  scalar/sse4.1/avx2); the output is the same.
+
+With --arrow, the rows decoded without error are also exported in the
+Arrow IPC file format (ColumnarExport.h), in row order - e.g.
+pyarrow.ipc.open_file(pyarrow.memory_map(file)).read_all().
+
+bench compares the batch decoder with decodeBresser5In1Payload() on random
+frames (half valid, half random bytes): all fields and tolerated errors
+must be identical, the frame rates of each are printed.
+
+export-bench compares writing and reading random readings as the text
+lines printed by the sketch (snprintf/sscanf) with the Arrow export
+(ColumnarWriter/ColumnarReader), both in memory: the checksums of the
+values read back must be identical, rates and bytes per reading are
+printed.
+
+The output directory gets one file per column, <name>.bin, a plain
+little-endian array of one type, and schema.txt (rows, then name and type
+of each column) - e.g. numpy.fromfile("temp_c.bin", "<f4"). status is the
+DecodeStatus, or 255 if the frame does not start with 0xD4; the fields of
+rows with status != 0 are zero. flags has a bit per *_ok field
+(DECODED_FLAG_x).
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -pthread -DCOLUMNAR_ROWS=65536 -DCOLUMNAR_MAX_SENSORS=4096 -DCOLUMNAR_MAX_BLOCKS=65536 \
+        -o bresser_offline tools/bresser_offline.cpp BresserDecoder.cpp BatchDecoder.cpp BresserEncoder.cpp \
+        TrafficGen.cpp CC1101Sim.cpp CC1101Bus.cpp ColumnarExport.cpp
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "../BresserDecoder.h"
+#include "../BatchDecoder.h"
+#include "../ColumnarExport.h"
+#include "../TrafficGen.h"
+
+// Records per chunk
+#define OFFLINE_CHUNK 65536
+
+// Status of frames without the sync byte 0xD4
+#define STATUS_NO_SYNC 255
+
+// Bits of the flags column
+#define DECODED_FLAG_TEMP     0x01
+#define DECODED_FLAG_UV       0x02
+#define DECODED_FLAG_WIND     0x04
+#define DECODED_FLAG_RAIN     0x08
+#define DECODED_FLAG_MOISTURE 0x10
+#define DECODED_FLAG_BATTERY  0x20
+
+enum ColumnId {
+    COL_TIME_S, COL_TIME_MS, COL_STATUS, COL_PROTOCOL, COL_RSSI, COL_SENSOR_ID, COL_CHAN, COL_FLAGS,
+    COL_TEMP_C, COL_HUMIDITY, COL_UV, COL_WIND_DIR, COL_WIND_GUST, COL_WIND_AVG, COL_RAIN_MM, COL_MOISTURE,
+    COL_COUNT
+};
+
+struct Column {
+    const char *name;
+    const char *type;              // numpy notation
+    unsigned    size;
+};
+
+static const Column columns[COL_COUNT] = {
+    { "time_s",             "<u4", 4 },
+    { "time_ms",            "<u2", 2 },
+    { "status",             "u1",  1 },
+    { "protocol",           "u1",  1 },
+    { "rssi",               "i1",  1 },
+    { "sensor_id",          "<u4", 4 },
+    { "chan",               "u1",  1 },
+    { "flags",              "u1",  1 },
+    { "temp_c",             "<f4", 4 },
+    { "humidity",           "u1",  1 },
+    { "uv",                 "<f4", 4 },
+    { "wind_direction_deg", "<f4", 4 },
+    { "wind_gust_ms",       "<f4", 4 },
+    { "wind_avg_ms",        "<f4", 4 },
+    { "rain_mm",            "<f4", 4 },
+    { "moisture",           "u1",  1 },
+};
+
+struct Capture {
+    const char          *path;
+    const CaptureRecord *records;
+    size_t               count;
+    size_t               first_row;
+    void                *map;
+    size_t               map_len;
+};
+
+struct Chunk {
+    const Capture *capture;
+    size_t         first;          // record within the capture
+    size_t         count;
+};
+
+struct WorkerStats {
+    uint64_t frames;
+    uint64_t status[DECODE_SKIP + 2];  // per DecodeStatus, then no sync
+    uint32_t chunks;
+    uint32_t steals;
+};
+
+#define STATUS_INDEX(status) (((status) == STATUS_NO_SYNC) ? DECODE_SKIP + 1 : (status))
+
+//
+// Output columns, memory-mapped
+//
+class ColumnWriter {
+public:
+    ColumnWriter() : _rows(0) {
+        memset(_data, 0, sizeof(_data));
+    }
+
+    ~ColumnWriter() {
+        for (int c = 0; c < COL_COUNT; c++) {
+            if (_data[c]) {
+                munmap(_data[c], _rows * columns[c].size);
+            }
+        }
+    }
+
+    bool create(const char *dir, size_t rows) {
+        _rows = rows;
+        if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+            fprintf(stderr, "%s: %s\n", dir, strerror(errno));
+            return false;
+        }
+        for (int c = 0; c < COL_COUNT; c++) {
+            char path[512];
+            snprintf(path, sizeof(path), "%s/%s.bin", dir, columns[c].name);
+            int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+            if (fd < 0 || ftruncate(fd, rows * columns[c].size) < 0) {
+                fprintf(stderr, "%s: %s\n", path, strerror(errno));
+                if (fd >= 0) {
+                    close(fd);
+                }
+                return false;
+            }
+            if (rows) {
+                void *p = mmap(nullptr, rows * columns[c].size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (p == MAP_FAILED) {
+                    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+                    close(fd);
+                    return false;
+                }
+                _data[c] = (uint8_t *)p;
+            }
+            close(fd);
+        }
+        char path[512];
+        snprintf(path, sizeof(path), "%s/schema.txt", dir);
+        FILE *f = fopen(path, "w");
+        if (!f) {
+            fprintf(stderr, "%s: %s\n", path, strerror(errno));
+            return false;
+        }
+        fprintf(f, "rows %zu\n", rows);
+        for (int c = 0; c < COL_COUNT; c++) {
+            fprintf(f, "%s %s\n", columns[c].name, columns[c].type);
+        }
+        fclose(f);
+        return true;
+    }
+
+    template<typename T>
+    void set(ColumnId c, size_t row, T value) {
+        memcpy(&_data[c][row * sizeof(T)], &value, sizeof(T));
+    }
+
+    template<typename T>
+    T get(ColumnId c, size_t row) const {
+        T value;
+        memcpy(&value, &_data[c][row * sizeof(T)], sizeof(T));
+        return value;
+    }
+
+private:
+    uint8_t *_data[COL_COUNT];
+    size_t   _rows;
+};
+
+//
+// Store row of a frame and its reading (zero unless status is DECODE_OK)
+//
+static void storeRow(ColumnWriter *out, size_t row, const CaptureRecord *rec, uint8_t status, const WeatherData &data)
+{
+    out->set<uint32_t>(COL_TIME_S, row, rec->time_s);
+    out->set<uint16_t>(COL_TIME_MS, row, rec->time_ms);
+    out->set<uint8_t>(COL_PROTOCOL, row, rec->protocol);
+    out->set<int8_t>(COL_RSSI, row, rec->rssi);
+    out->set<uint8_t>(COL_STATUS, row, status);
+
+    uint8_t flags = (data.temp_ok ? DECODED_FLAG_TEMP : 0) | (data.uv_ok ? DECODED_FLAG_UV : 0) |
+                    (data.wind_ok ? DECODED_FLAG_WIND : 0) | (data.rain_ok ? DECODED_FLAG_RAIN : 0) |
+                    (data.moisture_ok ? DECODED_FLAG_MOISTURE : 0) | (data.battery_ok ? DECODED_FLAG_BATTERY : 0);
+    out->set<uint32_t>(COL_SENSOR_ID, row, data.sensor_id);
+    out->set<uint8_t>(COL_CHAN, row, data.chan);
+    out->set<uint8_t>(COL_FLAGS, row, flags);
+    out->set<float>(COL_TEMP_C, row, data.temp_c);
+    out->set<uint8_t>(COL_HUMIDITY, row, (uint8_t)data.humidity);
+    out->set<float>(COL_UV, row, data.uv);
+    out->set<float>(COL_WIND_DIR, row, data.wind_direction_deg);
+    out->set<float>(COL_WIND_GUST, row, data.wind_gust_meter_sec);
+    out->set<float>(COL_WIND_AVG, row, data.wind_avg_meter_sec);
+    out->set<float>(COL_RAIN_MM, row, data.rain_mm);
+    out->set<uint8_t>(COL_MOISTURE, row, (uint8_t)data.moisture);
+}
+
+// Fixed set of data for 5-in-1 sensor (as in the sketch)
+static void set5In1Flags(WeatherData *data)
+{
+    data->temp_ok     = true;
+    data->uv_ok       = false;
+    data->wind_ok     = true;
+    data->rain_ok     = true;
+    data->moisture_ok = false;
+}
+
+//
+// Decode one frame as the sketch does and store its row
+//
+static uint8_t decodeRecord(const CaptureRecord *rec, ColumnWriter *out, size_t row)
+{
+    uint8_t frame[BRESSER_FRAME_SIZE];
+    memcpy(frame, rec->data, sizeof(frame));
+    WeatherData data;
+    memset(&data, 0, sizeof(data));
+
+    uint8_t status = STATUS_NO_SYNC;
+    if (frame[0] == 0xD4) {
+        if (rec->protocol == BRESSER_6IN1) {
+            status = decodeBresser6In1Payload(&frame[1], sizeof(frame) - 1, &data);
+        } else {
+            status = decodeBresser5In1Payload(&frame[1], sizeof(frame) - 1, &data);
+            set5In1Flags(&data);
+        }
+    }
+    if (status != DECODE_OK) {
+        memset(&data, 0, sizeof(data));
+    }
+    storeRow(out, row, rec, status, data);
+    return status;
+}
+
+//
+// Batch decoding of a chunk: 5-in-1 frames transposed into planes, the
+// others decoded one by one
+//
+class BatchChunk {
+public:
+    BatchChunk(size_t frames) :
+        _planes(BRESSER_5IN1_SIZE * frames), _rows(frames), _sensor_id(frames), _temp_c(frames),
+        _humidity(frames), _wind_dir(frames), _gust(frames), _wind_avg(frames), _rain(frames),
+        _battery(frames), _tolerated(frames), _stride(frames)
+    {}
+
+    void decode(const Chunk *c, ColumnWriter *out, WorkerStats *s, BatchIsa isa);
+
+private:
+    std::vector<uint8_t>  _planes;
+    std::vector<size_t>   _rows;     // record of each batched frame
+    std::vector<uint32_t> _sensor_id;
+    std::vector<float>    _temp_c;
+    std::vector<uint8_t>  _humidity;
+    std::vector<float>    _wind_dir;
+    std::vector<float>    _gust;
+    std::vector<float>    _wind_avg;
+    std::vector<float>    _rain;
+    std::vector<uint8_t>  _battery;
+    std::vector<uint8_t>  _tolerated;
+    size_t                _stride;
+};
+
+void BatchChunk::decode(const Chunk *c, ColumnWriter *out, WorkerStats *s, BatchIsa isa)
+{
+    size_t n = 0;
+    for (size_t i = 0; i < c->count; i++) {
+        const CaptureRecord *rec = &c->capture->records[c->first + i];
+        if (rec->protocol == BRESSER_5IN1 && rec->data[0] == 0xD4) {
+            for (unsigned k = 0; k < BRESSER_5IN1_SIZE; k++) {
+                _planes[k * _stride + n] = rec->data[1 + k];
+            }
+            _rows[n++] = c->first + i;
+        } else {
+            uint8_t status = decodeRecord(rec, out, c->capture->first_row + c->first + i);
+            s->status[STATUS_INDEX(status)]++;
+        }
+    }
+
+    Batch5In1Frames   in  = { _planes.data(), _stride, n };
+    Batch5In1Readings res = { _sensor_id.data(), _temp_c.data(), _humidity.data(), _wind_dir.data(),
+                              _gust.data(), _wind_avg.data(), _rain.data(), _battery.data(), _tolerated.data() };
+    decodeBresser5In1Batch(&in, &res, isa);
+
+    for (size_t j = 0; j < n; j++) {
+        WeatherData data;
+        memset(&data, 0, sizeof(data));
+        data.sensor_id           = _sensor_id[j];
+        data.temp_c              = _temp_c[j];
+        data.humidity            = _humidity[j];
+        data.wind_direction_deg  = _wind_dir[j];
+        data.wind_gust_meter_sec = _gust[j];
+        data.wind_avg_meter_sec  = _wind_avg[j];
+        data.rain_mm             = _rain[j];
+        data.battery_ok          = _battery[j];
+        set5In1Flags(&data);
+        storeRow(out, c->capture->first_row + _rows[j], &c->capture->records[_rows[j]], DECODE_OK, data);
+    }
+    s->status[DECODE_OK] += n;
+}
+
+//
+// Work-stealing distribution of chunk numbers: one range per worker,
+// begin << 32 | end
+//
+class ChunkRanges {
+public:
+    ChunkRanges(unsigned workers, uint32_t chunks) : _ranges(workers) {
+        for (unsigned w = 0; w < workers; w++) {
+            uint64_t begin = (uint64_t)chunks * w / workers;
+            uint64_t end   = (uint64_t)chunks * (w + 1) / workers;
+            _ranges[w].store(begin << 32 | end, std::memory_order_relaxed);
+        }
+    }
+
+    // Next chunk of worker - from its own range, else stolen; false if all
+    // are taken
+    bool next(unsigned worker, uint32_t *pChunk, uint32_t *pSteals) {
+        while (true) {
+            uint64_t r = _ranges[worker].load(std::memory_order_acquire);
+            uint32_t begin = r >> 32;
+            uint32_t end   = (uint32_t)r;
+            if (begin < end) {
+                if (_ranges[worker].compare_exchange_weak(r, (uint64_t)(begin + 1) << 32 | end,
+                                                          std::memory_order_acq_rel)) {
+                    *pChunk = begin;
+                    return true;
+                }
+                continue;
+            }
+            if (!steal(worker)) {
+                return false;
+            }
+            (*pSteals)++;
+        }
+    }
+
+private:
+    // Move the back half of the largest range to worker (whose range is
+    // empty) - false if there is nothing left
+    bool steal(unsigned worker) {
+        while (true) {
+            unsigned victim = worker;
+            uint32_t most   = 0;
+            for (unsigned w = 0; w < _ranges.size(); w++) {
+                uint64_t r = _ranges[w].load(std::memory_order_relaxed);
+                uint32_t n = (uint32_t)r - (uint32_t)(r >> 32);
+                if ((uint32_t)(r >> 32) < (uint32_t)r && n > most) {
+                    most   = n;
+                    victim = w;
+                }
+            }
+            if (victim == worker) {
+                return false;
+            }
+            uint64_t r     = _ranges[victim].load(std::memory_order_acquire);
+            uint32_t begin = r >> 32;
+            uint32_t end   = (uint32_t)r;
+            if (begin >= end) {
+                continue;
+            }
+            uint32_t mid = end - (end - begin + 1) / 2;
+            if (_ranges[victim].compare_exchange_strong(r, (uint64_t)begin << 32 | mid, std::memory_order_acq_rel)) {
+                // Only thieves change a range which is not empty - the owner
+                // sets its own range only while it is empty
+                _ranges[worker].store((uint64_t)mid << 32 | end, std::memory_order_release);
+                return true;
+            }
+        }
+    }
+
+    std::vector<std::atomic<uint64_t>> _ranges;
+};
+
+
+static bool mapCapture(Capture *c)
+{
+    int fd = open(c->path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        fprintf(stderr, "%s: %s\n", c->path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    c->map_len = st.st_size;
+    c->map     = nullptr;
+    c->count   = 0;
+    if (c->map_len >= sizeof(CaptureHeader)) {
+        c->map = mmap(nullptr, c->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (c->map == MAP_FAILED || !c->map) {
+        fprintf(stderr, "%s: not a capture file\n", c->path);
+        return false;
+    }
+    const CaptureHeader *h = (const CaptureHeader *)c->map;
+    if (memcmp(h->magic, CAPTURE_MAGIC, sizeof(h->magic)) != 0 || h->record_size != sizeof(CaptureRecord)) {
+        fprintf(stderr, "%s: not a capture file\n", c->path);
+        munmap(c->map, c->map_len);
+        return false;
+    }
+    // Read in order - also by each worker within its chunk
+    madvise(c->map, c->map_len, MADV_SEQUENTIAL);
+    c->records = (const CaptureRecord *)((const uint8_t *)c->map + sizeof(CaptureHeader));
+    c->count   = (c->map_len - sizeof(CaptureHeader)) / sizeof(CaptureRecord);
+    return true;
+}
+
+static bool parseIsa(const char *name, BatchIsa *pIsa)
+{
+    for (int isa = BATCH_SCALAR; isa <= batchIsa(); isa++) {
+        if (strcmp(name, batchIsaName((BatchIsa)isa)) == 0) {
+            *pIsa = (BatchIsa)isa;
+            return true;
+        }
+    }
+    return false;
+}
+
+//
+// Export the rows decoded without error in the Arrow IPC file format
+//
+static bool exportArrow(const char *path, const std::vector<Capture> &captures, const ColumnWriter &out)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return false;
+    }
+    // Large arrays - not on the stack
+    static ColumnarWriter writer;
+    bool ok = writer.begin(columnarFileSink, f, true);
+    size_t row = 0;
+    for (size_t i = 0; i < captures.size() && ok; i++) {
+        for (size_t j = 0; j < captures[i].count && ok; j++, row++) {
+            if (out.get<uint8_t>(COL_STATUS, row) != DECODE_OK) {
+                continue;
+            }
+            uint8_t flags = out.get<uint8_t>(COL_FLAGS, row);
+            WeatherData data;
+            memset(&data, 0, sizeof(data));
+            data.sensor_id           = out.get<uint32_t>(COL_SENSOR_ID, row);
+            data.chan                = out.get<uint8_t>(COL_CHAN, row);
+            data.temp_ok             = flags & DECODED_FLAG_TEMP;
+            data.temp_c              = out.get<float>(COL_TEMP_C, row);
+            data.humidity            = out.get<uint8_t>(COL_HUMIDITY, row);
+            data.uv_ok               = flags & DECODED_FLAG_UV;
+            data.uv                  = out.get<float>(COL_UV, row);
+            data.wind_ok             = flags & DECODED_FLAG_WIND;
+            data.wind_direction_deg  = out.get<float>(COL_WIND_DIR, row);
+            data.wind_gust_meter_sec = out.get<float>(COL_WIND_GUST, row);
+            data.wind_avg_meter_sec  = out.get<float>(COL_WIND_AVG, row);
+            data.rain_ok             = flags & DECODED_FLAG_RAIN;
+            data.rain_mm             = out.get<float>(COL_RAIN_MM, row);
+            data.battery_ok          = flags & DECODED_FLAG_BATTERY;
+            data.moisture_ok         = flags & DECODED_FLAG_MOISTURE;
+            data.moisture            = out.get<uint8_t>(COL_MOISTURE, row);
+            ok = writer.add(&data, out.get<uint32_t>(COL_TIME_S, row), out.get<int8_t>(COL_RSSI, row),
+                            captures[i].records[j].lqi);
+        }
+    }
+    ok = ok && writer.finish();
+    if (fclose(f) != 0 || !ok) {
+        fprintf(stderr, "%s: export failed (disk full or more than %u batches)\n", path, COLUMNAR_MAX_BLOCKS);
+        return false;
+    }
+    const ColumnarStats &st = writer.stats();
+    printf("arrow: %u rows, %u batches, %u sensors, %llu bytes\n", st.rows, st.batches, st.sensors,
+           (unsigned long long)st.bytes);
+    if (st.unknown) {
+        printf("arrow: %u rows without sensor_id (more than %u sensors)\n", st.unknown, COLUMNAR_MAX_SENSORS);
+    }
+    return true;
+}
+
+static int decode(int argc, char **argv)
+{
+    const char *outDir  = nullptr;
+    unsigned    threads = std::thread::hardware_concurrency();
+    size_t      chunk   = OFFLINE_CHUNK;
+    bool        batch   = false;
+    BatchIsa    isa     = batchIsa();
+    const char *arrow   = nullptr;
+    std::vector<Capture> captures;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--chunk") == 0 && i + 1 < argc) {
+            chunk = atol(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch = true;
+        } else if (strcmp(argv[i], "--arrow") == 0 && i + 1 < argc) {
+            arrow = argv[++i];
+        } else if (strcmp(argv[i], "--isa") == 0 && i + 1 < argc) {
+            if (!parseIsa(argv[++i], &isa)) {
+                fprintf(stderr, "%s: not supported\n", argv[i]);
+                return 2;
+            }
+        } else if (!outDir) {
+            outDir = argv[i];
+        } else {
+            Capture c;
+            memset(&c, 0, sizeof(c));
+            c.path = argv[i];
+            captures.push_back(c);
+        }
+    }
+    if (!outDir || captures.empty() || threads == 0 || chunk == 0) {
+        fprintf(stderr, "usage: bresser_offline decode <out-dir> <capture>... [--threads n] [--chunk n] [--batch [--isa name]] [--arrow file]\n");
+        return 2;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    size_t rows = 0;
+    std::vector<Chunk> chunks;
+    for (size_t i = 0; i < captures.size(); i++) {
+        if (!mapCapture(&captures[i])) {
+            return 1;
+        }
+        captures[i].first_row = rows;
+        rows += captures[i].count;
+    }
+    for (size_t i = 0; i < captures.size(); i++) {
+        for (size_t first = 0; first < captures[i].count; first += chunk) {
+            Chunk c = { &captures[i], first, (captures[i].count - first < chunk) ? captures[i].count - first : chunk };
+            chunks.push_back(c);
+        }
+    }
+
+    ColumnWriter out;
+    if (!out.create(outDir, rows)) {
+        return 1;
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    ChunkRanges ranges(threads, chunks.size());
+    std::vector<WorkerStats> stats(threads);
+    std::vector<std::thread> workers;
+    for (unsigned w = 0; w < threads; w++) {
+        memset(&stats[w], 0, sizeof(WorkerStats));
+        workers.emplace_back([&, w] {
+            WorkerStats *s = &stats[w];
+            std::unique_ptr<BatchChunk> batchChunk(batch ? new BatchChunk(chunk) : nullptr);
+            uint32_t n;
+            while (ranges.next(w, &n, &s->steals)) {
+                const Chunk *c = &chunks[n];
+                if (batchChunk) {
+                    batchChunk->decode(c, &out, s, isa);
+                    s->frames += c->count;
+                    s->chunks++;
+                    continue;
+                }
+                for (size_t i = 0; i < c->count; i++) {
+                    uint8_t status = decodeRecord(&c->capture->records[c->first + i], &out,
+                                                  c->capture->first_row + c->first + i);
+                    s->status[STATUS_INDEX(status)]++;
+                }
+                s->frames += c->count;
+                s->chunks++;
+            }
+        });
+    }
+    for (auto &t : workers) {
+        t.join();
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    WorkerStats total;
+    memset(&total, 0, sizeof(total));
+    for (unsigned w = 0; w < threads; w++) {
+        total.frames += stats[w].frames;
+        total.chunks += stats[w].chunks;
+        total.steals += stats[w].steals;
+        for (unsigned i = 0; i < sizeof(total.status) / sizeof(total.status[0]); i++) {
+            total.status[i] += stats[w].status[i];
+        }
+    }
+    double setup  = std::chrono::duration<double>(t1 - t0).count();
+    double decode = std::chrono::duration<double>(t2 - t1).count();
+    printf("%llu frames, %u chunks, %u threads, %u steals, %s\n", (unsigned long long)total.frames,
+           total.chunks, threads, total.steals, batch ? batchIsaName(isa) : "frame by frame");
+    printf("ok %llu, parity %llu, checksum %llu, digest %llu, skipped %llu, no sync %llu\n",
+           (unsigned long long)total.status[DECODE_OK], (unsigned long long)total.status[DECODE_PAR_ERR],
+           (unsigned long long)total.status[DECODE_CHK_ERR], (unsigned long long)total.status[DECODE_DIG_ERR],
+           (unsigned long long)total.status[DECODE_SKIP], (unsigned long long)total.status[DECODE_SKIP + 1]);
+    printf("setup %.3f s, decode %.3f s, %.0f frames/s\n", setup, decode, decode > 0 ? total.frames / decode : 0);
+
+    int result = 0;
+    if (arrow) {
+        if (exportArrow(arrow, captures, out)) {
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t2).count();
+            printf("export %.3f s, %.0f frames/s\n", t, t > 0 ? total.frames / t : 0);
+        } else {
+            result = 1;
+        }
+    }
+
+    for (size_t i = 0; i < captures.size(); i++) {
+        munmap(captures[i].map, captures[i].map_len);
+    }
+    return result;
+}
+
+static int generate(int argc, char **argv)
+{
+    const char   *path   = nullptr;
+    unsigned long frames = 0;
+    TrafficConfig cfg;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--sensors") == 0 && i + 1 < argc) {
+            cfg.sensors = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ber") == 0 && i + 1 < argc) {
+            cfg.ber = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            cfg.seed = atoi(argv[++i]);
+        } else if (!path) {
+            path = argv[i];
+        } else {
+            frames = strtoul(argv[i], nullptr, 0);
+        }
+    }
+    if (!path || frames == 0 || cfg.sensors == 0 || cfg.sensors > TRAFFIC_MAX_SENSORS) {
+        fprintf(stderr, "usage: bresser_offline generate <capture> <frames> [--sensors n] [--ber x] [--seed s]\n");
+        return 2;
+    }
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    CaptureHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, CAPTURE_MAGIC, sizeof(h.magic));
+    h.record_size = sizeof(CaptureRecord);
+    fwrite(&h, sizeof(h), 1, f);
+
+    static TrafficGen gen;
+    gen.begin(cfg, 0);
+    const uint32_t epoch = 1700000000;
+    SimFrame     frame;
+    TrafficTruth truth;
+    for (unsigned long i = 0; i < frames && gen.next(&frame, &truth); i++) {
+        CaptureRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        rec.time_s   = epoch + frame.start_us / 1000000;
+        rec.time_ms  = (frame.start_us / 1000) % 1000;
+        rec.rssi     = (int8_t)frame.rssi;
+        rec.lqi      = frame.lqi;
+        rec.protocol = (truth.protocol == TRAFFIC_6IN1) ? BRESSER_6IN1 : BRESSER_5IN1;
+        rec.len      = (frame.len < BRESSER_FRAME_SIZE) ? frame.len : BRESSER_FRAME_SIZE;
+        memcpy(rec.data, frame.data, rec.len);
+        fwrite(&rec, sizeof(rec), 1, f);
+    }
+    if (fclose(f) != 0) {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        return 1;
+    }
+    return 0;
+}
+
+// Tolerated errors reported by the frame by frame decoder
+static uint8_t benchTolerated;
+
+static void benchToleratedHook(DecodeStatus status, void *)
+{
+    benchTolerated |= (status == DECODE_PAR_ERR) ? BATCH_PAR_ERR : BATCH_CHK_ERR;
+}
+
+static uint32_t benchRandom(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+static bool sameBits(float a, float b)
+{
+    return memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+static int bench(int argc, char **argv)
+{
+    size_t   frames = 4000000;
+    uint32_t seed   = 1;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else {
+            frames = strtoul(argv[i], nullptr, 0);
+        }
+    }
+    if (frames == 0 || seed == 0) {
+        fprintf(stderr, "usage: bresser_offline bench [frames] [--seed s]\n");
+        return 2;
+    }
+
+    // Half encoded readings (some with a bit error), half random bytes - all
+    // nibble values occur, valid BCD or not
+    std::vector<uint8_t> aos(frames * BRESSER_5IN1_SIZE);
+    uint32_t rng = seed;
+    for (size_t i = 0; i < frames; i++) {
+        uint8_t *msg = &aos[i * BRESSER_5IN1_SIZE];
+        if (i & 1) {
+            for (unsigned k = 0; k < BRESSER_5IN1_SIZE; k++) {
+                msg[k] = benchRandom(&rng);
+            }
+            continue;
+        }
+        WeatherData w;
+        memset(&w, 0, sizeof(w));
+        w.sensor_id           = benchRandom(&rng) & 0xff;
+        w.temp_c              = (int)(benchRandom(&rng) % 1000 - 400) * 0.1f;
+        w.humidity            = benchRandom(&rng) % 100;
+        w.wind_direction_deg  = (benchRandom(&rng) % 16) * 22.5f;
+        w.wind_gust_meter_sec = (benchRandom(&rng) % 500) * 0.1f;
+        w.wind_avg_meter_sec  = (benchRandom(&rng) % 500) * 0.1f;
+        w.rain_mm             = (benchRandom(&rng) % 10000) * 0.1f;
+        w.battery_ok          = benchRandom(&rng) & 1;
+        encodeBresser5In1Payload(&w, msg);
+        if ((benchRandom(&rng) & 7) == 0) {
+            msg[benchRandom(&rng) % BRESSER_5IN1_SIZE] ^= 1 << (benchRandom(&rng) % 8);
+        }
+    }
+
+    // Frame by frame, as in the sketch - best of 3
+    DecoderHooks hooks = { nullptr, benchToleratedHook, nullptr };
+    setDecoderHooks(&hooks);
+    std::vector<WeatherData> ref(frames);
+    std::vector<uint8_t>     refTolerated(frames);
+    double scalar = 1e9;
+    for (int run = 0; run < 3; run++) {
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < frames; i++) {
+            benchTolerated = 0;
+            decodeBresser5In1Payload(&aos[i * BRESSER_5IN1_SIZE], BRESSER_5IN1_SIZE, &ref[i]);
+            refTolerated[i] = benchTolerated;
+        }
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        scalar = (t < scalar) ? t : scalar;
+    }
+    DecoderHooks none = { nullptr, nullptr, nullptr };
+    setDecoderHooks(&none);
+    printf("%zu frames\n", frames);
+    printf("%-16s %8.1f M frames/s\n", "frame by frame", frames / scalar / 1e6);
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<uint8_t> planes(frames * BRESSER_5IN1_SIZE);
+    for (size_t i = 0; i < frames; i++) {
+        for (unsigned k = 0; k < BRESSER_5IN1_SIZE; k++) {
+            planes[k * frames + i] = aos[i * BRESSER_5IN1_SIZE + k];
+        }
+    }
+    double transpose = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("%-16s %8.1f M frames/s\n", "transpose", frames / transpose / 1e6);
+
+    std::vector<uint32_t> sensor_id(frames);
+    std::vector<float>    temp_c(frames), wind_dir(frames), gust(frames), wind_avg(frames), rain(frames);
+    std::vector<uint8_t>  humidity(frames), battery(frames), tolerated(frames);
+    Batch5In1Frames   in  = { planes.data(), frames, frames };
+    Batch5In1Readings out = { sensor_id.data(), temp_c.data(), humidity.data(), wind_dir.data(),
+                              gust.data(), wind_avg.data(), rain.data(), battery.data(), tolerated.data() };
+    int failed = 0;
+    for (int isa = BATCH_SCALAR; isa <= batchIsa(); isa++) {
+        double best = 1e9;
+        for (int run = 0; run < 3; run++) {
+            memset(tolerated.data(), 0xee, frames);
+            auto t0 = std::chrono::steady_clock::now();
+            decodeBresser5In1Batch(&in, &out, (BatchIsa)isa);
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            best = (t < best) ? t : best;
+        }
+        size_t mismatches = 0;
+        for (size_t i = 0; i < frames; i++) {
+            const WeatherData *r = &ref[i];
+            if (sensor_id[i] != r->sensor_id || !sameBits(temp_c[i], r->temp_c) || humidity[i] != r->humidity ||
+                !sameBits(wind_dir[i], r->wind_direction_deg) || !sameBits(gust[i], r->wind_gust_meter_sec) ||
+                !sameBits(wind_avg[i], r->wind_avg_meter_sec) || !sameBits(rain[i], r->rain_mm) ||
+                battery[i] != r->battery_ok || tolerated[i] != refTolerated[i]) {
+                mismatches++;
+            }
+        }
+        printf("batch %-10s %8.1f M frames/s  x%.1f  mismatches %zu\n", batchIsaName((BatchIsa)isa),
+               frames / best / 1e6, scalar / best, mismatches);
+        failed |= (mismatches != 0);
+    }
+    return failed;
+}
+
+//
+// Export benchmark: a reading as printed by the sketch
+//
+struct ExportReading {
+    WeatherData data;
+    bool        is6in1;
+    uint32_t    time;
+    float       rssi;
+    uint8_t     lqi;
+};
+
+static int formatLine(char *buf, size_t size, const ExportReading *r)
+{
+    const WeatherData *w = &r->data;
+    int len = snprintf(buf, size, "Id: [%8X] Battery: [%s] ", w->sensor_id, w->battery_ok ? "OK " : "Low");
+    if (r->is6in1) {
+        len += snprintf(buf + len, size - len, "Ch: [%d] ", w->chan);
+    }
+    if (w->temp_ok) {
+        len += snprintf(buf + len, size - len, "Temp: [%5.1fC] Hum: [%3d%%] ", w->temp_c, w->humidity);
+    } else {
+        len += snprintf(buf + len, size - len, "Temp: [---.-C] Hum: [---%%] ");
+    }
+    if (w->wind_ok) {
+        len += snprintf(buf + len, size - len, "Wind max: [%4.1fm/s] Wind avg: [%4.1fm/s] Wind dir: [%5.1fdeg] ",
+                        w->wind_gust_meter_sec, w->wind_avg_meter_sec, w->wind_direction_deg);
+    } else {
+        len += snprintf(buf + len, size - len, "Wind max: [--.-m/s] Wind avg: [--.-m/s] ");
+    }
+    if (w->rain_ok) {
+        len += snprintf(buf + len, size - len, "Rain: [%7.1fmm] ", w->rain_mm);
+    } else {
+        len += snprintf(buf + len, size - len, "Rain: [-----.-mm] ");
+    }
+    if (w->moisture_ok) {
+        len += snprintf(buf + len, size - len, "Moisture: [%2d%%] ", w->moisture);
+    }
+    len += snprintf(buf + len, size - len, "RSSI: [%5.1fdBm] LQI: [%3u]\n", r->rssi, r->lqi);
+    return len;
+}
+
+static bool skipText(const char **p, const char *text)
+{
+    size_t len = strlen(text);
+    if (strncmp(*p, text, len) != 0) {
+        return false;
+    }
+    *p += len;
+    return true;
+}
+
+// Parse a line of formatLine(), as read by fgets()
+static bool parseLine(const char *p, ExportReading *r)
+{
+    WeatherData *w = &r->data;
+    memset(r, 0, sizeof(*r));
+    char     battery[4] = { 0 };
+    unsigned lqi;
+    int      n = 0;
+    if (sscanf(p, "Id: [%X] Battery: [%3c] %n", &w->sensor_id, battery, &n) != 2 || !n) {
+        return false;
+    }
+    p += n;
+    w->battery_ok = (battery[0] == 'O');
+    int chan;
+    n = 0;
+    if (sscanf(p, "Ch: [%d] %n", &chan, &n) == 1 && n) {
+        w->chan   = chan;
+        r->is6in1 = true;
+        p += n;
+    }
+    if (!skipText(&p, "Temp: [---.-C] Hum: [---%] ")) {
+        n = 0;
+        if (sscanf(p, "Temp: [%fC] Hum: [%d%%] %n", &w->temp_c, &w->humidity, &n) != 2 || !n) {
+            return false;
+        }
+        w->temp_ok = true;
+        p += n;
+    }
+    if (!skipText(&p, "Wind max: [--.-m/s] Wind avg: [--.-m/s] ")) {
+        n = 0;
+        if (sscanf(p, "Wind max: [%fm/s] Wind avg: [%fm/s] Wind dir: [%fdeg] %n", &w->wind_gust_meter_sec,
+                   &w->wind_avg_meter_sec, &w->wind_direction_deg, &n) != 3 || !n) {
+            return false;
+        }
+        w->wind_ok = true;
+        p += n;
+    }
+    if (!skipText(&p, "Rain: [-----.-mm] ")) {
+        n = 0;
+        if (sscanf(p, "Rain: [%fmm] %n", &w->rain_mm, &n) != 1 || !n) {
+            return false;
+        }
+        w->rain_ok = true;
+        p += n;
+    }
+    n = 0;
+    if (sscanf(p, "Moisture: [%d%%] %n", &w->moisture, &n) == 1 && n) {
+        w->moisture_ok = true;
+        p += n;
+    }
+    n = 0;
+    if (sscanf(p, "RSSI: [%fdBm] LQI: [%u]%n", &r->rssi, &lqi, &n) != 2 || !n || p[n] != '\n') {
+        return false;
+    }
+    r->lqi = lqi;
+    return true;
+}
+
+// Checksum of the fields in both formats - values in tenths
+static uint64_t exportChecksum(uint64_t sum, uint32_t sensor_id, uint8_t chan, bool battery_ok, const float *temp_c,
+                               const uint8_t *humidity, const float *wind, const float *rain_mm,
+                               const uint8_t *moisture, float rssi, uint8_t lqi)
+{
+    const uint64_t k = 1000003;
+    sum = (sum * k) ^ sensor_id;
+    sum = (sum * k) ^ chan;
+    sum = (sum * k) ^ battery_ok;
+    sum = (sum * k) ^ (temp_c ? lroundf(*temp_c * 10) : -1000000);
+    sum = (sum * k) ^ (humidity ? *humidity : 1000);
+    for (int i = 0; i < 3; i++) {
+        sum = (sum * k) ^ (wind ? lroundf(wind[i] * 10) : -1000000);
+    }
+    sum = (sum * k) ^ (rain_mm ? lroundf(*rain_mm * 10) : -1000000);
+    sum = (sum * k) ^ (moisture ? *moisture : 1000);
+    sum = (sum * k) ^ lroundf(rssi * 10);
+    sum = (sum * k) ^ lqi;
+    return sum;
+}
+
+static uint64_t readingChecksum(uint64_t sum, const ExportReading *r)
+{
+    const WeatherData *w = &r->data;
+    float   wind[3]  = { w->wind_gust_meter_sec, w->wind_avg_meter_sec, w->wind_direction_deg };
+    uint8_t humidity = w->humidity;
+    uint8_t moisture = w->moisture;
+    return exportChecksum(sum, w->sensor_id, w->chan, w->battery_ok, w->temp_ok ? &w->temp_c : nullptr,
+                          w->temp_ok ? &humidity : nullptr, w->wind_ok ? wind : nullptr,
+                          w->rain_ok ? &w->rain_mm : nullptr, w->moisture_ok ? &moisture : nullptr, r->rssi, r->lqi);
+}
+
+static bool bitSet(const uint8_t *bits, size_t i)
+{
+    return (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+static bool isValid(const ColumnarBatch *b, ColumnarColumn c, size_t i)
+{
+    return !b->valid[c] || bitSet(b->valid[c], i);
+}
+
+struct MemorySink {
+    uint8_t *data;
+    size_t   size;
+    size_t   len;
+};
+
+static bool memorySink(const uint8_t *data, size_t len, void *ctx)
+{
+    MemorySink *m = (MemorySink *)ctx;
+    if (len > m->size - m->len) {
+        return false;
+    }
+    memcpy(m->data + m->len, data, len);
+    m->len += len;
+    return true;
+}
+
+static int exportBench(int argc, char **argv)
+{
+    size_t   count = 2000000;
+    uint32_t seed  = 1;
+
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = atoi(argv[++i]);
+        } else {
+            count = strtoul(argv[i], nullptr, 0);
+        }
+    }
+    if (count == 0 || seed == 0) {
+        fprintf(stderr, "usage: bresser_offline export-bench [readings] [--seed s]\n");
+        return 2;
+    }
+
+    // 5-in-1 readings and 6-in-1 readings of alternating message types, as
+    // decoded - values in tenths
+    std::vector<ExportReading> readings(count);
+    uint32_t rng = seed;
+    uint32_t sensors[32];
+    for (int i = 0; i < 32; i++) {
+        sensors[i] = benchRandom(&rng);
+    }
+    for (size_t i = 0; i < count; i++) {
+        ExportReading *r = &readings[i];
+        WeatherData   *w = &r->data;
+        memset(r, 0, sizeof(*r));
+        unsigned s = benchRandom(&rng) % 32;
+        r->is6in1              = s >= 8;
+        r->time                = 1700000000 + i;
+        r->rssi                = -(int)(benchRandom(&rng) % 700 + 300) * 0.1f;
+        r->lqi                 = benchRandom(&rng) % 128;
+        w->sensor_id           = r->is6in1 ? sensors[s] : (sensors[s] & 0xff);
+        w->chan                = r->is6in1 ? s % 8 : 0;
+        w->battery_ok          = benchRandom(&rng) % 16 != 0;
+        w->temp_ok             = !r->is6in1 || (i & 1);
+        w->temp_c              = (int)(benchRandom(&rng) % 1000 - 400) * 0.1f;
+        w->humidity            = benchRandom(&rng) % 100;
+        w->wind_ok             = true;
+        w->wind_direction_deg  = (benchRandom(&rng) % 16) * 22.5f;
+        w->wind_gust_meter_sec = (benchRandom(&rng) % 500) * 0.1f;
+        w->wind_avg_meter_sec  = (benchRandom(&rng) % 500) * 0.1f;
+        w->rain_ok             = !w->temp_ok || !r->is6in1;
+        w->rain_mm             = (benchRandom(&rng) % 100000) * 0.1f;
+        w->moisture_ok         = r->is6in1 && s % 8 == 7;
+        w->moisture            = benchRandom(&rng) % 100;
+    }
+    uint64_t expected = 0;
+    for (size_t i = 0; i < count; i++) {
+        expected = readingChecksum(expected, &readings[i]);
+    }
+
+    // Text: lines in memory - best of 3
+    std::vector<char> text(count * 192);
+    size_t textLen  = 0;
+    double textWrite = 1e9, textRead = 1e9;
+    uint64_t textSum = 0;
+    for (int run = 0; run < 3; run++) {
+        auto t0 = std::chrono::steady_clock::now();
+        textLen = 0;
+        for (size_t i = 0; i < count; i++) {
+            textLen += formatLine(&text[textLen], text.size() - textLen, &readings[i]);
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        textSum = 0;
+        const char *p   = text.data();
+        const char *end = p + textLen;
+        char line[256];
+        ExportReading r;
+        bool parsed = true;
+        for (size_t i = 0; i < count && parsed; i++) {
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            size_t len = nl ? nl + 1 - p : 0;
+            parsed = len > 0 && len < sizeof(line);
+            if (parsed) {
+                memcpy(line, p, len);
+                line[len] = 0;
+                p += len;
+                parsed = parseLine(line, &r);
+            }
+            textSum = readingChecksum(textSum, &r);
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        textWrite = std::min(textWrite, std::chrono::duration<double>(t1 - t0).count());
+        textRead  = std::min(textRead, std::chrono::duration<double>(t2 - t1).count());
+    }
+
+    // Arrow: file format in memory
+    std::vector<uint8_t> arrow(count * 64 + 24 * COLUMNAR_MAX_BLOCKS + 65536);
+    static ColumnarWriter writer;
+    static ColumnarReader reader;
+    MemorySink sink = { arrow.data(), arrow.size(), 0 };
+    double arrowWrite = 1e9, arrowRead = 1e9;
+    uint64_t arrowSum = 0;
+    bool ok = true;
+    for (int run = 0; run < 3 && ok; run++) {
+        auto t0 = std::chrono::steady_clock::now();
+        sink.len = 0;
+        ok = writer.begin(memorySink, &sink, true);
+        for (size_t i = 0; i < count && ok; i++) {
+            ok = writer.add(&readings[i].data, readings[i].time, readings[i].rssi, readings[i].lqi);
+        }
+        ok = ok && writer.finish();
+        auto t1 = std::chrono::steady_clock::now();
+        std::vector<uint32_t> ids(writer.stats().sensors);
+        ok = ok && reader.open(sink.data, sink.len) && reader.dictionary(ids.data(), ids.size()) == ids.size();
+        arrowSum = 0;
+        for (unsigned b = 0; b < reader.batches() && ok; b++) {
+            ColumnarBatch batch;
+            ok = reader.batch(b, &batch);
+            const int16_t *sensor   = (const int16_t *)batch.values[COLUMNAR_SENSOR_ID];
+            const uint8_t *chan     = (const uint8_t *)batch.values[COLUMNAR_CHAN];
+            const uint8_t *battery  = (const uint8_t *)batch.values[COLUMNAR_BATTERY_OK];
+            const float   *temp_c   = (const float *)batch.values[COLUMNAR_TEMP_C];
+            const uint8_t *humidity = (const uint8_t *)batch.values[COLUMNAR_HUMIDITY];
+            const float   *gust     = (const float *)batch.values[COLUMNAR_WIND_GUST];
+            const float   *avg      = (const float *)batch.values[COLUMNAR_WIND_AVG];
+            const float   *dir      = (const float *)batch.values[COLUMNAR_WIND_DIRECTION];
+            const float   *rain_mm  = (const float *)batch.values[COLUMNAR_RAIN_MM];
+            const uint8_t *moisture = (const uint8_t *)batch.values[COLUMNAR_MOISTURE];
+            const float   *rssi     = (const float *)batch.values[COLUMNAR_RSSI];
+            const uint8_t *lqi      = (const uint8_t *)batch.values[COLUMNAR_LQI];
+            for (size_t i = 0; ok && i < batch.rows; i++) {
+                float wind[3] = { gust[i], avg[i], dir[i] };
+                arrowSum = exportChecksum(arrowSum, isValid(&batch, COLUMNAR_SENSOR_ID, i) ? ids[sensor[i]] : 0, chan[i],
+                                          bitSet(battery, i),
+                                          isValid(&batch, COLUMNAR_TEMP_C, i) ? &temp_c[i] : nullptr,
+                                          isValid(&batch, COLUMNAR_HUMIDITY, i) ? &humidity[i] : nullptr,
+                                          isValid(&batch, COLUMNAR_WIND_GUST, i) ? wind : nullptr,
+                                          isValid(&batch, COLUMNAR_RAIN_MM, i) ? &rain_mm[i] : nullptr,
+                                          isValid(&batch, COLUMNAR_MOISTURE, i) ? &moisture[i] : nullptr, rssi[i], lqi[i]);
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+        arrowWrite = std::min(arrowWrite, std::chrono::duration<double>(t1 - t0).count());
+        arrowRead  = std::min(arrowRead, std::chrono::duration<double>(t2 - t1).count());
+    }
+    if (!ok) {
+        fprintf(stderr, "arrow export failed\n");
+        return 1;
+    }
+
+    printf("%zu readings\n", count);
+    printf("%-6s write %7.2f M readings/s  read %7.2f M readings/s  %5.1f bytes/reading  checksum %s\n", "text",
+           count / textWrite / 1e6, count / textRead / 1e6, (double)textLen / count,
+           textSum == expected ? "ok" : "MISMATCH");
+    printf("%-6s write %7.2f M readings/s  read %7.2f M readings/s  %5.1f bytes/reading  checksum %s\n", "arrow",
+           count / arrowWrite / 1e6, count / arrowRead / 1e6, (double)sink.len / count,
+           arrowSum == expected ? "ok" : "MISMATCH");
+    return (textSum == expected && arrowSum == expected) ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "decode") == 0) {
+        return decode(argc - 2, &argv[2]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "generate") == 0) {
+        return generate(argc - 2, &argv[2]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "bench") == 0) {
+        return bench(argc - 2, &argv[2]);
+    }
+    if (argc >= 2 && strcmp(argv[1], "export-bench") == 0) {
+        return exportBench(argc - 2, &argv[2]);
+    }
+    fprintf(stderr, "usage: bresser_offline generate <capture> <frames> [--sensors n] [--ber x] [--seed s]\n"
+                    "       bresser_offline decode <out-dir> <capture>... [--threads n] [--chunk n] [--batch [--isa name]] [--arrow file]\n"
+                    "       bresser_offline bench [frames] [--seed s]\n"
+                    "       bresser_offline export-bench [readings] [--seed s]\n");
+    return 2;
+}
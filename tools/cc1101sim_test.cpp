@@ -0,0 +1,264 @@
+/*
+cc1101sim_test - CC1101Sim driving RadioArray and LowPowerRx (Linux host)
+
+    cc1101sim_test
+
+Runs the receive path of the sketch against the simulated radio, on the
+virtual clock:
+
+- model basics: a frame sent while the radio is idle, one outside the
+  channel filter and one overlapping another are each missed and counted
+  as such
+- RadioArray polled every 1 ms: 20000 frames, 35 ms apart, are all read,
+  unchanged; polled every 60 ms: frames are lost to RX FIFO overflows,
+  which RadioArray counts as the model does, and every frame read is
+  still intact
+- link model (setLinkModel()): frames at falling signal-to-noise ratios -
+  nearly all intact far above the noise (a few start while the receiver
+  is busy with a sync word matched by noise), fewer intact the closer
+  they come to it
+- LowPowerRx: a sensor transmitting every 12 s for three hours is caught
+  in the predicted windows, with the radio in RX for a small fraction of
+  the time
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -DCLOCK_VIRTUAL -o cc1101sim_test tools/cc1101sim_test.cpp CC1101Sim.cpp \
+        CC1101Bus.cpp RadioArray.cpp LowPowerRx.cpp SensorSchedule.cpp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../CC1101Sim.h"
+#include "../Clock.h"
+#include "../LowPowerRx.h"
+#include "../RadioArray.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define FRAME_LEN 27
+#define SYNC_WORD 0xAA2D
+
+// Fixed length 5-in-1 frames, sync word 0xAA2D, 8.2 kBaud; a new model
+// starts at time 0, so the virtual clock is set back
+static void configure(CC1101Sim *sim)
+{
+    clockVirtualUs() = 0;
+    sim->writeReg(CC1101_PKTCTRL0, 0x00);
+    sim->writeReg(CC1101_PKTLEN, FRAME_LEN);
+    sim->writeReg(CC1101_SYNC1, SYNC_WORD >> 8);
+    sim->writeReg(CC1101_SYNC0, SYNC_WORD & 0xff);
+    sim->writeReg(CC1101_MDMCFG4, 0x88);
+    sim->writeReg(CC1101_MDMCFG3, 0x83);
+}
+
+static void frame(SimFrame *f, uint32_t seq, uint64_t start_us, float rssi)
+{
+    memset(f, 0, sizeof(*f));
+    f->start_us = start_us;
+    f->rssi     = rssi;
+    f->sync     = SYNC_WORD;
+    f->len      = FRAME_LEN;
+    for (int j = 0; j < FRAME_LEN; j++) {
+        f->data[j] = seq * 7 + j;
+    }
+}
+
+// Frame as sent by frame() - its sequence number or -1
+static int sequence(const uint8_t *data, uint32_t seq_hint)
+{
+    for (uint32_t seq = seq_hint; seq < seq_hint + 64; seq++) {
+        bool same = true;
+        for (int j = 0; j < FRAME_LEN && same; j++) {
+            same = data[j] == (uint8_t)(seq * 7 + j);
+        }
+        if (same) {
+            return seq;
+        }
+    }
+    return -1;
+}
+
+struct RunResult {
+    unsigned read;                 // frames read by RadioArray
+    unsigned intact;               // ... unchanged
+    uint32_t overflows;            // counted by RadioArray
+};
+
+// n frames spaced spacing_us apart at rssi, RadioArray serviced every
+// poll_us
+static RunResult run(CC1101Sim *sim, unsigned n, uint64_t spacing_us, uint64_t poll_us, float rssi)
+{
+    RadioArray radios;
+    radios.add(sim, -1);
+    radios.begin();
+    RunResult r = {0, 0, 0};
+    uint64_t start = sim->now() + 1000;
+    unsigned sent = 0;
+    uint32_t next = 0;
+    for (uint64_t t = sim->now(); sent < n || t < start + n * spacing_us + 100000;) {
+        t += poll_us;
+        while (sent < n && start + sent * spacing_us < t) {
+            SimFrame f;
+            frame(&f, sent, start + sent * spacing_us, rssi);
+            sim->inject(&f);
+            sent++;
+        }
+        sim->advance(t);
+        radios.service(clockMillis());
+        RadioFrame rf;
+        while (radios.read(&rf, clockMillis())) {
+            r.read++;
+            int seq = sequence(rf.data, next);
+            if (seq >= 0) {
+                r.intact++;
+                next = seq + 1;
+            }
+        }
+    }
+    r.overflows = radios.stats(0).overflows;
+    return r;
+}
+
+static void basics()
+{
+    CC1101Sim sim;
+    configure(&sim);
+    SimFrame f;
+
+    // Idle: not listening
+    frame(&f, 0, 1000, -60);
+    sim.inject(&f);
+    sim.advance(100000);
+    CHECK(sim.stats().not_listening == 1 && sim.stats().received == 0, "frame received while idle");
+
+    // Outside the channel filter
+    sim.strobe(CC1101_SRX);
+    frame(&f, 1, 200000, -60);
+    f.frequency_hz = 2 * sim.bandwidth();
+    sim.inject(&f);
+    sim.advance(300000);
+    CHECK(sim.stats().off_channel == 1 && sim.stats().received == 0, "frame outside channel filter received");
+
+    // Second frame starting during the first one
+    frame(&f, 2, 400000, -60);
+    sim.inject(&f);
+    frame(&f, 3, 410000, -60);
+    sim.inject(&f);
+    sim.advance(500000);
+    uint8_t buf[CC1101_FIFO_SIZE];
+    uint8_t n = CC1101_FIFO_BYTES(sim.readReg(CC1101_RXBYTES));
+    sim.readBurst(CC1101_FIFO, buf, n);
+    CHECK(sim.stats().collisions == 1 && sim.stats().received == 1 && n >= FRAME_LEN && sequence(buf, 2) == 2,
+          "overlapping frames: %u collisions, %u received", (unsigned)sim.stats().collisions,
+          (unsigned)sim.stats().received);
+    printf("basics: idle, off channel and overlapping frames missed\n");
+}
+
+static void polling()
+{
+    CC1101Sim fast;
+    configure(&fast);
+    RunResult r = run(&fast, 20000, 35000, 1000, -60);
+    printf("RadioArray polled every 1 ms: %u of 20000 frames read, %u intact, %u overflows\n", r.read, r.intact,
+           (unsigned)r.overflows);
+    CHECK(r.read == 20000 && r.intact == 20000 && r.overflows == 0, "frames lost at 1 ms polling");
+
+    CC1101Sim slow;
+    configure(&slow);
+    r = run(&slow, 20000, 35000, 60000, -60);
+    printf("RadioArray polled every 60 ms: %u of 20000 frames read, %u intact, %u overflows (model: %u)\n", r.read,
+           r.intact, (unsigned)r.overflows, (unsigned)slow.stats().overflows);
+    CHECK(r.overflows > 0 && r.overflows == slow.stats().overflows && r.read < 20000 && r.intact == r.read,
+          "overflows at 60 ms polling not accounted for");
+}
+
+static void linkModel()
+{
+    static const float levels[] = {-60, -85, -90, -93, -96};
+    unsigned previous = 1000;
+    printf("link model, noise -100 dBm:\n");
+    for (float rssi : levels) {
+        CC1101Sim sim;
+        configure(&sim);
+        sim.setLinkModel(true);
+        RunResult r = run(&sim, 1000, 100000, 1000, rssi);
+        printf("  %5.0f dBm: %4u of 1000 frames read, %4u intact, %u sync words missed, %u bits flipped\n", rssi,
+               r.read, r.intact, (unsigned)sim.stats().weak, (unsigned)sim.stats().bit_errors);
+        CHECK(r.intact <= previous + 10, "more frames intact at %.0f dBm than above", rssi);
+        CHECK(rssi < -85 || r.intact >= 990, "%u of 1000 frames intact far above the noise", r.intact);
+        CHECK(rssi != levels[4] || r.intact < 500, "%u of 1000 frames intact close to the noise", r.intact);
+        previous = r.intact;
+    }
+}
+
+static void lowPower()
+{
+    CC1101Sim sim;
+    configure(&sim);
+    sim.writeReg(CC1101_MDMCFG1, 0x42);  // 8 preamble bytes
+    SensorSchedule schedule;
+    LowPowerRx lp;
+    lp.begin(&sim, &schedule, 0, 0);
+
+    const uint64_t period = 12000000;
+    uint64_t next = 1000000;
+    unsigned sent = 0, caught = 0;
+    const uint64_t end = 3ull * 3600 * 1000000;
+    while (clockVirtualUs() < end) {
+        while (next < clockVirtualUs() + 20000000 && next < end - 100000) {
+            SimFrame f;
+            frame(&f, sent, next, -60);
+            sim.inject(&f);
+            sent++;
+            next += period;
+        }
+        uint64_t before = clockVirtualUs();
+        bool received = lp.waitForFrame();
+        if (clockVirtualUs() == before) {
+            sim.advance(before + 1000);
+        }
+        if (received) {
+            uint8_t buf[CC1101_FIFO_SIZE];
+            uint8_t n = CC1101_FIFO_BYTES(sim.readReg(CC1101_RXBYTES));
+            if (n) {
+                sim.readBurst(CC1101_FIFO, buf, n);
+                schedule.arrival(1, clockMillis());
+                caught++;
+            }
+        }
+        schedule.poll(clockMillis());
+    }
+    const LowPowerStats &st = lp.stats();
+    printf("LowPowerRx, 3 h: %u of %u frames caught (%u in predicted windows), radio in RX %.2f%% of the time\n",
+           caught, sent, (unsigned)st.frames_window, 100 * lp.rxFraction());
+    CHECK(caught * 100 >= sent * 99, "%u of %u frames caught", caught, sent);
+    CHECK(lp.rxFraction() < 0.1f, "radio in RX %.1f%% of the time", 100 * lp.rxFraction());
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+    basics();
+    polling();
+    linkModel();
+    lowPower();
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,181 @@
+/*
+emulator_test - SensorEmulator through the simulated radio (Linux host)
+
+    emulator_test
+
+SensorEmulator transmits through one CC1101Sim, whose frames are injected
+into a second one (onTransmit()) received by RadioArray; every frame read is
+decoded, on the virtual clock, 10 minutes per case:
+
+- 4 sensors every 12 s and 8 sensors every 1 s: every frame sent is
+  decoded, with the sensor's ID, and the rain counters advance by 0.1 mm
+  per rain frame without gaps
+- 8 sensors every 200 ms: more than the transmitter can send - frames
+  fail (the radio is still transmitting), every frame sent is still
+  decoded, and the frames missing per sensor add up to the failed ones
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -DCLOCK_VIRTUAL -o emulator_test tools/emulator_test.cpp SensorEmulator.cpp \
+        CC1101Sim.cpp CC1101Bus.cpp RadioArray.cpp BresserEncoder.cpp BresserDecoder.cpp
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../BresserDecoder.h"
+#include "../CC1101Sim.h"
+#include "../Clock.h"
+#include "../RadioArray.h"
+#include "../SensorEmulator.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define RUN_US 600000000ull
+
+// As RadioLib configures the radio for the sketch: fixed length 27, sync
+// word 0xAA2D, 8.2 kBaud, 4 preamble bytes
+static void configure(CC1101Sim *sim)
+{
+    sim->writeReg(CC1101_PKTCTRL0, 0x00);
+    sim->writeReg(CC1101_PKTLEN, BRESSER_FRAME_SIZE);
+    sim->writeReg(CC1101_SYNC1, 0xAA);
+    sim->writeReg(CC1101_SYNC0, 0x2D);
+    sim->writeReg(CC1101_MDMCFG4, 0x88);
+    sim->writeReg(CC1101_MDMCFG3, 0x83);
+    sim->writeReg(CC1101_MDMCFG1, 0x22);
+}
+
+static void relay(const SimFrame *frame, void *ctx)
+{
+    ((CC1101Sim *)ctx)->inject(frame);
+}
+
+// Transmit as radio.transmit() would start it - fails while the radio is
+// still sending the previous frame
+static bool transmit(const uint8_t *frame, uint8_t len, void *ctx)
+{
+    CC1101Sim *sim = (CC1101Sim *)ctx;
+    if (sim->readStatus(CC1101_MARCSTATE) != 0x01) {
+        return false;
+    }
+    sim->strobe(CC1101_SFTX);
+    sim->writeBurst(CC1101_FIFO, frame, len);
+    sim->strobe(CC1101_STX);
+    return true;
+}
+
+// ID of emulated sensor i
+static uint32_t sensorId(unsigned i)
+{
+    return (i % 2) ? 0xE0E00000 + i : 0xE0 + i;
+}
+
+struct Received {
+    uint32_t frames;
+    uint32_t rain;                 // latest rain counter (0.1 mm)
+    uint32_t gaps;                 // rain frames missing
+};
+
+// n sensors (5-in-1 and 6-in-1 alternating) every period_ms, spread over the
+// period
+static void run(unsigned n, uint32_t period_ms, bool saturated)
+{
+    clockVirtualUs() = 0;
+    CC1101Sim tx, rx;
+    configure(&tx);
+    configure(&rx);
+    tx.onTransmit(relay, &rx);
+    RadioArray radios;
+    radios.add(&rx, -1);
+    radios.begin();
+    SensorEmulator emulator;
+    emulator.begin(transmit, &tx);
+    for (unsigned i = 0; i < n; i++) {
+        emulator.add((i % 2) ? BRESSER_6IN1 : BRESSER_5IN1, sensorId(i), period_ms, i * period_ms / n);
+    }
+
+    Received got[EMULATOR_MAX_SENSORS];
+    memset(got, 0, sizeof(got));
+    unsigned decoded = 0, foreign = 0;
+    for (uint64_t t = 0; t < RUN_US; t += 1000) {
+        emulator.poll(t / 1000);
+        tx.advance(t);
+        rx.advance(t);
+        radios.service(t / 1000);
+        RadioFrame frame;
+        while (radios.read(&frame, t / 1000)) {
+            WeatherData w;
+            uint8_t     msg[BRESSER_5IN1_SIZE];
+            memset(&w, 0, sizeof(w));
+            memcpy(msg, &frame.data[1], sizeof(msg));
+            DecodeStatus status = decodeBresser6In1Payload(msg, sizeof(msg), &w);
+            if (status != DECODE_OK) {
+                memcpy(msg, &frame.data[1], sizeof(msg));
+                status = decodeBresser5In1Payload(msg, sizeof(msg), &w);
+            }
+            unsigned i = (w.sensor_id & 0xff) - ((w.sensor_id < 0x100) ? 0xE0 : 0);
+            if (frame.data[0] != 0xD4 || status != DECODE_OK || i >= n || w.sensor_id != sensorId(i)) {
+                foreign++;
+                continue;
+            }
+            decoded++;
+            got[i].frames++;
+            if (w.rain_ok) {
+                uint32_t rain = lroundf(w.rain_mm * 10);
+                got[i].gaps += rain - got[i].rain - 1;
+                got[i].rain  = rain;
+            }
+        }
+    }
+
+    const EmulatorStats &st = emulator.stats();
+    unsigned gaps = 0, missing = 0;
+    for (unsigned i = 0; i < n; i++) {
+        gaps    += got[i].gaps;
+        missing += emulator.frames(i) - got[i].frames;
+    }
+    printf("%u sensors every %u ms: %u sent, %u failed, %u skipped; %u decoded (%.1f%%), %u missing, "
+           "%u rain frames missing\n", n, (unsigned)period_ms, (unsigned)st.sent, (unsigned)st.failed,
+           (unsigned)st.skipped, decoded, st.sent ? 100.0 * decoded / st.sent : 0.0, missing, gaps);
+    CHECK(foreign == 0, "%u frames not decoded or from unknown sensors", foreign);
+    CHECK(decoded == st.sent && decoded == rx.stats().received, "%u of %u frames decoded", decoded,
+          (unsigned)st.sent);
+    if (!saturated) {
+        CHECK(st.failed == 0 && st.skipped == 0 && gaps == 0, "%u failed, %u skipped, %u rain frames missing",
+              (unsigned)st.failed, (unsigned)st.skipped, gaps);
+        for (unsigned i = 0; i < n; i++) {
+            CHECK(got[i].frames == emulator.frames(i), "sensor %u: %u of %u frames decoded", i,
+                  (unsigned)got[i].frames, (unsigned)emulator.frames(i));
+        }
+    } else {
+        CHECK(st.failed > 0 && missing == st.failed && gaps <= missing, "%u failed, %u frames missing",
+              (unsigned)st.failed, missing);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        fprintf(stderr, "usage: %s\n", argv[0]);
+        return 2;
+    }
+    run(4, 12000, false);
+    run(8, 1000, false);
+    run(8, 200, true);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
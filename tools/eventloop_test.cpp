@@ -0,0 +1,308 @@
+/*
+eventloop_test - deterministic tests of EventLoop on the virtual clock (Linux host)
+
+    eventloop_test [--seed s]
+
+Built with CLOCK_VIRTUAL: time only moves when the test sets it, so every
+dispatch happens at a known time and each run gives the same result.
+
+- order: highest priority first, FIFO within a priority, a task queued
+  only once however often it is posted
+- preemption: a radio signal raised while housekeeping runs is dispatched
+  right after that task, before the housekeeping still queued
+- timers: periodic and one-shot timers run exactly at their due times,
+  also beyond one revolution of the wheel and across the wrap of the
+  millisecond clock; cancelled timers do not run
+- latency: the measured dispatch latency is the time a task really waited
+- an hour of simulated traffic: radio interrupts at random times between
+  housekeeping tasks busy for up to 20 ms - the radio latency stays below
+  the longest housekeeping run, periodic tasks keep their rate (runs of a
+  timer due while its task is still queued are coalesced)
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -DCLOCK_VIRTUAL -o eventloop_test tools/eventloop_test.cpp EventLoop.cpp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../Clock.h"
+#include "../EventLoop.h"
+
+#ifndef CLOCK_VIRTUAL
+#error "eventloop_test must be built with -DCLOCK_VIRTUAL"
+#endif
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static EventLoop *loop;
+
+// Tasks append their number to the trace
+static char     trace[256];
+static unsigned traceLen;
+
+// Due times of the runs of a task (ms)
+static uint32_t runsAt[4][2048];
+static unsigned runs[4];
+
+static uint32_t isrClock(void)
+{
+    return clockMicros();
+}
+
+static void traced(void *ctx)
+{
+    if (traceLen < sizeof(trace) - 1) {
+        trace[traceLen++] = '0' + (int)(long)ctx;
+        trace[traceLen]   = '\0';
+    }
+}
+
+static void timed(void *ctx)
+{
+    int i = (int)(long)ctx;
+    if (runs[i] < sizeof(runsAt[i]) / sizeof(runsAt[i][0])) {
+        runsAt[i][runs[i]] = clockMillis();
+    }
+    runs[i]++;
+}
+
+static void reset(uint64_t now_us)
+{
+    delete loop;
+    loop = new EventLoop();
+    loop->setIsrClock(isrClock);
+    clockVirtualUs() = now_us;
+    traceLen = 0;
+    trace[0] = '\0';
+    memset(runs, 0, sizeof(runs));
+}
+
+//
+// Run the loop until until_us, sleeping (moving the clock) while idle
+//
+static void runUntil(uint64_t until_us)
+{
+    while (clockVirtualUs() < until_us) {
+        if (loop->run()) {
+            continue;
+        }
+        uint64_t next = (clockVirtualUs() / 1000 + (loop->idleMs() ? loop->idleMs() : 1)) * 1000;
+        clockVirtualUs() = (next < until_us) ? next : until_us;
+    }
+    loop->run();
+}
+
+static void testOrder()
+{
+    reset(1000000);
+    int hk1   = loop->addTask("hk1", traced, (void *)1, EVENT_PRIORITY_HOUSEKEEPING);
+    int hk2   = loop->addTask("hk2", traced, (void *)2, EVENT_PRIORITY_HOUSEKEEPING);
+    int out   = loop->addTask("out", traced, (void *)3, EVENT_PRIORITY_OUTPUT);
+    int radio = loop->addTask("radio", traced, (void *)4, EVENT_PRIORITY_RADIO);
+
+    loop->post(hk2);
+    loop->post(hk1);
+    loop->post(hk2);
+    loop->post(out);
+    loop->signal(radio);
+    loop->post(hk2);
+    unsigned n = loop->run();
+    printf("order: %s (%u runs, %u posts)\n", trace, n, (unsigned)loop->stats().posts);
+    CHECK(strcmp(trace, "4321") == 0, "dispatched %s, expected 4321", trace);
+    CHECK(n == 4 && loop->stats().posts == 6 && loop->stats().signals == 1, "%u runs", n);
+}
+
+static int preemptRadio;
+
+static void preempting(void *ctx)
+{
+    traced(ctx);
+    if ((long)ctx == 1) {
+        // "Interrupt" while the first housekeeping task runs
+        clockVirtualUs() += 5000;
+        loop->signal(preemptRadio);
+        clockVirtualUs() += 15000;
+    }
+}
+
+static void testPreemption()
+{
+    reset(1000000);
+    for (long i = 1; i <= 3; i++) {
+        loop->post(loop->addTask("hk", preempting, (void *)i, EVENT_PRIORITY_HOUSEKEEPING));
+    }
+    preemptRadio = loop->addTask("radio", traced, (void *)9, EVENT_PRIORITY_RADIO);
+    loop->run();
+    printf("preemption: %s, radio latency %u us\n", trace, (unsigned)loop->stats(EVENT_PRIORITY_RADIO).latency_max_us);
+    CHECK(strcmp(trace, "1923") == 0, "dispatched %s, expected 1923", trace);
+    CHECK(loop->stats(EVENT_PRIORITY_RADIO).latency_max_us == 15000, "radio latency %u us, expected 15000",
+          (unsigned)loop->stats(EVENT_PRIORITY_RADIO).latency_max_us);
+}
+
+static void testTimers(uint64_t start_us, const char *what)
+{
+    reset(start_us);
+    uint32_t t0 = clockMillis();
+    int fast = loop->addTask("fast", timed, (void *)0, EVENT_PRIORITY_HOUSEKEEPING);
+    int slow = loop->addTask("slow", timed, (void *)1, EVENT_PRIORITY_HOUSEKEEPING);
+    int once = loop->addTask("once", timed, (void *)2, EVENT_PRIORITY_OUTPUT);
+    int gone = loop->addTask("gone", timed, (void *)3, EVENT_PRIORITY_OUTPUT);
+    loop->every(fast, 10);
+    loop->every(slow, 1000);                    // beyond one revolution
+    loop->after(once, 3 * EVENT_WHEEL_SLOTS + 7);
+    loop->cancel(loop->after(gone, 50));
+
+    runUntil(start_us + 5000000);
+
+    bool exact = true;
+    for (unsigned k = 0; k < runs[0] && k < 500; k++) {
+        exact = exact && runsAt[0][k] == t0 + 10 * (k + 1);
+    }
+    for (unsigned k = 0; k < runs[1] && k < 5; k++) {
+        exact = exact && runsAt[1][k] == t0 + 1000 * (k + 1);
+    }
+    printf("timers (%s): 10 ms %u runs, 1000 ms %u runs, one-shot %u at +%u ms, cancelled %u, on time: %s\n",
+           what, runs[0], runs[1], runs[2], (unsigned)(runsAt[2][0] - t0), runs[3], exact ? "yes" : "no");
+    CHECK(runs[0] == 500 && runs[1] == 5, "%u/%u periodic runs, expected 500/5", runs[0], runs[1]);
+    CHECK(runs[2] == 1 && runsAt[2][0] == t0 + 3 * EVENT_WHEEL_SLOTS + 7, "one-shot %u runs at +%u ms",
+          runs[2], (unsigned)(runsAt[2][0] - t0));
+    CHECK(runs[3] == 0, "cancelled timer ran %u times", runs[3]);
+    CHECK(exact, "timers not run at their due times");
+    CHECK(loop->stats(EVENT_PRIORITY_HOUSEKEEPING).latency_max_us == 0, "timer latency %u us",
+          (unsigned)loop->stats(EVENT_PRIORITY_HOUSEKEEPING).latency_max_us);
+}
+
+static void testLatency()
+{
+    reset(1000000);
+    int radio = loop->addTask("radio", traced, (void *)1, EVENT_PRIORITY_RADIO);
+    int hk    = loop->addTask("hk", traced, (void *)2, EVENT_PRIORITY_HOUSEKEEPING);
+    loop->signal(radio);
+    clockVirtualUs() += 250;
+    loop->post(hk);
+    clockVirtualUs() += 750;
+    loop->run();
+    printf("latency: radio %u us, housekeeping %u us\n", (unsigned)loop->stats(EVENT_PRIORITY_RADIO).latency_max_us,
+           (unsigned)loop->stats(EVENT_PRIORITY_HOUSEKEEPING).latency_max_us);
+    CHECK(loop->stats(EVENT_PRIORITY_RADIO).latency_max_us == 1000, "radio latency %u us, expected 1000",
+          (unsigned)loop->stats(EVENT_PRIORITY_RADIO).latency_max_us);
+    CHECK(loop->stats(EVENT_PRIORITY_HOUSEKEEPING).latency_max_us == 750, "latency %u us, expected 750",
+          (unsigned)loop->stats(EVENT_PRIORITY_HOUSEKEEPING).latency_max_us);
+}
+
+//
+// An hour of traffic: housekeeping tasks take virtual time, radio
+// interrupts arrive at random times - also while a task runs
+//
+static int      trafficRadio;
+static uint64_t nextInterrupt;
+static unsigned interrupts;
+static unsigned radioRuns;
+static unsigned hkRuns[3];
+static const uint32_t hkPeriod[3] = {10, 100, 1000};     // ms
+static const uint32_t hkBusy[3]   = {2000, 5000, 20000}; // us per run
+
+static void interruptsUntil(uint64_t until_us)
+{
+    uint64_t now = clockVirtualUs();
+    while (nextInterrupt <= until_us) {
+        clockVirtualUs() = nextInterrupt;
+        loop->signal(trafficRadio);
+        interrupts++;
+        nextInterrupt += 1000 + rand() % 60000;
+    }
+    clockVirtualUs() = now;
+}
+
+static void work(uint32_t us)
+{
+    interruptsUntil(clockVirtualUs() + us);
+    clockVirtualUs() += us;
+}
+
+static void onRadio(void *)
+{
+    radioRuns++;
+    work(300);
+}
+
+static void onHousekeeping(void *ctx)
+{
+    int i = (int)(long)ctx;
+    hkRuns[i]++;
+    work(hkBusy[i]);
+}
+
+static void testTraffic()
+{
+    reset(0);
+    nextInterrupt = 1000;
+    trafficRadio  = loop->addTask("radio", onRadio, nullptr, EVENT_PRIORITY_RADIO);
+    for (long i = 0; i < 3; i++) {
+        loop->every(loop->addTask("hk", onHousekeeping, (void *)i, EVENT_PRIORITY_HOUSEKEEPING), hkPeriod[i]);
+    }
+
+    const uint64_t end = 3600ull * 1000000;
+    while (clockVirtualUs() < end) {
+        interruptsUntil(clockVirtualUs());
+        if (!loop->run()) {
+            uint32_t idle = loop->idleMs();
+            uint64_t t    = clockVirtualUs() + (idle ? idle * 1000 : 100);
+            clockVirtualUs() = (t < nextInterrupt) ? t : nextInterrupt;
+        }
+    }
+
+    const EventPriorityStats &radio = loop->stats(EVENT_PRIORITY_RADIO);
+    const EventPriorityStats &hk    = loop->stats(EVENT_PRIORITY_HOUSEKEEPING);
+    printf("traffic: %u interrupts, radio %u runs, latency avg %.0f max %u us | housekeeping %u/%u/%u runs, "
+           "latency avg %.0f max %u us\n",
+           interrupts, radioRuns, loop->latency(EVENT_PRIORITY_RADIO), (unsigned)radio.latency_max_us,
+           hkRuns[0], hkRuns[1], hkRuns[2], loop->latency(EVENT_PRIORITY_HOUSEKEEPING), (unsigned)hk.latency_max_us);
+    CHECK(radioRuns > 0 && radioRuns <= interrupts, "%u radio runs for %u interrupts", radioRuns, interrupts);
+    CHECK(radio.latency_max_us <= hkBusy[2] + 300, "radio latency %u us", (unsigned)radio.latency_max_us);
+    for (int i = 0; i < 3; i++) {
+        // Runs of a late timer are coalesced into one - only the 10 ms
+        // timer may fall behind the 20 ms task
+        unsigned expected = 3600 * 1000 / hkPeriod[i];
+        CHECK(hkRuns[i] <= expected && hkRuns[i] >= expected * 8 / 10, "housekeeping %d: %u runs, expected %u",
+              i, hkRuns[i], expected);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    testOrder();
+    testPreemption();
+    testTimers(1000000, "from 1 s");
+    testTimers((0x100000000ull - 2000) * 1000, "across the wrap");
+    testLatency();
+    testTraffic();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,214 @@
+/*
+freqtrack_test - FreqTracker compensation against carrier offsets (Linux host)
+
+    freqtrack_test [--hours h] [--seed n]
+
+Six TrafficGen sensors (RSSI -97..-85 dBm, noise -105 dBm) with carrier
+offsets drifting by +-12 kHz are received through CC1101Sim with the link
+model, configured from the sketch's register image, polled every 1 ms on the
+virtual clock (default 2 hours). The radio is retuned between packets as
+the sketch does with FREQ_TRACKING, and the frames decoded are compared
+without compensation, with the global compensation and with the offset of
+the sensor whose SensorSchedule window is open (nominal frequency in
+between):
+
+- receiver +30 kHz, sensors +-20 kHz: all three catch nearly every frame
+- receiver +40 kHz, sensors +-40 kHz: both compensations catch far more
+  than none
+- sensors +-90 kHz: the global compensation settles on the sensors heard
+  first and loses the others, per-sensor compensation catches far more
+  than either
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root - spare schedule entries, as the sketch
+needs them with FREQ_TRACKING):
+
+    g++ -O2 -std=c++11 -DSCHEDULE_MAX_SENSORS=16 -o freqtrack_test tools/freqtrack_test.cpp FreqTracker.cpp \
+        SensorSchedule.cpp TrafficGen.cpp CC1101Sim.cpp CC1101Bus.cpp CC1101Image.cpp BresserEncoder.cpp \
+        BresserDecoder.cpp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../BresserDecoder.h"
+#include "../BresserEncoder.h"
+#include "../CC1101Image.h"
+#include "../FreqTracker.h"
+#include "../SensorSchedule.h"
+#include "../TrafficGen.h"
+
+#if SCHEDULE_MAX_SENSORS < 16
+    #error "build with -DSCHEDULE_MAX_SENSORS=16 - junk IDs fill the default table"
+#endif
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define FREQUENCY_HZ 868.3e6
+#define STEP_US      1000
+
+enum Mode { NONE, GLOBAL, PER_SENSOR };
+
+static const char *modeNames[] = {"none", "global", "per sensor"};
+
+struct Scenario {
+    const char *name;
+    float       bias_khz;          // receiver offset
+    float       spread_khz;        // sensor offsets, uniform +-
+};
+
+static uint64_t runUs = 2 * 3600000000ull;
+static uint32_t seed  = 1;
+
+// FSCTRL0 to listen with - freqTarget() of the sketch
+static int8_t target(Mode mode, const FreqTracker &tracker, const SensorSchedule &schedule, uint32_t now_ms)
+{
+    if (mode == GLOBAL) {
+        return tracker.compensation();
+    }
+    if (mode == PER_SENSOR) {
+        uint32_t ids[FREQ_MAX_SENSORS];
+        unsigned n = tracker.sensors(ids, FREQ_MAX_SENSORS);
+        for (unsigned i = 0; i < n; i++) {
+            SchedulePrediction p;
+            if (schedule.predict(ids[i], &p) && (int32_t)(now_ms - (p.next_ms - p.window_ms)) >= 0 &&
+                (int32_t)(p.next_ms + p.window_ms - now_ms) >= 0) {
+                return tracker.compensation(ids[i]);
+            }
+        }
+    }
+    return 0;
+}
+
+// Frames decoded (percent of those sent)
+static float run(const Scenario &sc, Mode mode)
+{
+    static TrafficGen gen;
+    CC1101Sim sim;
+    sim.setLinkModel(true);
+    sim.setNoise(-105);
+    constexpr CC1101Image image = cc1101Image({ 868.3, 8.21, 57.136417, 270, 10, 32, 27, false, 0 });
+    cc1101ApplyImage(&sim, image);
+    sim.writeReg(CC1101_IOCFG0, 0x06);
+    FreqTracker    tracker;
+    SensorSchedule schedule;
+
+    TrafficConfig cfg;
+    cfg.sensors        = 6;
+    cfg.share_6in1     = 0.5f;
+    cfg.data_rate      = sim.dataRate();
+    cfg.seed           = seed;
+    cfg.frequency_hz   = FREQUENCY_HZ + sc.bias_khz * 1e3f;
+    cfg.freq_offset_hz = sc.spread_khz * 1e3f;
+    cfg.freq_drift_hz  = 12e3f;
+    cfg.rssi_min       = -97;
+    cfg.rssi_max       = -85;
+    gen.begin(cfg, 0);
+
+    SimFrame     frame;
+    TrafficTruth truth;
+    bool     pending   = gen.next(&frame, &truth);
+    bool     listening = false, receiving = false;
+    unsigned decoded   = 0;
+    for (uint64_t now = 0; now < runUs; now += STEP_US) {
+        while (pending && frame.start_us < now + STEP_US) {
+            sim.inject(&frame);
+            pending = gen.next(&frame, &truth);
+        }
+        sim.advance(now);
+        uint32_t now_ms = now / 1000;
+
+        // GDO0 high from the sync word to the end of the packet
+        if (sim.gdo(0)) {
+            receiving = true;
+            continue;
+        }
+        if (receiving) {
+            receiving = false;
+            uint8_t data[BRESSER_FRAME_SIZE + 2];
+            sim.readBurst(CC1101_FIFO, data, sizeof(data));
+            int8_t freqest = (int8_t)sim.readReg(CC1101_FREQEST);
+            sim.strobe(CC1101_SIDLE);
+            sim.strobe(CC1101_SFRX);
+            listening = false;
+
+            WeatherData w;
+            uint8_t     msg[BRESSER_5IN1_SIZE];
+            memcpy(msg, &data[1], sizeof(msg));
+            DecodeStatus status = decodeBresser6In1Payload(msg, sizeof(msg), &w);
+            if (status != DECODE_OK) {
+                memcpy(msg, &data[1], sizeof(msg));
+                status = decodeBresser5In1Payload(msg, sizeof(msg), &w);
+            }
+            if (data[0] == 0xD4 && status == DECODE_OK) {
+                decoded++;
+                tracker.update(w.sensor_id, freqest);
+                schedule.arrival(w.sensor_id, now_ms);
+            }
+        }
+        schedule.poll(now_ms);
+
+        int8_t fsctrl0 = target(mode, tracker, schedule, now_ms);
+        if (!listening || fsctrl0 != tracker.fsctrl0()) {
+            sim.strobe(CC1101_SIDLE);
+            sim.writeReg(CC1101_FSCTRL0, (uint8_t)fsctrl0);
+            tracker.retuned(fsctrl0);
+            sim.strobe(CC1101_SFRX);
+            sim.strobe(CC1101_SRX);
+            listening = true;
+        }
+    }
+    return 100.0f * decoded / gen.stats().frames;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--hours") == 0 && i + 1 < argc) {
+            runUs = (uint64_t)(atof(argv[++i]) * 3600e6);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--hours h] [--seed n]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    static const Scenario scenarios[] = {
+        {"receiver +30 kHz, sensors +-20 kHz", 30, 20},
+        {"receiver +40 kHz, sensors +-40 kHz", 40, 40},
+        {"sensors +-90 kHz",                    0, 90},
+    };
+    printf("frames decoded, %.1f h:\n", runUs / 3600e6);
+    printf("%-36s %10s %10s %10s\n", "", modeNames[NONE], modeNames[GLOBAL], modeNames[PER_SENSOR]);
+    float r[3][3];
+    for (int s = 0; s < 3; s++) {
+        printf("%-36s", scenarios[s].name);
+        for (int m = NONE; m <= PER_SENSOR; m++) {
+            r[s][m] = run(scenarios[s], (Mode)m);
+            printf(" %9.1f%%", r[s][m]);
+        }
+        printf("\n");
+    }
+    CHECK(r[0][NONE] > 95 && r[0][GLOBAL] > 95 && r[0][PER_SENSOR] > 95,
+          "offsets within the filter: %.1f%%, %.1f%%, %.1f%%", r[0][NONE], r[0][GLOBAL], r[0][PER_SENSOR]);
+    CHECK(r[1][GLOBAL] > r[1][NONE] + 10 && r[1][PER_SENSOR] > r[1][NONE] + 10,
+          "receiver off by 40 kHz: %.1f%% without, %.1f%%/%.1f%% with compensation", r[1][NONE], r[1][GLOBAL],
+          r[1][PER_SENSOR]);
+    CHECK(r[2][PER_SENSOR] > r[2][NONE] + 5 && r[2][PER_SENSOR] > r[2][GLOBAL] + 5,
+          "sensors +-90 kHz: %.1f%% per sensor, %.1f%% without, %.1f%% global", r[2][PER_SENSOR], r[2][NONE],
+          r[2][GLOBAL]);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
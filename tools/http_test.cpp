@@ -0,0 +1,226 @@
+/*
+http_test - HttpServer with well-behaved and stalled clients (Linux host)
+
+    http_test [--port p]
+
+Runs the server on a local port (default 18080) and connects to it from the
+same thread, calling poll() in between like the sketch's loop does:
+
+- GET / returns the readings with an ETag, a request with that ETag gets a
+  304, an unknown path a 404, a route its chunked body
+- a client which connects and sends nothing, and one which requests a
+  route body of 4 MB without reading it: poll() must not wait for either
+  (the longest call is printed), other clients are served meanwhile and
+  both connections are closed once HTTP_TIMEOUT_MS has passed (on the
+  virtual clock)
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -DCLOCK_VIRTUAL -o http_test tools/http_test.cpp HttpServer.cpp SensorSnapshots.cpp
+*/
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <string>
+
+#include "../Clock.h"
+#include "../HttpServer.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define BIG_PARTS 1024
+
+static HttpServer server;
+static uint16_t   port = 18080;
+static uint32_t   longestPollUs;
+
+static uint32_t realMicros()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000u + ts.tv_nsec / 1000);
+}
+
+static void poll()
+{
+    uint32_t start = realMicros();
+    server.poll();
+    uint32_t us = realMicros() - start;
+    if (us > longestPollUs) {
+        longestPollUs = us;
+    }
+}
+
+// Route body of BIG_PARTS parts of 4000 bytes
+static int renderBig(char *buf, unsigned size, unsigned part, void *ctx)
+{
+    (void)ctx;
+    if (part >= BIG_PARTS) {
+        return 0;
+    }
+    if (size < 4000) {
+        return -1;
+    }
+    memset(buf, 'a' + part % 26, 4000);
+    return 4000;
+}
+
+static int connectServer()
+{
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connect");
+        exit(2);
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    return fd;
+}
+
+// Send request and poll until the server closes the connection - the
+// complete response, or "" if it has not been closed within 2 s
+static std::string request(const char *req)
+{
+    int fd = connectServer();
+    std::string resp;
+    if (send(fd, req, strlen(req), 0) != (int)strlen(req)) {
+        close(fd);
+        return resp;
+    }
+    uint32_t start = realMicros();
+    while (realMicros() - start < 2000000) {
+        poll();
+        char buf[4096];
+        int n = recv(fd, buf, sizeof(buf), 0);
+        if (n == 0) {
+            close(fd);
+            return resp;
+        }
+        if (n > 0) {
+            resp.append(buf, n);
+        } else {
+            usleep(100);
+        }
+    }
+    close(fd);
+    return "";
+}
+
+static std::string header(const std::string &resp, const char *name)
+{
+    std::string key = std::string("\r\n") + name + ": ";
+    size_t p = resp.find(key);
+    if (p == std::string::npos) {
+        return "";
+    }
+    p += key.size();
+    return resp.substr(p, resp.find("\r\n", p) - p);
+}
+
+// Serve a few requests meanwhile - true if all were answered
+static bool servesOthers()
+{
+    for (int i = 0; i < 3; i++) {
+        if (request("GET / HTTP/1.1\r\nHost: test\r\n\r\n").compare(0, 15, "HTTP/1.1 200 OK") != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--port") == 0 && i + 1 < argc) {
+            port = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--port p]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!server.begin(port)) {
+        fprintf(stderr, "cannot listen on port %u\n", port);
+        return 2;
+    }
+    server.route("/big", "text/plain", renderBig, nullptr);
+    WeatherData d;
+    memset(&d, 0, sizeof(d));
+    d.sensor_id  = 0xfa5e1c20;
+    d.temp_ok    = true;
+    d.temp_c     = 12.3f;
+    d.humidity   = 56;
+    d.battery_ok = true;
+    server.update(&d, 1650000000);
+    server.render();
+
+    // Well-behaved clients
+    std::string resp = request("GET / HTTP/1.1\r\nHost: test\r\n\r\n");
+    std::string etag = header(resp, "ETag");
+    CHECK(resp.compare(0, 15, "HTTP/1.1 200 OK") == 0 && resp.find("\"id\":\"fa5e1c20\"") != std::string::npos &&
+          !etag.empty(), "GET /: %s", resp.c_str());
+    resp = request(("GET / HTTP/1.1\r\nIf-None-Match: " + etag + "\r\n\r\n").c_str());
+    CHECK(resp.compare(0, 25, "HTTP/1.1 304 Not Modified") == 0, "GET / with ETag: %s", resp.c_str());
+    resp = request("GET /nothing HTTP/1.1\r\n\r\n");
+    CHECK(resp.compare(0, 22, "HTTP/1.1 404 Not Found") == 0, "GET /nothing: %s", resp.c_str());
+    resp = request("GET /big HTTP/1.1\r\n\r\n");
+    size_t body = resp.find("\r\n\r\n") + 4;
+    size_t bodyLen = BIG_PARTS * (4000 + 7) + 5;   // "fa0\r\n" ... "\r\n", "0\r\n\r\n"
+    CHECK(resp.compare(0, 15, "HTTP/1.1 200 OK") == 0 && resp.size() - body == bodyLen &&
+          resp.compare(resp.size() - 5, 5, "0\r\n\r\n") == 0, "GET /big: %u bytes of body",
+          (unsigned)(resp.size() - body));
+    printf("well-behaved clients: longest poll() %u us\n", (unsigned)longestPollUs);
+
+    // A client sending nothing, one not reading its response
+    longestPollUs = 0;
+    int silent = connectServer();
+    int stalled = connectServer();
+    const char big[] = "GET /big HTTP/1.1\r\n\r\n";
+    CHECK(send(stalled, big, sizeof(big) - 1, 0) == sizeof(big) - 1, "request not sent");
+    for (int i = 0; i < 100; i++) {
+        poll();
+        usleep(100);
+    }
+    bool others = servesOthers();
+    printf("stalled clients: longest poll() %u us, others served: %s\n", (unsigned)longestPollUs,
+           others ? "yes" : "no");
+    CHECK(longestPollUs < 50000, "poll() took %u us", (unsigned)longestPollUs);
+    CHECK(others, "requests not served while two clients stall");
+
+    clockVirtualUs() += HTTP_TIMEOUT_MS * 1000ull;
+    poll();
+    char buf[64];
+    int n = recv(silent, buf, sizeof(buf), 0);
+    CHECK(n == 0 && server.stats().timeouts == 2, "stalled connections not closed after %u ms (%u timeouts)",
+          (unsigned)HTTP_TIMEOUT_MS, (unsigned)server.stats().timeouts);
+    close(silent);
+    close(stalled);
+
+    const HttpStats &st = server.stats();
+    printf("%u requests, %u not modified, %u not found, %u timeouts\n", (unsigned)st.requests,
+           (unsigned)st.not_modified, (unsigned)st.not_found, (unsigned)st.timeouts);
+    server.end();
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
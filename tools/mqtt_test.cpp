@@ -0,0 +1,204 @@
+/*
+mqtt_test - MqttPublisher on a simulated clock (Linux host)
+
+    mqtt_test [--seed s]
+
+Runs the publisher for a simulated hour, the messages going to a callback
+which parses them instead of a broker:
+
+- three sensors transmitting every 12 s, one frame in ten followed by a
+  reading of a random ID (as decoded from a corrupted 5-in-1 frame): the
+  junk IDs must not keep a sensor out, every sensor is published at least
+  every refresh_ms and the last temperature published is within the
+  deadband of the current one
+- wind direction swinging around north (350..10 deg): no change is
+  published for it until it really turns
+- a table full of confirmed sensors: a new sensor is taken once one of them
+  is stale, not before
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -o mqtt_test tools/mqtt_test.cpp MqttPublisher.cpp
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../MqttPublisher.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define SENSORS  3
+#define PERIOD_MS 12000
+
+struct Published {
+    uint32_t id;
+    uint32_t at;                   // last message with this sensor
+    uint32_t max_gap;              // longest time without a message
+    float    temp_c;
+    unsigned wind_dir;             // messages with wind_dir
+};
+
+static Published published[SENSORS + 1];
+static uint32_t  clockMs;
+
+// Value of a field in a sensor's JSON object - false: not contained
+static bool field(const char *obj, const char *end, const char *name, float *pValue)
+{
+    char key[24];
+    snprintf(key, sizeof(key), "\"%s\":", name);
+    const char *p = strstr(obj, key);
+    if (!p || p > end) {
+        return false;
+    }
+    *pValue = strtof(p + strlen(key), nullptr);
+    return true;
+}
+
+static bool collect(const char *topic, const char *payload, unsigned len, void *ctx)
+{
+    (void)topic;
+    (void)ctx;
+    char msg[MQTT_PAYLOAD_SIZE + 1];
+    memcpy(msg, payload, len);
+    msg[len] = '\0';
+    for (const char *obj = strstr(msg, "{\"id\":\""); obj; obj = strstr(obj + 1, "{\"id\":\"")) {
+        uint32_t id = strtoul(obj + 7, nullptr, 16);
+        const char *end = strchr(obj, '}');
+        for (Published &p : published) {
+            if (p.id != id) {
+                continue;
+            }
+            if (clockMs - p.at > p.max_gap) {
+                p.max_gap = clockMs - p.at;
+            }
+            p.at = clockMs;
+            field(obj, end, "temp_c", &p.temp_c);
+            float dir;
+            p.wind_dir += field(obj, end, "wind_dir", &dir);
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    // Three sensors and an hour of junk IDs
+    static MqttPublisher mqtt;
+    mqtt.begin("bresser/readings", collect, nullptr);
+    float temp[SENSORS] = {12, 18, 25};
+    for (int s = 0; s < SENSORS; s++) {
+        published[s].id = 0x39580000 + s;
+    }
+    unsigned junk = 0;
+    for (clockMs = 0; clockMs < 3600000; clockMs += 1000) {
+        for (int s = 0; s < SENSORS; s++) {
+            if (clockMs % PERIOD_MS != (uint32_t)s * 4000) {
+                continue;
+            }
+            WeatherData d;
+            memset(&d, 0, sizeof(d));
+            d.sensor_id  = published[s].id;
+            d.temp_ok    = true;
+            d.wind_ok    = true;
+            d.battery_ok = true;
+            temp[s] += (rand() % 3 - 1) * 0.03f;
+            d.temp_c   = temp[s];
+            d.humidity = 50;
+            mqtt.update(&d, clockMs);
+            if (rand() % 10 == 0) {
+                d.sensor_id = rand();
+                mqtt.update(&d, clockMs);
+                junk++;
+            }
+        }
+        mqtt.flush(clockMs);
+    }
+    const MqttStats &st = mqtt.stats();
+    printf("%u frames (%u junk IDs): %u publishes, %u bytes - naive: %u publishes, %u bytes\n",
+           (unsigned)st.frames, junk, (unsigned)st.publishes, (unsigned)st.bytes, (unsigned)st.naive_publishes,
+           (unsigned)st.naive_bytes);
+    printf("%u sensors replaced, %u readings not tracked\n", (unsigned)st.evictions, (unsigned)st.untracked);
+    CHECK(st.evictions > 0, "junk IDs did not fill the table");
+    for (int s = 0; s < SENSORS; s++) {
+        const Published &p = published[s];
+        CHECK(p.at > 0 && p.max_gap <= MqttPublisher::defaultConfig.refresh_ms + 2 * PERIOD_MS &&
+              fabsf(p.temp_c - temp[s]) < MqttPublisher::defaultConfig.deadband[MQTT_TEMP] + 0.05f,
+              "sensor %08x: last published %u ms, longest gap %u ms, temp %.1f (now %.2f)", (unsigned)p.id,
+              (unsigned)p.at, (unsigned)p.max_gap, p.temp_c, temp[s]);
+    }
+
+    // Wind direction around north
+    static MqttPublisher wind;
+    wind.begin("bresser/readings", collect, nullptr);
+    Published &w = published[SENSORS];
+    w.id = 0x0012c300;
+    WeatherData d;
+    memset(&d, 0, sizeof(d));
+    d.sensor_id = w.id;
+    d.wind_ok   = true;
+    unsigned frames = 0;
+    for (clockMs = 0; clockMs < 120000; clockMs += PERIOD_MS, frames++) {
+        d.wind_direction_deg = (frames % 2) ? 350 + rand() % 10 : rand() % 11;
+        wind.update(&d, clockMs);
+        wind.flush(clockMs, true);
+    }
+    printf("wind direction 350..10 deg: %u of %u frames published\n", w.wind_dir, frames);
+    CHECK(w.wind_dir == 1, "wind direction swinging around north published %u times", w.wind_dir);
+    d.wind_direction_deg = 45;
+    wind.update(&d, clockMs);
+    wind.flush(clockMs, true);
+    CHECK(w.wind_dir == 2, "wind direction turned to 45 deg not published");
+
+    // Table full of confirmed sensors: a new one is taken once one is stale
+    static MqttPublisher full;
+    full.begin("bresser/readings", collect, nullptr);
+    memset(&d, 0, sizeof(d));
+    d.temp_ok = true;
+    for (unsigned k = 0; k < MQTT_MIN_READINGS; k++) {
+        for (uint32_t id = 1; id <= MQTT_MAX_SENSORS; id++) {
+            d.sensor_id = id;
+            full.update(&d, k * PERIOD_MS);
+        }
+    }
+    d.sensor_id = 100;
+    full.update(&d, MQTT_STALE_MS - 1);
+    bool early = full.stats().untracked == 1;
+    // All but sensor 1 heard again
+    for (uint32_t id = 2; id <= MQTT_MAX_SENSORS; id++) {
+        d.sensor_id = id;
+        full.update(&d, MQTT_STALE_MS);
+    }
+    d.sensor_id = 100;
+    full.update(&d, MQTT_STALE_MS + 2 * PERIOD_MS);
+    bool late = full.stats().evictions == 1 && full.stats().untracked == 1;
+    CHECK(early && late, "stale sensor not replaced (new sensor rejected before: %d, taken after: %d)", early,
+          late);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,382 @@
+/*
+readinglog_test - ReadingLog write throughput and crash recovery (Linux host)
+
+    readinglog_test [--dir path] [--records n] [--seed s]
+
+Works in the directory path (default /tmp/readinglog_test, emptied first):
+
+- throughput: n records (default 200000) are appended, several sensors
+  interleaved; prints records/s, bytes written per record (data + index)
+  and the mean and longest page write. The log rotates through more than
+  LOG_MAX_SEGMENTS segments on the way.
+- seek: for timestamps across the whole log, seek() must find the first
+  record at or after the timestamp, as found by a linear scan
+- crash recovery: the tail of the last segment is cut at a random byte
+  offset or a random byte of it is damaged, the index loses entries or gets
+  stale ones - after begin(), every record read back must be intact, in
+  order, the records before the damage must all be there, seek() must
+  still be exact and appending must continue
+- clock set back: a record older than the one before is stored with the
+  latest timestamp (also across a reopen), so seeking stays exact
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -o readinglog_test tools/readinglog_test.cpp ReadingLog.cpp
+*/
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+
+#include "../Clock.h"
+#include "../ReadingLog.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static char dir[LOG_PATH_LEN];
+
+static void clearDir()
+{
+    char path[LOG_PATH_LEN + 256];
+    DIR *d = opendir(dir);
+    if (!d) {
+        return;
+    }
+    struct dirent *de;
+    while ((de = readdir(d)) != nullptr) {
+        if (de->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+}
+
+static void lastSegmentPath(char *path, unsigned size)
+{
+    unsigned last = 0;
+    DIR *d = opendir(dir);
+    struct dirent *de;
+    while (d && (de = readdir(d)) != nullptr) {
+        unsigned seg;
+        if (sscanf(de->d_name, "seg%5u.log", &seg) == 1 && seg > last) {
+            last = seg;
+        }
+    }
+    if (d) {
+        closedir(d);
+    }
+    snprintf(path, size, "%s/seg%05u.log", dir, last);
+}
+
+static long fileSize(const char *path)
+{
+    struct stat st;
+    return (stat(path, &st) == 0) ? st.st_size : -1;
+}
+
+static void cutFile(const char *path, long size)
+{
+    CHECK(truncate(path, size) == 0, "cannot truncate %s", path);
+}
+
+// Sensor and values of the reading with timestamp ts
+static void reading(uint32_t ts, WeatherData *d)
+{
+    memset(d, 0, sizeof(*d));
+    d->sensor_id  = 0x1000 + ts % 7;
+    d->temp_ok    = true;
+    d->temp_c     = (float)(ts % 400) / 10;
+    d->humidity   = ts % 100;
+    d->rain_ok    = true;
+    d->rain_mm    = (float)(ts / 10) / 10;
+    d->battery_ok = true;
+}
+
+static bool recordOk(const LogRecord *rec)
+{
+    WeatherData d;
+    LogRecord   expected;
+    reading(rec->timestamp, &d);
+    logRecordFromWeatherData(&d, rec->timestamp, &expected);
+    return memcmp(rec, &expected, sizeof(expected)) == 0;
+}
+
+// All records readable from the start - checks their contents and order
+static std::vector<uint32_t> readAll(ReadingLog *log, const char *what)
+{
+    std::vector<uint32_t> all;
+    ReadingLog::Cursor c;
+    LogRecord rec;
+    bool intact = true, ordered = true;
+    log->seek(0, &c);
+    while (c.next(&rec)) {
+        intact  = intact && recordOk(&rec);
+        ordered = ordered && (all.empty() || rec.timestamp >= all.back());
+        all.push_back(rec.timestamp);
+    }
+    CHECK(intact, "%s: damaged record handed out", what);
+    CHECK(ordered, "%s: records out of order", what);
+    return all;
+}
+
+// seek() against a linear search of all timestamps
+static void checkSeek(ReadingLog *log, const std::vector<uint32_t> &all, const char *what)
+{
+    if (all.empty()) {
+        return;
+    }
+    unsigned wrong = 0, probes = 0;
+    uint32_t span = all.back() - all.front() + 2;
+    for (unsigned k = 0; k < 200; k++) {
+        uint32_t from = all.front() + (uint32_t)((uint64_t)span * k / 200) + rand() % 3;
+        size_t   i    = 0;
+        while (i < all.size() && all[i] < from) {
+            i++;
+        }
+        ReadingLog::Cursor c;
+        LogRecord rec;
+        bool found = log->seek(from, &c) && c.next(&rec);
+        probes++;
+        if (found != (i < all.size()) || (found && rec.timestamp != all[i])) {
+            wrong++;
+        }
+    }
+    CHECK(wrong == 0, "%s: %u of %u seeks wrong", what, wrong, probes);
+}
+
+static void testThroughput(unsigned records)
+{
+    clearDir();
+    ReadingLog log;
+    CHECK(log.begin(dir), "begin() failed");
+
+    uint32_t start = clockMicros();
+    bool ok = true;
+    for (uint32_t ts = 1; ts <= records; ts++) {
+        WeatherData d;
+        reading(ts, &d);
+        ok = log.append(&d, ts) && ok;
+    }
+    ok = log.flush() && ok;
+    double elapsed = (clockMicros() - start) / 1e6;
+    const LogStats &st = log.stats();
+    CHECK(ok, "append() failed");
+    printf("throughput: %u records in %.2f s, %.0f records/s, %.1f bytes/record, %u pages, "
+           "page write avg. %.0f us, max. %u us\n",
+           records, elapsed, records / elapsed, (double)st.bytes / st.records, (unsigned)st.pages,
+           (double)st.write_us / st.pages, (unsigned)st.write_us_max);
+
+    std::vector<uint32_t> all = readAll(&log, "throughput");
+    unsigned kept = (unsigned)all.size();
+    unsigned max  = LOG_MAX_SEGMENTS * LOG_RECORDS_PER_SEGMENT;
+    CHECK(kept <= max && kept + LOG_RECORDS_PER_SEGMENT > (records < max ? records : max) &&
+          !all.empty() && all.back() == records, "%u records kept of %u", kept, records);
+    checkSeek(&log, all, "throughput");
+}
+
+//
+// Append n records in a child process which then exits without flushing or
+// closing the log, as on a reset - returns the records lost from its page
+// buffer
+//
+static unsigned crash(uint32_t ts, unsigned n, bool flush)
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        ReadingLog *log = new ReadingLog;
+        if (!log->begin(dir)) {
+            _exit(255);
+        }
+        for (unsigned k = 0; k < n; k++) {
+            WeatherData d;
+            reading(ts + k, &d);
+            log->append(&d, ts + k);
+        }
+        if (flush) {
+            log->flush();
+        }
+        _exit(log->pending());
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) != 255, "log not opened after crash");
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 0;
+}
+
+static void testRecovery(unsigned trials)
+{
+    std::vector<uint32_t> expected;
+    unsigned lost = 0;
+
+    clearDir();
+    uint32_t ts = 1;
+    for (unsigned t = 0; t < trials; t++) {
+        unsigned n       = 1 + rand() % (3 * LOG_RECORDS_PER_SEGMENT / 2);
+        unsigned pending = crash(ts, n, rand() % 2);
+        for (unsigned k = 0; k < n - pending; k++) {
+            expected.push_back(ts + k);
+        }
+        ts   += n;
+        lost += pending;
+
+        char path[LOG_PATH_LEN + 16];
+        char index[LOG_PATH_LEN + 16];
+        lastSegmentPath(path, sizeof(path));
+        snprintf(index, sizeof(index), "%s/index", dir);
+        long size = fileSize(path);
+        long cut  = size;
+        switch (rand() % 4) {
+        case 0:
+            // Torn write: the file ends within a page
+            if (size > 0) {
+                cut = size - 1 - rand() % (size < LOG_PAGE_SIZE ? size : LOG_PAGE_SIZE);
+                cutFile(path, cut);
+            }
+            break;
+        case 1:
+            // A byte of the last page damaged
+            if (size > 0) {
+                cut = size - 1 - rand() % (size < LOG_PAGE_SIZE ? size : LOG_PAGE_SIZE);
+                FILE *f = fopen(path, "r+b");
+                fseek(f, cut, SEEK_SET);
+                int c = fgetc(f);
+                fseek(f, cut, SEEK_SET);
+                fputc(c ^ (1 << rand() % 8), f);
+                fclose(f);
+            }
+            break;
+        case 2:
+            // Index lost or cut
+            cutFile(index, (fileSize(index) / sizeof(LogIndexEntry) / 2) * sizeof(LogIndexEntry));
+            break;
+        case 3:
+            // Index entry written, data not
+            if (size > 0) {
+                cut = size - (size % LOG_PAGE_SIZE ? size % LOG_PAGE_SIZE : LOG_PAGE_SIZE);
+                cutFile(path, cut);
+            }
+            break;
+        }
+        // Records of the last segment from the damage on are gone
+        unsigned damaged = (unsigned)(size / sizeof(LogRecord) - cut / sizeof(LogRecord));
+        expected.resize(expected.size() - damaged);
+        lost += damaged;
+
+        // All other records must have survived - except for the segments
+        // deleted as the log rotates
+        ReadingLog log;
+        CHECK(log.begin(dir), "trial %u: begin() after crash failed", t);
+        std::vector<uint32_t> after = readAll(&log, "recovery");
+        bool same = after.size() <= expected.size() &&
+                    std::equal(after.begin(), after.end(), expected.end() - after.size());
+        CHECK(same && after.size() + (LOG_MAX_SEGMENTS - 2) * LOG_RECORDS_PER_SEGMENT > expected.size(),
+              "trial %u: %u records after recovery, expected %u", t, (unsigned)after.size(),
+              (unsigned)expected.size());
+        checkSeek(&log, after, "recovery");
+
+        // Appending continues behind the recovered data
+        WeatherData d;
+        reading(ts, &d);
+        CHECK(log.append(&d, ts) && log.flush(), "trial %u: append after recovery failed", t);
+        std::vector<uint32_t> more = readAll(&log, "recovery");
+        CHECK(!more.empty() && more.back() == ts, "trial %u: record appended after recovery not found", t);
+        expected = more;
+        ts++;
+    }
+    printf("crash recovery: %u trials, %u records lost in crashes (page buffer and damaged tail)\n", trials, lost);
+}
+
+static void testClockBack()
+{
+    clearDir();
+    {
+        ReadingLog log;
+        log.begin(dir);
+        for (uint32_t ts = 1000000; ts < 1000000 + 3 * LOG_RECORDS_PER_PAGE; ts++) {
+            WeatherData d;
+            reading(ts, &d);
+            log.append(&d, ts);
+        }
+    }
+    // Reboot with the clock not set yet
+    ReadingLog log;
+    log.begin(dir);
+    uint32_t last = 1000000 + 3 * LOG_RECORDS_PER_PAGE - 1;
+    for (uint32_t ts = 5; ts < 5 + 2 * LOG_RECORDS_PER_PAGE; ts++) {
+        WeatherData d;
+        reading(ts, &d);
+        log.append(&d, ts);
+    }
+    log.flush();
+    CHECK(log.stats().clamped == 2 * LOG_RECORDS_PER_PAGE, "%u records clamped",
+          (unsigned)log.stats().clamped);
+
+    unsigned n = 0;
+    bool ordered = true;
+    uint32_t prev = 0;
+    ReadingLog::Cursor c;
+    LogRecord rec;
+    log.seek(0, &c);
+    while (c.next(&rec)) {
+        ordered = ordered && rec.timestamp >= prev;
+        prev = rec.timestamp;
+        n++;
+    }
+    CHECK(ordered && n == 5 * LOG_RECORDS_PER_PAGE && prev == last, "clock set back: %u records, last %u",
+          n, (unsigned)prev);
+    unsigned found = 0;
+    log.seek(last, &c);
+    while (c.next(&rec)) {
+        found++;
+    }
+    printf("clock set back: %u records clamped, seek to the latest timestamp finds %u records\n",
+           (unsigned)log.stats().clamped, found);
+    CHECK(found == 2 * LOG_RECORDS_PER_PAGE + 1, "seek after clock set back: %u records", found);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned records = 200000;
+    unsigned seed    = 1;
+    strcpy(dir, "/tmp/readinglog_test");
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--dir") == 0 && i + 1 < argc && strlen(argv[i + 1]) < LOG_PATH_LEN) {
+            strcpy(dir, argv[++i]);
+        } else if (strcmp(argv[i], "--records") == 0 && i + 1 < argc) {
+            records = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--dir path] [--records n] [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+    mkdir(dir, 0755);
+
+    testThroughput(records);
+    testRecovery(200);
+    testClockBack();
+    clearDir();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
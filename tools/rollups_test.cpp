@@ -0,0 +1,203 @@
+/*
+rollups_test - Rollups against the raw readings (Linux host)
+
+    rollups_test [--seed s]
+
+Feeds three days of readings (every 12 s, with gaps) of two sensors, one in
+ten followed by a reading of a random ID (as decoded from a corrupted
+5-in-1 frame), and compares query() and series() with the aggregates
+computed from the raw readings:
+
+- windows aligned to a level (e.g. the last 24 h hourly): exact
+- windows not aligned: the readings of the buckets inside the window only,
+  never a reading from outside it
+- the junk IDs do not keep a new sensor out; a sensor gone silent is
+  replaced once stale, not before
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -o rollups_test tools/rollups_test.cpp Rollups.cpp
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../Rollups.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define START_TS 1700006400u       // midnight
+
+struct Raw {
+    uint32_t ts;
+    int32_t  temp_x10;
+};
+
+static Rollups rollups;
+static std::vector<Raw> raw[2];
+static const uint32_t ids[2] = {0x39582376, 0x42};
+
+// Aggregate of the raw readings in [from, to)
+static RollupResult expected(int sensor, uint32_t from, uint32_t to)
+{
+    RollupResult r = {0, 0, 0, 0};
+    int64_t sum = 0;
+    int32_t min = 0, max = 0;
+    for (const Raw &x : raw[sensor]) {
+        if (x.ts < from || x.ts >= to) {
+            continue;
+        }
+        min = (r.count == 0 || x.temp_x10 < min) ? x.temp_x10 : min;
+        max = (r.count == 0 || x.temp_x10 > max) ? x.temp_x10 : max;
+        sum += x.temp_x10;
+        r.count++;
+    }
+    r.min = min * 0.1f;
+    r.max = max * 0.1f;
+    r.avg = r.count ? (float)sum / r.count * 0.1f : 0;
+    return r;
+}
+
+static bool same(const RollupResult &a, const RollupResult &b)
+{
+    return a.count == b.count && fabsf(a.min - b.min) < 0.01f && fabsf(a.max - b.max) < 0.01f &&
+           fabsf(a.avg - b.avg) < 0.01f;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+    printf("%u sensors, %u bytes\n", (unsigned)ROLLUP_MAX_SENSORS, (unsigned)sizeof(Rollups));
+
+    uint32_t now = START_TS + 3 * 86400;
+    for (uint32_t t = START_TS; t < now; t += 12) {
+        // Both sensors off the air for an hour on the second day
+        if (t >= START_TS + 86400 + 7200 && t < START_TS + 86400 + 10800) {
+            continue;
+        }
+        for (int s = 0; s < 2; s++) {
+            WeatherData d;
+            memset(&d, 0, sizeof(d));
+            d.sensor_id  = ids[s];
+            d.temp_ok    = true;
+            d.temp_c     = 10 * sinf((t - START_TS) / 86400.0f * 6.2832f) + s * 5 + (rand() % 11 - 5) / 10.0f;
+            d.humidity   = 50;
+            d.battery_ok = true;
+            uint32_t ts  = t + s;
+            CHECK(rollups.add(&d, ts), "reading of sensor %08x not rolled up", (unsigned)ids[s]);
+            raw[s].push_back({ts, (int32_t)lroundf(d.temp_c * 10)});
+            if (rand() % 10 == 0) {
+                d.sensor_id = rand();
+                rollups.add(&d, ts);
+            }
+        }
+    }
+    printf("%u junk IDs replaced, %u readings not rolled up\n", (unsigned)rollups.evictions(),
+           (unsigned)rollups.untracked());
+
+    // Aligned: exact
+    unsigned wrong = 0, queries = 0;
+    for (int s = 0; s < 2; s++) {
+        RollupResult res[60];
+        struct { uint32_t span, step; } windows[] = {
+            {3600, 60}, {6 * 3600, 600}, {86400, 3600}, {2 * 86400, 3600}, {2 * 86400, 86400}
+        };
+        for (auto &w : windows) {
+            unsigned n = rollups.series(ids[s], ROLLUP_TEMP, now - w.span, now, w.step, res, 60);
+            CHECK(n == w.span / w.step, "%u of %u steps", n, w.span / w.step);
+            for (unsigned i = 0; i < n; i++, queries++) {
+                uint32_t from = now - w.span + i * w.step;
+                RollupResult e = expected(s, from, from + w.step);
+                wrong += !same(res[i], e);
+            }
+        }
+    }
+    printf("aligned windows: %u of %u aggregates differ from the raw readings\n", wrong, queries);
+    CHECK(wrong == 0, "%u aligned aggregates wrong", wrong);
+
+    // Not aligned: readings of whole buckets inside the window
+    wrong = 0;
+    queries = 0;
+    unsigned narrowed = 0;
+    for (int k = 0; k < 2000; k++) {
+        int      s    = k % 2;
+        uint32_t to   = (k % 3 == 0) ? now : now - rand() % (2 * 86400);
+        uint32_t from = to - 60 - rand() % (to - START_TS > 86400 ? 86400 : to - START_TS - 60);
+        RollupResult r;
+        if (!rollups.query(ids[s], ROLLUP_TEMP, from, to, &r)) {
+            continue;
+        }
+        queries++;
+        RollupResult all = expected(s, from, to);
+        // Some bucket boundaries inside the window hold exactly the readings
+        // counted
+        bool found = false;
+        for (unsigned l = 0; l < ROLLUP_LEVELS && !found; l++) {
+            uint32_t res   = Rollups::resolution(l);
+            uint32_t first = (from + res - 1) / res * res;
+            uint32_t end   = (to % res == 0 || raw[s].back().ts >= to) ? to / res * res : to;
+            found = (first < end) && same(r, expected(s, first, end));
+        }
+        wrong    += !found || r.count > all.count;
+        narrowed += r.count < all.count;
+    }
+    printf("windows not aligned: %u of %u aggregates not made of whole buckets inside the window "
+           "(%u narrowed)\n", wrong, queries, narrowed);
+    CHECK(wrong == 0, "%u aggregates include readings outside their window", wrong);
+
+    // A window ending now includes the latest reading
+    RollupResult r;
+    rollups.query(ids[0], ROLLUP_TEMP, now - 90, now, &r);
+    CHECK(r.count == expected(0, now - 60, now).count && r.count > 0, "latest readings missing: %u",
+          (unsigned)r.count);
+
+    // Table full of confirmed sensors: a new one is taken once one is stale
+    Rollups full;
+    WeatherData d;
+    memset(&d, 0, sizeof(d));
+    d.temp_ok = true;
+    for (unsigned k = 0; k < ROLLUP_MIN_READINGS; k++) {
+        for (uint32_t id = 1; id <= ROLLUP_MAX_SENSORS; id++) {
+            d.sensor_id = id;
+            full.add(&d, START_TS + k * 12);
+        }
+    }
+    d.sensor_id = 100;
+    bool early = full.add(&d, START_TS + ROLLUP_STALE_S - 1);
+    // All but sensor 1 heard again
+    for (uint32_t id = 2; id <= ROLLUP_MAX_SENSORS; id++) {
+        d.sensor_id = id;
+        full.add(&d, START_TS + ROLLUP_STALE_S);
+    }
+    d.sensor_id = 100;
+    bool late = full.add(&d, START_TS + ROLLUP_STALE_S + 100);
+    CHECK(!early && late && full.query(100, ROLLUP_TEMP, START_TS, START_TS + 2 * ROLLUP_STALE_S, &r) &&
+          !full.query(1, ROLLUP_TEMP, START_TS, START_TS + 2 * ROLLUP_STALE_S, &r),
+          "stale sensor not replaced (new sensor taken before: %d, after: %d)", early, late);
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
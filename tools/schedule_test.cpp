@@ -0,0 +1,190 @@
+/*
+schedule_test - SensorSchedule on a simulated clock (Linux host)
+
+    schedule_test [--seed s]
+
+Runs the estimator for a simulated hour, much faster than real-time, with
+the clock wrapping around in the middle:
+
+- two sensors (12000.3 ms and 12500 ms periods), +-20 ms timestamp jitter,
+  10% of the frames lost and some repeated: the period estimate, the
+  fraction of arrivals inside their predicted window and the loss ratio are
+  checked against the simulated values
+- a sensor missing for several periods: the gap is counted as lost frames,
+  not as a new period
+- eviction: IDs heard once (corrupted frames) fill the table and must not
+  keep a new sensor out; confirmed sensors stay until they are stale
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -o schedule_test tools/schedule_test.cpp SensorSchedule.cpp
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../SensorSchedule.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+// Clock offset: the simulated hour wraps around 2^32 ms
+#define CLOCK_BASE 4294000000u
+
+static void testPeriodic()
+{
+    SensorSchedule schedule;
+    const uint32_t ids[2]    = {0x42, 0x39582376};
+    const double   period[2] = {12000.3, 12500.0};
+    const double   start[2]  = {1000, 5000};
+    unsigned sent[2] = {0, 0}, lost[2] = {0, 0};
+    unsigned predicted = 0, inWindow = 0;
+
+    for (uint32_t ms = 0; ms < 3600 * 1000u; ms += 10) {
+        uint32_t now = CLOCK_BASE + ms;
+        for (int i = 0; i < 2; i++) {
+            if (ms < start[i] + period[i] * sent[i]) {
+                continue;
+            }
+            sent[i]++;
+            uint32_t at = now + rand() % 41 - 20;
+            if (rand() % 10 == 0) {
+                lost[i]++;
+                continue;
+            }
+            SchedulePrediction p;
+            if (sent[i] > 10 && schedule.predict(ids[i], &p)) {
+                predicted++;
+                int32_t err = at - p.next_ms;
+                if (err <= (int32_t)p.window_ms && -err <= (int32_t)p.window_ms) {
+                    inWindow++;
+                }
+            }
+            schedule.arrival(ids[i], at);
+            if (rand() % 4 == 0) {
+                schedule.arrival(ids[i], at + 30);
+            }
+        }
+        schedule.poll(now);
+    }
+
+    for (int i = 0; i < 2; i++) {
+        SchedulePrediction p;
+        const ScheduleStats *st = schedule.stats(ids[i]);
+        CHECK(st && schedule.predict(ids[i], &p), "sensor %08x not tracked", (unsigned)ids[i]);
+        if (!st) {
+            continue;
+        }
+        float expected = (float)lost[i] / sent[i];
+        printf("sensor %08x: period %.2f ms (%.1f), window +-%u ms, received %u, lost %u (%u sent, %u lost), "
+               "%u duplicates, %u resyncs\n",
+               (unsigned)ids[i], p.period_ms, period[i], (unsigned)p.window_ms, (unsigned)st->received,
+               (unsigned)st->lost, sent[i], lost[i], (unsigned)st->duplicates, (unsigned)st->resyncs);
+        CHECK(fabs(p.period_ms - period[i]) < 1, "period %.2f, expected %.1f", p.period_ms, period[i]);
+        CHECK(fabsf(schedule.lossRatio(ids[i]) - expected) < 0.02f, "loss ratio %.3f, expected %.3f",
+              schedule.lossRatio(ids[i]), expected);
+        CHECK(st->resyncs == 0, "%u resyncs", (unsigned)st->resyncs);
+    }
+    printf("arrivals in predicted window: %u/%u\n", inWindow, predicted);
+    CHECK(inWindow >= predicted * 99 / 100, "%u of %u arrivals in window", inWindow, predicted);
+}
+
+static void testGap()
+{
+    SensorSchedule schedule;
+    uint32_t now = CLOCK_BASE;
+    for (int k = 0; k < 20; k++) {
+        schedule.arrival(1, now);
+        now += 12000;
+    }
+    // Five frames missed
+    now += 5 * 12000;
+    for (uint32_t t = now - 6 * 12000; t != now; t += 100) {
+        schedule.poll(t);
+    }
+    schedule.arrival(1, now);
+    const ScheduleStats *st = schedule.stats(1);
+    SchedulePrediction p;
+    schedule.predict(1, &p);
+    printf("gap of 5 frames: lost %u, resyncs %u, period %.1f ms\n", (unsigned)st->lost, (unsigned)st->resyncs,
+           p.period_ms);
+    CHECK(st->lost == 5, "lost %u, expected 5", (unsigned)st->lost);
+    CHECK(st->resyncs == 0 && fabs(p.period_ms - 12000) < 1, "period %.1f after gap", p.period_ms);
+}
+
+static void testEviction()
+{
+    SensorSchedule schedule;
+    uint32_t now = CLOCK_BASE;
+
+    // Junk IDs fill the table
+    for (uint32_t id = 1000; id < 1000 + 4 * SCHEDULE_MAX_SENSORS; id++) {
+        schedule.arrival(id, now);
+        now += 100;
+    }
+    // A new sensor is tracked nevertheless, and stays while more junk IDs
+    // come in
+    for (unsigned k = 0; k < SCHEDULE_MIN_ARRIVALS + 2; k++) {
+        schedule.arrival(1, now);
+        for (unsigned id = 0; id < SCHEDULE_MAX_SENSORS / 2; id++) {
+            schedule.arrival(2000 + 100 * k + id, now + 100 + id);
+        }
+        now += 12000;
+    }
+    const ScheduleStats *st = schedule.stats(1);
+    printf("eviction: sensor received %u, %u evictions, %u untracked\n", st ? (unsigned)st->received : 0,
+           (unsigned)schedule.evictions(), (unsigned)schedule.untracked());
+    CHECK(st && st->received == SCHEDULE_MIN_ARRIVALS + 2, "sensor amid junk IDs: %u arrivals",
+          st ? (unsigned)st->received : 0);
+
+    // Only confirmed sensors: new IDs are not tracked until one is stale
+    SensorSchedule full;
+    now = CLOCK_BASE;
+    for (int k = 0; k < SCHEDULE_MIN_ARRIVALS; k++) {
+        for (uint32_t id = 1; id <= SCHEDULE_MAX_SENSORS; id++) {
+            full.arrival(id, now + id);
+        }
+        now += 12000;
+    }
+    full.arrival(100, now);
+    CHECK(!full.stats(100) && full.untracked() == 1, "confirmed sensor replaced");
+    now += SCHEDULE_STALE_MS;
+    for (uint32_t id = 2; id <= SCHEDULE_MAX_SENSORS; id++) {
+        full.arrival(id, now + id);
+    }
+    full.arrival(100, now + 1000);
+    CHECK(full.stats(100) && !full.stats(1), "stale sensor not replaced");
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    testPeriodic();
+    testGap();
+    testEviction();
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,251 @@
+/*
+snapshot_stress - multi-threaded stress test of SensorSnapshots (Linux host)
+
+    snapshot_stress [--readers n] [--seconds s]
+
+First, single-threaded, slot reuse: sensors heard once (junk IDs made up
+by corrupted frames) give way to each other without pushing a confirmed
+sensor out, are dropped once all slots hold confirmed sensors, and a sensor
+not written for SNAPSHOT_STALE_WRITES writes gives way to a new one.
+
+Then one writer thread stores readings of SNAPSHOT_MAX_SENSORS - 1 sensors
+as fast as it can, in turn, each round followed by one of a new junk ID,
+which takes over the spare slot from the previous one; n reader threads
+(default 3) read all slots over and over, by slot (read()) and by sensor ID
+(find()). Every field of reading n is derived from n (and the sensor), as
+is its timestamp, so a reader checks that all fields of a copy come from
+the same write - a torn read, or a copy mixing two sensors of a reused
+slot, shows up as a mismatch. Readers also check that the readings of a
+sensor never go back in time.
+
+Prints the write and read rates, the torn reads retried by the seqlock and
+the inconsistent copies handed out (must be 0); the exit status is 1 if
+there were any or a reuse check failed. Run it with more readers than
+cores, too: the writer is then preempted in the middle of a write.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -pthread -o snapshot_stress tools/snapshot_stress.cpp SensorSnapshots.cpp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../SensorSnapshots.h"
+
+#define SENSOR_BASE 0x1000
+
+// Sensors written in every round - the spare slot goes to junk IDs
+#define SENSORS (SNAPSHOT_MAX_SENSORS - 1)
+
+static SensorSnapshots       snapshots;
+static std::atomic<bool>     stop(false);
+static std::atomic<uint64_t> reads(0);
+static std::atomic<uint64_t> inconsistent(0);
+
+//
+// Reading n of sensor - every field depends on n
+//
+static void fill(WeatherData *d, unsigned sensor, uint32_t n)
+{
+    memset(d, 0, sizeof(*d));
+    d->s_type              = n & 0x0f;
+    d->sensor_id           = SENSOR_BASE + sensor;
+    d->chan                = (n >> 4) & 0x07;
+    d->temp_ok             = n & 1;
+    d->temp_c              = (float)(n & 0xffff) / 10;
+    d->humidity            = n % 100;
+    d->uv_ok               = n & 2;
+    d->uv                  = (float)(n & 0xff) / 10;
+    d->wind_ok             = n & 4;
+    d->wind_direction_deg  = (float)(n % 360);
+    d->wind_gust_meter_sec = (float)(n & 0x3ff) / 10;
+    d->wind_avg_meter_sec  = (float)(n & 0x1ff) / 10;
+    d->rain_ok             = n & 8;
+    d->rain_mm             = (float)(n & 0xfffff) / 10;
+    d->battery_ok          = n & 16;
+    d->moisture_ok         = n & 32;
+    d->moisture            = n % 101;
+}
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static bool write(SensorSnapshots *table, unsigned sensor, uint32_t n)
+{
+    WeatherData d;
+    fill(&d, sensor, n);
+    return table->write(&d, n);
+}
+
+static bool present(const SensorSnapshots *table, unsigned sensor)
+{
+    WeatherData d;
+    return table->find(SENSOR_BASE + sensor, &d, nullptr);
+}
+
+//
+// Slot reuse, single-threaded
+//
+static void reuse()
+{
+    static SensorSnapshots table;
+    uint32_t n = 1;
+
+    // Confirmed sensors, then junk IDs heard once
+    for (unsigned round = 0; round < SNAPSHOT_MIN_WRITES; round++) {
+        for (unsigned sensor = 0; sensor < SENSORS; sensor++) {
+            write(&table, sensor, n++);
+        }
+    }
+    unsigned junk = 1000;
+    for (unsigned k = 0; k < 1000; k++) {
+        CHECK(write(&table, junk++, n++), "junk ID %u dropped while a junk slot is in use", junk - 1);
+    }
+    unsigned kept = 0;
+    for (unsigned sensor = 0; sensor < SENSORS; sensor++) {
+        kept += present(&table, sensor);
+    }
+    CHECK(kept == SENSORS && present(&table, junk - 1) && table.stats().evictions == 999,
+          "%u of %u sensors kept, %u slots reused", kept, SENSORS, (unsigned)table.stats().evictions);
+
+    // All slots confirmed and recently written: junk is dropped
+    for (unsigned sensor = 0; sensor < SENSORS; sensor++) {
+        write(&table, sensor, n++);
+    }
+    unsigned sensor = SENSORS;
+    for (unsigned round = 0; round < SNAPSHOT_MIN_WRITES; round++) {
+        write(&table, sensor, n++);
+    }
+    CHECK(!write(&table, junk++, n++) && table.stats().full == 1 && present(&table, sensor),
+          "junk ID written over a confirmed sensor");
+
+    // Sensor 0 goes silent and gives way to a new one
+    for (unsigned k = 0; k < SNAPSHOT_STALE_WRITES; k++) {
+        write(&table, 1 + k % SENSORS, n++);
+    }
+    CHECK(write(&table, junk, n++) && !present(&table, 0) && present(&table, junk),
+          "silent sensor not replaced after %u writes", (unsigned)SNAPSHOT_STALE_WRITES);
+    printf("slot reuse: %u slots reused, %u readings dropped\n", (unsigned)table.stats().evictions,
+           (unsigned)table.stats().full);
+}
+
+static bool consistent(const WeatherData *d, unsigned sensor, uint32_t timestamp)
+{
+    WeatherData expected;
+    fill(&expected, sensor, timestamp);
+    return d->s_type == expected.s_type && d->sensor_id == expected.sensor_id && d->chan == expected.chan &&
+           d->temp_ok == expected.temp_ok && d->temp_c == expected.temp_c && d->humidity == expected.humidity &&
+           d->uv_ok == expected.uv_ok && d->uv == expected.uv && d->wind_ok == expected.wind_ok &&
+           d->wind_direction_deg == expected.wind_direction_deg &&
+           d->wind_gust_meter_sec == expected.wind_gust_meter_sec &&
+           d->wind_avg_meter_sec == expected.wind_avg_meter_sec && d->rain_ok == expected.rain_ok &&
+           d->rain_mm == expected.rain_mm && d->battery_ok == expected.battery_ok &&
+           d->moisture_ok == expected.moisture_ok && d->moisture == expected.moisture;
+}
+
+static void reader()
+{
+    uint32_t latest[SENSORS] = {0};
+    uint64_t n = 0, bad = 0;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        unsigned count = snapshots.count();
+        for (unsigned i = 0; i < count; i++) {
+            WeatherData d;
+            uint32_t    timestamp;
+            if (!snapshots.read(i, &d, &timestamp)) {
+                continue;
+            }
+            n++;
+            unsigned sensor = d.sensor_id - SENSOR_BASE;
+            if (d.sensor_id < SENSOR_BASE || !consistent(&d, sensor, timestamp) ||
+                (sensor < SENSORS && timestamp < latest[sensor])) {
+                bad++;
+                continue;
+            }
+            if (sensor >= SENSORS) {
+                // Junk ID - its slot may already have been reused
+                if (snapshots.find(d.sensor_id, &d, &timestamp)) {
+                    n++;
+                    bad += !consistent(&d, sensor, timestamp);
+                }
+                continue;
+            }
+            latest[sensor] = timestamp;
+
+            if (snapshots.find(SENSOR_BASE + sensor, &d, &timestamp)) {
+                n++;
+                if (!consistent(&d, sensor, timestamp) || timestamp < latest[sensor]) {
+                    bad++;
+                }
+            }
+        }
+    }
+    reads += n;
+    inconsistent += bad;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned readers = 3;
+    unsigned seconds = 3;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--readers") == 0 && i + 1 < argc) {
+            readers = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+            seconds = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--readers n] [--seconds s]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    reuse();
+
+    std::vector<std::thread> threads;
+    for (unsigned r = 0; r < readers; r++) {
+        threads.emplace_back(reader);
+    }
+
+    // Timestamps start at 1 and increase per sensor
+    auto     start  = std::chrono::steady_clock::now();
+    uint64_t writes = 0;
+    while (std::chrono::steady_clock::now() - start < std::chrono::seconds(seconds)) {
+        for (int k = 0; k < 1000; k++) {
+            // A round: the sensors, then a junk ID
+            WeatherData d;
+            uint32_t    n      = (uint32_t)(writes / (SENSORS + 1) + 1);
+            unsigned    sensor = writes % (SENSORS + 1);
+            fill(&d, (sensor < SENSORS) ? sensor : SENSORS + n % 0x100000, n);
+            snapshots.write(&d, n);
+            writes++;
+        }
+    }
+    stop = true;
+    for (auto &t : threads) {
+        t.join();
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%u readers, %u cores, %.1f s: %.1f M writes/s, %.1f M reads/s, %u retries (%.3f%% of reads), "
+           "%u slots reused, %llu inconsistent\n",
+           readers, std::thread::hardware_concurrency(), elapsed, writes / elapsed / 1e6,
+           reads.load() / elapsed / 1e6, (unsigned)snapshots.retries(),
+           reads.load() ? 100.0 * snapshots.retries() / reads.load() : 0.0,
+           (unsigned)snapshots.stats().evictions, (unsigned long long)inconsistent.load());
+    return (inconsistent.load() || failures) ? 1 : 0;
+}
@@ -0,0 +1,249 @@
+/*
+timeseries_bench - TimeSeriesStore throughput, size and eviction (Linux host)
+
+    timeseries_bench [--sensors n] [--days d] [--seed s]
+
+Feeds n sensors (default TS_MAX_SENSORS - 1) transmitting every 12 s with
+slowly changing weather for d days (default 7) into the store; one frame in
+ten is followed by a reading of a random ID (as decoded from a corrupted
+5-in-1 frame). Prints:
+
+- encode and decode throughput (readings/s)
+- bytes per reading stored, compared to WeatherData plus timestamp and to
+  a ReadingLog record (32 bytes)
+
+and checks that
+
+- every reading still stored decodes to the values fed in (quantized to
+  the store's resolution), the oldest ones having given way to new ones
+- the junk IDs have not kept a sensor out, and a sensor gone silent is
+  replaced once stale
+
+Prints FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -o timeseries_bench tools/timeseries_bench.cpp TimeSeriesStore.cpp
+*/
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#include "../Clock.h"
+#include "../TimeSeriesStore.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define SENSOR_BASE 0x39580000u
+#define PERIOD_S    12
+#define START_TS    1700000000u
+
+struct Reading {
+    uint32_t    ts;
+    WeatherData data;
+};
+
+struct Sensor {
+    uint32_t             id;
+    uint32_t             next_ts;
+    float                temp, gust, dir, rain;
+    int                  hum;
+    std::vector<Reading> sent;
+};
+
+static float randf(float range)
+{
+    return (rand() / (float)RAND_MAX * 2 - 1) * range;
+}
+
+static void weather(Sensor *s, WeatherData *d)
+{
+    s->temp = s->temp + randf(0.05f);
+    s->hum  = s->hum + (rand() % 20 == 0 ? rand() % 3 - 1 : 0);
+    s->hum  = (s->hum < 10) ? 10 : (s->hum > 99) ? 99 : s->hum;
+    s->gust = fabsf(s->gust + randf(0.3f));
+    s->dir  = fmodf(s->dir + randf(20) + 360, 360);
+    s->rain += (rand() % 50 == 0) ? 0.3f : 0;
+
+    memset(d, 0, sizeof(*d));
+    d->sensor_id           = s->id;
+    d->temp_ok             = true;
+    d->temp_c              = s->temp;
+    d->humidity            = s->hum;
+    d->wind_ok             = true;
+    d->wind_gust_meter_sec = s->gust;
+    d->wind_avg_meter_sec  = s->gust * 0.7f;
+    d->wind_direction_deg  = s->dir;
+    d->rain_ok             = true;
+    d->rain_mm             = s->rain;
+    d->battery_ok          = true;
+}
+
+// Equal at the resolution of the store
+static bool same(const WeatherData *a, const WeatherData *b)
+{
+    return a->sensor_id == b->sensor_id && a->temp_ok == b->temp_ok && a->wind_ok == b->wind_ok &&
+           a->rain_ok == b->rain_ok && a->battery_ok == b->battery_ok &&
+           lroundf(a->temp_c * 10) == lroundf(b->temp_c * 10) && a->humidity == b->humidity &&
+           lroundf(a->wind_gust_meter_sec * 10) == lroundf(b->wind_gust_meter_sec * 10) &&
+           lroundf(a->wind_avg_meter_sec * 10) == lroundf(b->wind_avg_meter_sec * 10) &&
+           lroundf(a->wind_direction_deg * 10) == lroundf(b->wind_direction_deg * 10) &&
+           lroundf(a->rain_mm * 10) == lroundf(b->rain_mm * 10);
+}
+
+struct Check {
+    const Sensor *sensor;
+    size_t        next;
+    unsigned      wrong;
+};
+
+static void collect(uint32_t timestamp, const WeatherData *pData, void *ctx)
+{
+    Check *c = (Check *)ctx;
+    if (c->next >= c->sensor->sent.size() || c->sensor->sent[c->next].ts != timestamp ||
+        !same(&c->sensor->sent[c->next].data, pData)) {
+        c->wrong++;
+    }
+    c->next++;
+}
+
+static void count(uint32_t, const WeatherData *, void *ctx)
+{
+    (*(unsigned *)ctx)++;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned sensors = TS_MAX_SENSORS - 1;
+    unsigned days    = 7;
+    unsigned seed    = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--sensors") == 0 && i + 1 < argc) {
+            sensors = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) {
+            days = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--sensors n] [--days d] [--seed s]\n", argv[0]);
+            return 2;
+        }
+    }
+    srand(seed);
+
+    static TimeSeriesStore store;
+    std::vector<Sensor> sensor(sensors);
+    for (unsigned i = 0; i < sensors; i++) {
+        sensor[i].id      = SENSOR_BASE + i;
+        sensor[i].next_ts = START_TS + rand() % PERIOD_S;
+        sensor[i].temp    = 10 + randf(5);
+        sensor[i].hum     = 60;
+        sensor[i].gust    = 2;
+        sensor[i].dir     = 180;
+        sensor[i].rain    = 100;
+    }
+
+    // Encode
+    uint32_t end = START_TS + days * 86400;
+    unsigned readings = 0, junk = 0, rejected = 0;
+    for (uint32_t now = START_TS; now < end; now++) {
+        for (auto &s : sensor) {
+            if (now < s.next_ts) {
+                continue;
+            }
+            s.next_ts += PERIOD_S + (rand() % 3 == 0);
+            Reading r;
+            r.ts = now;
+            weather(&s, &r.data);
+            bool ok = store.add(&r.data, r.ts);
+            readings++;
+            rejected += !ok;
+            s.sent.push_back(r);
+
+            if (rand() % 10 == 0) {
+                WeatherData d = r.data;
+                d.sensor_id = rand();
+                store.add(&d, now);
+                junk++;
+            }
+        }
+    }
+
+    // Encode again, timed without the simulation
+    static TimeSeriesStore replay;
+    uint32_t start = clockMicros();
+    for (auto &s : sensor) {
+        for (auto &r : s.sent) {
+            replay.add(&r.data, r.ts);
+        }
+    }
+    double encode_s = (clockMicros() - start) / 1e6;
+
+    // Decode
+    start = clockMicros();
+    unsigned decoded = 0;
+    for (int k = 0; k < 10; k++) {
+        for (auto &s : sensor) {
+            store.forEach(s.id, 0, 0xffffffff, count, &decoded);
+        }
+    }
+    double decode_s = (clockMicros() - start) / 1e6;
+
+    uint32_t stored = store.storedReadings();
+    uint32_t bytes  = store.compressedBytes();
+    printf("%u sensors, %u days: %u readings (+%u junk IDs), %u stored in %u bytes\n", sensors, days, readings,
+           junk, (unsigned)stored, (unsigned)bytes);
+    printf("encode %.0f readings/s, decode %.0f readings/s\n", readings / encode_s, decoded / decode_s);
+    printf("%.2f bytes/reading - %.1fx smaller than WeatherData + timestamp (%u bytes), %.1fx smaller than a "
+           "ReadingLog record (32 bytes)\n",
+           (double)bytes / stored, (sizeof(WeatherData) + 4) * (double)stored / bytes,
+           (unsigned)(sizeof(WeatherData) + 4), 32.0 * stored / bytes);
+    printf("%u series replaced, %u readings dropped, %u chunks dropped from arenas\n",
+           (unsigned)store.stats().replaced, (unsigned)store.stats().dropped, (unsigned)store.stats().evicted);
+
+    // Contents: the latest readings of each sensor, unchanged
+    CHECK(rejected == 0, "%u readings of sensors rejected", rejected);
+    for (auto &s : sensor) {
+        unsigned n = 0;
+        store.forEach(s.id, 0, 0xffffffff, count, &n);
+        Check c = { &s, s.sent.size() - n, 0 };
+        store.forEach(s.id, 0, 0xffffffff, collect, &c);
+        CHECK(n > 0 && c.wrong == 0 && c.next == s.sent.size(), "sensor %08x: %u of %u readings wrong",
+              (unsigned)s.id, c.wrong, n);
+    }
+
+    // With the table full of sensors, one gone silent is replaced once
+    // stale, not before
+    if (sensors + 1 == TS_MAX_SENSORS) {
+        WeatherData d;
+        weather(&sensor[0], &d);
+        d.sensor_id = 0x12345678;
+        for (unsigned k = 0; k < TS_MIN_READINGS; k++) {
+            store.add(&d, end + k);
+        }
+        d.sensor_id = 0x87654321;
+        uint32_t dropped = store.stats().dropped;
+        store.add(&d, end + TS_STALE_S - 100);
+        unsigned n = 0;
+        store.forEach(0x87654321, 0, 0xffffffff, count, &n);
+        CHECK(store.stats().dropped > dropped && n == 0, "confirmed sensor replaced before it was stale");
+        store.add(&d, end + TS_STALE_S + 100);
+        store.forEach(0x87654321, 0, 0xffffffff, count, &n);
+        CHECK(n == 1, "stale sensor not replaced");
+    }
+
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}
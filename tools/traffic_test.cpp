@@ -0,0 +1,143 @@
+/*
+traffic_test - encoders, decoders and TrafficGen against each other (Linux host)
+
+    traffic_test [--seed n] [--readings n]
+
+- TrafficGen::roundTrip(): random readings across the value range of both
+  protocols (default 100000 each, from 10 seeds) are encoded, decoded and
+  encoded again - every reading must come back, every frame byte for byte
+- an hour of traffic of 100 sensors without bit errors: frames in order of
+  start time, overlaps flagged as counted, and every frame decodes to the
+  reading it was generated from
+- the same traffic with a bit error rate of 1e-3: frames without errors
+  still decode, and the bits flipped match the rate (the share of
+  corrupted frames which still decode as sent is printed - the 5-in-1
+  decoder tolerates parity and checksum errors)
+
+Prints the results and FAIL lines; the exit status is 1 if a check failed.
+
+Build (from the repository root):
+
+    g++ -O2 -std=c++11 -o traffic_test tools/traffic_test.cpp TrafficGen.cpp BresserEncoder.cpp BresserDecoder.cpp
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../BresserDecoder.h"
+#include "../TrafficGen.h"
+
+static int failures;
+
+#define CHECK(cond, ...) \
+    do { \
+        if (!(cond)) { \
+            printf("FAIL %s:%d: ", __FILE__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+#define SEEDS 10
+#define HOUR_US 3600000000ull
+
+static void roundTrips(uint32_t seed, unsigned readings)
+{
+    unsigned mismatches = 0;
+    for (uint32_t i = 0; i < SEEDS; i++) {
+        TrafficConfig cfg;
+        cfg.seed = seed + i;
+        TrafficGen gen;
+        gen.begin(cfg, 0);
+        mismatches += gen.roundTrip(readings / SEEDS);
+    }
+    printf("round trip: %u readings per protocol, %u mismatches\n", readings / SEEDS * SEEDS, mismatches);
+    CHECK(mismatches == 0, "%u readings did not survive encoding and decoding", mismatches);
+}
+
+// Decode frame as the receiver does - true if it carries the reading sent
+static bool decodesTo(const SimFrame *f, const TrafficTruth *truth)
+{
+    uint8_t     msg[SIM_FRAME_SIZE];
+    WeatherData out;
+    memset(&out, 0, sizeof(out));
+    memcpy(msg, &f->data[1], f->len - 1);
+    DecodeStatus status = (truth->protocol == TRAFFIC_5IN1) ?
+        decodeBresser5In1Payload(msg, f->len - 1, &out) :
+        decodeBresser6In1Payload(msg, f->len - 1, &out);
+    return status == DECODE_OK && TrafficGen::same(truth->protocol, &truth->reading, &out);
+}
+
+static void traffic(uint32_t seed, double ber)
+{
+    TrafficConfig cfg;
+    cfg.sensors = 100;
+    cfg.ber     = ber;
+    cfg.seed    = seed;
+    TrafficGen gen;
+    gen.begin(cfg, 0);
+
+    SimFrame     f;
+    TrafficTruth truth;
+    uint64_t     prevStart = 0, lastEnd = 0;
+    unsigned     frames = 0, disorder = 0, overlaps = 0, flagged = 0;
+    unsigned     clean = 0, cleanBad = 0, corrupted = 0, corruptedPassed = 0;
+    double       bits = 0, flipped = 0;
+    while (gen.next(&f, &truth) && f.start_us < HOUR_US) {
+        frames++;
+        disorder += f.start_us < prevStart;
+        prevStart = f.start_us;
+        overlaps += f.start_us < lastEnd;
+        flagged  += truth.overlap;
+        uint64_t end = f.start_us + gen.airTime(f.len);
+        lastEnd = (end > lastEnd) ? end : lastEnd;
+
+        bits    += 8 * f.len;
+        flipped += truth.bit_errors;
+        bool ok = decodesTo(&f, &truth);
+        if (truth.bit_errors == 0) {
+            clean++;
+            cleanBad += !ok;
+        } else {
+            corrupted++;
+            corruptedPassed += ok;
+        }
+    }
+    printf("ber %g: %u frames in an hour, %u overlapping, %u corrupted (%u decoded as sent), "
+           "%u of %u intact frames not decoded\n", ber, frames, overlaps, corrupted, corruptedPassed, cleanBad,
+           clean);
+    CHECK(frames >= 100 * 299 && frames <= 100 * 301, "%u frames from 100 sensors in an hour", frames);
+    CHECK(disorder == 0, "%u frames out of order", disorder);
+    CHECK(overlaps == flagged, "%u overlapping frames, %u flagged", overlaps, flagged);
+    CHECK(cleanBad == 0, "%u frames without bit errors not decoded to the reading sent", cleanBad);
+    if (ber == 0) {
+        CHECK(corrupted == 0, "%u frames corrupted without bit errors", corrupted);
+    } else {
+        // The stats include the first frame after the hour
+        CHECK(gen.stats().corrupted - corrupted <= 1, "%u frames corrupted, %u counted", corrupted,
+              (unsigned)gen.stats().corrupted);
+        CHECK(flipped > 0.9 * ber * bits && flipped < 1.1 * ber * bits, "%.0f of %.0f bits flipped", flipped, bits);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t seed     = 1;
+    unsigned readings = 100000;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            seed = strtoul(argv[++i], nullptr, 0);
+        } else if (strcmp(argv[i], "--readings") == 0 && i + 1 < argc) {
+            readings = strtoul(argv[++i], nullptr, 0);
+        } else {
+            fprintf(stderr, "usage: %s [--seed n] [--readings n]\n", argv[0]);
+            return 2;
+        }
+    }
+    roundTrips(seed, readings);
+    traffic(seed, 0);
+    traffic(seed, 1e-3);
+    printf("%s\n", failures ? "FAILED" : "OK");
+    return failures ? 1 : 0;
+}